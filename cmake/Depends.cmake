@@ -210,3 +210,4 @@ else ()
 endif ()
 pkg_check_modules (MPG123 IMPORTED_TARGET libmpg123)
 pkg_check_modules (WEBP IMPORTED_TARGET libwebp)
+pkg_check_modules (WEBPDEMUX IMPORTED_TARGET libwebpdemux)
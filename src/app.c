@@ -21,17 +21,23 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "app.h"
+#include "archivecache.h"
 #include "bookmarks.h"
 #include "defs.h"
+#include "diskcache.h"
 #include "export.h"
 #include "feeds.h"
 #include "gmcerts.h"
+#include "resolver.h"
 #include "gmdocument.h"
 #include "gmutil.h"
 #include "history.h"
+#include "media.h"
 #include "ipc.h"
 #include "mimehooks.h"
+#include "pageindex.h"
 #include "periodic.h"
+#include "profiler.h"
 #include "resources.h"
 #include "sitespec.h"
 #include "ui/certimportwidget.h"
@@ -152,6 +158,7 @@ struct Impl_App {
     iMimeHooks * mimehooks;
     iGmCerts *   certs;
     iVisited *   visited;
+    iPageIndex * pageIndex;
     iBookmarks * bookmarks;
     iMainOrExtraWindow *window; /* currently active MainWindow or extra Window */
     iPtrArray    mainWindows;
@@ -176,6 +183,9 @@ struct Impl_App {
     iBool        isLoadingPrefs;
     iStringList *launchCommands;
     iBool        isFinishedLaunching;
+    iTime        launchTime;
+    double       resourceInitSeconds;
+    double       launchSeconds; /* until the first window and state were ready */
     iTime        lastDropTime; /* for detecting drops of multiple items */
     int          autoReloadTimer;
     iPeriodic    periodic;
@@ -296,6 +306,7 @@ static iString *serializePrefs_App_(const iApp *d) {
     appendFormat_String(str, "imageloadscroll arg:%d\n", d->prefs.loadImageInsteadOfScrolling);
     appendFormat_String(str, "cachesize.set arg:%d\n", d->prefs.maxCacheSize);
     appendFormat_String(str, "memorysize.set arg:%d\n", d->prefs.maxMemorySize);
+    appendFormat_String(str, "runcachesize.set arg:%d\n", d->prefs.maxRunCacheSize);
     appendFormat_String(str, "urlsize.set arg:%d\n", d->prefs.maxUrlSize);
     appendFormat_String(str, "decodeurls arg:%d\n", d->prefs.decodeUserVisibleURLs);
     appendFormat_String(str, "linewidth.set arg:%d\n", d->prefs.lineWidth);
@@ -343,6 +354,7 @@ static iString *serializePrefs_App_(const iApp *d) {
         { "prefs.mono.gemini", &d->prefs.monospaceGemini },
         { "prefs.mono.gopher", &d->prefs.monospaceGopher },
         { "prefs.plaintext.wrap", &d->prefs.plainTextWrap },
+        { "prefs.prefetch.hover", &d->prefs.prefetchOnHover },
         { "prefs.redirect.allowscheme", &d->prefs.allowSchemeChangingRedirect },
         { "prefs.retaintabs", &d->prefs.retainTabs },
         { "prefs.sideicon", &d->prefs.sideIcon },
@@ -872,6 +884,7 @@ static void saveState_App_(const iApp *d) {
        tree. The data is largely not reorderable and should not be modified
        by the user manually. */
     iFile *f = newCStr_File(concatPath_CStr(dataDir_App_(), tempStateFileName_App_));
+    beginMark_DiskCache(); /* cached bodies referenced by the state */
     if (open_File(f, writeOnly_FileMode)) {
         writeData_File(f, magicState_App_, 4);
         writeU32_File(f, latest_FileVersion); /* version */
@@ -929,6 +942,8 @@ static void saveState_App_(const iApp *d) {
        before the state file is fully written. */
     commitFile_App(concatPath_CStr(dataDir_App_(), stateFileName_App_),
                    concatPath_CStr(dataDir_App_(), tempStateFileName_App_));
+    sweep_DiskCache();
+    save_PageIndex(d->pageIndex, dataDir_App_());
 }
 
 void commitFile_App(const char *path, const char *tempPathWithNewContents) {
@@ -1082,6 +1097,7 @@ void disableRefresh_App(iBool dis) {
 
 static void init_App_(iApp *d, int argc, char **argv) {
     iBool doDump = iFalse;
+    initCurrent_Time(&d->launchTime);
 #if defined (iPlatformAndroid)
     /* Internal storage may be limited in size. */
     migrateInternalUserDirToExternalStorage_App_(d);
@@ -1129,6 +1145,8 @@ static void init_App_(iApp *d, int argc, char **argv) {
             "resources.lgr" /* cwd */
         };
         iBool wasLoaded = iFalse;
+        iTime startTime;
+        initCurrent_Time(&startTime);
         iForIndices(i, paths) {
             if (init_Resources(paths[i])) {
                 wasLoaded = iTrue;
@@ -1139,8 +1157,12 @@ static void init_App_(iApp *d, int argc, char **argv) {
             fprintf(stderr, "failed to load resources: %s\n", strerror(errno));
             exit(-1);
         }
+        d->resourceInitSeconds = elapsedSeconds_Time(&startTime);
     }
     init_Lang();
+    init_ArchiveCache();
+    init_Resolver();
+    init_Profiler();
     iStringList *openCmds = new_StringList();
 #if !defined (iPlatformAndroidMobile)
     /* Configure the valid command line options. */ {
@@ -1254,6 +1276,7 @@ static void init_App_(iApp *d, int argc, char **argv) {
     d->mimehooks = new_MimeHooks();
     d->certs     = new_GmCerts(dataDir_App_());
     d->visited   = new_Visited();
+    d->pageIndex = new_PageIndex();
     d->bookmarks = new_Bookmarks();
     /* Dumping requested pages. */
     if (doDump) {
@@ -1330,6 +1353,7 @@ static void init_App_(iApp *d, int argc, char **argv) {
     d->window = (iWindow *) new_MainWindow(*winRect0); /* first window is always created */
     addWindow_App(as_MainWindow(d->window));
     load_Visited(d->visited, dataDir_App_());
+    load_PageIndex(d->pageIndex, dataDir_App_());
     load_Bookmarks(d->bookmarks, dataDir_App_());
     load_MimeHooks(d->mimehooks, dataDir_App_());
     if (isFirstRun) {
@@ -1346,6 +1370,7 @@ static void init_App_(iApp *d, int argc, char **argv) {
                       0x1f306);
     }
     init_Feeds(dataDir_App_());
+    init_DiskCache(dataDir_App_());
     /* Widget state init. */
     processEvents_App(postedEventsOnly_AppEventMode);
     if (!loadState_App_(d)) {
@@ -1387,6 +1412,7 @@ static void init_App_(iApp *d, int argc, char **argv) {
     }
 #endif
     d->isFinishedLaunching = iTrue;
+    d->launchSeconds       = elapsedSeconds_Time(&d->launchTime);
     /* Run any commands that were pending completion of launch. */ {
         iForEach(StringList, i, d->launchCommands) {
             postCommandString_Root(NULL, i.value);
@@ -1431,8 +1457,13 @@ static void deinit_App(iApp *d) {
     }
     iAssert(isEmpty_PtrArray(&d->mainWindows));
     deinit_PtrArray(&d->mainWindows);
+    deinitImageDecoders_Media();
     d->window = NULL;
     deinit_Feeds();
+    deinit_DiskCache();
+    deinit_ArchiveCache();
+    deinit_Resolver();
+    deinit_Profiler();
     save_Keys(dataDir_App_());
     deinit_Keys();
     deinit_Fonts();
@@ -1442,6 +1473,7 @@ static void deinit_App(iApp *d) {
     delete_Bookmarks(d->bookmarks);
     save_Visited(d->visited, dataDir_App_());
     delete_Visited(d->visited);
+    delete_PageIndex(d->pageIndex);
     delete_GmCerts(d->certs);
     save_MimeHooks(d->mimehooks);
     delete_MimeHooks(d->mimehooks);
@@ -1576,6 +1608,14 @@ const iString *debugInfo_App(void) {
     iString *msg = collectNew_String();
     iObjectList *docs = iClob(listDocuments_App(NULL));
     format_String(msg, "# Debug information\n");
+    appendFormat_String(msg, "## Startup\n"); {
+        size_t resSize = 0;
+        const size_t numRes = numLoaded_Resources(&resSize);
+        appendFormat_String(msg, "Launch: %.1f ms\n", d->launchSeconds * 1000.0);
+        appendFormat_String(msg, "Opening resources: %.1f ms\n", d->resourceInitSeconds * 1000.0);
+        appendFormat_String(msg, "Resources extracted: %zu of %d (%.3f MB)\n",
+                            numRes, max_ResourceId, resSize / 1.0e6f);
+    }
     appendFormat_String(msg, "## Memory usage\n"); {
         iMemInfo total = { 0, 0 };
         iForEach(ObjectList, i, docs) {
@@ -1587,6 +1627,13 @@ const iString *debugInfo_App(void) {
         appendFormat_String(msg, "Total cache: %.3f MB\n", total.cacheSize / 1.0e6f);
         appendFormat_String(msg, "Total memory: %.3f MB\n", total.memorySize / 1.0e6f);
     }
+    if (current_Text()) {
+        const iRunCacheStats runs = runCacheStats_Text(current_Text());
+        appendFormat_String(msg, "## Shaped text runs\n");
+        appendFormat_String(msg, "Cached: %zu (%.3f MB of %.3f MB)\n", runs.count,
+                            runs.size / 1.0e6f, runs.budget / 1.0e6f);
+        appendFormat_String(msg, "Hits: %zu, misses: %zu\n", runs.hits, runs.misses);
+    }
     appendFormat_String(msg, "## Documents\n");
     iForEach(ObjectList, k, docs) {
         iDocumentWidget *doc = k.object;
@@ -1611,6 +1658,17 @@ const iString *debugInfo_App(void) {
     }
     appendFormat_String(msg, "## MIME hooks\n");
     append_String(msg, debugInfo_MimeHooks(d->mimehooks));
+    appendFormat_String(msg, "## Resolver prefetch\n");
+    appendFormat_String(msg, "Host names looked up in advance: %zu\n", numPrefetched_Resolver());
+    appendFormat_String(msg, "## Caches\n");
+    appendFormat_String(msg, "=> about:debug?cache Response cache\n");
+    appendFormat_String(msg, "## Performance\n");
+    appendFormat_String(msg, "=> about:debug?profiler Frame profiler\n");
+    appendFormat_String(msg, "## Benchmarks\n");
+    appendFormat_String(msg, "=> about:debug?layout Progressive document layout\n");
+    appendFormat_String(msg, "=> about:debug?url URL parsing\n");
+    appendFormat_String(msg, "=> about:debug?commands Command dispatch\n");
+    appendFormat_String(msg, "=> about:debug?imagestyle Image styles\n");
     return msg;
 }
 
@@ -1638,57 +1696,11 @@ iObjectList *listAllDocuments_App(void) {
 }
 
 void trimCache_App(void) {
-    iApp *d = &app_;
-    size_t cacheSize = 0;
-    const size_t limit = d->prefs.maxCacheSize * 1000000;
-    iObjectList *docs = listAllDocuments_App();
-    iForEach(ObjectList, i, docs) {
-        cacheSize += cacheSize_History(history_DocumentWidget(i.object));
-    }
-    init_ObjectListIterator(&i, docs);
-    iBool wasPruned = iFalse;
-    while (cacheSize > limit) {
-        iDocumentWidget *doc = i.object;
-        const size_t pruned = pruneLeastImportant_History(history_DocumentWidget(doc));
-        if (pruned) {
-            cacheSize -= pruned;
-            wasPruned = iTrue;
-        }
-        next_ObjectListIterator(&i);
-        if (!i.value) {
-            if (!wasPruned) break;
-            wasPruned = iFalse;
-            init_ObjectListIterator(&i, docs);
-        }
-    }
-    iRelease(docs);
+    trimCache_History(app_.prefs.maxCacheSize * 1000000);
 }
 
 void trimMemory_App(void) {
-    iApp *d = &app_;
-    size_t memorySize = 0;
-    const size_t limit = d->prefs.maxMemorySize * 1000000;
-    iObjectList *docs = listAllDocuments_App();
-    iForEach(ObjectList, i, docs) {
-        memorySize += memorySize_History(history_DocumentWidget(i.object));
-    }
-    init_ObjectListIterator(&i, docs);
-    iBool wasPruned = iFalse;
-    while (memorySize > limit) {
-        iDocumentWidget *doc = i.object;
-        const size_t pruned = pruneLeastImportantMemory_History(history_DocumentWidget(doc));
-        if (pruned) {
-            memorySize -= pruned;
-            wasPruned = iTrue;
-        }
-        next_ObjectListIterator(&i);
-        if (!i.value) {
-            if (!wasPruned) break;
-            wasPruned = iFalse;
-            init_ObjectListIterator(&i, docs);
-        }
-    }
-    iRelease(docs);
+    trimMemory_History(app_.prefs.maxMemorySize * 1000000);
 }
 
 static iPtrArray *listWindows_App_(const iApp *d, iPtrArray *windows) {
@@ -1849,6 +1861,7 @@ void processEvents_App(enum iAppEventMode eventMode) {
                 }
                 savePrefs_App_(d);
                 saveState_App_(d);
+                saveTrusted_GmCerts(d->certs);
                 d->isSuspended = iTrue;
                 if (d->isTextInputActive) {
                     SDL_StopTextInput();
@@ -1861,6 +1874,7 @@ void processEvents_App(enum iAppEventMode eventMode) {
                 }
                 savePrefs_App_(d);
                 saveState_App_(d);
+                saveTrusted_GmCerts(d->certs);
                 break;
             }
             case SDL_DROPFILE: {
@@ -2016,6 +2030,10 @@ void processEvents_App(enum iAppEventMode eventMode) {
                 }
 #endif /* LAGRANGE_ENABLE_MOUSE_TOUCH_EMULATION */
                 iBool wasUsed = iFalse;
+                const iBool isCommand = isCommand_SDLEvent(&ev);
+                if (isCommand) {
+                    beginDispatch_Command(command_UserEvent(&ev));
+                }
                 /* Focus navigation events take prioritity. */
                 if (!wasUsed) {
                     /* Keyboard focus navigation with arrow keys. */
@@ -2149,6 +2167,7 @@ void processEvents_App(enum iAppEventMode eventMode) {
                         handleCommand_App(ev.user.data1);
                     }
                     /* Allocated by postCommand_Apps(). */
+                    endDispatch_Command();
                     free(ev.user.data1);
                 }
                 /* Refresh after hover changes. */ {
@@ -2192,6 +2211,7 @@ static void runTickers_App_(iApp *d) {
         d->lastTickerTime = 0;
         return;
     }
+    const uint64_t profileBegin = begin_Profiler(tickers_ProfilerScope);
     /* Update window state. */ {
         iPtrArray *winList = listWindows_App();
         iForEach(PtrArray, i, winList) {
@@ -2223,6 +2243,7 @@ static void runTickers_App_(iApp *d) {
     if (isEmpty_SortedArray(&d->tickers)) {
         d->lastTickerTime = 0;
     }
+    end_Profiler(tickers_ProfilerScope, profileBegin);
 }
 
 static int resizeWatcher_(void *user, SDL_Event *event) {
@@ -2328,11 +2349,10 @@ void refresh_App(void) {
             setCurrent_Window(win);
             switch (win->type) {
                 case main_WindowType: {
-//                    iTime draw;
-//                    initCurrent_Time(&draw);
+                    const uint64_t profileBegin = begin_Profiler(draw_ProfilerScope);
                     draw_MainWindow(as_MainWindow(win));
-//                    printf("draw: %lld \u03bcs\n", (long long) (elapsedSeconds_Time(&draw) * 1000000));
-//                    fflush(stdout);
+                    end_Profiler(draw_ProfilerScope, profileBegin);
+                    endFrame_Profiler();
                     break;
                 }
                 default:
@@ -2443,16 +2463,18 @@ int run_App(int argc, char **argv) {
     return rc;
 }
 
-void postRefresh_App(void) {
+static void postRefresh_App_(iBool isFullRedraw) {
     iApp *d = &app_;
 #if defined (LAGRANGE_ENABLE_IDLE_SLEEP)
     d->isIdling = iFalse;
 #endif
-    iAtomicInt *pendingWindow = (get_Window() ? &get_Window()->isRefreshPending
-                                              : NULL);
+    iWindow *win = get_Window();
     iBool wasPending = exchange_Atomic(&d->pendingRefresh, iTrue);
-    if (pendingWindow) {
-        wasPending |= exchange_Atomic(pendingWindow, iTrue);
+    if (win) {
+        if (isFullRedraw) {
+            set_Atomic(&win->isFullRedrawPending, iTrue);
+        }
+        wasPending |= exchange_Atomic(&win->isRefreshPending, iTrue);
     }
     if (!wasPending) {
         SDL_Event ev = { .type = SDL_USEREVENT };
@@ -2461,6 +2483,14 @@ void postRefresh_App(void) {
     }
 }
 
+void postRefresh_App(void) {
+    postRefresh_App_(iTrue);
+}
+
+void postDamageRefresh_App(void) {
+    postRefresh_App_(iFalse);
+}
+
 void postCommand_Root(iRoot *d, const char *command) {
     iAssert(command);
     if (strlen(command) == 0) {
@@ -2725,6 +2755,10 @@ iVisited *visited_App(void) {
     return app_.visited;
 }
 
+iPageIndex *pageIndex_App(void) {
+    return app_.pageIndex;
+}
+
 iBookmarks *bookmarks_App(void) {
     return app_.bookmarks;
 }
@@ -2822,6 +2856,8 @@ static iBool handlePrefsCommands_(iWidget *d, const char *cmd) {
                          toInt_String(text_InputWidget(findChild_Widget(d, "prefs.cachesize"))));
         postCommandf_App("memorysize.set arg:%d",
                          toInt_String(text_InputWidget(findChild_Widget(d, "prefs.memorysize"))));
+        postCommandf_App("runcachesize.set arg:%d",
+                         toInt_String(text_InputWidget(findChild_Widget(d, "prefs.runcachesize"))));
         postCommandf_App("urlsize.set arg:%d",
                          toInt_String(text_InputWidget(findChild_Widget(d, "prefs.urlsize"))));
         postCommandf_App("ca.file path:%s",
@@ -3231,10 +3267,11 @@ static const iString *popClosedTabUrl_App_(iApp *d) {
 }
 
 static iBool handleNonWindowRelatedCommand_App_(iApp *d, const char *cmd) {
+    const enum iCommandId cmdId = nameId_Command(cmd);
     const iBool isFrozen = !d->window ||
         (d->window->type == main_WindowType && as_MainWindow(d->window)->isDrawFrozen);
     /* Commands related to preferences. */
-    if (equal_Command(cmd, "prefs.changed")) {
+    if (cmdId == prefsChanged_CommandId) {
         savePrefs_App_(d);
         return iTrue;
     }
@@ -3530,6 +3567,10 @@ static iBool handleNonWindowRelatedCommand_App_(iApp *d, const char *cmd) {
         d->prefs.allowSchemeChangingRedirect = arg_Command(cmd) != 0;
         return iTrue;
     }
+    else if (equal_Command(cmd, "prefs.prefetch.hover.changed")) {
+        d->prefs.prefetchOnHover = arg_Command(cmd) != 0;
+        return iTrue;
+    }
     else if (equal_Command(cmd, "smoothscroll")) {
         d->prefs.smoothScrolling = arg_Command(cmd);
         return iTrue;
@@ -3668,6 +3709,15 @@ static iBool handleNonWindowRelatedCommand_App_(iApp *d, const char *cmd) {
         }
         return iTrue;
     }
+    else if (equal_Command(cmd, "runcachesize.set")) {
+        d->prefs.maxRunCacheSize = iMax(1, arg_Command(cmd));
+        iPtrArray *winList = listWindows_App();
+        iConstForEach(PtrArray, i, winList) {
+            setRunCacheBudget_Text(text_Window(i.ptr), runCacheBudget_Prefs(&d->prefs));
+        }
+        delete_PtrArray(winList);
+        return iTrue;
+    }
     else if (equal_Command(cmd, "urlsize.set")) {
         d->prefs.maxUrlSize = arg_Command(cmd);
         if (d->prefs.maxUrlSize < 1024) {
@@ -3788,7 +3838,7 @@ static iBool handleNonWindowRelatedCommand_App_(iApp *d, const char *cmd) {
         refresh_Feeds();
         return iTrue;
     }
-    else if (equal_Command(cmd, "visited.changed")) {
+    else if (cmdId == visitedChanged_CommandId) {
         save_Visited(d->visited, dataDir_App_());
         return iFalse;
     }
@@ -3796,6 +3846,10 @@ static iBool handleNonWindowRelatedCommand_App_(iApp *d, const char *cmd) {
         saveIdentities_GmCerts(d->certs);
         return iFalse;
     }
+    else if (equal_Command(cmd, "trusted.save")) {
+        saveTrusted_GmCerts(d->certs);
+        return iTrue;
+    }
     else if (equal_Command(cmd, "ident.signin")) {
         const iString *url = collect_String(suffix_Command(cmd, "url"));
         signIn_GmCerts(
@@ -4065,6 +4119,7 @@ static iBool handleOpenCommand_App_(iApp *d, const char *cmd) {
 
 iBool handleCommand_App(const char *cmd) {
     iApp *d = &app_;
+    const enum iCommandId cmdId = nameId_Command(cmd);
     const iBool isFrozen   = isDrawFrozen_Window(d->window);
     const iBool isHeadless = numWindows_App() == 0;
     const iBool isMainWin  = d->window && d->window->type == main_WindowType;
@@ -4135,6 +4190,34 @@ iBool handleCommand_App(const char *cmd) {
         reload_Fonts(); /* also does font cache reset, window invalidation */
         return iTrue;
     }
+    else if (equal_Command(cmd, "profiler.toggle")) {
+        setEnabled_Profiler(!isEnabled_Profiler());
+        postCommand_App("navigate.reload"); /* profiler page shows the status */
+        postRefresh_App();
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "window.damage.toggle")) {
+        setDamageShown_Window(!isDamageShown_Window());
+        postCommand_App("navigate.reload"); /* profiler page shows the status */
+        postRefresh_App();
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "profiler.export")) {
+        iDate now;
+        initCurrent_Date(&now);
+        const iString *path = collect_String(concat_Path(
+            downloadDir_App(),
+            collect_String(format_Date(&now, "Lagrange Trace %Y-%m-%d %H%M%S.json"))));
+        if (exportTrace_Profiler(path)) {
+            makeSimpleMessage_Widget("Frame profiler",
+                                     format_CStr("Trace events were saved to:\n%s", cstr_String(path)));
+        }
+        else {
+            makeSimpleMessage_Widget(uiTextCaution_ColorEscape "Frame profiler",
+                                     format_CStr("Failed to write %s", cstr_String(path)));
+        }
+        return iTrue;
+    }
     else if (equal_Command(cmd, "font.find")) {
         searchOnlineLibraryForCharacters_Fonts(string_Command(cmd, "chars"));
         return iTrue;
@@ -4201,7 +4284,7 @@ iBool handleCommand_App(const char *cmd) {
         }
         return iTrue;
     }
-    else if (equal_Command(cmd, "zoom.delta")) {
+    else if (cmdId == zoomDelta_CommandId) {
         int delta = arg_Command(cmd);
         if (d->prefs.zoomPercent < 100 || (delta < 0 && d->prefs.zoomPercent == 100)) {
             delta /= 2;
@@ -4242,7 +4325,7 @@ iBool handleCommand_App(const char *cmd) {
             cstr_String(collect_String(urlEncode_String(collectNewCStr_String(value)))));
         return iTrue;
     }
-    else if (equal_Command(cmd, "open")) {
+    else if (cmdId == open_CommandId) {
         return handleOpenCommand_App_(d, cmd);
     }
     else if (equal_Command(cmd, "file.open")) {
@@ -4440,6 +4523,7 @@ iBool handleCommand_App(const char *cmd) {
         setToggle_Widget(findChild_Widget(dlg, "prefs.swipe.page"), d->prefs.pageSwipe);
         setToggle_Widget(findChild_Widget(dlg, "prefs.gopher.gemstyle"), d->prefs.geminiStyledGopher);
         setToggle_Widget(findChild_Widget(dlg, "prefs.redirect.allowscheme"), d->prefs.allowSchemeChangingRedirect);
+        setToggle_Widget(findChild_Widget(dlg, "prefs.prefetch.hover"), d->prefs.prefetchOnHover);
         updatePrefsPinSplitButtons_(dlg, d->prefs.pinSplit);
         updateScrollSpeedButtons_(dlg, mouse_ScrollType, d->prefs.smoothScrollSpeed[mouse_ScrollType]);
         updateScrollSpeedButtons_(dlg, keyboard_ScrollType, d->prefs.smoothScrollSpeed[keyboard_ScrollType]);
@@ -4511,6 +4595,8 @@ iBool handleCommand_App(const char *cmd) {
                             collectNewFormat_String("%d", d->prefs.maxCacheSize));
         setText_InputWidget(findChild_Widget(dlg, "prefs.memorysize"),
                             collectNewFormat_String("%d", d->prefs.maxMemorySize));
+        setText_InputWidget(findChild_Widget(dlg, "prefs.runcachesize"),
+                            collectNewFormat_String("%d", d->prefs.maxRunCacheSize));
         setText_InputWidget(findChild_Widget(dlg, "prefs.urlsize"),
                             collectNewFormat_String("%d", d->prefs.maxUrlSize));
         setToggle_Widget(findChild_Widget(dlg, "prefs.decodeurls"), d->prefs.decodeUserVisibleURLs);
@@ -4652,7 +4738,7 @@ iBool handleCommand_App(const char *cmd) {
         }
         return iFalse;
     }
-    else if (equal_Command(cmd, "document.changed")) {
+    else if (cmdId == documentChanged_CommandId) {
         /* Set of open tabs has changed. */
         postCommand_App("document.openurls.changed");
         if (deviceType_App() == phone_AppDeviceType) {
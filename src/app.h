@@ -36,6 +36,7 @@ iDeclareType(CommandLine)
 iDeclareType(GmCerts)
 iDeclareType(MainWindow)
 iDeclareType(MimeHooks)
+iDeclareType(PageIndex)
 iDeclareType(Periodic)
 iDeclareType(Root)
 iDeclareType(Visited)
@@ -107,6 +108,7 @@ iBool               isTextInputActive_App           (void);
 const iCommandLine *commandLine_App     (void);
 iGmCerts *          certs_App           (void);
 iVisited *          visited_App         (void);
+iPageIndex *        pageIndex_App       (void);
 iBookmarks *        bookmarks_App       (void);
 iMimeHooks *        mimeHooks_App       (void);
 iPeriodic *         periodic_App        (void);
@@ -159,6 +161,7 @@ void        closePopups_App     (iBool doForce);
 iWindow *   findWindow_App      (int windowType, const char *widgetId);
 
 void        postRefresh_App     (void);
+void        postDamageRefresh_App   (void); /* only the damaged areas of roots need redrawing */
 void        postCommand_Root    (iRoot *, const char *command);
 void        postCommandf_Root   (iRoot *, const char *command, ...);
 void        postCommandf_App    (const char *command, ...);
@@ -0,0 +1,174 @@
+/* Copyright 2023 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "archivecache.h"
+
+#include <the_Foundation/fileinfo.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/time.h>
+
+iDeclareTypeConstruction(OpenArchive)
+
+struct Impl_OpenArchive {
+    iString   path;
+    iTime     modified;
+    size_t    size;
+    iMutex *  mtx;      /* held while the archive is being used */
+    iArchive *archive;  /* opened by the first user */
+    iBool     isFailed; /* could not be opened */
+    int       numUsers; /* guarded by the cache mutex */
+    iBool     isCached; /* deleted by the last user after being removed from the cache */
+};
+
+void init_OpenArchive(iOpenArchive *d) {
+    init_String(&d->path);
+    iZap(d->modified);
+    d->size     = 0;
+    d->mtx      = new_Mutex();
+    d->archive  = NULL;
+    d->isFailed = iFalse;
+    d->numUsers = 0;
+    d->isCached = iTrue;
+}
+
+void deinit_OpenArchive(iOpenArchive *d) {
+    iRelease(d->archive);
+    delete_Mutex(d->mtx);
+    deinit_String(&d->path);
+}
+
+iDefineTypeConstruction(OpenArchive)
+
+iArchive *archive_OpenArchive(iOpenArchive *d) {
+    return d->archive;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(ArchiveCache)
+
+static const size_t maxOpen_ArchiveCache_ = 4;
+
+struct Impl_ArchiveCache {
+    iMutex *  mtx;
+    iPtrArray open; /* most recently used first */
+};
+
+static iArchiveCache archiveCache_;
+
+void init_ArchiveCache(void) {
+    iArchiveCache *d = &archiveCache_;
+    d->mtx = new_Mutex();
+    init_PtrArray(&d->open);
+}
+
+void deinit_ArchiveCache(void) {
+    iArchiveCache *d = &archiveCache_;
+    iForEach(PtrArray, i, &d->open) {
+        delete_OpenArchive(i.ptr);
+    }
+    deinit_PtrArray(&d->open);
+    delete_Mutex(d->mtx);
+}
+
+static void forget_ArchiveCache_(iArchiveCache *d, iOpenArchive *oa) {
+    /* Called with the cache mutex locked, after `oa` has been removed from the list. */
+    iUnused(d);
+    oa->isCached = iFalse;
+    if (oa->numUsers == 0) {
+        delete_OpenArchive(oa);
+    }
+}
+
+iOpenArchive *lock_ArchiveCache(const iString *path) {
+    iArchiveCache *d = &archiveCache_;
+    if (!fileExists_FileInfo(path)) {
+        return NULL;
+    }
+    iFileInfo *info = new_FileInfo(path);
+    const iTime  modified = lastModified_FileInfo(info);
+    const size_t size     = size_FileInfo(info);
+    iRelease(info);
+    lock_Mutex(d->mtx);
+    iOpenArchive *found = NULL;
+    iForEach(PtrArray, i, &d->open) {
+        iOpenArchive *oa = i.ptr;
+        if (equal_String(&oa->path, path)) {
+            remove_PtrArrayIterator(&i);
+            if (oa->size == size && !cmp_Time(&oa->modified, &modified)) {
+                found = oa;
+            }
+            else {
+                forget_ArchiveCache_(d, oa); /* file has been changed */
+            }
+            break;
+        }
+    }
+    if (!found) {
+        found = new_OpenArchive();
+        set_String(&found->path, path);
+        found->modified = modified;
+        found->size     = size;
+        while (size_PtrArray(&d->open) >= maxOpen_ArchiveCache_) {
+            iOpenArchive *oldest = at_PtrArray(&d->open, size_PtrArray(&d->open) - 1);
+            popBack_Array(&d->open);
+            forget_ArchiveCache_(d, oldest);
+        }
+    }
+    pushFront_PtrArray(&d->open, found);
+    found->numUsers++;
+    unlock_Mutex(d->mtx);
+    /* Opening reads the central directory, so it is done without blocking other archives. */
+    lock_Mutex(found->mtx);
+    if (!found->archive && !found->isFailed) {
+        iArchive *arch = new_Archive();
+        if (openFile_Archive(arch, path)) {
+            found->archive = arch;
+        }
+        else {
+            iRelease(arch);
+            found->isFailed = iTrue;
+            lock_Mutex(d->mtx);
+            if (found->isCached) {
+                removeOne_PtrArray(&d->open, found);
+                found->isCached = iFalse; /* deleted when unlocked */
+            }
+            unlock_Mutex(d->mtx);
+        }
+    }
+    if (!found->archive) {
+        unlock_ArchiveCache(found);
+        return NULL;
+    }
+    return found; /* remains locked */
+}
+
+void unlock_ArchiveCache(iOpenArchive *oa) {
+    iArchiveCache *d = &archiveCache_;
+    unlock_Mutex(oa->mtx);
+    lock_Mutex(d->mtx);
+    if (--oa->numUsers == 0 && !oa->isCached) {
+        delete_OpenArchive(oa);
+    }
+    unlock_Mutex(d->mtx);
+}
@@ -0,0 +1,134 @@
+/* Copyright 2023 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "diskcache.h"
+
+#include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
+#include <the_Foundation/path.h>
+#include <the_Foundation/stringset.h>
+#include <stdio.h>
+
+iDeclareType(DiskCache)
+
+static const char *dirName_DiskCache_    = "cache";
+static const char *tempSuffix_DiskCache_ = ".tmp";
+
+struct Impl_DiskCache {
+    iString     dir;
+    iStringSet *marked; /* keys in use */
+};
+
+static iDiskCache diskCache_;
+
+static uint64_t fnv1a_(const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static const iString *path_DiskCache_(const iDiskCache *d, const iString *key) {
+    return collect_String(concat_Path(&d->dir, key));
+}
+
+void init_DiskCache(const char *saveDir) {
+    iDiskCache *d = &diskCache_;
+    init_String(&d->dir);
+    set_String(&d->dir, collect_String(concatCStr_Path(collectNewCStr_String(saveDir),
+                                                       dirName_DiskCache_)));
+    makeDirs_Path(&d->dir);
+    d->marked = new_StringSet();
+}
+
+void deinit_DiskCache(void) {
+    iDiskCache *d = &diskCache_;
+    iRelease(d->marked);
+    deinit_String(&d->dir);
+}
+
+const iString *store_DiskCache(const iBlock *data) {
+    iDiskCache *d = &diskCache_;
+    /* Two independent hashes make collisions practically impossible. */
+    iString *key = collectNewFormat_String(
+        "%016llx%08x",
+        (unsigned long long) fnv1a_(constData_Block(data), size_Block(data)),
+        iCrc32(constData_Block(data), size_Block(data)));
+    const iString *path = path_DiskCache_(d, key);
+    if (!fileExists_FileInfo(path)) {
+        /* Written under a temporary name so an interrupted write is never mistaken for
+           complete contents. */
+        iString *tempPath = collectNewFormat_String("%s%s", cstr_String(path),
+                                                    tempSuffix_DiskCache_);
+        iFile *f = new_File(tempPath);
+        if (open_File(f, writeOnly_FileMode)) {
+            write_File(f, data);
+            close_File(f);
+            rename(cstr_String(tempPath), cstr_String(path));
+        }
+        iRelease(f);
+    }
+    mark_DiskCache(key);
+    return key;
+}
+
+iBool load_DiskCache(const iString *key, size_t size, iBlock *data_out) {
+    iDiskCache *d = &diskCache_;
+    iBool ok = iFalse;
+    iFile *f = new_File(path_DiskCache_(d, key));
+    if (open_File(f, readOnly_FileMode)) {
+        if (size_File(f) == size) {
+            iBlock *data = readAll_File(f);
+            set_Block(data_out, data);
+            delete_Block(data);
+            ok = (size_Block(data_out) == size);
+        }
+    }
+    iRelease(f);
+    return ok;
+}
+
+void beginMark_DiskCache(void) {
+    clear_StringSet(diskCache_.marked);
+}
+
+void mark_DiskCache(const iString *key) {
+    if (!isEmpty_String(key)) {
+        insert_StringSet(diskCache_.marked, key);
+    }
+}
+
+void sweep_DiskCache(void) {
+    iDiskCache *d = &diskCache_;
+    iForEach(DirFileInfo, info, iClob(new_DirFileInfo(&d->dir))) {
+        const iString *path = path_FileInfo(info.value);
+        iString *name = collectNewRange_String(baseName_Path(path));
+        if (startsWith_String(name, ".")) {
+            continue;
+        }
+        if (!contains_StringSet(d->marked, name)) {
+            remove(cstr_String(path));
+        }
+    }
+}
@@ -25,15 +25,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "gmrequest.h"
 #include "visited.h"
 #include "lang.h"
+#include "pageindex.h"
 #include "app.h"
 
+#include <the_Foundation/buffer.h>
 #include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
 #include <the_Foundation/hash.h>
 #include <the_Foundation/intset.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/queue.h>
 #include <the_Foundation/regexp.h>
+#include <the_Foundation/stringhash.h>
 #include <the_Foundation/stringset.h>
 #include <the_Foundation/thread.h>
 #include <SDL_timer.h>
@@ -79,17 +83,69 @@ iBool isUnread_FeedEntry(const iFeedEntry *d) {
 
 /*----------------------------------------------------------------------------------------------*/
 
-static int requestTimeoutSeconds_FeedJob_ = 10.0f;
+iDeclareClass(FeedHost)
+
+/* Per-host request accounting. Hosts that fail to respond are left alone for a while, with
+   the delay doubling after each consecutive failure. */
+struct Impl_FeedHost {
+    iObject object;
+    int     numActive;
+    int     numFailures; /* consecutive */
+    iTime   retryTime;   /* not contacted again before this */
+};
+
+static const double initialBackoffSeconds_FeedHost_ = 5 * 60;
+static const double maxBackoffSeconds_FeedHost_     = 24 * 60 * 60;
+
+void init_FeedHost(iFeedHost *d) {
+    d->numActive   = 0;
+    d->numFailures = 0;
+    iZap(d->retryTime);
+}
+
+void deinit_FeedHost(iFeedHost *d) {
+    iUnused(d);
+}
+
+iDefineObjectConstruction(FeedHost)
+iDefineClass(FeedHost)
+
+static iBool isBackingOff_FeedHost_(const iFeedHost *d) {
+    return isValid_Time(&d->retryTime) && elapsedSeconds_Time(&d->retryTime) < 0;
+}
+
+static void setResult_FeedHost_(iFeedHost *d, iBool isFailed) {
+    if (isFailed) {
+        const double delay = iMin(maxBackoffSeconds_FeedHost_,
+                                  initialBackoffSeconds_FeedHost_ * (1 << iMin(d->numFailures, 10)));
+        d->numFailures++;
+        initTimeout_Time(&d->retryTime, delay);
+    }
+    else {
+        d->numFailures = 0;
+        iZap(d->retryTime);
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const double requestTimeoutSeconds_FeedJob_ = 10.0; /* without receiving anything */
 
 struct Impl_FeedJob {
     iString     url;
     uint32_t    bookmarkId;
-    iTime       startTime;
+    iTime       lastActivity;
+    size_t      lastBodySize;
     iBool       isFirstUpdate; /* hasn't been checked ever before */
     iBool       checkHeadings;
     iBool       ignoreWeb;
     iGmRequest *request;
+    iFeedHost * host; /* owned by Feeds */
     int         numRedirect;
+    iBool       hasDigest;
+    uint64_t    sourceDigest;  /* previous merge's, updated after parsing */
+    uint32_t    resultsDigest;
+    iBool       isUnchanged;   /* same as last time, nothing was parsed */
     iPtrArray   results;
 };
 
@@ -97,9 +153,15 @@ static void init_FeedJob(iFeedJob *d, const iBookmark *bookmark) {
     initCopy_String(&d->url, &bookmark->url);
     d->bookmarkId = id_Bookmark(bookmark);
     d->request = NULL;
+    d->host = NULL;
     d->numRedirect = 0;
+    d->hasDigest = iFalse;
+    d->sourceDigest = 0;
+    d->resultsDigest = 0;
+    d->isUnchanged = iFalse;
     init_PtrArray(&d->results);
-    iZap(d->startTime);
+    iZap(d->lastActivity);
+    d->lastBodySize = 0;
     d->isFirstUpdate = iFalse;
     d->checkHeadings = (bookmark->flags & headings_BookmarkFlag) != 0;
     d->ignoreWeb     = (bookmark->flags & ignoreWeb_BookmarkFlag) != 0;
@@ -115,15 +177,91 @@ static void deinit_FeedJob(iFeedJob *d) {
 }
 
 static iBool isTimedOut_FeedJob_(iFeedJob *d) {
-    return elapsedSeconds_Time(&d->startTime) > requestTimeoutSeconds_FeedJob_;
+    /* Slow servers are fine as long as data keeps coming in. */
+    const size_t received = bodySize_GmRequest(d->request);
+    if (received != d->lastBodySize) {
+        d->lastBodySize = received;
+        initCurrent_Time(&d->lastActivity);
+        return iFalse;
+    }
+    return elapsedSeconds_Time(&d->lastActivity) > requestTimeoutSeconds_FeedJob_;
+}
+
+static double secondsUntilTimeout_FeedJob_(const iFeedJob *d) {
+    return requestTimeoutSeconds_FeedJob_ - elapsedSeconds_Time(&d->lastActivity);
+}
+
+static iBool isHostFailure_FeedJob_(const iFeedJob *d) {
+    const enum iGmStatusCode code = status_GmRequest(d->request);
+    return code == tlsFailure_GmStatusCode || code == serverUnavailable_GmStatusCode ||
+           code == slowDown_GmStatusCode;
+}
+
+static uint64_t sourceDigest_FeedJob_(const iFeedJob *d, const iBlock *body) {
+    /* The final URL and the parsing options affect the results as much as the content. */
+    const uint32_t context = iCrc32(cstr_String(&d->url), size_String(&d->url)) ^
+                             (d->checkHeadings ? 1 : 0) ^ (d->ignoreWeb ? 2 : 0);
+    return ((uint64_t) (context ^ (uint32_t) size_Block(body)) << 32) |
+           iCrc32(constData_Block(body), size_Block(body));
+}
+
+static uint32_t resultsDigest_FeedJob_(const iFeedJob *d) {
+    iString digestSrc;
+    init_String(&digestSrc);
+    iConstForEach(PtrArray, i, &d->results) {
+        const iFeedEntry *entry = i.ptr;
+        /* Headings are timestamped when seen, so their time is not part of the content. */
+        appendFormat_String(&digestSrc,
+                            "%s\n%s\n%llu\n",
+                            cstr_String(&entry->url),
+                            cstr_String(&entry->title),
+                            entry->isHeading ? 0ull
+                                             : (unsigned long long) integralSeconds_Time(
+                                                   &entry->posted));
+    }
+    const uint32_t digest = iCrc32(cstr_String(&digestSrc), size_String(&digestSrc));
+    deinit_String(&digestSrc);
+    return digest;
 }
 
 iDefineTypeConstructionArgs(FeedJob, (const iBookmark *bm), bm)
 
 /*----------------------------------------------------------------------------------------------*/
 
-static const char *feedsFilename_Feeds_         = "feeds.txt";
+iDeclareType(FeedDigest)
+
+/* What a subscription looked like when its entries were last merged. */
+struct Impl_FeedDigest {
+    iHashNode node; /* key is the bookmark ID */
+    uint64_t  source;
+    uint32_t  results;
+    iTime     mergedAt;
+};
+
+enum iFeedLogRecord {
+    feed_FeedLogRecord       = 1, /* ID, URL */
+    entry_FeedLogRecord      = 2, /* feed ID, posted, discovered, URL, title */
+    touch_FeedLogRecord      = 3, /* feed ID, discovered, URL */
+    remove_FeedLogRecord     = 4, /* feed ID, URL */
+    removeFeed_FeedLogRecord = 5, /* feed ID */
+    refreshed_FeedLogRecord  = 6, /* time */
+    digest_FeedLogRecord     = 7, /* feed ID, source, results, merge time */
+};
+
+static const char *feedsFilename_Feeds_         = "feeds.txt"; /* old format, migrated */
+static const char *logFilename_Feeds_           = "feeds.lgr";
+static const char *tempLogFilename_Feeds_       = "feeds.lgr.tmp";
+static const char *magicLog_Feeds_              = "lgFd";
+static const uint32_t logVersion_Feeds_         = 1;
+static const size_t minCompactedRecords_Feeds_  = 1000;
+/* Seeing an entry again is only recorded if it hasn't been seen in a while. This is
+   negligible compared to `maxAge_Visited`. */
+static const double touchIntervalSeconds_Feeds_ = 24 * 60 * 60;
 static const int   updateIntervalSeconds_Feeds_ = 4 * 60 * 60;
+static const size_t maxConcurrentRequests_Feeds_ = 16;
+static const int   maxRequestsPerHost_Feeds_    = 2;
+/* Unchanged feeds are still merged once in a while so their entries don't age out. */
+static const double maxUnmergedSeconds_Feeds_   = 24 * 60 * 60;
 
 struct Impl_Feeds {
     iMutex *  mtx;
@@ -133,18 +271,37 @@ struct Impl_Feeds {
     int       refreshTimer;
     iThread * worker;
     iBool     stopWorker;
+    iMutex    wakeMtx;
+    iCondition wakeCond; /* a request has finished or the worker should stop */
+    iBool     isWakePending;
     iPtrArray jobs; /* pending */
+    iStringHash *hosts; /* FeedHost objects keyed by host name */
+    iHash     digests; /* FeedDigest nodes; guarded by `mtx` */
+    iBuffer * log;     /* records not yet written to the file; guarded by `mtx` */
+    iBuffer * record;  /* record being written */
+    iIntSet   loggedFeeds; /* bookmark IDs declared in the log file */
+    size_t    numLogRecords; /* since last compaction */
     iSortedArray entries; /* pointers to all discovered feed entries, sorted by entry ID (URL) */
 };
 
 static iFeeds feeds_;
 
-#define maxConcurrentRequests_Feeds 4
+static void requestFinished_Feeds_(iAnyObject *obj) {
+    /* Called in a request's background thread. The request itself is the receiver. */
+    iUnused(obj);
+    iFeeds *d = &feeds_;
+    lock_Mutex(&d->wakeMtx);
+    d->isWakePending = iTrue;
+    signal_Condition(&d->wakeCond);
+    unlock_Mutex(&d->wakeMtx);
+}
 
 static void submit_FeedJob_(iFeedJob *d) {
     d->request = new_GmRequest(certs_App());
+    iConnect(GmRequest, d->request, finished, d->request, requestFinished_Feeds_);
     setUrl_GmRequest(d->request, &d->url);
-    initCurrent_Time(&d->startTime);
+    initCurrent_Time(&d->lastActivity);
+    d->lastBodySize = 0;
     submit_GmRequest(d->request);
 }
 
@@ -157,14 +314,52 @@ static const iPtrArray *listSubscriptions_(void) {
     return list_Bookmarks(bookmarks_App(), NULL, isSubscribed_, NULL);
 }
 
-static iFeedJob *startNextJob_Feeds_(iFeeds *d) {
-    if (isEmpty_PtrArray(&d->jobs)) {
-        return NULL;
+static iFeedHost *host_Feeds_(iFeeds *d, const iString *url) {
+    iString key;
+    initRange_String(&key, urlHost_String(url));
+    iFeedHost *host = value_StringHash(d->hosts, &key);
+    if (!host) {
+        host = new_FeedHost();
+        insert_StringHash(d->hosts, &key, host);
+        iRelease(host);
+    }
+    deinit_String(&key);
+    return host;
+}
+
+static size_t startJobs_Feeds_(iFeeds *d, iPtrArray *active) {
+    /* Returns the number of jobs dropped because their host is backing off. Jobs whose host
+       is already busy are left in the queue. */
+    size_t numSkipped = 0;
+    for (size_t i = 0;
+         i < size_PtrArray(&d->jobs) && size_PtrArray(active) < maxConcurrentRequests_Feeds_;) {
+        iFeedJob  *job  = at_PtrArray(&d->jobs, i);
+        iFeedHost *host = host_Feeds_(d, &job->url);
+        if (isBackingOff_FeedHost_(host)) {
+            remove_PtrArray(&d->jobs, i);
+            delete_FeedJob(job);
+            numSkipped++;
+            continue;
+        }
+        if (host->numActive >= maxRequestsPerHost_Feeds_) {
+            i++;
+            continue;
+        }
+        remove_PtrArray(&d->jobs, i);
+        job->host = host;
+        host->numActive++;
+        submit_FeedJob_(job);
+        pushBack_PtrArray(active, job);
     }
-    iFeedJob *job;
-    take_PtrArray(&d->jobs, 0, (void **) &job);
-    submit_FeedJob_(job);
-    return job;
+    return numSkipped;
+}
+
+static double secondsUntilNextTimeout_Feeds_(const iPtrArray *active) {
+    double seconds = requestTimeoutSeconds_FeedJob_;
+    iConstForEach(PtrArray, i, active) {
+        seconds = iMin(seconds, secondsUntilTimeout_FeedJob_(i.ptr));
+    }
+    return iMax(0.05, seconds);
 }
 
 static iBool isTrimmablePunctuation_(iChar c) {
@@ -210,6 +405,16 @@ static iBool parseResult_FeedJob_(iFeedJob *d) {
     }
     /* TODO: Should tell the user if the request failed. */       
     if (isSuccess_GmStatusCode(status_GmRequest(d->request))) {
+        /* Nothing to do if the source is exactly the same as last time. */ {
+            const iBlock  *body   = &lockResponse_GmRequest(d->request)->body;
+            const uint64_t digest = sourceDigest_FeedJob_(d, body);
+            unlockResponse_GmRequest(d->request);
+            if (d->hasDigest && digest == d->sourceDigest) {
+                d->isUnchanged = iTrue;
+                return iTrue;
+            }
+            d->sourceDigest = digest;
+        }
         iBeginCollect();
         iTime now;
         iTime perEntryAdjust;
@@ -281,48 +486,192 @@ static iBool parseResult_FeedJob_(iFeedJob *d) {
         deinit_String(&src);
         iRelease(linkPattern);
         iEndCollect();
+        /* The source may have changed in ways that don't matter (e.g., a visitor counter). */
+        const uint32_t digest = resultsDigest_FeedJob_(d);
+        d->isUnchanged = d->hasDigest && digest == d->resultsDigest;
+        d->resultsDigest = digest;
     }
     return iTrue;
 }
 
-static void save_Feeds_(iFeeds *d) {
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
-    if (open_File(f, write_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
-        iString *str = new_String();
-        format_String(str, "%llu\n# Feeds\n", (unsigned long long)
-                      integralSeconds_Time(&d->lastRefreshedAt));
-        write_File(f, utf8_String(str));
-        /* Index of feeds for IDs. */ {
-            iConstForEach(PtrArray, i, listSubscriptions_()) {
-                const iBookmark *bm = i.ptr;
-                format_String(str, "%08x %s\n", id_Bookmark(bm), cstr_String(&bm->url));
-                write_File(f, utf8_String(str));
+/* The database is an append-only log of records. Entries are written once when discovered,
+   and later changes are small delta records. The log is compacted into a snapshot of the
+   current state when it has grown too long compared to the number of entries. */
+
+static iBool isAgedOut_FeedEntry_(const iFeedEntry *d, const iTime *now) {
+    /* Heading entries are kept as long as they are present in the source. */
+    return !d->isHeading && isValid_Time(&d->discovered) &&
+           secondsSince_Time(now, &d->discovered) > maxAge_Visited;
+}
+
+static void beginRecord_Feeds_(iFeeds *d) {
+    openEmpty_Buffer(d->record);
+}
+
+static void endRecord_Feeds_(iFeeds *d, enum iFeedLogRecord type) {
+    iStream *log = stream_Buffer(d->log);
+    write8_Stream(log, type);
+    writeU32_Stream(log, (uint32_t) size_Block(data_Buffer(d->record)));
+    write_Stream(log, data_Buffer(d->record));
+    close_Buffer(d->record);
+    d->numLogRecords++;
+}
+
+static void logFeed_Feeds_(iFeeds *d, uint32_t bookmarkId) {
+    /* Bookmark IDs are not persistent, so each log session declares the ones it uses. */
+    if (contains_IntSet(&d->loggedFeeds, bookmarkId)) {
+        return;
+    }
+    insert_IntSet(&d->loggedFeeds, bookmarkId);
+    const iBookmark *bm = get_Bookmarks(bookmarks_App(), bookmarkId);
+    beginRecord_Feeds_(d);
+    writeU32_Stream(stream_Buffer(d->record), bookmarkId);
+    serialize_String(bm ? &bm->url : collectNew_String(), stream_Buffer(d->record));
+    endRecord_Feeds_(d, feed_FeedLogRecord);
+}
+
+static void logEntry_Feeds_(iFeeds *d, const iFeedEntry *entry) {
+    logFeed_Feeds_(d, entry->bookmarkId);
+    beginRecord_Feeds_(d);
+    iStream *outs = stream_Buffer(d->record);
+    writeU32_Stream(outs, entry->bookmarkId);
+    writeU64_Stream(outs, integralSeconds_Time(&entry->posted));
+    writeU64_Stream(outs, integralSeconds_Time(&entry->discovered));
+    serialize_String(&entry->url, outs);
+    serialize_String(&entry->title, outs);
+    endRecord_Feeds_(d, entry_FeedLogRecord);
+}
+
+static void logTouch_Feeds_(iFeeds *d, const iFeedEntry *entry) {
+    logFeed_Feeds_(d, entry->bookmarkId);
+    beginRecord_Feeds_(d);
+    iStream *outs = stream_Buffer(d->record);
+    writeU32_Stream(outs, entry->bookmarkId);
+    writeU64_Stream(outs, integralSeconds_Time(&entry->discovered));
+    serialize_String(&entry->url, outs);
+    endRecord_Feeds_(d, touch_FeedLogRecord);
+}
+
+static void logRemove_Feeds_(iFeeds *d, const iFeedEntry *entry) {
+    logFeed_Feeds_(d, entry->bookmarkId);
+    beginRecord_Feeds_(d);
+    writeU32_Stream(stream_Buffer(d->record), entry->bookmarkId);
+    serialize_String(&entry->url, stream_Buffer(d->record));
+    endRecord_Feeds_(d, remove_FeedLogRecord);
+}
+
+static void logRemoveFeed_Feeds_(iFeeds *d, uint32_t bookmarkId) {
+    logFeed_Feeds_(d, bookmarkId);
+    beginRecord_Feeds_(d);
+    writeU32_Stream(stream_Buffer(d->record), bookmarkId);
+    endRecord_Feeds_(d, removeFeed_FeedLogRecord);
+}
+
+static void logRefreshed_Feeds_(iFeeds *d) {
+    beginRecord_Feeds_(d);
+    writeU64_Stream(stream_Buffer(d->record), integralSeconds_Time(&d->lastRefreshedAt));
+    endRecord_Feeds_(d, refreshed_FeedLogRecord);
+}
+
+static void logDigest_Feeds_(iFeeds *d, const iFeedDigest *digest) {
+    logFeed_Feeds_(d, digest->node.key);
+    beginRecord_Feeds_(d);
+    iStream *outs = stream_Buffer(d->record);
+    writeU32_Stream(outs, digest->node.key);
+    writeU64_Stream(outs, digest->source);
+    writeU32_Stream(outs, digest->results);
+    writeU64_Stream(outs, integralSeconds_Time(&digest->mergedAt));
+    endRecord_Feeds_(d, digest_FeedLogRecord);
+}
+
+static void writeLogHeader_Feeds_(iStream *outs) {
+    writeData_Stream(outs, magicLog_Feeds_, 4);
+    writeU32_Stream(outs, logVersion_Feeds_);
+}
+
+static iBool compactLog_Feeds_(iFeeds *d);
+
+static void flushLog_Feeds_(iFeeds *d) {
+    /* Appends pending records to the file. If the file can't be opened, the records are
+       kept for the next flush. */
+    iBool isTorn = iFalse;
+    lock_Mutex(d->mtx);
+    if (!isEmpty_Block(data_Buffer(d->log))) {
+        const iString *path = collect_String(concatCStr_Path(&d->saveDir, logFilename_Feeds_));
+        const iBool    isNew = !fileExists_FileInfo(path);
+        iFile         *f     = new_File(path);
+        if (open_File(f, append_FileMode)) {
+            if (isNew) {
+                writeLogHeader_Feeds_(stream_File(f));
             }
+            const size_t size = size_Block(data_Buffer(d->log));
+            isTorn = (write_File(f, data_Buffer(d->log)) != size);
+            close_Buffer(d->log);
+            openEmpty_Buffer(d->log);
         }
-        writeData_File(f, "# Entries\n", 10);
-        iTime now;
-        initCurrent_Time(&now);
-        iConstForEach(Array, i, &d->entries.values) {
-            const iFeedEntry *entry = *(const iFeedEntry **) i.value;
-            /* Heading entries are kept as long as they are present in the source. */
-            if (!entry->isHeading && isValid_Time(&entry->discovered) &&
-                secondsSince_Time(&now, &entry->discovered) > maxAge_Visited) {
-                continue; /* Forget entries discovered long ago. */
-            }
-            format_String(str, "%x\n%llu\n%llu\n%s\n%s\n",
-                          entry->bookmarkId,
-                          (unsigned long long) integralSeconds_Time(&entry->posted),
-                          (unsigned long long) integralSeconds_Time(&entry->discovered),
-                          cstr_String(&entry->url),
-                          cstr_String(&entry->title));
-            write_File(f, utf8_String(str));
-        }
-        delete_String(str);
+        iRelease(f);
+    }
+    unlock_Mutex(d->mtx);
+    if (isTorn) {
+        /* Further records must not be appended after a partially written one. */
+        compactLog_Feeds_(d);
+    }
+}
+
+static iBool isLogWritten_Feeds_(const iFeeds *d, size_t size) {
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, logFilename_Feeds_)));
+    const iBool ok = open_File(f, readOnly_FileMode) && size_File(f) == size;
+    iRelease(f);
+    return ok;
+}
+
+static iBool compactLog_Feeds_(iFeeds *d) {
+    /* Replaces the log with a snapshot of the current state. Pending records become
+       redundant. Returns false if the snapshot could not be written. */
+    iBool ok = iFalse;
+    lock_Mutex(d->mtx);
+    close_Buffer(d->log);
+    openEmpty_Buffer(d->log);
+    clear_IntSet(&d->loggedFeeds);
+    d->numLogRecords = 0;
+    writeLogHeader_Feeds_(stream_Buffer(d->log));
+    logRefreshed_Feeds_(d);
+    iTime now;
+    initCurrent_Time(&now);
+    iConstForEach(Array, i, &d->entries.values) {
+        const iFeedEntry *entry = *(const iFeedEntry **) i.value;
+        if (!isAgedOut_FeedEntry_(entry, &now)) {
+            logEntry_Feeds_(d, entry);
+        }
+    }
+    iConstForEach(Hash, j, &d->digests) {
+        logDigest_Feeds_(d, (const iFeedDigest *) j.value);
+    }
+    const iString *tempPath = collect_String(concatCStr_Path(&d->saveDir, tempLogFilename_Feeds_));
+    iFile *f = new_File(tempPath);
+    if (open_File(f, writeOnly_FileMode)) {
+        const size_t size = size_Block(data_Buffer(d->log));
+        ok = (write_File(f, data_Buffer(d->log)) == size);
         close_File(f);
-        unlock_Mutex(d->mtx);
+        if (ok) {
+            commitFile_App(cstrCollect_String(concatCStr_Path(&d->saveDir, logFilename_Feeds_)),
+                           cstr_String(tempPath));
+            ok = isLogWritten_Feeds_(d, size);
+        }
+        else {
+            remove(cstr_String(tempPath));
+        }
     }
     iRelease(f);
+    close_Buffer(d->log);
+    openEmpty_Buffer(d->log);
+    unlock_Mutex(d->mtx);
+    return ok;
+}
+
+static iBool isLogCompactable_Feeds_(const iFeeds *d) {
+    return d->numLogRecords > minCompactedRecords_Feeds_ &&
+           d->numLogRecords > 2 * size_SortedArray(&d->entries);
 }
 
 static iBool isHeadingEntry_FeedEntry_(const iFeedEntry *d) {
@@ -363,6 +712,7 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
             if (!contains_StringSet(known, &entry->url)) {
 //                printf("  {%s} is new\n", cstr_String(&entry->url));
                 insert_SortedArray(&d->entries, &entry);
+                logEntry_Feeds_(d, entry);
                 gotNew = iTrue;
                 remove_PtrArrayIterator(&i);
             }
@@ -378,6 +728,7 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
             if (entry->bookmarkId == sourceId &&
                 !contains_StringSet(presentInSource, &entry->url)) {
 //                printf("    {%s}\n", cstr_String(&entry->url));
+                logRemove_Feeds_(d, entry);
                 delete_FeedEntry(entry);
                 remove_ArrayIterator(&e);
             }
@@ -425,18 +776,34 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
                      newDate.day != oldDate.day)) {
                     changed = iTrue;
                 }
+                const iBool isModified =
+                    !equal_String(&existing->title, &entry->title) ||
+                    integralSeconds_Time(&existing->posted) != integralSeconds_Time(&entry->posted);
+                const iBool isStale = !isValid_Time(&existing->discovered) ||
+                                      secondsSince_Time(&entry->discovered, &existing->discovered) >
+                                          touchIntervalSeconds_Feeds_;
                 set_String(&existing->title, &entry->title);
-                existing->posted     = entry->posted;
-                existing->discovered = entry->discovered; /* prevent discarding */
+                existing->posted = entry->posted;
+                if (isModified || isStale) {
+                    existing->discovered = entry->discovered; /* prevent discarding */
+                }
+                if (isModified) {
+                    logEntry_Feeds_(d, existing);
+                }
+                else if (isStale) {
+                    logTouch_Feeds_(d, existing);
+                }
                 delete_FeedEntry(entry);
                 if (changed) {
                     /* TODO: better to use a new flag for read feed entries? */
                     removeUrl_Visited(visited_App(), &existing->url);
+                    remove_PageIndex(pageIndex_App(), &existing->url);
                     gotNew = iTrue;
                 }
             }
             else {
                 insert_SortedArray(&d->entries, &entry);
+                logEntry_Feeds_(d, entry);
                 gotNew = iTrue;
             }
             remove_PtrArrayIterator(&i);
@@ -448,64 +815,118 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
     return gotNew;
 }
 
+static void updateDigest_Feeds_(iFeeds *d, const iFeedJob *job) {
+    lock_Mutex(d->mtx);
+    iFeedDigest *digest = (iFeedDigest *) value_Hash(&d->digests, job->bookmarkId);
+    if (!digest) {
+        digest = iMalloc(FeedDigest);
+        digest->node.key = job->bookmarkId;
+        insert_Hash(&d->digests, &digest->node);
+    }
+    digest->source  = job->sourceDigest;
+    digest->results = job->resultsDigest;
+    initCurrent_Time(&digest->mergedAt);
+    logDigest_Feeds_(d, digest);
+    unlock_Mutex(d->mtx);
+}
+
 static iThreadResult fetch_Feeds_(iThread *thread) {
     iFeeds *d = &feeds_;
     iUnused(thread);
-    iFeedJob *work[maxConcurrentRequests_Feeds]; /* We'll do a couple of concurrent requests. */
-    iZap(work);
+    iPtrArray active; /* jobs with a request in flight */
+    init_PtrArray(&active);
     iBool gotNew = iFalse;
     postCommand_App("feeds.update.started");
     const size_t totalJobs = size_PtrArray(&d->jobs);
-    int numFinishedJobs = 0;
-    while (!d->stopWorker) {
-        /* Start new jobs. */
-        iForIndices(i, work) {
-            if (!work[i]) {
-                work[i] = startNextJob_Feeds_(d);
-            }
+    size_t numFinishedJobs = 0;
+    size_t numSkippedJobs = 0;
+    size_t numUnchangedJobs = 0;
+    iTime startTime;
+    initCurrent_Time(&startTime);
+    for (;;) {
+        const size_t numSkipped = startJobs_Feeds_(d, &active);
+        numSkippedJobs += numSkipped;
+        numFinishedJobs += numSkipped;
+        /* Stop if everything has finished. */
+        if (isEmpty_PtrArray(&active)) {
+            break;
         }
-        sleep_Thread(0.5); /* TODO: wait on a Condition so we can exit quickly */
-        if (d->stopWorker) break;
-        size_t ongoing = 0;
-        iBool doNotify = iFalse;
-        iForIndices(i, work) {
-            if (work[i]) {
-                if (isFinished_GmRequest(work[i]->request)) {
-                    if (parseResult_FeedJob_(work[i])) {
-                        gotNew |= updateEntries_Feeds_(
-                            d, work[i]->checkHeadings, work[i]->bookmarkId, &work[i]->results);
-                        delete_FeedJob(work[i]);
-                        work[i] = NULL;
-                        numFinishedJobs++;
-                        doNotify = iTrue;
-                    }
-                    else {
-                        ongoing++;
-                    }
+        /* Sleep until a request finishes, the next one times out, or we are asked to stop. */
+        lock_Mutex(&d->wakeMtx);
+        if (!d->isWakePending && !d->stopWorker) {
+            iTime until;
+            initTimeout_Time(&until, secondsUntilNextTimeout_Feeds_(&active));
+            waitTimeout_Condition(&d->wakeCond, &d->wakeMtx, &until);
+        }
+        d->isWakePending = iFalse;
+        const iBool isStopping = d->stopWorker;
+        unlock_Mutex(&d->wakeMtx);
+        if (isStopping) {
+            break;
+        }
+        iBool doNotify = numSkipped > 0;
+        iForEach(PtrArray, i, &active) {
+            iFeedJob *job = i.ptr;
+            iBool isFailed = iFalse;
+            if (isFinished_GmRequest(job->request)) {
+                isFailed = isHostFailure_FeedJob_(job);
+                if (!parseResult_FeedJob_(job)) {
+                    continue; /* redirected */
                 }
-                else if (isTimedOut_FeedJob_(work[i])) {
-                    /* Maybe we'll get it next time! */
-                    delete_FeedJob(work[i]);
-                    work[i] = NULL;
-                    numFinishedJobs++;
-                    doNotify = iTrue;
+                if (job->isUnchanged) {
+                    numUnchangedJobs++;
                 }
                 else {
-                    ongoing++;
+                    gotNew |= updateEntries_Feeds_(
+                        d, job->checkHeadings, job->bookmarkId, &job->results);
+                    if (isSuccess_GmStatusCode(status_GmRequest(job->request))) {
+                        updateDigest_Feeds_(d, job);
+                    }
+                    flushLog_Feeds_(d);
                 }
-                /* TODO: abort job if it takes too long (> 15 seconds?) */
             }
+            else if (isTimedOut_FeedJob_(job)) {
+                /* Maybe we'll get it next time! */
+                isFailed = iTrue;
+            }
+            else {
+                continue;
+            }
+            job->host->numActive--;
+            setResult_FeedHost_(job->host, isFailed);
+            delete_FeedJob(job);
+            remove_PtrArrayIterator(&i);
+            numFinishedJobs++;
+            doNotify = iTrue;
         }
         if (doNotify) {
-            postCommandf_App("feeds.update.progress arg:%d total:%zu", numFinishedJobs, totalJobs);
-        }
-        /* Stop if everything has finished. */
-        if (ongoing == 0 && isEmpty_PtrArray(&d->jobs)) {
-            break;
+            const double elapsed = iMax(0.001, elapsedSeconds_Time(&startTime));
+            postCommandf_App("feeds.update.progress arg:%zu total:%zu skipped:%zu "
+                             "unchanged:%zu rate:%.1f",
+                             numFinishedJobs,
+                             totalJobs,
+                             numSkippedJobs,
+                             numUnchangedJobs,
+                             (numFinishedJobs - numSkippedJobs) / elapsed);
         }
     }
+    /* Drop whatever is still in flight if we are stopping early. */
+    iForEach(PtrArray, i, &active) {
+        iFeedJob *job = i.ptr;
+        job->host->numActive--;
+        delete_FeedJob(job);
+    }
+    deinit_PtrArray(&active);
+    lock_Mutex(d->mtx);
     initCurrent_Time(&d->lastRefreshedAt);
-    save_Feeds_(d);
+    logRefreshed_Feeds_(d);
+    unlock_Mutex(d->mtx);
+    if (isLogCompactable_Feeds_(d)) {
+        compactLog_Feeds_(d);
+    }
+    else {
+        flushLog_Feeds_(d);
+    }
     /* Check if there are visited URLs marked as Kept that can be cleared because they are no
        longer present in the database. */ {
         iStringSet *knownEntryUrls = new_StringSet();
@@ -524,8 +945,10 @@ static iThreadResult fetch_Feeds_(iThread *thread) {
         }
         iRelease(knownEntryUrls);
     }
-    postCommandf_App("feeds.update.finished arg:%d unread:%zu", gotNew ? 1 : 0,
-                     numUnread_Feeds());
+    postCommandf_App("feeds.update.finished arg:%d unread:%zu unchanged:%zu",
+                     gotNew ? 1 : 0,
+                     numUnread_Feeds(),
+                     numUnchangedJobs);
     return 0;
 }
 
@@ -543,11 +966,22 @@ static iBool startWorker_Feeds_(iFeeds *d) {
 //            fflush(stdout);
             insert_IntSet(&d->previouslyCheckedFeeds, id_Bookmark(bm));
         }
+        /* Unchanged feeds can be skipped, unless they haven't been merged in a while. */
+        lock_Mutex(d->mtx);
+        const iFeedDigest *digest = (const iFeedDigest *) value_Hash(&d->digests, job->bookmarkId);
+        if (digest && !job->isFirstUpdate &&
+            elapsedSeconds_Time(&digest->mergedAt) < maxUnmergedSeconds_Feeds_) {
+            job->hasDigest     = iTrue;
+            job->sourceDigest  = digest->source;
+            job->resultsDigest = digest->results;
+        }
+        unlock_Mutex(d->mtx);
         pushBack_PtrArray(&d->jobs, job);
     }
     if (!isEmpty_Array(&d->jobs)) {
         d->worker = new_Thread(fetch_Feeds_);
         d->stopWorker = iFalse;
+        d->isWakePending = iFalse;
         start_Thread(d->worker);
         return iTrue;
     }
@@ -562,7 +996,10 @@ static uint32_t refresh_Feeds_(uint32_t interval, void *data) {
 
 static void stopWorker_Feeds_(iFeeds *d) {
     if (d->worker) {
+        lock_Mutex(&d->wakeMtx);
         d->stopWorker = iTrue;
+        signal_Condition(&d->wakeCond);
+        unlock_Mutex(&d->wakeMtx);
         join_Thread(d->worker);
         iReleasePtr(&d->worker);
     }
@@ -590,8 +1027,7 @@ struct Impl_FeedHashNode {
     uint32_t  bookmarkId;
 };
 
-static void load_Feeds_(iFeeds *d) {
-    /* TODO: If there are lots of entries, it would make sense to load async. */
+static void loadText_Feeds_(iFeeds *d) {
     iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
     if (open_File(f, read_FileMode | text_FileMode)) {
         iBlock * src     = readAll_File(f);
@@ -696,6 +1132,205 @@ static void load_Feeds_(iFeeds *d) {
     iRelease(f);
 }
 
+static iFeedEntry *findEntry_Feeds_(iFeeds *d, uint32_t bookmarkId, const iString *url) {
+    iFeedEntry key;
+    init_FeedEntry(&key);
+    set_String(&key.url, url);
+    key.bookmarkId = bookmarkId;
+    const iFeedEntry *keyPtr = &key;
+    size_t pos;
+    iFeedEntry *entry = NULL;
+    if (locate_SortedArray(&d->entries, &keyPtr, &pos)) {
+        entry = *(iFeedEntry **) at_SortedArray(&d->entries, pos);
+    }
+    deinit_FeedEntry(&key);
+    return entry;
+}
+
+static void replayRecord_Feeds_(iFeeds *d, enum iFeedLogRecord type, iStream *ins,
+                                iHash *feeds) {
+    if (type == refreshed_FeedLogRecord) {
+        d->lastRefreshedAt.ts.tv_sec = readU64_Stream(ins);
+        return;
+    }
+    const uint32_t feedId = readU32_Stream(ins);
+    if (type == feed_FeedLogRecord) {
+        iString url;
+        init_String(&url);
+        deserialize_String(&url, ins);
+        iFeedHashNode *node = (iFeedHashNode *) value_Hash(feeds, feedId);
+        if (!node) {
+            node = iMalloc(FeedHashNode);
+            node->node.key = feedId;
+            insert_Hash(feeds, &node->node);
+        }
+        node->bookmarkId = isEmpty_String(&url) ? 0 : findUrl_Bookmarks(bookmarks_App(), &url);
+        if (node->bookmarkId) {
+            insert_IntSet(&d->previouslyCheckedFeeds, node->bookmarkId);
+        }
+        deinit_String(&url);
+        return;
+    }
+    const iFeedHashNode *node = (const iFeedHashNode *) value_Hash(feeds, feedId);
+    if (!node || !node->bookmarkId) {
+        return; /* no longer subscribed */
+    }
+    switch (type) {
+        case entry_FeedLogRecord: {
+            iFeedEntry *entry = new_FeedEntry();
+            entry->bookmarkId           = node->bookmarkId;
+            entry->posted.ts.tv_sec     = readU64_Stream(ins);
+            entry->discovered.ts.tv_sec = readU64_Stream(ins);
+            deserialize_String(&entry->url, ins);
+            deserialize_String(&entry->title, ins);
+            entry->isHeading = isHeadingEntry_FeedEntry_(entry);
+            iFeedEntry *existing = findEntry_Feeds_(d, entry->bookmarkId, &entry->url);
+            if (existing) {
+                set_String(&existing->title, &entry->title);
+                existing->posted     = entry->posted;
+                existing->discovered = entry->discovered;
+                delete_FeedEntry(entry);
+            }
+            else {
+                insert_SortedArray(&d->entries, &entry);
+            }
+            break;
+        }
+        case touch_FeedLogRecord: {
+            const uint64_t discovered = readU64_Stream(ins);
+            iString url;
+            init_String(&url);
+            deserialize_String(&url, ins);
+            iFeedEntry *entry = findEntry_Feeds_(d, node->bookmarkId, &url);
+            if (entry) {
+                entry->discovered.ts.tv_sec  = discovered;
+                entry->discovered.ts.tv_nsec = 0;
+            }
+            deinit_String(&url);
+            break;
+        }
+        case remove_FeedLogRecord: {
+            iString url;
+            init_String(&url);
+            deserialize_String(&url, ins);
+            iFeedEntry *entry = findEntry_Feeds_(d, node->bookmarkId, &url);
+            if (entry) {
+                remove_SortedArray(&d->entries, &entry);
+                delete_FeedEntry(entry);
+            }
+            deinit_String(&url);
+            break;
+        }
+        case removeFeed_FeedLogRecord: {
+            iForEach(Array, i, &d->entries.values) {
+                iFeedEntry **entry = i.value;
+                if ((*entry)->bookmarkId == node->bookmarkId) {
+                    delete_FeedEntry(*entry);
+                    remove_ArrayIterator(&i);
+                }
+            }
+            free(remove_Hash(&d->digests, node->bookmarkId));
+            break;
+        }
+        case digest_FeedLogRecord: {
+            iFeedDigest *digest = (iFeedDigest *) value_Hash(&d->digests, node->bookmarkId);
+            if (!digest) {
+                digest = iMalloc(FeedDigest);
+                iZap(*digest);
+                digest->node.key = node->bookmarkId;
+                insert_Hash(&d->digests, &digest->node);
+            }
+            digest->source             = readU64_Stream(ins);
+            digest->results            = readU32_Stream(ins);
+            digest->mergedAt.ts.tv_sec = readU64_Stream(ins);
+            break;
+        }
+        default:
+            break; /* unknown records are skipped */
+    }
+}
+
+static iBool loadLog_Feeds_(iFeeds *d, iBool *isTorn) {
+    /* `isTorn` is set if the last record was incomplete. New records must not be appended
+       after it, or they would be read as part of it. */
+    *isTorn = iFalse;
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, logFilename_Feeds_)));
+    if (!open_File(f, readOnly_FileMode)) {
+        iRelease(f);
+        return iFalse;
+    }
+    iBlock  *src = readAll_File(f);
+    iBuffer *buf = new_Buffer();
+    open_Buffer(buf, src);
+    iStream *ins = stream_Buffer(buf);
+    iHash   *feeds = new_Hash(); /* mapping from log IDs to bookmarks */
+    iBool    ok    = iTrue;
+    char     magic[4];
+    readData_Stream(ins, sizeof(magic), magic);
+    if (!memcmp(magic, magicLog_Feeds_, sizeof(magic)) &&
+        readU32_Stream(ins) <= logVersion_Feeds_) {
+        const size_t size = size_Block(src);
+        while (pos_Stream(ins) + 5 <= size) {
+            const enum iFeedLogRecord type    = read8_Stream(ins);
+            const size_t              len     = readU32_Stream(ins);
+            const size_t              start   = pos_Stream(ins);
+            if (start + len > size) {
+                break; /* incomplete write */
+            }
+            replayRecord_Feeds_(d, type, ins, feeds);
+            seek_Stream(ins, start + len);
+            d->numLogRecords++;
+        }
+        *isTorn = (pos_Stream(ins) != size);
+    }
+    else {
+        fprintf(stderr, "[Feeds] %s has an unsupported format\n", logFilename_Feeds_);
+        ok = iFalse;
+    }
+    iForEach(Hash, i, feeds) {
+        free(i.value);
+    }
+    delete_Hash(feeds);
+    iRelease(buf);
+    delete_Block(src);
+    iRelease(f);
+    return ok;
+}
+
+static void load_Feeds_(iFeeds *d) {
+    /* TODO: If there are lots of entries, it would make sense to load async. */
+    iBool isTorn;
+    if (!loadLog_Feeds_(d, &isTorn)) {
+        const iString *oldPath = collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_));
+        const iString *logPath = collect_String(concatCStr_Path(&d->saveDir, logFilename_Feeds_));
+        if (fileExists_FileInfo(oldPath)) {
+            loadText_Feeds_(d);
+            /* The old file is only removed once its contents are safely in the log. */
+            if (compactLog_Feeds_(d)) {
+                remove(cstr_String(oldPath));
+            }
+        }
+        else if (fileExists_FileInfo(logPath)) {
+            /* Rewrite an unusable log so new records aren't appended after a bad header. */
+            compactLog_Feeds_(d);
+        }
+        return;
+    }
+    /* Log records for entries that have since aged out are still there. */
+    iTime now;
+    initCurrent_Time(&now);
+    iForEach(Array, i, &d->entries.values) {
+        iFeedEntry **entry = i.value;
+        if (isAgedOut_FeedEntry_(*entry, &now)) {
+            delete_FeedEntry(*entry);
+            remove_ArrayIterator(&i);
+        }
+    }
+    if (isTorn || isLogCompactable_Feeds_(d)) {
+        compactLog_Feeds_(d);
+    }
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 void init_Feeds(const char *saveDir) {
@@ -705,7 +1340,18 @@ void init_Feeds(const char *saveDir) {
     init_IntSet(&d->previouslyCheckedFeeds);
     iZap(d->lastRefreshedAt);
     d->worker = NULL;
+    d->stopWorker = iFalse;
+    init_Mutex(&d->wakeMtx);
+    init_Condition(&d->wakeCond);
+    d->isWakePending = iFalse;
     init_PtrArray(&d->jobs);
+    d->hosts = new_StringHash();
+    init_Hash(&d->digests);
+    d->log = new_Buffer();
+    openEmpty_Buffer(d->log);
+    d->record = new_Buffer();
+    init_IntSet(&d->loggedFeeds);
+    d->numLogRecords = 0;
     init_SortedArray(&d->entries, sizeof(iFeedEntry *), cmp_FeedEntryPtr_);
     load_Feeds_(d);
     /* Update feeds if it has been a while. */
@@ -721,8 +1367,19 @@ void deinit_Feeds(void) {
     iFeeds *d = &feeds_;
     SDL_RemoveTimer(d->refreshTimer);
     stopWorker_Feeds_(d);
+    flushLog_Feeds_(d);
     iAssert(isEmpty_PtrArray(&d->jobs));
     deinit_PtrArray(&d->jobs);
+    iRelease(d->hosts);
+    iForEach(Hash, j, &d->digests) {
+        free(j.value);
+    }
+    deinit_Hash(&d->digests);
+    iRelease(d->record);
+    iRelease(d->log);
+    deinit_IntSet(&d->loggedFeeds);
+    deinit_Condition(&d->wakeCond);
+    deinit_Mutex(&d->wakeMtx);
     deinit_String(&d->saveDir);
     delete_Mutex(d->mtx);
     iForEach(Array, i, &d->entries.values) {
@@ -743,6 +1400,10 @@ void refreshFinished_Feeds(void) {
 
 void removeEntries_Feeds(uint32_t feedBookmarkId) {
     iFeeds *d = &feeds_;
+    lock_Mutex(d->mtx);
+    free(remove_Hash(&d->digests, feedBookmarkId)); /* entries must be merged again */
+    logRemoveFeed_Feeds_(d, feedBookmarkId);
+    unlock_Mutex(d->mtx);
     iForEach(Array, i, &d->entries.values) {
         iFeedEntry **entry = i.value;
         if ((*entry)->bookmarkId == feedBookmarkId) {
@@ -750,6 +1411,7 @@ void removeEntries_Feeds(uint32_t feedBookmarkId) {
             remove_ArrayIterator(&i);
         }
     }
+    flushLog_Feeds_(d);
 }
 
 void markEntryAsRead_Feeds(uint32_t feedBookmarkId, const iString *entryUrl, iBool isRead) {
@@ -788,6 +1450,7 @@ void markEntryAsRead_Feeds(uint32_t feedBookmarkId, const iString *entryUrl, iBo
             /* The unread state depends on whether the URL has been visited. */
             if (!isRead && containsUrl_Visited(vis, entryUrl)) {
                 removeUrl_Visited(vis, entryUrl);
+                remove_PageIndex(pageIndex_App(), entryUrl);
             }
             else if (isRead) {
                 visitUrl_Visited(vis, entryUrl, transient_VisitedUrlFlag | kept_VisitedUrlFlag);
@@ -22,6 +22,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "fontpack.h"
 #include "resources.h"
+#include "ui/text.h"
 #include "ui/window.h"
 #include "gmrequest.h"
 #include "app.h"
@@ -798,6 +799,7 @@ void deinit_Fonts(void) {
     if (isTerminal_Platform()) {
         return; /* fonts are not used */
     }
+    waitForMetrics_Text(); /* background layout may still be using the fonts */
     unloadFonts_Fonts_(d);
     iAssert(isEmpty_ObjectList(d->files));
     deinit_PtrArray(&d->specOrder);
@@ -25,6 +25,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "defs.h"
 #include "app.h"
 
+#include <the_Foundation/buffer.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
 #include <the_Foundation/mutex.h>
@@ -35,12 +36,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/stringlist.h>
 #include <the_Foundation/time.h>
 #include <ctype.h>
+#include <SDL_timer.h>
 
 static const char *trustedFilename_GmCerts_   = "trusted.2.txt";
 static const char *identsDir_GmCerts_         = "idents";
 static const char *oldIdentsFilename_GmCerts_ = "idents.binary";
 static const char *identsFilename_GmCerts_    = "idents.lgr";
 static const char *tempIdentsFilename_GmCerts_= "idents.lgr.tmp";
+static const uint32_t saveDelay_GmCerts_      = 5000; /* ms */
 
 iDeclareClass(TrustEntry)
 
@@ -241,6 +244,8 @@ struct Impl_GmCerts {
     iMutex *mtx;
     iString saveDir;
     iStringHash *trusted;
+    iBool isTrustedModified; /* not saved yet */
+    SDL_TimerID saveTimer;
     iPtrArray idents;
 };
 
@@ -289,14 +294,46 @@ void saveIdentities_GmCerts(const iGmCerts *d) {
                    cstr_String(tempPath));
 }
 
-static void save_GmCerts_(const iGmCerts *d) {
-    iBeginCollect();
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, trustedFilename_GmCerts_)));
-    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        serialize_GmCerts(d, stream_File(f), NULL);        
+void saveTrusted_GmCerts(iGmCerts *d) {
+    /* The entries are serialized while locked, but the file is written afterwards so
+       certificate checks in request threads don't need to wait for it. */
+    iBuffer *buf = NULL;
+    lock_Mutex(d->mtx);
+    if (d->saveTimer) {
+        SDL_RemoveTimer(d->saveTimer);
+        d->saveTimer = 0;
+    }
+    if (d->isTrustedModified) {
+        buf = new_Buffer();
+        openEmpty_Buffer(buf);
+        serialize_GmCerts(d, stream_Buffer(buf), NULL);
+        d->isTrustedModified = iFalse;
+    }
+    unlock_Mutex(d->mtx);
+    if (buf) {
+        iBeginCollect();
+        iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, trustedFilename_GmCerts_)));
+        if (open_File(f, writeOnly_FileMode | text_FileMode)) {
+            write_File(f, data_Buffer(buf));
+        }
+        iRelease(f);
+        iRelease(buf);
+        iEndCollect();
+    }
+}
+
+static uint32_t saveTimeout_GmCerts_(uint32_t interval, void *context) {
+    iUnused(interval, context);
+    postCommand_App("trusted.save");
+    return 0; /* does not repeat */
+}
+
+static void setTrustedModified_GmCerts_(iGmCerts *d) {
+    /* Called with `mtx` locked. Changes are saved in batches after a delay. */
+    d->isTrustedModified = iTrue;
+    if (!d->saveTimer) {
+        d->saveTimer = SDL_AddTimer(saveDelay_GmCerts_, saveTimeout_GmCerts_, d);
     }
-    iRelease(f);
-    iEndCollect();
 }
 
 static void loadIdentityFromCertificate_GmCerts_(iGmCerts *d, const iString *crtPath) {
@@ -495,6 +532,8 @@ void init_GmCerts(iGmCerts *d, const char *saveDir) {
     d->mtx = new_Mutex();
     initCStr_String(&d->saveDir, saveDir);
     d->trusted = new_StringHash();
+    d->isTrustedModified = iFalse;
+    d->saveTimer = 0;
     init_PtrArray(&d->idents);
     load_GmCerts_(d);
     setVerifyFunc_TlsRequest(verify_GmCerts_);
@@ -502,6 +541,7 @@ void init_GmCerts(iGmCerts *d, const char *saveDir) {
 
 void deinit_GmCerts(iGmCerts *d) {
     setVerifyFunc_TlsRequest(NULL);
+    saveTrusted_GmCerts(d);
     iGuardMutex(d->mtx, {
         saveIdentities_GmCerts(d);
         iForEach(PtrArray, i, &d->idents) {
@@ -593,7 +633,7 @@ iBool checkTrust_GmCerts(iGmCerts *d, iRangecc domain, uint16_t port, const iTls
         }
     }
     if (ok) {
-        save_GmCerts_(d);
+        setTrustedModified_GmCerts_(d);
     }
     unlock_Mutex(d->mtx);
     delete_Block(fingerprint);
@@ -615,7 +655,7 @@ void setTrusted_GmCerts(iGmCerts *d, iRangecc domain, uint16_t port, const iBloc
     else {
         insert_StringHash(d->trusted, &key, iClob(trust = new_TrustEntry(fingerprint, validUntil)));
     }
-    save_GmCerts_(d);
+    setTrustedModified_GmCerts_(d);
     unlock_Mutex(d->mtx);
     deinit_String(&key);
 }
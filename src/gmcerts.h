@@ -88,6 +88,7 @@ void                importIdentity_GmCerts  (iGmCerts *, iTlsCertificate *cert,
                                              const iString *notes); /* takes ownership */
 void                deleteIdentity_GmCerts  (iGmCerts *, iGmIdentity *identity);
 void                saveIdentities_GmCerts  (const iGmCerts *);
+void                saveTrusted_GmCerts     (iGmCerts *); /* if modified */
 void                serialize_GmCerts       (const iGmCerts *, iStream *trusted, iStream *identsMeta);
 void                deserializeTrusted_GmCerts      (iGmCerts *, iStream *ins, enum iImportMethod method);
 iBool               deserializeIdentities_GmCerts   (iGmCerts *, iStream *ins, enum iImportMethod method);
@@ -28,10 +28,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "ui/text.h"
 #include "ui/metrics.h"
 #include "ui/mediaui.h"
+#include "ui/util.h"
 #include "ui/window.h"
 #include "visited.h"
 #include "bookmarks.h"
 #include "app.h"
+#include "profiler.h"
 #include "defs.h"
 
 #include <the_Foundation/intset.h>
@@ -152,13 +154,43 @@ static uint32_t themeHash_(const iBlock *data) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(GmLayoutState)
+
+/* Progressive layout keeps track of where to continue when more source is appended. Runs
+   before `sourcePos` are final; the rest of the layout is discarded and redone. */
+struct Impl_GmLayoutState {
+    size_t           sourcePos; /* iInvalidPos if layout must be done from scratch */
+    size_t           numRuns;
+    size_t           numLinks;
+    size_t           numHeadings;
+    size_t           numPreMeta;
+    size_t           numAuxText;
+    iInt2            pos;
+    iBool            isFirstText;
+    iBool            addQuoteIcon;
+    iBool            isPreformat;
+    int              preFont;
+    uint16_t         preId;
+    iBool            enableIndents;
+    enum iGmLineType prevType;
+    enum iGmLineType prevNonBlankType;
+    iBool            followsBlank;
+    iBool            isTitleFromHeading;
+};
+
 struct Impl_GmDocument {
     iObject object;
     enum iSourceFormat origFormat;
     enum iSourceFormat viewFormat; /* what the user prefers to see */
     enum iSourceFormat format;
-    iString   origSource; /* original (unnormalized) source */
+    iString   origSource; /* original (unnormalized) source; shared with the caller */
+    size_t    origOffset; /* position of `origSource` in the original; only the unimported
+                             tail is kept while more content is coming */
     iString   source;     /* normalized (possibly converted) source */
+    iBool     isSourceRewritten; /* `source` differs from `origSource` */
+    size_t    importPos;  /* how much of the original source has been imported to `source` */
+    iBool     isImportPreformat; /* normalization state at `importPos` */
+    iBool     isPartial;  /* more source is coming; only complete lines are imported */
     iString   url;        /* for resolving relative links */
     iString   localHost;
     iInt2     size;
@@ -166,10 +198,16 @@ struct Impl_GmDocument {
     iBool     enableCommandLinks; /* `about:command?` only allowed on selected pages */
     iBool     isSpartan;
     iBool     isLayoutInvalidated;
+    iBool     isLayoutCopy; /* laid out in a background thread; `media` is borrowed */
+    iAtomicInt isLayoutCancelled;
+    iGmLayoutState layoutState; /* for continuing a progressive layout */
     iArray    layout; /* contents of source, laid out in document space */
+    iArray    runIndex; /* first run reaching into each block of document height */
+    iArray    locIndex; /* indices of every Nth run in source order */
     iStringArray auxText; /* generated text that appears on the page but is not part of the source */
     iPtrArray links;
     iString   title; /* the first top-level title */
+    iString   firstContentLine; /* may be used as a title if one isn't specified */
     iArray    headings;
     iArray    preMeta; /* metadata about preformatted blocks */
     iGmTheme  theme;
@@ -183,7 +221,22 @@ struct Impl_GmDocument {
 };
 
 iDefineObjectConstruction(GmDocument)
-    
+
+static iRegExp *linkPattern_;
+static iRegExp *spartanQueryPattern_;
+static iRegExp *ansiPattern_;
+static iRegExp *ansiDetectPattern_;
+
+static void initPatterns_GmDocument_(void) {
+    /* Compiled in the main thread so that layout can also run in a background thread. */
+    if (!linkPattern_) {
+        linkPattern_         = newGemtextLink_RegExp();
+        spartanQueryPattern_ = new_RegExp("=:\\s*([^\\s]+)(\\s.*)?", 0);
+        ansiPattern_         = makeAnsiEscapePattern_Text(iTrue /* with ESC */);
+        ansiDetectPattern_   = new_RegExp("\x1b[[()]([0-9;AB]*?)[ABCDEFGHJKSTfimn]", 0);
+    }
+}
+
 static void import_GmDocument_(iGmDocument *);
 
 static iBool isForcedMonospace_GmDocument_(const iGmDocument *d) {
@@ -335,14 +388,6 @@ static iBool isAllowedLinkIcon_Char_(iChar icon) {
 
 static iRangecc addLink_GmDocument_(iGmDocument *d, iRangecc line, iGmLinkId *linkId) {
     /* Returns the human-readable label of the link. */
-    static iRegExp *pattern_;
-    static iRegExp *spartanQueryPattern_;
-    if (!pattern_) {
-        pattern_ = newGemtextLink_RegExp();
-    }
-    if (d->isSpartan && !spartanQueryPattern_) {
-        spartanQueryPattern_ = new_RegExp("=:\\s*([^\\s]+)(\\s.*)?", 0);
-    }
     iGmLink *link = NULL;
     iRegExpMatch m;
     init_RegExpMatch(&m);
@@ -357,7 +402,7 @@ static iRangecc addLink_GmDocument_(iGmDocument *d, iRangecc line, iGmLinkId *li
     if (!link) {
         init_RegExpMatch(&m);
     }
-    if (!link && matchRange_RegExp(pattern_, line, &m)) {
+    if (!link && matchRange_RegExp(linkPattern_, line, &m)) {
         link = new_GmLink();
         link->urlRange = capturedRange_RegExpMatch(&m, 1);
         setRange_String(&link->url, link->urlRange);
@@ -681,11 +726,109 @@ static iBool isHRule_(iRangecc line) {
     return n >= 3;
 }
 
-static void doLayout_GmDocument_(iGmDocument *d) {
-    static iRegExp *ansiPattern_;
-    if (!ansiPattern_) {
-        ansiPattern_ = makeAnsiEscapePattern_Text(iTrue /* with ESC */);
+static iBool nextLine_GmDocument_(const iRangecc content, iRangecc *line) {
+    /* Every newline-terminated line is returned, and the last line also when it is not
+       terminated. This way a source split at line boundaries produces the same lines. */
+    const char *start = content.start;
+    if (line->start) {
+        if (line->end >= content.end) {
+            return iFalse;
+        }
+        start = line->end + 1;
+    }
+    if (start >= content.end) {
+        return iFalse;
+    }
+    const char *eol = memchr(start, '\n', content.end - start);
+    *line = (iRangecc){ start, eol ? eol : content.end };
+    return iTrue;
+}
+
+static void truncateLinks_GmDocument_(iGmDocument *d, size_t count) {
+    while (size_PtrArray(&d->links) > count) {
+        iGmLink *link;
+        take_PtrArray(&d->links, size_PtrArray(&d->links) - 1, (void **) &link);
+        delete_GmLink(link);
+    }
+}
+
+/* The run index speeds up finding runs by position. For each block of document height,
+   it has the index of the first run whose bottom edge reaches the block, so any search can
+   start there instead of at the beginning of the layout. */
+static const int    runIndexBlockHeight_GmDocument_ = 256; /* pixels */
+static const size_t locIndexInterval_GmDocument_    = 64;  /* runs */
+
+static int runIndexKey_GmDocument_(const iGmRun *run) {
+    /* Rendering checks visual bounds; hit testing checks the bounds of non-decoration runs. */
+    int bottom = bottom_Rect(run->visBounds);
+    if (~run->flags & decoration_GmRunFlag) {
+        bottom = iMax(bottom, bottom_Rect(run->bounds));
+    }
+    return bottom;
+}
+
+static iBool isSourceRun_GmDocument_(const iGmDocument *d, const iGmRun *run) {
+    return ~run->flags & decoration_GmRunFlag && run->text.start >= constBegin_String(&d->source) &&
+           run->text.start < constEnd_String(&d->source);
+}
+
+static void updateRunIndex_GmDocument_(iGmDocument *d, size_t firstNewRun) {
+    /* Entries referring to discarded or new runs are recalculated. */
+    while (!isEmpty_Array(&d->runIndex) &&
+           *(const size_t *) constBack_Array(&d->runIndex) >= firstNewRun) {
+        popBack_Array(&d->runIndex);
+    }
+    while (!isEmpty_Array(&d->locIndex) &&
+           *(const size_t *) constBack_Array(&d->locIndex) >= firstNewRun) {
+        popBack_Array(&d->locIndex);
+    }
+    size_t lastLoc = isEmpty_Array(&d->locIndex)
+                         ? iInvalidPos
+                         : *(const size_t *) constBack_Array(&d->locIndex);
+    for (size_t i = firstNewRun; i < size_Array(&d->layout); i++) {
+        const iGmRun *run = constAt_Array(&d->layout, i);
+        const int     key = runIndexKey_GmDocument_(run);
+        while ((int) size_Array(&d->runIndex) * runIndexBlockHeight_GmDocument_ <= key) {
+            pushBack_Array(&d->runIndex, &i);
+        }
+        if (isSourceRun_GmDocument_(d, run) &&
+            (lastLoc == iInvalidPos || i >= lastLoc + locIndexInterval_GmDocument_)) {
+            pushBack_Array(&d->locIndex, &i);
+            lastLoc = i;
+        }
+    }
+}
+
+static size_t firstRunIndex_GmDocument_(const iGmDocument *d, int y) {
+    /* Runs before the returned index are all above `y`. */
+    if (y < 0) {
+        return 0;
+    }
+    const size_t block = y / runIndexBlockHeight_GmDocument_;
+    if (block >= size_Array(&d->runIndex)) {
+        return size_Array(&d->layout);
+    }
+    return constValue_Array(&d->runIndex, block, size_t);
+}
+
+static void rollbackLayout_GmDocument_(iGmDocument *d) {
+    /* Discard everything that was laid out after the last committed position. */
+    const iGmLayoutState *st = &d->layoutState;
+    resize_Array(&d->layout, st->numRuns);
+    truncateLinks_GmDocument_(d, st->numLinks);
+    resize_Array(&d->headings, st->numHeadings);
+    resize_Array(&d->preMeta, st->numPreMeta);
+    while (size_StringArray(&d->auxText) > st->numAuxText) {
+        remove_StringArray(&d->auxText, size_StringArray(&d->auxText) - 1);
+    }
+    if (!st->isTitleFromHeading) {
+        clear_String(&d->title);
     }
+}
+
+static void doLayout_GmDocument_(iGmDocument *d, iBool isContinued) {
+    /* When continuing, the layout picks up from where the previous (partial) update left off
+       and only the lines appended after that point are processed. */
     const iPrefs *prefs             = prefs_App();
     const iBool   isMono            = isForcedMonospace_GmDocument_(d);
     const iBool   isGopher          = isGopher_GmDocument_(d);
@@ -724,17 +867,32 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     static const char *pointingFinger  = "\U0001f449";
     static const char *uploadArrow     = upload_Icon;
     static const char *image           = photo_Icon;
-    clear_Array(&d->layout);
-    clear_StringArray(&d->auxText);
-    clearLinks_GmDocument_(d);
-    clear_Array(&d->headings);
+    if (isContinued && d->layoutState.sourcePos == iInvalidPos) {
+        isContinued = iFalse;
+    }
     const iArray *oldPreMeta = collect_Array(copy_Array(&d->preMeta)); /* remember fold states */
-    clear_Array(&d->preMeta);
-    clear_String(&d->title);
+    if (isContinued) {
+        rollbackLayout_GmDocument_(d);
+    }
+    else {
+        clear_Array(&d->layout);
+        clear_Array(&d->runIndex);
+        clear_Array(&d->locIndex);
+        clear_StringArray(&d->auxText);
+        clearLinks_GmDocument_(d);
+        clear_Array(&d->headings);
+        clear_Array(&d->preMeta);
+        clear_String(&d->title);
+        clear_String(&d->firstContentLine);
+        d->layoutState.sourcePos = iInvalidPos;
+    }
     if (d->size.x <= 0 || isEmpty_String(&d->source)) {
         return;
     }
-    updateOpenURLs_GmDocument_(d);
+    const uint64_t profileBegin = begin_Profiler(layout_ProfilerScope);
+    if (!d->isLayoutCopy) {
+        updateOpenURLs_GmDocument_(d); /* a copy gets the open URLs from the original */
+    }
     const iRangecc   content       = range_String(&d->source);
     iRangecc         contentLine   = iNullRange;
     iInt2            pos           = zero_I2();
@@ -749,8 +907,9 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     enum iGmLineType prevType      = text_GmLineType;
     enum iGmLineType prevNonBlankType = text_GmLineType;
     iBool            followsBlank  = iFalse;
-    iString          firstContentLine; /* may be used as a title if one isn't specified */
-    init_String(&firstContentLine);
+    iRangecc         span          = content; /* lines to lay out */
+    iGmLayoutState   preStart      = { .sourcePos = iInvalidPos }; /* start of an unterminated block */
+    iBool            isPreOpen     = iFalse;
     if (isGopher && !prefs->geminiStyledGopher) {
         isFirstText = iFalse;
     }
@@ -758,11 +917,49 @@ static void doLayout_GmDocument_(iGmDocument *d) {
         isPreformat = iTrue;
         isFirstText = iFalse;
     }
-    d->warnings &= ~missingGlyphs_GmDocumentWarning;
+    if (isContinued) {
+        const iGmLayoutState *st = &d->layoutState;
+        span.start       = content.start + st->sourcePos;
+        pos              = st->pos;
+        isFirstText      = st->isFirstText;
+        addQuoteIcon     = st->addQuoteIcon;
+        isPreformat      = st->isPreformat;
+        preFont          = st->preFont;
+        preId            = st->preId;
+        enableIndents    = st->enableIndents;
+        prevType         = st->prevType;
+        prevNonBlankType = st->prevNonBlankType;
+        followsBlank     = st->followsBlank;
+    }
+    else {
+        d->warnings &= ~missingGlyphs_GmDocumentWarning;
+    }
+    const size_t firstNewRun = size_Array(&d->layout);
+#define currentLayoutState_(srcPos) \
+    (iGmLayoutState){ .sourcePos          = (srcPos), \
+                      .numRuns            = size_Array(&d->layout), \
+                      .numLinks           = size_PtrArray(&d->links), \
+                      .numHeadings        = size_Array(&d->headings), \
+                      .numPreMeta         = size_Array(&d->preMeta), \
+                      .numAuxText         = size_StringArray(&d->auxText), \
+                      .pos                = pos, \
+                      .isFirstText        = isFirstText, \
+                      .addQuoteIcon       = addQuoteIcon, \
+                      .isPreformat        = isPreformat, \
+                      .preFont            = preFont, \
+                      .preId              = preId, \
+                      .enableIndents      = enableIndents, \
+                      .prevType           = prevType, \
+                      .prevNonBlankType   = prevNonBlankType, \
+                      .followsBlank       = followsBlank, \
+                      .isTitleFromHeading = !isEmpty_String(&d->title) }
     checkMissing_Text(); /* clear the flag */
     setAnsiFlags_Text(d->theme.ansiEscapes);
-    while (nextSplit_Rangecc(content, "\n", &contentLine)) {
-        iRangecc line = contentLine; /* `line` will be trimmed; modifying would confuse `nextSplit_Rangecc` */
+    while (nextLine_GmDocument_(span, &contentLine)) {
+        if (value_Atomic(&d->isLayoutCancelled)) {
+            break; /* the result will be discarded */
+        }
+        iRangecc line = contentLine; /* `line` will be trimmed; modifying would confuse `nextLine_GmDocument_` */
         if (*line.end == '\r') {
             line.end--; /* trim CR always */
         }
@@ -792,7 +989,9 @@ static void doLayout_GmDocument_(iGmDocument *d) {
             }
             indent = indents[type];
             if (type == preformatted_GmLineType) {
-                /* Begin a new preformatted block. */
+                /* Begin a new preformatted block. If the block is still missing its end,
+                   it will need to be laid out again when more content is appended. */
+                preStart = currentLayoutState_(contentLine.start - content.start);
                 isPreformat = iTrue;
                 const size_t preIndex = preId++;
                 preFont = preformatted_FontId;
@@ -800,6 +999,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
                 iGmPreMeta meta = { .bounds = line };
                 meta.pixelRect.size = measurePreformattedBlock_GmDocument_(
                     d, line.start, preFont, &meta.contents, &meta.bounds.end);
+                isPreOpen = (meta.bounds.end == line.end); /* closing ``` not found */
                 const float oversizeRatio =
                     meta.pixelRect.size.x /
                     (float) (d->size.x -
@@ -848,6 +1048,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
             if (d->format == gemini_SourceFormat &&
                 startsWithSc_Rangecc(line, "```", &iCaseSensitive)) {
                 isPreformat = iFalse;
+                isPreOpen = iFalse;
                 continue;
             }
             run.mediaType = max_MediaType; /* preformatted block */
@@ -927,6 +1128,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
                 pos.y += height_Rect(altText.bounds);
                 contentLine = meta->bounds; /* Skip the whole thing. */
                 isPreformat = iFalse;
+                isPreOpen = iFalse;
                 prevType = preformatted_GmLineType;
                 continue;
             }
@@ -938,9 +1140,9 @@ static void doLayout_GmDocument_(iGmDocument *d) {
             replaceRegExp_String(&d->title, ansiPattern_, "", NULL, NULL);
         }
         else if (type != preformatted_GmLineType && type != heading1_GmLineType &&
-                 isEmpty_String(&firstContentLine) && size_Range(&line) >= 3) {
-            setRange_String(&firstContentLine, line);
-            replaceRegExp_String(&firstContentLine, ansiPattern_, "", NULL, NULL);
+                 isEmpty_String(&d->firstContentLine) && size_Range(&line) >= 3) {
+            setRange_String(&d->firstContentLine, line);
+            replaceRegExp_String(&d->firstContentLine, ansiPattern_, "", NULL, NULL);
         }
         /* List bullet. */
         if (type == bullet_GmLineType) {
@@ -1255,28 +1457,38 @@ static void doLayout_GmDocument_(iGmDocument *d) {
         prevNonBlankType = type;
         followsBlank = iFalse;
     }
+    /* Remember where to continue if more content is appended. */
+    if (isPreOpen) {
+        d->layoutState = preStart;
+    }
+    else {
+        d->layoutState = currentLayoutState_(size_String(&d->source));
+    }
+#undef currentLayoutState_
     d->size.y = pos.y;
     if (checkMissing_Text()) {
         d->warnings |= missingGlyphs_GmDocumentWarning;
     }
     /* Go over the preformatted blocks and mark them wide if at least one run is wide. */ {
         /* TODO: Store the dimensions and ranges for later access. */
-        iForEach(Array, i, &d->layout) {
-            iGmRun *run = i.value;
+        /* Blocks before `firstNewRun` were already checked in an earlier update. */
+        for (size_t i = firstNewRun; i < size_Array(&d->layout); i++) {
+            iGmRun *run = at_Array(&d->layout, i);
             if (preId_GmRun(run) && run->flags & wide_GmRunFlag) {
                 iGmRunRange block = findPreformattedRange_GmDocument(d, run);
                 for (const iGmRun *j = block.start; j != block.end; j++) {
                     iConstCast(iGmRun *, j)->flags |= wide_GmRunFlag;
                 }
                 /* Skip to the end of the block. */
-                i.pos = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
+                i = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
             }
         }
     }
+    updateRunIndex_GmDocument_(d, firstNewRun);
     setAnsiFlags_Text(allowAll_AnsiFlag);
     /* If a title wasn't found, use the first content line but truncate it if it's long. */
     if (isEmpty_String(&d->title)) {
-        set_String(&d->title, &firstContentLine);
+        set_String(&d->title, &d->firstContentLine);
         if (length_String(&d->title) > 40) {
             truncate_String(&d->title, 40);
             /* Find a word boundary. */
@@ -1286,17 +1498,23 @@ static void doLayout_GmDocument_(iGmDocument *d) {
         }
         trim_String(&d->title);
     }
-    deinit_String(&firstContentLine);
+    end_Profiler(layout_ProfilerScope, profileBegin);
 //    printf("[GmDocument] layout size: %zu runs (%zu bytes)\n",
 //           size_Array(&d->layout), size_Array(&d->layout) * sizeof(iGmRun));        
 }
 
 void init_GmDocument(iGmDocument *d) {
+    initPatterns_GmDocument_();
     d->origFormat = gemini_SourceFormat; /* format of `origSource` */
     d->format     = gemini_SourceFormat; /* format of `source` */
     d->viewFormat = gemini_SourceFormat; /* user's preference */
     init_String(&d->origSource);
+    d->origOffset = 0;
     init_String(&d->source);
+    d->isSourceRewritten = iFalse;
+    d->importPos = 0;
+    d->isImportPreformat = iFalse;
+    d->isPartial = iFalse;
     init_String(&d->url);
     init_String(&d->localHost);
     d->outsideMargin = 0;
@@ -1304,10 +1522,17 @@ void init_GmDocument(iGmDocument *d) {
     d->enableCommandLinks = iFalse;
     d->isSpartan = iFalse;
     d->isLayoutInvalidated = iFalse;
+    d->isLayoutCopy = iFalse;
+    set_Atomic(&d->isLayoutCancelled, iFalse);
+    iZap(d->layoutState);
+    d->layoutState.sourcePos = iInvalidPos;
     init_Array(&d->layout, sizeof(iGmRun));
+    init_Array(&d->runIndex, sizeof(size_t));
+    init_Array(&d->locIndex, sizeof(size_t));
     init_StringArray(&d->auxText);
     init_PtrArray(&d->links);
     init_String(&d->title);
+    init_String(&d->firstContentLine);
     init_Array(&d->headings, sizeof(iGmHeading));
     init_Array(&d->preMeta, sizeof(iGmPreMeta));
     d->themeSeed = 0;
@@ -1321,13 +1546,18 @@ void init_GmDocument(iGmDocument *d) {
 
 void deinit_GmDocument(iGmDocument *d) {
     iReleasePtr(&d->openURLs);
-    delete_Media(d->media);
+    if (!d->isLayoutCopy) {
+        delete_Media(d->media);
+    }
+    deinit_String(&d->firstContentLine);
     deinit_String(&d->title);
     clearLinks_GmDocument_(d);
     deinit_PtrArray(&d->links);
     deinit_Array(&d->preMeta);
     deinit_Array(&d->headings);
     deinit_StringArray(&d->auxText);
+    deinit_Array(&d->locIndex);
+    deinit_Array(&d->runIndex);
     deinit_Array(&d->layout);
     deinit_String(&d->localHost);
     deinit_String(&d->url);
@@ -1972,14 +2202,26 @@ void invalidatePalette_GmDocument(iGmDocument *d) {
 }
 
 void setFormat_GmDocument(iGmDocument *d, enum iSourceFormat format) {
+    const enum iSourceFormat viewFormat =
+        (format == plainText_SourceFormat ? format : gemini_SourceFormat);
+    if (d->origFormat != format || d->viewFormat != viewFormat) {
+        d->importPos = 0; /* source must be fully imported again */
+    }
     d->origFormat = format;
-    d->viewFormat = (format == plainText_SourceFormat ? format : gemini_SourceFormat);
+    d->viewFormat = viewFormat;
 }
 
 iBool setViewFormat_GmDocument(iGmDocument *d, enum iSourceFormat viewFormat) {
     if (d->viewFormat != viewFormat) {
         d->viewFormat = viewFormat;
-        import_GmDocument_(d);        
+        if (d->origOffset) {
+            /* Only part of the source is available. It will be imported again when the next
+               update provides the full source. */
+            d->importPos = 0;
+        }
+        else {
+            import_GmDocument_(d);
+        }
         return iTrue;
     }
     return iFalse;
@@ -1988,7 +2230,7 @@ iBool setViewFormat_GmDocument(iGmDocument *d, enum iSourceFormat viewFormat) {
 void setWidth_GmDocument(iGmDocument *d, int width, int canvasWidth) {
     d->size.x        = width;
     d->outsideMargin = iMax(0, (canvasWidth - width) / 2); /* distance to edge of the canvas */
-    doLayout_GmDocument_(d); /* TODO: just flag need-layout and do it later */
+    doLayout_GmDocument_(d, iFalse); /* TODO: just flag need-layout and do it later */
 }
 
 iBool updateWidth_GmDocument(iGmDocument *d, int width, int canvasWidth) {
@@ -2000,13 +2242,84 @@ iBool updateWidth_GmDocument(iGmDocument *d, int width, int canvasWidth) {
 }
 
 void redoLayout_GmDocument(iGmDocument *d) {
-    doLayout_GmDocument_(d);
+    doLayout_GmDocument_(d, iFalse);
 }
 
 void invalidateLayout_GmDocument(iGmDocument *d) {
     d->isLayoutInvalidated = iTrue;
 }
 
+iGmDocument *newLayoutCopy_GmDocument(const iGmDocument *d) {
+    /* The copy has its own layout so it can be laid out in a background thread while the
+       original remains usable. Strings share their data until either side modifies them. */
+    iGmDocument *copy = new_GmDocument();
+    delete_Media(copy->media);
+    copy->media              = d->media; /* read-only during layout */
+    copy->isLayoutCopy       = iTrue;
+    copy->origFormat         = d->origFormat;
+    copy->viewFormat         = d->viewFormat;
+    copy->format             = d->format;
+    set_String(&copy->origSource, &d->origSource);
+    copy->origOffset         = d->origOffset;
+    set_String(&copy->source, &d->source);
+    copy->isSourceRewritten  = d->isSourceRewritten;
+    copy->importPos          = d->importPos;
+    copy->isImportPreformat  = d->isImportPreformat;
+    copy->isPartial          = d->isPartial;
+    set_String(&copy->url, &d->url);
+    set_String(&copy->localHost, &d->localHost);
+    copy->size               = d->size;
+    copy->outsideMargin      = d->outsideMargin;
+    copy->enableCommandLinks = d->enableCommandLinks;
+    copy->isSpartan          = d->isSpartan;
+    setCopy_Array(&copy->preMeta, &d->preMeta); /* fold states */
+    copy->theme              = d->theme;
+    copy->themeSeed          = d->themeSeed;
+    copy->siteIcon           = d->siteIcon;
+    copy->openURLs           = d->openURLs ? ref_Object(d->openURLs) : NULL;
+    copy->warnings           = d->warnings;
+    copy->isPaletteValid     = d->isPaletteValid;
+    memcpy(copy->palette, d->palette, sizeof(d->palette));
+    return copy;
+}
+
+void adoptLayout_GmDocument(iGmDocument *d, iGmDocument *laidOut) {
+    /* Source and layout are swapped as a unit because the runs point to the source. */
+    iAssert(laidOut->isLayoutCopy);
+    iAssert(laidOut->media == d->media);
+    iSwap(iString,        d->origSource,       laidOut->origSource);
+    iSwap(iString,        d->source,           laidOut->source);
+    iSwap(iArray,         d->layout,           laidOut->layout);
+    iSwap(iArray,         d->runIndex,         laidOut->runIndex);
+    iSwap(iArray,         d->locIndex,         laidOut->locIndex);
+    iSwap(iStringArray,   d->auxText,          laidOut->auxText);
+    iSwap(iPtrArray,      d->links,            laidOut->links);
+    iSwap(iString,        d->title,            laidOut->title);
+    iSwap(iString,        d->firstContentLine, laidOut->firstContentLine);
+    iSwap(iArray,         d->headings,         laidOut->headings);
+    iSwap(iArray,         d->preMeta,          laidOut->preMeta);
+    iSwap(iGmLayoutState, d->layoutState,      laidOut->layoutState);
+    d->format              = laidOut->format;
+    d->origOffset          = laidOut->origOffset;
+    d->isSourceRewritten   = laidOut->isSourceRewritten;
+    d->importPos           = laidOut->importPos;
+    d->isImportPreformat   = laidOut->isImportPreformat;
+    d->isPartial           = laidOut->isPartial;
+    d->size                = laidOut->size;
+    d->outsideMargin       = laidOut->outsideMargin;
+    d->theme               = laidOut->theme;
+    d->warnings            = laidOut->warnings;
+    d->isLayoutInvalidated = iFalse;
+}
+
+void cancelLayout_GmDocument(iGmDocument *d) {
+    set_Atomic(&d->isLayoutCancelled, iTrue);
+}
+
+iBool isLayoutCancelled_GmDocument(const iGmDocument *d) {
+    return value_Atomic(&d->isLayoutCancelled);
+}
+
 static void markLinkRunsVisited_GmDocument_(iGmDocument *d, const iIntSet *linkIds) {
     iForEach(Array, r, &d->layout) {
         iGmRun *run = r.value;
@@ -2050,10 +2363,12 @@ iLocalDef iBool isNormalizableSpace_(char ch) {
     return ch == ' ' || ch == '\t';
 }
 
-static void normalize_GmDocument(iGmDocument *d) {
-    iString *normalized = new_String();
-    iRangecc src = range_String(&d->source);
-    /* Check for a BOM. In UTF-8, the BOM can just be skipped if present. */ {
+static void appendNormalized_GmDocument_(iGmDocument *d, iRangecc src) {
+    /* Appends normalized lines to `source`. The preformatted state is carried over in
+       `isImportPreformat` so the source can be normalized in pieces as it arrives. */
+    iString *normalized = &d->source;
+    if (isEmpty_String(normalized)) {
+        /* Check for a BOM. In UTF-8, the BOM can just be skipped if present. */
         iChar ch = 0;
         decodeBytes_MultibyteChar(src.start, src.end, &ch);
         if (ch == 0xfeff) /* zero-width non-breaking space */ {
@@ -2061,12 +2376,9 @@ static void normalize_GmDocument(iGmDocument *d) {
         }
     }
     iRangecc line = iNullRange;
-    iBool isPreformat = iFalse;
-    if (d->format == plainText_SourceFormat) {
-        isPreformat = iTrue; /* Cannot be turned off. */
-    }
+    iBool isPreformat = d->isImportPreformat;
     iBool wasNormalized = iFalse;
-    while (nextSplit_Rangecc(src, "\n", &line)) {
+    while (nextLine_GmDocument_(src, &line)) {
         if (isPreformat) {
             for (const char *ch = line.start; ch != line.end; ch++) {
                 if (*ch != '\v') {
@@ -2122,14 +2434,22 @@ static void normalize_GmDocument(iGmDocument *d) {
         }
         appendCStr_String(normalized, "\n");
     }
+    d->isImportPreformat = isPreformat;
     iUnused(wasNormalized);
 //    printf("wasNormalized: %d\n", wasNormalized);
 //    fflush(stdout);
-    set_String(&d->source, collect_String(normalized));
     //normalize_String(&d->source); /* NFC */
 //    printf("orig:%zu norm:%zu\n", size_String(&d->origSource), size_String(&d->source));
 }
 
+static void normalize_GmDocument(iGmDocument *d) {
+    iString *src = copy_String(&d->source);
+    clear_String(&d->source);
+    d->isImportPreformat = (d->format == plainText_SourceFormat); /* cannot be turned off */
+    appendNormalized_GmDocument_(d, range_String(src));
+    delete_String(src);
+}
+
 void setUrl_GmDocument(iGmDocument *d, const iString *url) {
     url = canonicalUrl_String(url);
     set_String(&d->url, url);
@@ -2139,7 +2459,7 @@ void setUrl_GmDocument(iGmDocument *d, const iString *url) {
     d->isSpartan = equalCase_Rangecc(parts.scheme, "spartan");
     setRange_String(&d->localHost, parts.host);
     updateIconBasedOnUrl_GmDocument_(d);
-    if (!cmp_String(url, "about:fonts")) {
+    if (!cmp_String(url, "about:fonts") || !cmp_String(url, "about:debug?profiler")) {
         /* This is an interactive internal page. */
         d->enableCommandLinks = iTrue;
     }
@@ -2301,21 +2621,116 @@ static void convertMarkdownToGemtext_GmDocument_(iGmDocument *d) {
     d->format = gemini_SourceFormat;
 }
 
+static size_t importableSize_GmDocument_(const iGmDocument *d) {
+    /* While more content is expected, the last line may still be incomplete. */
+    iAssert(d->origOffset == 0);
+    const char *start = constBegin_String(&d->origSource);
+    const char *end   = constEnd_String(&d->origSource);
+    if (d->isPartial) {
+        while (end > start && end[-1] != '\n') {
+            end--;
+        }
+    }
+    return end - start;
+}
+
+static iBool isProgressive_GmDocument_(const iGmDocument *d) {
+    /* Markdown is converted to Gemtext as a whole, so it can't be imported piece by piece. */
+    return d->viewFormat == plainText_SourceFormat || d->origFormat != markdown_SourceFormat;
+}
+
+static void rebaseRange_(iRangecc *range, uintptr_t oldStart, uintptr_t oldEnd, ptrdiff_t delta) {
+    if ((uintptr_t) range->start >= oldStart && (uintptr_t) range->start <= oldEnd) {
+        range->start += delta;
+        range->end   += delta;
+    }
+}
+
+static void rebaseSource_GmDocument_(iGmDocument *d, const char *oldStart, size_t oldSize) {
+    /* The source buffer was reallocated. Layout, links, and other metadata refer to the
+       source via pointers so they must be moved along with it. Ranges pointing elsewhere
+       (auxiliary text, icons) are left untouched. */
+    const ptrdiff_t delta = constBegin_String(&d->source) - oldStart;
+    const uintptr_t start = (uintptr_t) oldStart;
+    const uintptr_t end   = start + oldSize;
+    if (delta == 0) {
+        return;
+    }
+    iForEach(Array, r, &d->layout) {
+        iGmRun *run = r.value;
+        rebaseRange_(&run->text, start, end, delta);
+    }
+    iForEach(PtrArray, i, &d->links) {
+        iGmLink *link = i.ptr;
+        rebaseRange_(&link->urlRange, start, end, delta);
+        rebaseRange_(&link->labelRange, start, end, delta);
+        rebaseRange_(&link->labelIcon, start, end, delta);
+    }
+    iForEach(Array, h, &d->headings) {
+        iGmHeading *head = h.value;
+        rebaseRange_(&head->text, start, end, delta);
+    }
+    iForEach(Array, p, &d->preMeta) {
+        iGmPreMeta *meta = p.value;
+        rebaseRange_(&meta->bounds, start, end, delta);
+        rebaseRange_(&meta->altText, start, end, delta);
+        rebaseRange_(&meta->contents, start, end, delta);
+    }
+}
+
+static void detectAnsiEscapes_GmDocument_(iGmDocument *d, const iString *text) {
+    iRegExpMatch m;
+    init_RegExpMatch(&m);
+    if (matchString_RegExp(ansiDetectPattern_, text, &m)) {
+        d->warnings |= ansiEscapes_GmDocumentWarning;
+    }
+}
+
+static void importMore_GmDocument_(iGmDocument *d) {
+    /* Append the newly available lines of `origSource` to `source`. */
+    const size_t end = importableSize_GmDocument_(d);
+    if (end <= d->importPos) {
+        return;
+    }
+    const char *orig    = constBegin_String(&d->origSource);
+    const char *oldBase = constBegin_String(&d->source);
+    const size_t oldSize = size_String(&d->source);
+    const iRangecc origChunk = { orig + d->importPos, orig + end };
+    iString *chunk = newRange_String(origChunk);
+    replace_String(chunk, "\r\n", "\n");
+    detectAnsiEscapes_GmDocument_(d, chunk);
+    d->importPos = end;
+    if (d->format != markdown_SourceFormat && shouldBeNormalized_GmDocument_(d)) {
+        appendNormalized_GmDocument_(d, range_String(chunk));
+    }
+    else {
+        append_String(&d->source, chunk);
+    }
+    delete_String(chunk);
+    if (!d->isSourceRewritten) {
+        /* Only the appended part needs to be checked. */
+        d->isSourceRewritten =
+            size_String(&d->source) - oldSize != size_Range(&origChunk) ||
+            memcmp(constBegin_String(&d->source) + oldSize, origChunk.start,
+                   size_Range(&origChunk)) != 0;
+    }
+    if (oldSize) {
+        rebaseSource_GmDocument_(d, oldBase, oldSize);
+    }
+}
+
 static void import_GmDocument_(iGmDocument *d) {
     d->format = d->origFormat;
-    set_String(&d->source, &d->origSource);
-    replace_String(&d->source, "\r\n", "\n");
-    /* Detect use of ANSI escapes. */ {
-        iRegExp *ansiEsc = new_RegExp("\x1b[[()]([0-9;AB]*?)[ABCDEFGHJKSTfimn]", 0);
-        iRegExpMatch m;
-        init_RegExpMatch(&m);
-        const iBool found = matchString_RegExp(ansiEsc, &d->origSource, &m);
-        iChangeFlags(d->warnings, ansiEscapes_GmDocumentWarning, found);
-        iRelease(ansiEsc);
-    }
+    clear_String(&d->source);
+    d->isSourceRewritten = iFalse;
+    d->importPos = 0;
+    d->isImportPreformat = iFalse;
+    d->layoutState.sourcePos = iInvalidPos; /* everything will be laid out again */
+    d->warnings &= ~ansiEscapes_GmDocumentWarning;
     if (d->viewFormat == plainText_SourceFormat) {
         d->format = plainText_SourceFormat;
         d->theme.ansiEscapes = allowAll_AnsiFlag;
+        importMore_GmDocument_(d);
         return;
     }
     /* Do an internal format conversion to Gemtext. */
@@ -2323,34 +2738,129 @@ static void import_GmDocument_(iGmDocument *d) {
     if (d->format == gemini_SourceFormat) {
         d->theme.ansiEscapes = prefs_App()->gemtextAnsiEscapes;
     }
-    else if (d->format == markdown_SourceFormat) {
+    else {
+        d->theme.ansiEscapes = allowAll_AnsiFlag;
+    }
+    importMore_GmDocument_(d); /* normalized line by line, unless Markdown */
+    if (d->format == markdown_SourceFormat) {
         convertMarkdownToGemtext_GmDocument_(d);
+        d->isSourceRewritten = iTrue;
         d->theme.ansiEscapes = allowAll_AnsiFlag; /* escapes are used for styling */
+        if (shouldBeNormalized_GmDocument_(d)) {
+            normalize_GmDocument(d);
+        }
     }
-    else {
-        d->theme.ansiEscapes = allowAll_AnsiFlag;
+}
+
+static iBool canContinueLayout_GmDocument_(const iGmDocument *d, int width, int canvasWidth) {
+    return d->layoutState.sourcePos != iInvalidPos && !d->isLayoutInvalidated &&
+           d->size.x == width && d->outsideMargin == iMax(0, (canvasWidth - width) / 2);
+}
+
+static size_t origSize_GmDocument_(const iGmDocument *d) {
+    return d->origOffset + size_String(&d->origSource);
+}
+
+static iBool isOrigPrefixOf_GmDocument_(const iGmDocument *d, const iString *source) {
+    /* Only the retained part of the original source can be compared. While more content is
+       coming, that is just the unimported tail. */
+    return size_String(source) >= origSize_GmDocument_(d) &&
+           memcmp(constBegin_String(source) + d->origOffset,
+                  constBegin_String(&d->origSource),
+                  size_String(&d->origSource)) == 0;
+}
+
+static void shareOrigSource_GmDocument_(iGmDocument *d, const iString *source) {
+    set_String(&d->origSource, source); /* not copied */
+    d->origOffset = 0;
+}
+
+static void releaseOrigSource_GmDocument_(iGmDocument *d) {
+    if (d->isPartial) {
+        /* The caller's buffer will keep growing as more content arrives. Holding a reference
+           to it would cause the entire buffer to be copied on the next append, so only the
+           incomplete tail is kept. The full source is shared again on the next update. */
+        const size_t pos = iMax(d->importPos, d->origOffset);
+        if (pos > d->origOffset) {
+            iString *tail = newRange_String(
+                (iRangecc){ constBegin_String(&d->origSource) + pos - d->origOffset,
+                            constEnd_String(&d->origSource) });
+            set_String(&d->origSource, tail);
+            delete_String(tail);
+            d->origOffset = pos;
+        }
     }
-    if (shouldBeNormalized_GmDocument_(d)) {
-        normalize_GmDocument(d);
+    else if (!d->isSourceRewritten && d->origOffset == 0 &&
+             d->importPos == size_String(&d->origSource) &&
+             size_String(&d->source) == size_String(&d->origSource) &&
+             constBegin_String(&d->source) != constBegin_String(&d->origSource)) {
+        /* Importing didn't change anything, so there is no need to keep two copies. */
+        const char  *oldStart = constBegin_String(&d->source);
+        const size_t oldSize  = size_String(&d->source);
+        set_String(&d->source, &d->origSource);
+        rebaseSource_GmDocument_(d, oldStart, oldSize);
     }
 }
 
-void setSource_GmDocument(iGmDocument *d, const iString *source, int width, int canvasWidth,
-                          enum iGmDocumentUpdate updateType) {
-    /* TODO: This API has been set up to allow partial/progressive updating of the content.
-       Currently the entire source is replaced every time, though. */
-//    printf("[GmDocument] source update (%zu bytes), width:%d, final:%d\n",
-//           size_String(source), width, updateType == final_GmDocumentUpdate);
-    if (size_String(source) == size_String(&d->origSource)) {
-        iAssert(equal_String(source, &d->origSource));
+static void update_GmDocument_(iGmDocument *d, const iString *source, int width,
+                               int canvasWidth, iBool isPartial) {
+    const size_t oldSize = origSize_GmDocument_(d);
+    if (size_String(source) == oldSize) {
+        iAssert(isOrigPrefixOf_GmDocument_(d, source));
 //        printf("[GmDocument] source is unchanged!\n");
+        shareOrigSource_GmDocument_(d, source);
+        if (d->isPartial && !isPartial) {
+            /* No more content is coming, so the trailing line is complete. */
+            d->isPartial = iFalse;
+            if (d->importPos > 0 && isProgressive_GmDocument_(d)) {
+                importMore_GmDocument_(d);
+                if (canContinueLayout_GmDocument_(d, width, canvasWidth)) {
+                    doLayout_GmDocument_(d, iTrue);
+                    return;
+                }
+            }
+            else {
+                import_GmDocument_(d);
+            }
+            setWidth_GmDocument(d, width, canvasWidth);
+            return;
+        }
+        if (d->importPos == 0 && oldSize > 0) {
+            /* Format has changed. */
+            import_GmDocument_(d);
+            setWidth_GmDocument(d, width, canvasWidth);
+            return;
+        }
         updateWidth_GmDocument(d, width, canvasWidth);
         return; /* Nothing to do. */
     }
+    /* Progressive updates append to the existing source. Only the new lines need to be
+       imported and laid out. */
+    const iBool isAppended =
+        size_String(source) > oldSize && isOrigPrefixOf_GmDocument_(d, source);
+    d->isPartial = isPartial;
+    shareOrigSource_GmDocument_(d, source);
+    if (isAppended && d->importPos > 0 && isProgressive_GmDocument_(d)) {
+        importMore_GmDocument_(d);
+        if (canContinueLayout_GmDocument_(d, width, canvasWidth)) {
+            doLayout_GmDocument_(d, iTrue);
+        }
+        else {
+            setWidth_GmDocument(d, width, canvasWidth);
+        }
+        return;
+    }
     /* Normalize and convert to Gemtext if needed. */
-    set_String(&d->origSource, source);
     import_GmDocument_(d);
-    setWidth_GmDocument(d, width, canvasWidth); /* re-do layout */    
+    setWidth_GmDocument(d, width, canvasWidth); /* re-do layout */
+}
+
+void setSource_GmDocument(iGmDocument *d, const iString *source, int width, int canvasWidth,
+                          enum iGmDocumentUpdate updateType) {
+//    printf("[GmDocument] source update (%zu bytes), width:%d, final:%d\n",
+//           size_String(source), width, updateType == final_GmDocumentUpdate);
+    update_GmDocument_(d, source, width, canvasWidth, updateType == partial_GmDocumentUpdate);
+    releaseOrigSource_GmDocument_(d);
 }
 
 void foldPre_GmDocument(iGmDocument *d, uint16_t preId) {
@@ -2388,9 +2898,10 @@ void render_GmDocument(const iGmDocument *d, iRangei visRangeY, iGmDocumentRende
                        void *context) {
     iBool isInside = iFalse;
     setAnsiFlags_Text(d->theme.ansiEscapes);
-    /* TODO: Check lookup table for quick starting position. */
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
+    const iGmRun *end = constEnd_Array(&d->layout);
+    for (const iGmRun *run = (const iGmRun *) constData_Array(&d->layout) +
+                             firstRunIndex_GmDocument_(d, visRangeY.start);
+         run < end; run++) {
         if (isInside) {
             if (top_Rect(run->visBounds) > visRangeY.end) {
                 break;
@@ -2480,9 +2991,11 @@ iGmRunRange runRange_GmDocument(const iGmDocument *d) {
 }
 
 size_t memorySize_GmDocument(const iGmDocument *d) {
+    const iBool isShared = constBegin_String(&d->source) == constBegin_String(&d->origSource);
     return size_String(&d->origSource) +
-           size_String(&d->source) +
+           (isShared ? 0 : size_String(&d->source)) +
            size_Array(&d->layout) * sizeof(iGmRun) +
+           (size_Array(&d->runIndex) + size_Array(&d->locIndex)) * sizeof(size_t) +
            size_Array(&d->links)  * sizeof(iGmLink) +
            memorySize_Media(d->media);
 }
@@ -2533,11 +3046,20 @@ iGmRunRange findPreformattedRange_GmDocument(const iGmDocument *d, const iGmRun
 }
 
 const iGmRun *findRun_GmDocument(const iGmDocument *d, iInt2 pos) {
-    /* TODO: Perf optimization likely needed; use a block map? */
-    const iGmRun *last = NULL;
-    iBool isFirstNonDecoration = iTrue;
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
+    const iGmRun *last  = NULL;
+    const iGmRun *first = constData_Array(&d->layout);
+    const iGmRun *end   = constEnd_Array(&d->layout);
+    const iGmRun *start = first + firstRunIndex_GmDocument_(d, pos.y);
+    /* The runs skipped over are all above the point, so the nearest one is the fallback. */
+    for (const iGmRun *prev = start; prev > first; ) {
+        prev--;
+        if (~prev->flags & decoration_GmRunFlag) {
+            last = prev;
+            break;
+        }
+    }
+    iBool isFirstNonDecoration = (last == NULL);
+    for (const iGmRun *run = start; run < end; run++) {
         if (run->flags & decoration_GmRunFlag) continue;
         const iRangei span = ySpan_Rect(run->bounds);
         if (contains_Range(&span, pos.y)) {
@@ -2568,8 +3090,22 @@ iRangecc findLoc_GmDocument(const iGmDocument *d, iInt2 pos) {
 }
 
 const iGmRun *findRunAtLoc_GmDocument(const iGmDocument *d, const char *textCStr) {
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
+    /* Binary search for the indexed runs that begin before the location. */
+    const iGmRun *first = constData_Array(&d->layout);
+    const iGmRun *end   = constEnd_Array(&d->layout);
+    size_t lo = 0, hi = size_Array(&d->locIndex);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (first[constValue_Array(&d->locIndex, mid, size_t)].text.start < textCStr) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    /* Step back an extra interval in case adjacent runs overlap in the source. */
+    const size_t startIndex = lo >= 2 ? constValue_Array(&d->locIndex, lo - 2, size_t) : 0;
+    for (const iGmRun *run = first + startIndex; run < end; run++) {
         if (run->flags & decoration_GmRunFlag) {
             continue;
         }
@@ -2775,4 +3311,71 @@ iBool preHasAltText_GmDocument(const iGmDocument *d, uint16_t preId) {
     return meta && !isEmpty_Range(&meta->altText);
 }
 
+/*----------------------------------------------------------------------------------------------*/
+
+static iString *makeBenchmarkSource_(size_t targetSize) {
+    iString *src = new_String();
+    for (int section = 1; size_String(src) < targetSize; section++) {
+        appendFormat_String(src, "## Section %d\n\n", section);
+        appendCStr_String(src,
+                          "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod "
+                          "tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim "
+                          "veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea "
+                          "commodo consequat.\n\n");
+        for (int i = 0; i < 8; i++) {
+            appendFormat_String(src, "=> gemini://example.com/%d/%d.gmi Entry %d.%d\n",
+                                section, i, section, i);
+        }
+        appendCStr_String(src, "\n* First item\n* Second item\n> Quoted text.\n\n```\n");
+        for (int i = 0; i < 6; i++) {
+            appendFormat_String(src, "%4d | preformatted line of the block\n", i);
+        }
+        appendCStr_String(src, "```\n\n");
+    }
+    return src;
+}
+
+const iString *benchmarkLayout_GmDocument(void) {
+    /* Feed a document in 4 KB chunks like a network request would, with one incremental
+       layout per chunk, and compare that to laying out the complete source once. */
+    const size_t chunkSize = 4096;
+    const int    width     = 90 * gap_Text * aspect_UI;
+    iString     *src       = makeBenchmarkSource_(500 * 1000);
+    iString     *msg       = collectNew_String();
+    iString     *partial   = new_String();
+    uint64_t     times[2];
+    size_t       numRuns   = 0;
+    size_t       numChunks = 0;
+    appendFormat_String(msg, "# Layout benchmark\n");
+    appendFormat_String(msg, "Source: %.1f KB, chunk size: %zu bytes, width: %d px\n",
+                        size_String(src) / 1.0e3, chunkSize, width);
+    for (int pass = 0; pass < 2; pass++) {
+        iGmDocument *doc = new_GmDocument();
+        setUrl_GmDocument(doc, collectNewCStr_String("gemini://example.com/benchmark.gmi"));
+        setFormat_GmDocument(doc, gemini_SourceFormat);
+        iPerfTimer timer;
+        init_PerfTimer(&timer);
+        if (pass == 0) {
+            for (size_t pos = 0; pos < size_String(src); pos += chunkSize) {
+                appendRange_String(partial, (iRangecc){
+                    constBegin_String(src) + pos,
+                    constBegin_String(src) + iMin(pos + chunkSize, size_String(src)) });
+                setSource_GmDocument(doc, partial, width, width, partial_GmDocumentUpdate);
+                numChunks++;
+            }
+        }
+        setSource_GmDocument(doc, src, width, width, final_GmDocumentUpdate);
+        times[pass] = elapsedMicroseconds_PerfTimer(&timer);
+        numRuns = size_Array(&doc->layout);
+        iRelease(doc);
+    }
+    appendFormat_String(msg, "Runs: %zu\n", numRuns);
+    appendFormat_String(msg, "* Progressive layout: %.1f ms (%.2f ms per chunk)\n",
+                        times[0] / 1.0e3, times[0] / 1.0e3 / iMax(1u, numChunks));
+    appendFormat_String(msg, "* Single layout of the complete source: %.1f ms\n", times[1] / 1.0e3);
+    delete_String(partial);
+    delete_String(src);
+    return msg;
+}
+
 iDefineClass(GmDocument)
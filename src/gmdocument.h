@@ -195,6 +195,10 @@ void    setWidth_GmDocument     (iGmDocument *, int width, int canvasWidth);
 iBool   updateWidth_GmDocument  (iGmDocument *, int width, int canvasWidth);
 void    redoLayout_GmDocument   (iGmDocument *);
 void    invalidateLayout_GmDocument(iGmDocument *); /* will have to be redone later */
+iGmDocument *newLayoutCopy_GmDocument(const iGmDocument *); /* for laying out in another thread */
+void    adoptLayout_GmDocument  (iGmDocument *, iGmDocument *laidOut); /* takes source and layout */
+void    cancelLayout_GmDocument (iGmDocument *); /* thread-safe */
+iBool   isLayoutCancelled_GmDocument(const iGmDocument *);
 iBool   updateOpenURLs_GmDocument(iGmDocument *);
 void    setUrl_GmDocument       (iGmDocument *, const iString *url);
 void    setSource_GmDocument    (iGmDocument *, const iString *source, int width, int canvasWidth,
@@ -260,3 +264,5 @@ iInt2           preRunMargin_GmDocument (const iGmDocument *, uint16_t preId);
 iBool           preIsFolded_GmDocument  (const iGmDocument *, uint16_t preId);
 iBool           preHasAltText_GmDocument(const iGmDocument *, uint16_t preId);
 
+const iString * benchmarkLayout_GmDocument  (void); /* for debugging */
+
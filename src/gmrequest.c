@@ -21,13 +21,20 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "gmrequest.h"
+#include "archivecache.h"
 #include "gmutil.h"
 #include "gmcerts.h"
+#include "gmdocument.h"
 #include "gopher.h"
+#include "media.h"
 #include "app.h" /* dataDir_App() */
 #include "mimehooks.h"
 #include "feeds.h"
 #include "bookmarks.h"
+#include "history.h"
+#include "resolver.h"
+#include "profiler.h"
+#include "ui/command.h"
 #include "ui/text.h"
 #include "resources.h"
 #include "sitespec.h"
@@ -40,6 +47,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/path.h>
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/socket.h>
+#include <the_Foundation/thread.h>
 #include <the_Foundation/tlsrequest.h>
 
 #include <SDL_timer.h>
@@ -125,6 +133,30 @@ void deserialize_GmResponse(iGmResponse *d, iStream *ins) {
     }
 }
 
+void serializeWithoutBody_GmResponse(const iGmResponse *d, iStream *outs) {
+    /* The body is stored separately by the caller. */
+    write32_Stream(outs, d->statusCode);
+    serialize_String(&d->meta, outs);
+    write32_Stream(outs, d->certFlags & ~haveFingerprint_GmCertFlag);
+    serialize_Date(&d->certValidUntil, outs);
+    serialize_String(&d->certSubject, outs);
+    writeU64_Stream(outs, d->when.ts.tv_sec);
+    serialize_Block(&d->identityFingerprint, outs);
+}
+
+void deserializeWithoutBody_GmResponse(iGmResponse *d, iStream *ins) {
+    d->statusCode = read32_Stream(ins);
+    deserialize_String(&d->meta, ins);
+    clear_Block(&d->body);
+    d->certFlags = read32_Stream(ins);
+    deserialize_Date(&d->certValidUntil, ins);
+    deserialize_String(&d->certSubject, ins);
+    clear_Block(&d->certFingerprint);
+    d->when.ts.tv_sec = readU64_Stream(ins);
+    d->when.ts.tv_nsec = 0;
+    deserialize_Block(&d->identityFingerprint, ins);
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(UploadData)
@@ -132,28 +164,77 @@ iDeclareTypeConstruction(UploadData)
     
 struct Impl_UploadData {
     iBlock  data;
+    iString filePath;   /* if set, the payload is read from this file when sending */
     iString mime;
     iString token;
+    size_t  headerSize; /* excluded from send progress */
 };
 
 iDefineTypeConstruction(UploadData)
 
+static const size_t uploadChunkSize_UploadData_ = 256 * 1024;
+
 void init_UploadData(iUploadData *d) {
     init_Block(&d->data, 0);
+    init_String(&d->filePath);
     init_String(&d->mime);
     init_String(&d->token);
+    d->headerSize = 0;
 }
 
 void deinit_UploadData(iUploadData *d) {
     deinit_String(&d->token);
     deinit_String(&d->mime);
+    deinit_String(&d->filePath);
     deinit_Block(&d->data);
 }
 
+static size_t payloadSize_UploadData_(const iUploadData *d) {
+    if (!isEmpty_String(&d->filePath)) {
+        const long size = fileSize_FileInfo(&d->filePath);
+        return size > 0 ? (size_t) size : 0;
+    }
+    return size_Block(&d->data);
+}
+
+static iBool appendPayload_UploadData_(const iUploadData *d, iBlock *dest, size_t payloadSize) {
+    if (isEmpty_String(&d->filePath)) {
+        append_Block(dest, &d->data);
+        return iTrue;
+    }
+    /* The file is read in chunks directly to its final place in the request buffer, so
+       no other copies of the payload are kept in memory. */
+    iFile *f = new_File(&d->filePath);
+    iBool ok = iFalse;
+    if (open_File(f, readOnly_FileMode)) {
+        const size_t start = size_Block(dest);
+        resize_Block(dest, start + payloadSize);
+        size_t pos = 0;
+        while (pos < payloadSize) {
+            const size_t num = readData_File(f,
+                                             iMin(uploadChunkSize_UploadData_, payloadSize - pos),
+                                             (char *) data_Block(dest) + start + pos);
+            if (num == 0) {
+                break;
+            }
+            pos += num;
+        }
+        ok = (pos == payloadSize);
+        if (!ok) {
+            truncate_Block(dest, start);
+        }
+    }
+    iRelease(f);
+    return ok;
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 static iAtomicInt idGen_;
 
+static const size_t localChunkSize_GmRequest_     = 1024 * 1024;
+static const size_t largeLocalFileSize_GmRequest_ = 4 * 1024 * 1024; /* read in the background */
+
 enum iGmRequestState {
     initialized_GmRequestState,
     receivingHeader_GmRequestState,
@@ -174,6 +255,11 @@ struct Impl_GmRequest {
     iTlsRequest *        req;
     iGopher              gopher;
     iSocket *            spartan;
+    iFile *              localFile;   /* large local file being read in the background */
+    iString *            localArchive; /* archive whose entry is read in the background */
+    iString *            localEntry;
+    iThread *            localReader;
+    iAtomicInt           isLocalCancelled;
     iGmResponse *        resp;
     iBool                isProxy;
     iBool                isFilterEnabled;
@@ -364,22 +450,40 @@ static void requestFinished_GmRequest_(iGmRequest *d, iTlsRequest *req) {
 }
 
 static const iBlock *aboutPageSource_(iRangecc path, iRangecc query) {
-    const struct { const char *name; const iBlock *data; } staticPages[] = {
-        { "about",          &blobAbout_Resources },
-        { "lagrange",       &blobLagrange_Resources },
-        { "help",           &blobHelp_Resources },
-        { "license",        &blobLicense_Resources },
-        { "version",        &blobVersion_Resources },
-        { "version-1.10",   &blobVersion_1_10_Resources },
-        { "version-1.5",    &blobVersion_1_5_Resources },
-        { "version-0.13",   &blobVersion_0_13_Resources },
+    static const struct { const char *name; enum iResourceId resource; } staticPages[] = {
+        { "about",          about_ResourceId },
+        { "lagrange",       lagrange_ResourceId },
+        { "help",           help_ResourceId },
+        { "license",        license_ResourceId },
+        { "version",        version_ResourceId },
+        { "version-1.10",   version_1_10_ResourceId },
+        { "version-1.5",    version_1_5_ResourceId },
+        { "version-0.13",   version_0_13_ResourceId },
     };
     iForIndices(i, staticPages) {
         if (equalCase_Rangecc(path, staticPages[i].name)) {
-            return staticPages[i].data;
+            return blob_Resources(staticPages[i].resource);
         }
     }
     if (equalCase_Rangecc(path, "debug")) {
+        if (equal_Rangecc(query, "?layout")) {
+            return utf8_String(benchmarkLayout_GmDocument());
+        }
+        if (equal_Rangecc(query, "?url")) {
+            return utf8_String(benchmark_Url());
+        }
+        if (equal_Rangecc(query, "?commands")) {
+            return utf8_String(benchmark_Command());
+        }
+        if (equal_Rangecc(query, "?imagestyle")) {
+            return utf8_String(benchmarkImageStyle_Media());
+        }
+        if (equal_Rangecc(query, "?cache")) {
+            return utf8_String(cacheInfo_History(prefs_App()->maxCacheSize * 1000000));
+        }
+        if (equal_Rangecc(query, "?profiler")) {
+            return utf8_String(infoPage_Profiler());
+        }
         return utf8_String(debugInfo_App());
     }
     if (equalCase_Rangecc(path, "fonts")) {
@@ -605,24 +709,33 @@ static void spartanError_GmRequest_(iGmRequest *d, iSocket *socket, int error, c
 }
 
 static void beginSpartanConnection_GmRequest_(iGmRequest *d, const iString *host, uint16_t port) {
-    d->state = receivingHeader_GmRequestState;
-    d->spartan = new_Socket(cstr_String(host), port);
-    iConnect(Socket, d->spartan, readyRead,    d, spartanRead_GmRequest_);
-    iConnect(Socket, d->spartan, disconnected, d, spartanDisconnected_GmRequest_);
-    iConnect(Socket, d->spartan, error,        d, spartanError_GmRequest_);
-    open_Socket(d->spartan);
     iUrl url;
     init_Url(&url, &d->url);
-    iBlock *message = new_Block(0);
-    iBlock *data    = new_Block(0);
+    iBlock *data = new_Block(0);
     if (!isEmpty_Range(&url.query)) {
         set_Block(data,
                   utf8_String(collect_String(urlDecode_String(
                       collectNewRange_String((iRangecc){ url.query.start + 1, url.query.end })))));
     }
     if (d->upload) {
-        set_Block(data, &d->upload->data);    
+        clear_Block(data);
+        if (!appendPayload_UploadData_(d->upload, data, payloadSize_UploadData_(d->upload))) {
+            /* The file may have been removed or truncated after it was chosen. */
+            delete_Block(data);
+            d->resp->statusCode = failedToOpenFile_GmStatusCode;
+            set_String(&d->resp->meta, &d->upload->filePath);
+            d->state = finished_GmRequestState;
+            iNotifyAudience(d, finished, GmRequestFinished);
+            return;
+        }
     }
+    d->state = receivingHeader_GmRequestState;
+    d->spartan = new_Socket(cstr_String(host), port);
+    iConnect(Socket, d->spartan, readyRead,    d, spartanRead_GmRequest_);
+    iConnect(Socket, d->spartan, disconnected, d, spartanDisconnected_GmRequest_);
+    iConnect(Socket, d->spartan, error,        d, spartanError_GmRequest_);
+    open_Socket(d->spartan);
+    iBlock *message = new_Block(0);
     printf_Block(message,
                  "%s %s %zu\r\n",
                  cstr_Rangecc(url.host),
@@ -649,6 +762,11 @@ void init_GmRequest(iGmRequest *d, iGmCerts *certs) {
     init_String(&d->url);
     init_Gopher(&d->gopher);
     d->spartan      = NULL;
+    d->localFile    = NULL;
+    d->localArchive = NULL;
+    d->localEntry   = NULL;
+    d->localReader  = NULL;
+    set_Atomic(&d->isLocalCancelled, iFalse);
     d->upload       = NULL;
     d->certs        = certs;
     d->req          = NULL;
@@ -673,6 +791,14 @@ void deinit_GmRequest(iGmRequest *d) {
     else {
         unlock_Mutex(d->mtx);
     }
+    if (d->localReader) {
+        set_Atomic(&d->isLocalCancelled, iTrue);
+        join_Thread(d->localReader);
+        iReleasePtr(&d->localReader);
+    }
+    iRelease(d->localFile);
+    delete_String(d->localArchive);
+    delete_String(d->localEntry);
     iReleasePtr(&d->req);
     delete_UploadData(d->upload);
     deinit_Gopher(&d->gopher);
@@ -726,6 +852,18 @@ void setUploadData_GmRequest(iGmRequest *d, const iString *mime, const iBlock *p
         d->upload = new_UploadData();   
     }
     set_Block(&d->upload->data, payload);
+    clear_String(&d->upload->filePath);
+    set_String(&d->upload->mime, mime);
+    set_String(&d->upload->token, token);
+}
+
+void setUploadFile_GmRequest(iGmRequest *d, const iString *mime, const iString *path,
+                             const iString *token) {
+    if (!d->upload) {
+        d->upload = new_UploadData();
+    }
+    clear_Block(&d->upload->data);
+    set_String(&d->upload->filePath, path);
     set_String(&d->upload->mime, mime);
     set_String(&d->upload->token, token);
 }
@@ -737,7 +875,9 @@ void setSendProgressFunc_GmRequest(iGmRequest *d, iGmRequestProgressFunc func) {
 static void bytesSent_GmRequest_(iGmRequest *d, iTlsRequest *req, size_t sent, size_t toSend) {
     iUnused(req);
     if (d->sendProgress) {
-        d->sendProgress(d, sent, toSend);
+        /* Report the progress of the payload itself. */
+        const size_t header = d->upload ? d->upload->headerSize : 0;
+        d->sendProgress(d, sent > header ? sent - header : 0, toSend > header ? toSend - header : 0);
     }
 }
 
@@ -753,6 +893,66 @@ static int cmp_FileInfoPtr_(const iFileInfo **a, const iFileInfo **b) {
     return cmpStringCase_String(path_FileInfo(*a), path_FileInfo(*b));
 }
 
+static iThreadResult readLocalFile_GmRequest_(iThread *thread) {
+    iGmRequest *d = userData_Thread(thread);
+    iBlock *chunk = new_Block(localChunkSize_GmRequest_);
+    for (;;) {
+        if (value_Atomic(&d->isLocalCancelled)) {
+            break;
+        }
+        const size_t num = readData_File(d->localFile, size_Block(chunk), data_Block(chunk));
+        if (num == 0) {
+            break;
+        }
+        lock_Mutex(d->mtx);
+        appendData_Block(&d->resp->body, constData_Block(chunk), num);
+        initCurrent_Time(&d->resp->when);
+        unlock_Mutex(d->mtx);
+        if (!d->isRespFiltered && exchange_Atomic(&d->allowUpdate, iFalse)) {
+            iNotifyAudience(d, updated, GmRequestUpdated);
+        }
+    }
+    delete_Block(chunk);
+    close_File(d->localFile);
+    lock_Mutex(d->mtx);
+    d->state = finished_GmRequestState;
+    unlock_Mutex(d->mtx);
+    if (d->isRespFiltered) {
+        applyFilter_GmRequest_(d);
+    }
+    iNotifyAudience(d, finished, GmRequestFinished);
+    return 0;
+}
+
+static iThreadResult readArchiveEntry_GmRequest_(iThread *thread) {
+    /* Entries are decompressed here so that large ones don't block the UI thread. */
+    iGmRequest   *d    = userData_Thread(thread);
+    iOpenArchive *oa   = lock_ArchiveCache(d->localArchive);
+    const iBlock *data = NULL;
+    if (oa && !value_Atomic(&d->isLocalCancelled)) {
+        data = data_Archive(archive_OpenArchive(oa), d->localEntry);
+    }
+    lock_Mutex(d->mtx);
+    if (data) {
+        set_Block(&d->resp->body, data);
+    }
+    else {
+        d->resp->statusCode = failedToOpenFile_GmStatusCode;
+        set_String(&d->resp->meta, d->localEntry);
+    }
+    initCurrent_Time(&d->resp->when);
+    d->state = finished_GmRequestState;
+    unlock_Mutex(d->mtx);
+    if (oa) {
+        unlock_ArchiveCache(oa);
+    }
+    if (d->isRespFiltered && data) {
+        applyFilter_GmRequest_(d);
+    }
+    iNotifyAudience(d, finished, GmRequestFinished);
+    return 0;
+}
+
 static const iString *directoryIndexPage_Archive_(const iArchive *d, const iString *entryPath) {
     static const char *names[] = { "index.gmi", "index.gemini" };
     iForIndices(i, names) {
@@ -861,6 +1061,19 @@ void submit_GmRequest(iGmRequest *d) {
             resp->statusCode = success_GmStatusCode;
             setCStr_String(&resp->meta, mediaType_Path(path));
             /* TODO: Detect text files based on contents? E.g., is the content valid UTF-8. */
+            if (size_File(f) > largeLocalFileSize_GmRequest_) {
+                /* Large files are read in a background thread and the body is delivered
+                   in chunks, like a network response. */
+                d->isRespFiltered =
+                    d->isFilterEnabled && willTryFilter_MimeHooks(mimeHooks_App(), &resp->meta);
+                d->state       = receivingBody_GmRequestState;
+                d->localFile   = f;
+                d->localReader = new_Thread(readLocalFile_GmRequest_);
+                setUserData_Thread(d->localReader, d);
+                iNotifyAudience(d, updated, GmRequestUpdated);
+                start_Thread(d->localReader);
+                return;
+            }
             set_Block(&resp->body, collect_Block(readAll_File(f)));
             d->state = receivingBody_GmRequestState;
             iNotifyAudience(d, updated, GmRequestUpdated);
@@ -869,8 +1082,9 @@ void submit_GmRequest(iGmRequest *d) {
             /* It could be a path inside an archive. */
             const iString *container = findContainerArchive_Path(path);
             if (container) {
-                iArchive *arch = iClob(new_Archive());
-                if (openFile_Archive(arch, container)) {
+                iOpenArchive *oa = lock_ArchiveCache(container);
+                if (oa) {
+                    iArchive *arch = archive_OpenArchive(oa);
                     iString *entryPath = collect_String(copy_String(path));
                     remove_Block(&entryPath->chars, 0, size_String(container) + 1); /* last slash, too */
                     iBool isDir = isDirectory_Archive(arch, entryPath);
@@ -959,19 +1173,31 @@ void submit_GmRequest(iGmRequest *d) {
                         set_Block(&resp->body, utf8_String(page));
                         delete_String(page);
                     }
+                    else if (entry_Archive(arch, entryPath)) {
+                        /* The entry is decompressed in the background, like a large file
+                           is read. */
+                        resp->statusCode = success_GmStatusCode;
+                        setCStr_String(&resp->meta, mediaType_Path(entryPath));
+                        d->isRespFiltered =
+                            d->isFilterEnabled &&
+                            willTryFilter_MimeHooks(mimeHooks_App(), &resp->meta);
+                        d->state        = receivingBody_GmRequestState;
+                        d->localArchive = copy_String(container);
+                        d->localEntry   = copy_String(entryPath);
+                        unlock_ArchiveCache(oa);
+                        iRelease(f);
+                        d->localReader = new_Thread(readArchiveEntry_GmRequest_);
+                        setUserData_Thread(d->localReader, d);
+                        iNotifyAudience(d, updated, GmRequestUpdated);
+                        start_Thread(d->localReader);
+                        return;
+                    }
                     else {
-                        const iBlock *data = data_Archive(arch, entryPath);
-                        if (data) {
-                            resp->statusCode = success_GmStatusCode;
-                            setCStr_String(&resp->meta, mediaType_Path(entryPath));
-                            set_Block(&resp->body, data);
-                        }
-                        else {
-                            resp->statusCode = failedToOpenFile_GmStatusCode;
-                            setCStr_String(&resp->meta, cstr_String(path));
-                        }
+                        resp->statusCode = failedToOpenFile_GmStatusCode;
+                        setCStr_String(&resp->meta, cstr_String(path));
                     }
                 fileRequestFinished:;
+                    unlock_ArchiveCache(oa);
                 }
             }
             else {
@@ -1044,57 +1270,67 @@ void submit_GmRequest(iGmRequest *d) {
         iNotifyAudience(d, finished, GmRequestFinished);
         return;
     }
-    d->state = receivingHeader_GmRequestState;
-    d->req = new_TlsRequest();
-    if (d->identity) {
-        setCertificate_TlsRequest(d->req, d->identity->cert);
-        set_Block(&resp->identityFingerprint, &d->identity->fingerprint);
-    }
-    /* Site-specific settings. */ {
-        iString siteRoot;
-        initRange_String(&siteRoot, urlRoot_String(&d->url));
-        setSessionCacheEnabled_TlsRequest(
-            d->req, value_SiteSpec(&siteRoot, tlsSessionCache_SiteSpeckey) != 0);
-        deinit_String(&siteRoot);
-    }
-    iConnect(TlsRequest, d->req, readyRead, d, readIncoming_GmRequest_);
-    iConnect(TlsRequest, d->req, sent, d, bytesSent_GmRequest_);
-    iConnect(TlsRequest, d->req, finished, d, requestFinished_GmRequest_);
-    if (port == 0) {
-        port = GEMINI_DEFAULT_PORT; /* default Gemini port */
-    }
-    setHost_TlsRequest(d->req, host, port);
     /* Titan requests can have an arbitrary payload. */
+    iBlock content;
+    init_Block(&content, 0);
     if (isTitan_GmRequest_(d)) {
-        iBlock content;
-        init_Block(&content, 0);
         if (d->upload) {
+            const size_t payloadSize = payloadSize_UploadData_(d->upload);
             printf_Block(&content,
                          "%s;mime=%s;size=%zu",
                          cstr_String(&d->url),
                          cstr_String(&d->upload->mime),
-                         size_Block(&d->upload->data));
+                         payloadSize);
             if (!isEmpty_String(&d->upload->token)) {
                 appendCStr_Block(&content, ";token=");
                 append_Block(&content,
                              utf8_String(collect_String(urlEncode_String(&d->upload->token))));
             }
             appendCStr_Block(&content, "\r\n");
-            append_Block(&content, &d->upload->data);
+            d->upload->headerSize = size_Block(&content);
+            if (!appendPayload_UploadData_(d->upload, &content, payloadSize)) {
+                deinit_Block(&content);
+                resp->statusCode = failedToOpenFile_GmStatusCode;
+                set_String(&resp->meta, &d->upload->filePath);
+                d->state = finished_GmRequestState;
+                iNotifyAudience(d, finished, GmRequestFinished);
+                return;
+            }
         }
         else {
             /* Empty data. */
             printf_Block(
                 &content, "%s;mime=application/octet-stream;size=0\r\n", cstr_String(&d->url));
         }
-        setContent_TlsRequest(d->req, &content);
-        deinit_Block(&content);
     }
     else {
         /* Gemini request. */
-        setContent_TlsRequest(d->req,
-                              utf8_String(collectNewFormat_String("%s\r\n", cstr_String(&d->url))));
+        printf_Block(&content, "%s\r\n", cstr_String(&d->url));
     }
+    d->state = receivingHeader_GmRequestState;
+    touch_Resolver(host); /* resolved by the request itself */
+    d->req = new_TlsRequest();
+    if (d->identity) {
+        setCertificate_TlsRequest(d->req, d->identity->cert);
+        set_Block(&resp->identityFingerprint, &d->identity->fingerprint);
+    }
+    /* Site-specific settings. */ {
+        iString siteRoot;
+        initRange_String(&siteRoot, urlRoot_String(&d->url));
+        setSessionCacheEnabled_TlsRequest(
+            d->req, value_SiteSpec(&siteRoot, tlsSessionCache_SiteSpeckey) != 0);
+        deinit_String(&siteRoot);
+    }
+    iConnect(TlsRequest, d->req, readyRead, d, readIncoming_GmRequest_);
+    iConnect(TlsRequest, d->req, sent, d, bytesSent_GmRequest_);
+    iConnect(TlsRequest, d->req, finished, d, requestFinished_GmRequest_);
+    if (port == 0) {
+        port = GEMINI_DEFAULT_PORT; /* default Gemini port */
+    }
+    setHost_TlsRequest(d->req, host, port);
+    /* The request shares the content buffer; ours is released right away. */
+    setContent_TlsRequest(d->req, &content);
+    deinit_Block(&content);
     submit_TlsRequest(d->req);
 }
 
@@ -1102,6 +1338,7 @@ void cancel_GmRequest(iGmRequest *d) {
     if (d->req) {
         cancel_TlsRequest(d->req);
     }
+    set_Atomic(&d->isLocalCancelled, iTrue);
     cancel_Gopher(&d->gopher);
 }
 
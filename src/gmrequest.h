@@ -43,7 +43,8 @@ enum iGmCertFlag {
 struct Impl_GmResponse {
     enum iGmStatusCode statusCode;
     iString            meta; /* MIME type or other metadata */
-    iBlock             body;
+    iBlock             body; /* shared copy-on-write; holding a reference while the request
+                                is ongoing causes the next append to copy it */
     int                certFlags;
     iBlock             certFingerprint;
     iDate              certValidUntil;
@@ -56,6 +57,8 @@ iDeclareTypeConstruction(GmResponse)
 iDeclareTypeSerialization(GmResponse)
 
 iGmResponse *       copy_GmResponse             (const iGmResponse *);
+void                serializeWithoutBody_GmResponse     (const iGmResponse *, iStream *outs);
+void                deserializeWithoutBody_GmResponse   (iGmResponse *, iStream *ins);
 
 /*----------------------------------------------------------------------------------------------*/
 
@@ -74,6 +77,8 @@ void                setUrl_GmRequest            (iGmRequest *, const iString *ur
 void                setIdentity_GmRequest       (iGmRequest *, const iGmIdentity *id);
 void                setUploadData_GmRequest     (iGmRequest *, const iString *mime,
                                                  const iBlock *payload, const iString *token);
+void                setUploadFile_GmRequest     (iGmRequest *, const iString *mime,
+                                                 const iString *path, const iString *token);
 void                setSendProgressFunc_GmRequest(iGmRequest *, iGmRequestProgressFunc func);
 void                submit_GmRequest            (iGmRequest *);
 void                cancel_GmRequest            (iGmRequest *);
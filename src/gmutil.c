@@ -25,6 +25,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "lang.h"
 #include "sitespec.h"
 #include "ui/color.h"
+#include "ui/util.h"
 
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
@@ -37,19 +38,8 @@ iRegExp *newGemtextLink_RegExp(void) {
     return new_RegExp("=>\\s*([^\\s]+)(\\s.*)?", 0);
 }
 
-void init_Url(iUrl *d, const iString *text) {
-    if (!text) {
-        iZap(*d);
-        return;
-    }
-    /* Handle "file:" as a special case since it only has the path part. */
-    if (startsWithCase_String(text, "file://")) {
-        iZap(*d);
-        const char *cstr = constBegin_String(text);
-        d->scheme = (iRangecc){ cstr, cstr + 4 };
-        d->path   = (iRangecc){ cstr + 7, constEnd_String(text) };
-        return;
-    }
+static void initRegExp_Url_(iUrl *d, const iString *text) {
+    /* Previous implementation of `init_Url`; kept for the benchmark. */
     static iRegExp *urlPattern_;
     static iRegExp *authPattern_;
     if (!urlPattern_) {
@@ -84,6 +74,116 @@ void init_Url(iUrl *d, const iString *text) {
     }
 }
 
+static iBool isSchemeChar_Url_(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '+' || c == '-' || c == '.';
+}
+
+static iBool isDigit_Url_(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static iBool isIPv6Char_Url_(char c) {
+    return isDigit_Url_(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') || c == ':';
+}
+
+static void initAuthority_Url_(iUrl *d, iRangecc auth) {
+    /* [userinfo "@"] host [":" port] */
+    for (const char *at = auth.start + 1; at < auth.end; at++) {
+        if (*at == '@' && at + 1 < auth.end) {
+            auth.start = at + 1;
+            break;
+        }
+    }
+    const char *pos = auth.start;
+    if (pos < auth.end && *pos == '[') {
+        const char *close = pos + 1;
+        while (close < auth.end && isIPv6Char_Url_(*close)) {
+            close++;
+        }
+        if (close < auth.end && *close == ']' && close > pos + 1) {
+            d->host = (iRangecc){ pos + 1, close }; /* without brackets */
+            pos = close + 1;
+        }
+    }
+    if (!d->host.start) {
+        while (pos < auth.end && *pos != ':' && *pos != '[' && *pos != ']') {
+            pos++;
+        }
+        d->host = (iRangecc){ auth.start, pos };
+    }
+    d->port = (iRangecc){ pos, pos };
+    if (pos + 1 < auth.end && *pos == ':' && isDigit_Url_(pos[1])) {
+        const char *digits = ++pos;
+        while (pos < auth.end && isDigit_Url_(*pos)) {
+            pos++;
+        }
+        d->port = (iRangecc){ digits, pos };
+    }
+}
+
+void init_Url(iUrl *d, const iString *text) {
+    if (!text) {
+        iZap(*d);
+        return;
+    }
+    /* Handle "file:" as a special case since it only has the path part. */
+    if (startsWithCase_String(text, "file://")) {
+        iZap(*d);
+        const char *cstr = constBegin_String(text);
+        d->scheme = (iRangecc){ cstr, cstr + 4 };
+        d->path   = (iRangecc){ cstr + 7, constEnd_String(text) };
+        return;
+    }
+    /* Split the URL into components in a single pass, as per RFC 3986:
+       [scheme ":"] ["//" authority] path ["?" query] ["#" fragment]
+       Missing components are empty ranges located where they would be. */
+    iZap(*d);
+    const char *pos = constBegin_String(text);
+    const char *end = constEnd_String(text);
+    const char *mark = pos;
+    while (mark < end && isSchemeChar_Url_(*mark)) {
+        mark++;
+    }
+    if (mark > pos && mark < end && *mark == ':') {
+        d->scheme = (iRangecc){ pos, mark };
+        pos = mark + 1;
+    }
+    else {
+        d->scheme = (iRangecc){ pos, pos };
+    }
+    if (end - pos >= 2 && pos[0] == '/' && pos[1] == '/') {
+        pos += 2;
+        mark = pos;
+        while (pos < end && *pos != '/' && *pos != '?' && *pos != '#') {
+            pos++;
+        }
+        initAuthority_Url_(d, (iRangecc){ mark, pos });
+    }
+    else {
+        d->host = d->port = (iRangecc){ pos, pos };
+    }
+    mark = pos;
+    while (pos < end && *pos != '?' && *pos != '#') {
+        pos++;
+    }
+    d->path = (iRangecc){ mark, pos };
+    mark = pos;
+    if (pos < end && *pos == '?') {
+        while (pos < end && *pos != '#') {
+            pos++;
+        }
+    }
+    d->query = (iRangecc){ mark, pos }; /* starts with a question mark */
+    mark = pos;
+    if (pos < end && *pos == '#') {
+        while (pos < end && *pos != '\n') {
+            pos++;
+        }
+    }
+    d->fragment = (iRangecc){ mark, pos }; /* starts with a hash */
+}
+
 uint16_t port_Url(const iUrl *d) {
     uint16_t port = 0;
     if (!isEmpty_Range(&d->port)) {
@@ -932,3 +1032,91 @@ const iGmError *get_GmError(enum iGmStatusCode code) {
     return &errors_[0].err; /* unknown */
 }
 
+
+static iBool isEqualRange_Url_(iRangecc a, iRangecc b) {
+    /* Missing components may be located differently, so only the contents are compared. */
+    return size_Range(&a) == size_Range(&b) && memcmp(a.start, b.start, size_Range(&a)) == 0;
+}
+
+static iBool isEqual_Url_(const iUrl *a, const iUrl *b) {
+    return isEqualRange_Url_(a->scheme, b->scheme) && isEqualRange_Url_(a->host, b->host) &&
+           isEqualRange_Url_(a->port, b->port) && isEqualRange_Url_(a->path, b->path) &&
+           isEqualRange_Url_(a->query, b->query) && isEqualRange_Url_(a->fragment, b->fragment);
+}
+
+const iString *benchmark_Url(void) {
+    static const char *corpus_[] = {
+        "gemini://gemini.circumlunar.space/",
+        "gemini://gemini.circumlunar.space/docs/specification.gmi",
+        "gemini://skyjake.fi/lagrange/",
+        "gemini://skyjake.fi:1965/gemlog/2021-08_lagrange-1.6.gmi",
+        "gemini://geminispace.info/search?lagrange%20browser",
+        "gemini://station.martinrue.com/skyjake/7c3c5b9b3b6b4d1f9c3a2c5f6e2d1a0b",
+        "gemini://user@example.com:1966/path/to/page.gmi?query=1#section-2",
+        "gemini://[2001:db8::1]:1965/ipv6.gmi",
+        "gemini://[::1]/",
+        "gemini://xn--bcher-kva.example/b%C3%BCcher.gmi",
+        "gemini://example.com/a/b/c/d/e/f/g/h/index.gmi",
+        "gemini://example.com",
+        "titan://example.com/upload.gmi;size=1024;mime=text/gemini;token=secret",
+        "spartan://mozz.us/",
+        "gopher://gopher.floodgap.com/",
+        "gopher://gopher.floodgap.com:70/1/world",
+        "gopher://gopher.floodgap.com/7/v2/vs%09lagrange",
+        "gopher://sdf.org/0/users/example/phlog/2021-01-01.txt",
+        "finger://example.com/user",
+        "https://github.com/skyjake/lagrange/releases",
+        "mailto:someone@example.com",
+        "data:text/plain;base64,SGVsbG8sIHdvcmxkIQ==",
+        "about:debug",
+        "/docs/faq.gmi",
+        "../gemlog/",
+        "atom.xml",
+        "?search%20terms",
+        "#fragment",
+        "//example.org/protocol-relative.gmi",
+    };
+    const int numRounds = 20000;
+    iString  *msg       = collectNew_String();
+    iString   urls[iElemCount(corpus_)];
+    uint64_t  times[2];
+    size_t    numMismatches = 0;
+    iForIndices(i, corpus_) {
+        initCStr_String(&urls[i], corpus_[i]);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        iPerfTimer timer;
+        init_PerfTimer(&timer);
+        for (int round = 0; round < numRounds; round++) {
+            iForIndices(i, urls) {
+                iUrl parts;
+                if (pass == 0) {
+                    init_Url(&parts, &urls[i]);
+                }
+                else {
+                    initRegExp_Url_(&parts, &urls[i]);
+                }
+            }
+        }
+        times[pass] = elapsedMicroseconds_PerfTimer(&timer);
+    }
+    appendFormat_String(msg, "# URL parsing benchmark\n");
+    appendFormat_String(msg, "URLs: %zu, rounds: %d\n", iElemCount(urls), numRounds);
+    appendFormat_String(msg, "* Single-pass parser: %.1f ms\n", times[0] / 1.0e3);
+    appendFormat_String(msg, "* Regular expressions: %.1f ms\n", times[1] / 1.0e3);
+    appendFormat_String(msg, "## Mismatches\n");
+    iForIndices(i, urls) {
+        iUrl a, b;
+        init_Url(&a, &urls[i]);
+        initRegExp_Url_(&b, &urls[i]);
+        if (!isEqual_Url_(&a, &b)) {
+            appendFormat_String(msg, "* %s\n", cstr_String(&urls[i]));
+            numMismatches++;
+        }
+        deinit_String(&urls[i]);
+    }
+    if (numMismatches == 0) {
+        appendFormat_String(msg, "None.\n");
+    }
+    return msg;
+}
@@ -116,6 +116,7 @@ struct Impl_Url {
 
 void            init_Url                (iUrl *, const iString *text);
 uint16_t        port_Url                (const iUrl *);
+const iString * benchmark_Url           (void); /* for debugging */
 
 iRangecc        urlScheme_String        (const iString *);
 iRangecc        urlHost_String          (const iString *);
@@ -21,6 +21,8 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "history.h"
+#include "diskcache.h"
+#include "pageindex.h"
 #include "ui/root.h"
 #include "app.h"
 
@@ -32,19 +34,110 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 static const size_t maxStack_History_ = 50; /* back/forward navigable items */
 
+static iBool isBodyLoaded_RecentUrl_(const iRecentUrl *d) {
+    return !isEmpty_Block(&d->cachedResponse->body) || isEmpty_String(&d->cachedBodyKey);
+}
+
+size_t cacheSize_RecentUrl(const iRecentUrl *d) {
+    size_t size = 0;
+    if (d->cachedResponse) {
+        size += size_String(&d->cachedResponse->meta);
+        size += isBodyLoaded_RecentUrl_(d) ? size_Block(&d->cachedResponse->body)
+                                           : d->cachedBodySize;
+    }
+    return size;    
+}
+
+/* Cached responses of all histories are tracked in one process-wide registry. The total
+   size is kept up to date as responses are added and forgotten, so checking it against
+   the limit does not require walking through every tab. */
+
+struct Impl_CacheEntry {
+    iHistory *         owner;
+    const iGmResponse *response;
+    iString            url;
+    size_t             size;
+    size_t             index; /* position in the registry */
+};
+
+iDeclareType(CacheRegistry)
+
+struct Impl_CacheRegistry {
+    iMutex *  mtx;
+    iPtrArray entries;
+    iPtrArray histories;
+    size_t    totalSize;
+    size_t    numHits;      /* revisits with a cached response */
+    size_t    numMisses;    /* revisits that had to be fetched again */
+    size_t    numDiskLoads; /* hits whose body was read from the disk cache */
+};
+
+static iCacheRegistry *cacheRegistry_(void) {
+    static iCacheRegistry reg_;
+    if (!reg_.mtx) {
+        reg_.mtx = new_Mutex();
+        init_PtrArray(&reg_.entries);
+        init_PtrArray(&reg_.histories);
+    }
+    return &reg_;
+}
+
+static void addCacheEntry_RecentUrl_(iRecentUrl *d, iHistory *owner) {
+    iAssert(!d->cacheEntry);
+    if (!d->cachedResponse) {
+        return;
+    }
+    iCacheRegistry *reg   = cacheRegistry_();
+    iCacheEntry *   entry = malloc(sizeof(iCacheEntry));
+    entry->owner    = owner;
+    entry->response = d->cachedResponse;
+    initCopy_String(&entry->url, &d->url);
+    entry->size = cacheSize_RecentUrl(d);
+    lock_Mutex(reg->mtx);
+    entry->index = size_PtrArray(&reg->entries);
+    pushBack_PtrArray(&reg->entries, entry);
+    reg->totalSize += entry->size;
+    unlock_Mutex(reg->mtx);
+    d->cacheEntry = entry;
+}
+
+static void removeCacheEntry_RecentUrl_(iRecentUrl *d) {
+    iCacheEntry *entry = d->cacheEntry;
+    if (!entry) {
+        return;
+    }
+    iCacheRegistry *reg = cacheRegistry_();
+    lock_Mutex(reg->mtx);
+    /* Swap with the last entry to keep removal O(1). */
+    iCacheEntry *last = at_PtrArray(&reg->entries, size_PtrArray(&reg->entries) - 1);
+    set_Array(&reg->entries, entry->index, &last);
+    last->index = entry->index;
+    popBack_Array(&reg->entries);
+    reg->totalSize -= entry->size;
+    unlock_Mutex(reg->mtx);
+    deinit_String(&entry->url);
+    free(entry);
+    d->cacheEntry = NULL;
+}
+
 void init_RecentUrl(iRecentUrl *d) {
     init_String(&d->url);
     d->normScrollY    = 0;
     d->cachedResponse = NULL;
+    init_String(&d->cachedBodyKey);
+    d->cachedBodySize = 0;
+    d->cacheEntry     = NULL;
     d->cachedDoc      = NULL;
     d->flags          = 0;
     init_Block(&d->setIdentity, 0);
 }
 
 void deinit_RecentUrl(iRecentUrl *d) {
+    removeCacheEntry_RecentUrl_(d);
     iRelease(d->cachedDoc);
     deinit_String(&d->url);
     delete_GmResponse(d->cachedResponse);
+    deinit_String(&d->cachedBodyKey);
     deinit_Block(&d->setIdentity);
 }
 
@@ -55,23 +148,49 @@ iRecentUrl *copy_RecentUrl(const iRecentUrl *d) {
     set_String(&copy->url, &d->url);
     copy->normScrollY    = d->normScrollY;
     copy->cachedResponse = d->cachedResponse ? copy_GmResponse(d->cachedResponse) : NULL;
+    set_String(&copy->cachedBodyKey, &d->cachedBodyKey);
+    copy->cachedBodySize = d->cachedBodySize;
     copy->cachedDoc      = ref_Object(d->cachedDoc);
     copy->flags          = d->flags;
     set_Block(&copy->setIdentity, &d->setIdentity);
     return copy;
 }
 
-size_t cacheSize_RecentUrl(const iRecentUrl *d) {
+static void forgetCachedResponse_RecentUrl_(iRecentUrl *d) {
+    removeCacheEntry_RecentUrl_(d);
+    delete_GmResponse(d->cachedResponse);
+    d->cachedResponse = NULL;
+    clear_String(&d->cachedBodyKey);
+    d->cachedBodySize = 0;
+}
+
+iBool loadCachedResponse_RecentUrl(iRecentUrl *d) {
+    iCacheRegistry *reg = cacheRegistry_();
+    if (d->cachedResponse && !isBodyLoaded_RecentUrl_(d)) {
+        if (load_DiskCache(&d->cachedBodyKey, d->cachedBodySize, &d->cachedResponse->body)) {
+            iGuardMutex(reg->mtx, reg->numDiskLoads++);
+        }
+        else {
+            forgetCachedResponse_RecentUrl_(d); /* will have to be fetched again */
+        }
+    }
+    iGuardMutex(reg->mtx, {
+        if (d->cachedResponse) {
+            reg->numHits++;
+        }
+        else {
+            reg->numMisses++;
+        }
+    });
+    return d->cachedResponse != NULL;
+}
+
+size_t memorySize_RecentUrl(const iRecentUrl *d) {
     size_t size = 0;
     if (d->cachedResponse) {
         size += size_String(&d->cachedResponse->meta);
         size += size_Block(&d->cachedResponse->body);
     }
-    return size;    
-}
-
-size_t memorySize_RecentUrl(const iRecentUrl *d) {
-    size_t size = cacheSize_RecentUrl(d);
     if (d->cachedDoc) {
         size += memorySize_GmDocument(d->cachedDoc);
     }
@@ -92,9 +211,13 @@ void init_History(iHistory *d) {
     d->mtx = new_Mutex();
     init_Array(&d->recent, sizeof(iRecentUrl));
     d->recentPos = 0;
+    iCacheRegistry *reg = cacheRegistry_();
+    iGuardMutex(reg->mtx, pushBack_PtrArray(&reg->histories, d));
 }
 
 void deinit_History(iHistory *d) {
+    iCacheRegistry *reg = cacheRegistry_();
+    iGuardMutex(reg->mtx, removeOne_PtrArray(&reg->histories, d));
     iGuardMutex(d->mtx, {
         clear_History(d);
         deinit_Array(&d->recent);
@@ -106,7 +229,10 @@ iHistory *copy_History(const iHistory *d) {
     lock_Mutex(d->mtx);
     iHistory *copy = new_History();
     iConstForEach(Array, i, &d->recent) {
-        pushBack_Array(&copy->recent, copy_RecentUrl(i.value));
+        iRecentUrl *item = copy_RecentUrl(i.value);
+        pushBack_Array(&copy->recent, item);
+        free(item); /* contents were moved to the array */
+        addCacheEntry_RecentUrl_(back_Array(&copy->recent), copy);
     }
     copy->recentPos = d->recentPos;
     unlock_Mutex(d->mtx);
@@ -187,7 +313,18 @@ void serialize_History(const iHistory *d, iStream *outs) {
         writeU16_Stream(outs, item->flags);
         if (item->cachedResponse) {
             write8_Stream(outs, 1);
-            serialize_GmResponse(item->cachedResponse, outs);
+            serializeWithoutBody_GmResponse(item->cachedResponse, outs);
+            if (isEmpty_String(&item->cachedBodyKey) &&
+                !isEmpty_Block(&item->cachedResponse->body)) {
+                /* The key is remembered so the body is written only once. */
+                iRecentUrl *mutItem = (iRecentUrl *) item;
+                set_String(&mutItem->cachedBodyKey,
+                           store_DiskCache(&item->cachedResponse->body));
+                mutItem->cachedBodySize = size_Block(&item->cachedResponse->body);
+            }
+            mark_DiskCache(&item->cachedBodyKey);
+            serialize_String(&item->cachedBodyKey, outs);
+            writeU64_Stream(outs, item->cachedBodySize);
         }
         else {
             write8_Stream(outs, 0);
@@ -213,11 +350,19 @@ void deserialize_History(iHistory *d, iStream *ins) {
         }
         if (read8_Stream(ins)) {
             item.cachedResponse = new_GmResponse();
-            deserialize_GmResponse(item.cachedResponse, ins);
+            if (version_Stream(ins) >= externalResponseBodies_FileVersion) {
+                deserializeWithoutBody_GmResponse(item.cachedResponse, ins);
+                deserialize_String(&item.cachedBodyKey, ins);
+                item.cachedBodySize = readU64_Stream(ins);
+            }
+            else {
+                deserialize_GmResponse(item.cachedResponse, ins);
+            }
         }
         if (version_Stream(ins) >= recentUrlSetIdentity_FileVersion) {
             deserialize_Block(&item.setIdentity, ins);
         }
+        addCacheEntry_RecentUrl_(&item, d);
         pushBack_Array(&d->recent, &item);
     }
     unlock_Mutex(d->mtx);
@@ -295,7 +440,7 @@ void add_History(iHistory *d, const iString *url) {
     lock_Mutex(d->mtx);
     /* Cut the trailing history items. */
     if (d->recentPos > 0) {
-        for (size_t i = 0; i < d->recentPos - 1; i++) {
+        for (size_t i = 0; i < d->recentPos; i++) {
             deinit_RecentUrl(recentUrl_History(d, i));
         }
         removeN_Array(&d->recent, size_Array(&d->recent) - d->recentPos, iInvalidSize);
@@ -425,16 +570,22 @@ void setIdentity_History(iHistory *d, const iBlock *identityFingerprint) {
 }
 
 void setCachedResponse_History(iHistory *d, const iGmResponse *response) {
+    iString *indexUrl = NULL;
     lock_Mutex(d->mtx);
     iRecentUrl *item = mostRecentUrl_History(d);
     if (item) {
-        delete_GmResponse(item->cachedResponse);
-        item->cachedResponse = NULL;
+        forgetCachedResponse_RecentUrl_(item);
         if (category_GmStatusCode(response->statusCode) == categorySuccess_GmStatusCode) {
             item->cachedResponse = copy_GmResponse(response);
+            addCacheEntry_RecentUrl_(item, d);
+            indexUrl = copy_String(&item->url);
         }
     }
     unlock_Mutex(d->mtx);
+    if (indexUrl) {
+        add_PageIndex(pageIndex_App(), indexUrl, response);
+        delete_String(indexUrl);
+    }
 }
 
 void setCachedDocument_History(iHistory *d, iGmDocument *doc) {
@@ -483,10 +634,7 @@ void clearCache_History(iHistory *d) {
     lock_Mutex(d->mtx);
     iForEach(Array, i, &d->recent) {
         iRecentUrl *url = i.value;
-        if (url->cachedResponse) {
-            delete_GmResponse(url->cachedResponse);
-            url->cachedResponse = NULL;
-        }
+        forgetCachedResponse_RecentUrl_(url);
         iReleasePtr(&url->cachedDoc); /* release all cached documents and media as well */
     }
     unlock_Mutex(d->mtx);
@@ -503,68 +651,176 @@ void invalidateCachedLayout_History(iHistory *d) {
     unlock_Mutex(d->mtx);
 }
 
-size_t pruneLeastImportant_History(iHistory *d) {
-    size_t delta  = 0;
-    size_t chosen = iInvalidPos;
-    double score  = 0.0f;
+iDeclareType(CacheCandidate)
+
+struct Impl_CacheCandidate {
+    double             score;
+    iHistory *         owner;
+    const iCacheEntry *entry; /* when trimming cached responses */
+    const iGmDocument *doc;   /* when trimming cached documents */
+    size_t             size;
+};
+
+static int cmpScoreDescending_CacheCandidate_(const void *a, const void *b) {
+    const iCacheCandidate *x = a, *y = b;
+    return x->score < y->score ? 1 : x->score > y->score ? -1 : 0;
+}
+
+static double ageFactor_GmResponse_(const iGmResponse *d, const iTime *now) {
+    return d ? pow(secondsSince_Time(now, &d->when) / 60.0, 1.25) : 1.0;
+}
+
+size_t trimCache_History(size_t limit) {
+    iCacheRegistry *reg = cacheRegistry_();
+    size_t evicted = 0;
+    lock_Mutex(reg->mtx);
+    if (reg->totalSize <= limit) {
+        unlock_Mutex(reg->mtx);
+        return 0;
+    }
+    /* Scores depend on the current time, so they are ranked only when something needs
+       to be evicted. Large and old responses go first regardless of which tab has them. */
     iTime now;
     initCurrent_Time(&now);
-    lock_Mutex(d->mtx);
-    iConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        if (url->cachedResponse) {
-            const double urlScore =
-                cacheSize_RecentUrl(url) *
-                pow(secondsSince_Time(&now, &url->cachedResponse->when) / 60.0, 1.25);
-            if (urlScore > score) {
-                chosen = index_ArrayConstIterator(&i);
-                score  = urlScore;
+    iArray candidates;
+    init_Array(&candidates, sizeof(iCacheCandidate));
+    iConstForEach(PtrArray, i, &reg->entries) {
+        const iCacheEntry *entry = i.ptr;
+        pushBack_Array(&candidates,
+                       &(iCacheCandidate){
+                           .score = entry->size * ageFactor_GmResponse_(entry->response, &now),
+                           .owner = entry->owner,
+                           .entry = entry });
+    }
+    unlock_Mutex(reg->mtx);
+    sort_Array(&candidates, cmpScoreDescending_CacheCandidate_);
+    iConstForEach(Array, i, &candidates) {
+        iBool isUnderLimit;
+        iGuardMutex(reg->mtx, isUnderLimit = (reg->totalSize <= limit));
+        if (isUnderLimit) {
+            break;
+        }
+        const iCacheCandidate *cand = i.value;
+        lock_Mutex(cand->owner->mtx);
+        iForEach(Array, j, &cand->owner->recent) {
+            iRecentUrl *url = j.value;
+            if (url->cacheEntry == cand->entry) {
+                evicted += cand->entry->size;
+                forgetCachedResponse_RecentUrl_(url);
+                iReleasePtr(&url->cachedDoc);
+                break;
             }
         }
+        unlock_Mutex(cand->owner->mtx);
     }
-    if (chosen != iInvalidPos) {
-        iRecentUrl *url = at_Array(&d->recent, chosen);
-        delta = cacheSize_RecentUrl(url);
-        delete_GmResponse(url->cachedResponse);
-        url->cachedResponse = NULL;
-        iReleasePtr(&url->cachedDoc);
-    }
-    unlock_Mutex(d->mtx);
-    return delta;
+    deinit_Array(&candidates);
+    return evicted;
 }
 
-size_t pruneLeastImportantMemory_History(iHistory *d) {
-    size_t delta  = 0;
-    size_t chosen = iInvalidPos;
-    double score  = 0.0f;
-    iTime now;
+size_t trimMemory_History(size_t limit) {
+    iCacheRegistry *reg = cacheRegistry_();
+    size_t total   = 0;
+    size_t evicted = 0;
+    iTime  now;
     initCurrent_Time(&now);
-    lock_Mutex(d->mtx);
-    iConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        if (d->recentPos == size_Array(&d->recent) - index_ArrayConstIterator(&i) - 1) {
-            continue; /* Not the current navigation position. */
+    iArray candidates;
+    init_Array(&candidates, sizeof(iCacheCandidate));
+    lock_Mutex(reg->mtx);
+    iPtrArray *histories = copy_PtrArray(&reg->histories);
+    unlock_Mutex(reg->mtx);
+    iConstForEach(PtrArray, h, histories) {
+        iHistory *d = h.ptr;
+        lock_Mutex(d->mtx);
+        iConstForEach(Array, i, &d->recent) {
+            const iRecentUrl *url = i.value;
+            total += memorySize_RecentUrl(url);
+            if (d->recentPos == size_Array(&d->recent) - index_ArrayConstIterator(&i) - 1) {
+                continue; /* Not the current navigation position. */
+            }
+            if (url->cachedDoc) {
+                pushBack_Array(&candidates,
+                               &(iCacheCandidate){
+                                   .score = memorySize_RecentUrl(url) *
+                                            ageFactor_GmResponse_(url->cachedResponse, &now),
+                                   .owner = d,
+                                   .doc   = url->cachedDoc,
+                                   .size  = memorySize_GmDocument(url->cachedDoc) });
+            }
         }
-        if (url->cachedDoc) {
-            const double urlScore =
-                memorySize_RecentUrl(url) *
-                (url->cachedResponse
-                     ? pow(secondsSince_Time(&now, &url->cachedResponse->when) / 60.0, 1.25)
-                     : 1.0);
-            if (urlScore > score) {
-                chosen = index_ArrayConstIterator(&i);
-                score  = urlScore;
+        unlock_Mutex(d->mtx);
+    }
+    delete_PtrArray(histories);
+    if (total > limit) {
+        sort_Array(&candidates, cmpScoreDescending_CacheCandidate_);
+        iConstForEach(Array, i, &candidates) {
+            if (total - evicted <= limit) {
+                break;
             }
+            const iCacheCandidate *cand = i.value;
+            lock_Mutex(cand->owner->mtx);
+            iForEach(Array, j, &cand->owner->recent) {
+                iRecentUrl *url = j.value;
+                if (url->cachedDoc == cand->doc) {
+                    iReleasePtr(&url->cachedDoc);
+                    evicted += cand->size;
+                    break;
+                }
+            }
+            unlock_Mutex(cand->owner->mtx);
         }
     }
-    if (chosen != iInvalidPos) {
-        iRecentUrl *url = at_Array(&d->recent, chosen);
-        const size_t before = memorySize_RecentUrl(url);
-        iReleasePtr(&url->cachedDoc);
-        delta = before - memorySize_RecentUrl(url);
+    deinit_Array(&candidates);
+    return evicted;
+}
+
+static int cmpSizeDescending_CacheEntryPtr_(const void *a, const void *b) {
+    const iCacheEntry *x = *(const void **) a, *y = *(const void **) b;
+    return -iCmp(x->size, y->size);
+}
+
+const iString *cacheInfo_History(size_t limit) {
+    iCacheRegistry *reg = cacheRegistry_();
+    iString *       str = collectNew_String();
+    iTime           now;
+    initCurrent_Time(&now);
+    lock_Mutex(reg->mtx);
+    const size_t revisits = reg->numHits + reg->numMisses;
+    format_String(str,
+                  "# Response cache\n"
+                  "* Cached responses: %zu in %zu tabs\n"
+                  "* Total size: %.1f MB (limit: %.1f MB)\n"
+                  "* Revisits: %zu\n"
+                  "* Hit rate: %.1f%% (%zu hits, %zu read from disk)\n",
+                  size_PtrArray(&reg->entries),
+                  size_PtrArray(&reg->histories),
+                  reg->totalSize / 1.0e6,
+                  limit / 1.0e6,
+                  revisits,
+                  revisits ? 100.0 * reg->numHits / revisits : 0.0,
+                  reg->numHits,
+                  reg->numDiskLoads);
+    iPtrArray *sorted = copy_PtrArray(&reg->entries);
+    sort_Array(sorted, cmpSizeDescending_CacheEntryPtr_);
+    appendCStr_String(str,
+                      "\n## Largest entries\n"
+                      "```\n"
+                      "      Size     Age  URL\n");
+    size_t count = 0;
+    iConstForEach(PtrArray, i, sorted) {
+        if (count++ == 20) {
+            break;
+        }
+        const iCacheEntry *entry = i.ptr;
+        appendFormat_String(str,
+                            "%10zu %6.0fm  %s\n",
+                            entry->size,
+                            secondsSince_Time(&now, &entry->response->when) / 60.0,
+                            cstr_String(&entry->url));
     }
-    unlock_Mutex(d->mtx);
-    return delta;
+    appendCStr_String(str, "```\n");
+    delete_PtrArray(sorted);
+    unlock_Mutex(reg->mtx);
+    return str;
 }
 
 void invalidateTheme_History(iHistory *d) {
@@ -578,53 +834,3 @@ void invalidateTheme_History(iHistory *d) {
     unlock_Mutex(d->mtx);
 }
 
-const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pattern) {
-    iStringArray *urls = iClob(new_StringArray());
-    lock_Mutex(d->mtx);
-    iStringSet inserted;
-    init_StringSet(&inserted);
-    iReverseConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        const iGmResponse *resp = url->cachedResponse;
-        if (resp && category_GmStatusCode(resp->statusCode) == categorySuccess_GmStatusCode) {
-            if (indexOfCStrSc_String(&resp->meta, "text/", &iCaseInsensitive) == iInvalidPos) {
-                continue;
-            }
-            iRegExpMatch m;
-            init_RegExpMatch(&m);
-            if (matchRange_RegExp(pattern, range_Block(&resp->body), &m)) {
-                iString entry;
-                init_String(&entry);
-                iRangei cap = m.range;
-                const int prefix = iMin(10, cap.start);
-                cap.start   = cap.start - prefix;
-                cap.end     = iMin(cap.end + 30, (int) size_Block(&resp->body));
-                const size_t maxLen = 60;
-                if (size_Range(&cap) > maxLen) {
-                    cap.end = cap.start + maxLen;
-                }
-                iString content;
-                initRange_String(&content, (iRangecc){ m.subject + cap.start, m.subject + cap.end });
-                /* This needs cleaning up; highlight the matched word. */
-                replace_Block(&content.chars, '\n', ' ');
-                replace_Block(&content.chars, '\r', ' ');
-                if (prefix + size_Range(&m.range) < size_String(&content)) {
-                    insertData_Block(&content.chars, prefix + size_Range(&m.range), uiText_ColorEscape, 2);
-                }
-                insertData_Block(&content.chars, prefix, uiTextStrong_ColorEscape, 2);
-                format_String(
-                    &entry, "match len:%zu str:%s", size_String(&content), cstr_String(&content));
-                deinit_String(&content);
-                appendFormat_String(&entry, " url:%s", cstr_String(&url->url));
-                if (!contains_StringSet(&inserted, &url->url)) {
-                    pushFront_StringArray(urls, &entry);
-                    insert_StringSet(&inserted, &url->url);
-                }
-                deinit_String(&entry);
-            }
-        }
-    }
-    deinit_StringSet(&inserted);
-    unlock_Mutex(d->mtx);
-    return urls;
-}
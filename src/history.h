@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/stringarray.h>
 #include <the_Foundation/time.h>
 
+iDeclareType(CacheEntry)
 iDeclareType(RecentUrl)
 iDeclareTypeConstruction(RecentUrl)
     
@@ -38,11 +39,16 @@ struct Impl_RecentUrl {
     iString      url;
     float        normScrollY;    /* normalized to document height */
     iGmResponse *cachedResponse; /* kept in memory for quicker back navigation */
+    iString      cachedBodyKey;  /* response body in the disk cache; body is loaded on demand */
+    size_t       cachedBodySize;
+    iCacheEntry *cacheEntry;     /* registered in the global cache accounting */
     iGmDocument *cachedDoc;      /* cached copy of the presentation: layout and media (not serialized) */
     iBlock       setIdentity;    /* fingerprint of identity that was pinned*/
     uint16_t     flags;
 };
 
+iBool   loadCachedResponse_RecentUrl    (iRecentUrl *); /* false if there is none */
+
 iDeclareType(MemInfo)
 
 struct Impl_MemInfo {
@@ -75,15 +81,12 @@ iRecentUrl *mostRecentUrl_History       (iHistory *);
 //iRecentUrl *findUrl_History             (iHistory *, const iString *url, int timeDir);
 
 void        clearCache_History                  (iHistory *);
-size_t      pruneLeastImportant_History         (iHistory *);
-size_t      pruneLeastImportantMemory_History   (iHistory *);
 void        invalidateTheme_History             (iHistory *); /* theme has changed, cached contents need updating */
 void        invalidateCachedLayout_History      (iHistory *);
 
 iBool       atNewest_History            (const iHistory *);
 iBool       atOldest_History            (const iHistory *);
 
-const iStringArray *   searchContents_History   (const iHistory *, const iRegExp *pattern); /* chronologically ascending */
 
 const iString *
             url_History                 (const iHistory *, size_t pos);
@@ -98,3 +101,9 @@ size_t      memorySize_History          (const iHistory *);
 
 iString *   debugInfo_History           (const iHistory *);
 iMemInfo    memoryUsage_History         (const iHistory *);
+
+/* Global limits apply to all histories together. Returns the number of bytes released. */
+size_t      trimCache_History           (size_t limit);
+size_t      trimMemory_History          (size_t limit);
+const iString *
+            cacheInfo_History           (size_t limit); /* debug page */
@@ -86,54 +86,49 @@ static void clear_Lang_(iLang *d) {
 }
 
 static void load_Lang_(iLang *d, const char *id) {
-    /* Load compiled language strings from a resource blob. */
-    /* TODO: How about an array for these? (id, blob, pluralType) */
-    iUnused(id);
-    const iBlock *data = equal_CStr(id, "fi")      ? &blobFi_Resources
-                       : equal_CStr(id, "fr")      ? &blobFr_Resources
-                       : equal_CStr(id, "cs")      ? &blobCs_Resources
-                       : equal_CStr(id, "ru")      ? &blobRu_Resources
-                       : equal_CStr(id, "eo")      ? &blobEo_Resources
-                       : equal_CStr(id, "es")      ? &blobEs_Resources
-                       : equal_CStr(id, "es_MX")   ? &blobEs_MX_Resources
-                       : equal_CStr(id, "eu")      ? &blobEu_Resources
-                       : equal_CStr(id, "de")      ? &blobDe_Resources
-                       : equal_CStr(id, "gl")      ? &blobGl_Resources
-                       : equal_CStr(id, "hu")      ? &blobHu_Resources
-                       : equal_CStr(id, "ia")      ? &blobIa_Resources
-                       : equal_CStr(id, "ie")      ? &blobIe_Resources
-                       : equal_CStr(id, "isv")     ? &blobIsv_Resources
-                       : equal_CStr(id, "ja")      ? &blobJa_Resources
-                       : equal_CStr(id, "it")      ? &blobIt_Resources
-                       : equal_CStr(id, "nl")      ? &blobNl_Resources
-                       : equal_CStr(id, "pl")      ? &blobPl_Resources
-                       : equal_CStr(id, "sk")      ? &blobSk_Resources
-                       : equal_CStr(id, "sr")      ? &blobSr_Resources
-                       : equal_CStr(id, "tok")     ? &blobTok_Resources
-                       : equal_CStr(id, "tr")      ? &blobTr_Resources
-                       : equal_CStr(id, "uk")      ? &blobUk_Resources
-                       : equal_CStr(id, "zh_Hans") ? &blobZh_Hans_Resources
-                       : equal_CStr(id, "zh_Hant") ? &blobZh_Hant_Resources
-                                                   : &blobEn_Resources;
-    if (data == &blobRu_Resources || data == &blobSr_Resources || data == &blobUk_Resources) {
-        d->pluralType = slavic_PluralType;
-    }
-    else if (data == &blobIsv_Resources) {
-        d->pluralType = oneTwoMany_PluralType;
-    }
-    else if (data == &blobCs_Resources || data == &blobSk_Resources) {
-        d->pluralType = oneFewMany_PluralType;
-    }
-    else if (data == &blobPl_Resources) {
-        d->pluralType = polish_PluralType;
-    }
-    else if (data == &blobZh_Hans_Resources || data == &blobZh_Hant_Resources ||
-             data == &blobTok_Resources || data == &blobJa_Resources) {
-        d->pluralType = none_PluralType;
-    }
-    else {
-        d->pluralType = notEqualToOne_PluralType;
+    /* Load compiled language strings from a resource blob. Only the selected language
+       gets extracted from the resource archive. */
+    static const struct {
+        const char *     id;
+        enum iResourceId resource;
+        enum iPluralType pluralType;
+    } languages_[] = {
+        { "cs",      langCs_ResourceId,     oneFewMany_PluralType },
+        { "de",      langDe_ResourceId,     notEqualToOne_PluralType },
+        { "eo",      langEo_ResourceId,     notEqualToOne_PluralType },
+        { "es",      langEs_ResourceId,     notEqualToOne_PluralType },
+        { "es_MX",   langEsMX_ResourceId,   notEqualToOne_PluralType },
+        { "eu",      langEu_ResourceId,     notEqualToOne_PluralType },
+        { "fi",      langFi_ResourceId,     notEqualToOne_PluralType },
+        { "fr",      langFr_ResourceId,     notEqualToOne_PluralType },
+        { "gl",      langGl_ResourceId,     notEqualToOne_PluralType },
+        { "hu",      langHu_ResourceId,     notEqualToOne_PluralType },
+        { "ia",      langIa_ResourceId,     notEqualToOne_PluralType },
+        { "ie",      langIe_ResourceId,     notEqualToOne_PluralType },
+        { "isv",     langIsv_ResourceId,    oneTwoMany_PluralType },
+        { "it",      langIt_ResourceId,     notEqualToOne_PluralType },
+        { "ja",      langJa_ResourceId,     none_PluralType },
+        { "nl",      langNl_ResourceId,     notEqualToOne_PluralType },
+        { "pl",      langPl_ResourceId,     polish_PluralType },
+        { "ru",      langRu_ResourceId,     slavic_PluralType },
+        { "sk",      langSk_ResourceId,     oneFewMany_PluralType },
+        { "sr",      langSr_ResourceId,     slavic_PluralType },
+        { "tok",     langTok_ResourceId,    none_PluralType },
+        { "tr",      langTr_ResourceId,     notEqualToOne_PluralType },
+        { "uk",      langUk_ResourceId,     slavic_PluralType },
+        { "zh_Hans", langZhHans_ResourceId, none_PluralType },
+        { "zh_Hant", langZhHant_ResourceId, none_PluralType },
+    };
+    enum iResourceId resource = langEn_ResourceId;
+    d->pluralType = notEqualToOne_PluralType;
+    iForIndices(i, languages_) {
+        if (equal_CStr(id, languages_[i].id)) {
+            resource      = languages_[i].resource;
+            d->pluralType = languages_[i].pluralType;
+            break;
+        }
     }
+    const iBlock *data = blob_Resources(resource);
     iMsgStr msg;
     for (const char *ptr = constBegin_Block(data); ptr != constEnd_Block(data); ptr++) {
         msg.id.start = ptr;
@@ -25,18 +25,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "gmrequest.h"
 #include "ui/window.h"
 #include "ui/paint.h" /* size_SDLTexture */
+#include "ui/util.h" /* iPerfTimer */
 #include "audio/player.h"
 #include "app.h"
+#define STB_IMAGE_IMPLEMENTATION /* animations need the GIF decoder internals */
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include "stb_image.h"
 #include "stb_image_resize.h"
 
 #if defined (LAGRANGE_ENABLE_WEBP)
 #   include <webp/decode.h>
 #endif
+#if defined (LAGRANGE_ENABLE_WEBP_DEMUX)
+#   include <webp/demux.h>
+#endif
 
 #include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/stringlist.h>
+#include <the_Foundation/thread.h>
+#include <SDL_cpuinfo.h>
 #include <SDL_hints.h>
 #include <SDL_render.h>
 #include <SDL_timer.h>
@@ -65,30 +74,50 @@ static void deinit_GmMediaProps_(iGmMediaProps *d) {
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(GmImage)
+iDeclareType(ImageJob)
 
 struct Impl_GmImage {
     iGmMediaProps props;
-    iBlock        partialData; /* cleared when image is converted to texture */
+    iBlock        partialData;  /* cleared when image is handed over for decoding */
     iInt2         size;
     size_t        numBytes;
+    size_t        previewBytes; /* amount of partial data decoded so far */
+    iImageJob *   job;          /* decoding in progress; owned by the decoder queue */
     SDL_Texture * texture;
+    uint32_t      nextFrameTime;
 };
 
-void init_GmImage(iGmImage *d, const iBlock *data) {
-    init_GmMediaProps_(&d->props);
-    initCopy_Block(&d->partialData, data);
-    d->size     = zero_I2();
-    d->numBytes = 0;
-    d->texture  = NULL;
-}
+/*----------------------------------------------------------------------------------------------*/
 
-void deinit_GmImage(iGmImage *d) {
-    deinit_Block(&d->partialData);
-    SDL_DestroyTexture(d->texture);
-    deinit_GmMediaProps_(&d->props);
+iDeclareType(ImageStyleColors)
+
+/* Theme colors are looked up in the main thread before decoding begins. */
+struct Impl_ImageStyleColors {
+    iColor dark;
+    iColor light;
+    iColor colorize;
+};
+
+static iImageStyleColors imageStyleColors_(enum iImageStyle style) {
+    iImageStyleColors colors = { .colorize = { 255, 255, 255, 255 } };
+    if (style == bgFg_ImageStyle) {
+        colors.dark  = get_Color(tmBackground_ColorId);
+        colors.light = get_Color(tmParagraph_ColorId);
+        if (hsl_Color(colors.dark).lum > hsl_Color(colors.light).lum) {
+            iSwap(iColor, colors.dark, colors.light);
+        }
+    }
+    else if (style == textColorized_ImageStyle || style == preformatColorized_ImageStyle) {
+        colors.colorize = get_Color(style == textColorized_ImageStyle ? tmParagraph_ColorId
+                                                                      : tmPreformatted_ColorId);
+    }
+    return colors;
 }
 
-static void applyImageStyle_(enum iImageStyle style, iInt2 size, uint8_t *imgData) {
+/* Straightforward per-pixel version. Used as a reference for checking the output of the
+   table-based version below. */
+static void applyImageStyleScalar_(enum iImageStyle style, const iImageStyleColors *colors,
+                                   iInt2 size, uint8_t *imgData) {
     if (style == original_ImageStyle) {
         return;
     }
@@ -96,11 +125,8 @@ static void applyImageStyle_(enum iImageStyle style, iInt2 size, uint8_t *imgDat
     size_t   numPixels = size.x * size.y;
     float    brighten  = 0.0f;
     if (style == bgFg_ImageStyle) {
-        iColor dark  = get_Color(tmBackground_ColorId);
-        iColor light = get_Color(tmParagraph_ColorId);
-        if (hsl_Color(dark).lum > hsl_Color(light).lum) {
-            iSwap(iColor, dark, light);
-        }        
+        const iColor dark  = colors->dark;
+        const iColor light = colors->light;
         while (numPixels-- > 0) {
             iHSLColor hsl = hsl_Color((iColor){ pos[0], pos[1], pos[2], 255 });
             const float s = 1.0f - hsl.lum;
@@ -112,10 +138,8 @@ static void applyImageStyle_(enum iImageStyle style, iInt2 size, uint8_t *imgDat
         }        
         return;
     }
-    iColor colorize = (iColor){ 255, 255, 255, 255 };
+    const iColor colorize = colors->colorize;
     if (style != grayscale_ImageStyle) {
-        colorize = get_Color(style == textColorized_ImageStyle ? tmParagraph_ColorId
-                                                               : tmPreformatted_ColorId);
         /* Compensate for change in mid-tones. */
         const int colMax = iMax(iMax(colorize.r, colorize.g), colorize.b);
         brighten = iClamp(1.0f - (colorize.r + colorize.g + colorize.b) / (colMax * 3), 0.0f, 0.5f);
@@ -133,67 +157,738 @@ static void applyImageStyle_(enum iImageStyle style, iInt2 size, uint8_t *imgDat
     }
 }
 
-void makeTexture_GmImage(iGmImage *d) {
-    iBlock *data     = &d->partialData;
-    d->numBytes      = size_Block(data);
-    uint8_t *imgData = NULL;
-    if (cmp_String(&d->props.mime, "image/webp") == 0) {
+iDeclareType(ImageStyleTable)
+
+/* All image styles only depend on the luminance of the pixel, i.e., the largest and smallest
+   of its RGB components. The styled color of each (max, min) pair is computed once, when first
+   needed, so the per-pixel work is reduced to a table lookup. */
+struct Impl_ImageStyleTable {
+    enum iImageStyle  style;
+    iImageStyleColors colors;
+    iHSLColor         hslColorize;
+    float             lumExponent;
+    uint8_t           gamma[256];
+    uint32_t          rgb[256 * 256]; /* (max << 8 | min) => 0xffBBGGRR, or zero if not set */
+};
+
+static iImageStyleTable *new_ImageStyleTable_(enum iImageStyle style,
+                                              const iImageStyleColors *colors) {
+    iImageStyleTable *d = calloc(1, sizeof(iImageStyleTable));
+    d->style  = style;
+    d->colors = *colors;
+    if (style != bgFg_ImageStyle) {
+        const iColor colorize = colors->colorize;
+        float        brighten = 0.0f;
+        if (style != grayscale_ImageStyle) {
+            /* Compensate for change in mid-tones. */
+            const int colMax = iMax(iMax(colorize.r, colorize.g), colorize.b);
+            brighten = iClamp(1.0f - (colorize.r + colorize.g + colorize.b) / (colMax * 3), 0.0f, 0.5f);
+        }
+        d->hslColorize = hsl_Color(colorize);
+        d->lumExponent = 1.0f + brighten * 2;
+        for (int i = 0; i < 256; i++) {
+            d->gamma[i] = powf(i / 255.0f, 1.0f - brighten * 0.75f) * 255;
+        }
+    }
+    return d;
+}
+
+static uint32_t styledColor_ImageStyleTable_(iImageStyleTable *d, uint8_t compMax,
+                                             uint8_t compMin) {
+    uint32_t *styled = &d->rgb[compMax << 8 | compMin];
+    if (!*styled) {
+        const float lum = hsl_Color((iColor){ compMax, compMin, compMin, 255 }).lum;
+        uint8_t rgb[3];
+        if (d->style == bgFg_ImageStyle) {
+            const iColor dark  = d->colors.dark;
+            const iColor light = d->colors.light;
+            const float  s     = 1.0f - lum;
+            const float  t     = lum;
+            rgb[0] = dark.r * s + light.r * t;
+            rgb[1] = dark.g * s + light.g * t;
+            rgb[2] = dark.b * s + light.b * t;
+        }
+        else {
+            iHSLColor out = { d->hslColorize.hue, d->hslColorize.sat, lum, 1.0f };
+            out.lum = powf(out.lum, d->lumExponent);
+            const iColor outRgb = rgb_HSLColor(out);
+            rgb[0] = d->gamma[outRgb.r];
+            rgb[1] = d->gamma[outRgb.g];
+            rgb[2] = d->gamma[outRgb.b];
+        }
+        *styled = 0xff000000 | rgb[2] << 16 | rgb[1] << 8 | rgb[0];
+    }
+    return *styled;
+}
+
+static void applyImageStyle_(enum iImageStyle style, const iImageStyleColors *colors, iInt2 size,
+                             uint8_t *imgData) {
+    if (style == original_ImageStyle) {
+        return;
+    }
+    iImageStyleTable *table = new_ImageStyleTable_(style, colors);
+    uint8_t *         pos   = imgData;
+    for (size_t numPixels = (size_t) size.x * size.y; numPixels > 0; numPixels--, pos += 4) {
+        const uint8_t  compMax = iMax(iMax(pos[0], pos[1]), pos[2]);
+        const uint8_t  compMin = iMin(iMin(pos[0], pos[1]), pos[2]);
+        const uint32_t styled  = styledColor_ImageStyleTable_(table, compMax, compMin);
+        pos[0] = styled;
+        pos[1] = styled >> 8;
+        pos[2] = styled >> 16;
+    }
+    free(table);
+}
+
+const iString *benchmarkImageStyle_Media(void) {
+    static const char *styleNames_[] = {
+        "Original", "Grayscale", "Background/foreground", "Text colorized", "Preformat colorized"
+    };
+    const iInt2 size      = init_I2(2048, 1536);
+    const size_t numBytes = 4 * (size_t) size.x * size.y;
+    uint8_t *   source    = malloc(numBytes);
+    uint8_t *   expected  = malloc(numBytes);
+    uint8_t *   actual    = malloc(numBytes);
+    /* Gradients with some noise, so all kinds of colors are present. */ {
+        uint32_t seed = 1;
+        for (int y = 0; y < size.y; y++) {
+            for (int x = 0; x < size.x; x++) {
+                uint8_t *px = source + 4 * ((size_t) y * size.x + x);
+                seed = seed * 1103515245 + 12345;
+                px[0] = x * 255 / size.x;
+                px[1] = y * 255 / size.y;
+                px[2] = seed >> 24;
+                px[3] = 255;
+            }
+        }
+    }
+    iString *msg = collectNew_String();
+    appendFormat_String(msg, "# Image style benchmark\n");
+    appendFormat_String(msg, "Image size: %d x %d\n", size.x, size.y);
+    for (int style = grayscale_ImageStyle; style <= preformatColorized_ImageStyle; style++) {
+        const iImageStyleColors colors = imageStyleColors_(style);
+        uint64_t times[2];
+        iPerfTimer timer;
+        memcpy(expected, source, numBytes);
+        init_PerfTimer(&timer);
+        applyImageStyleScalar_(style, &colors, size, expected);
+        times[0] = elapsedMicroseconds_PerfTimer(&timer);
+        memcpy(actual, source, numBytes);
+        init_PerfTimer(&timer);
+        applyImageStyle_(style, &colors, size, actual);
+        times[1] = elapsedMicroseconds_PerfTimer(&timer);
+        size_t numDiffering = 0;
+        for (size_t i = 0; i < numBytes; i++) {
+            if (expected[i] != actual[i]) {
+                numDiffering++;
+            }
+        }
+        appendFormat_String(msg, "\n## %s\n", styleNames_[style]);
+        appendFormat_String(msg, "* Per-pixel: %.1f ms\n", times[0] / 1.0e3);
+        appendFormat_String(msg, "* Lookup table: %.1f ms\n", times[1] / 1.0e3);
+        appendFormat_String(msg,
+                            numDiffering ? "Output DIFFERS in %zu bytes.\n" : "Output matches.\n",
+                            numDiffering);
+    }
+    free(actual);
+    free(expected);
+    free(source);
+    return msg;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(FrameDecoder)
+
+/* Frames of an animation are decoded one at a time, only when they are needed. */
+struct Impl_FrameDecoder {
+    const iBlock *data;
+    iBool         isWebP;
+    int           index;     /* of the next frame */
+    iBool         hasLooped;
+    stbi__context gifContext;
+    stbi__gif     gif;
+    uint8_t *     gifPrevious[2]; /* outputs of the two previous frames, for disposal */
+#if defined (LAGRANGE_ENABLE_WEBP_DEMUX)
+    WebPAnimDecoder *webp;
+    int              webpTimestamp;
+#endif
+};
+
+static void rewind_FrameDecoder_(iFrameDecoder *d) {
+    if (d->isWebP) {
+#if defined (LAGRANGE_ENABLE_WEBP_DEMUX)
+        WebPAnimDecoderReset(d->webp);
+        d->webpTimestamp = 0;
+#endif
+    }
+    else {
+        STBI_FREE(d->gif.out);
+        STBI_FREE(d->gif.background);
+        STBI_FREE(d->gif.history);
+        iZap(d->gif);
+        stbi__start_mem(&d->gifContext, constData_Block(d->data), (int) size_Block(d->data));
+    }
+    d->index = 0;
+}
+
+static iFrameDecoder *new_FrameDecoder_(const iBlock *data, iBool isWebP) {
+    iFrameDecoder *d = calloc(1, sizeof(iFrameDecoder));
+    d->data   = data;
+    d->isWebP = isWebP;
+#if defined (LAGRANGE_ENABLE_WEBP_DEMUX)
+    if (isWebP) {
+        WebPAnimDecoderOptions opts;
+        WebPAnimDecoderOptionsInit(&opts);
+        opts.color_mode = MODE_RGBA;
+        d->webp = WebPAnimDecoderNew(
+            &(WebPData){ constData_Block(data), size_Block(data) }, &opts);
+    }
+#endif
+    rewind_FrameDecoder_(d);
+    return d;
+}
+
+static void delete_FrameDecoder_(iFrameDecoder *d) {
+    if (d->isWebP) {
+#if defined (LAGRANGE_ENABLE_WEBP_DEMUX)
+        WebPAnimDecoderDelete(d->webp);
+#endif
+    }
+    else {
+        STBI_FREE(d->gif.out);
+        STBI_FREE(d->gif.background);
+        STBI_FREE(d->gif.history);
+    }
+    free(d->gifPrevious[0]);
+    free(d->gifPrevious[1]);
+    free(d);
+}
+
+/* Returns a new RGBA buffer, or NULL at the end of the animation or if there was an error. */
+static uint8_t *next_FrameDecoder_(iFrameDecoder *d, iInt2 *size_out, int *duration_out) {
+    static const int minDuration_  = 20;  /* ms; anything shorter means "unspecified" */
+    static const int defDuration_  = 100; /* ms */
+    const uint8_t *frame    = NULL;
+    int            duration = 0;
+    if (d->isWebP) {
+#if defined (LAGRANGE_ENABLE_WEBP_DEMUX)
+        uint8_t *buf;
+        int      timestamp;
+        WebPAnimInfo info;
+        if (d->webp && WebPAnimDecoderHasMoreFrames(d->webp) &&
+            WebPAnimDecoderGetNext(d->webp, &buf, &timestamp) &&
+            WebPAnimDecoderGetInfo(d->webp, &info)) {
+            frame            = buf;
+            duration         = timestamp - d->webpTimestamp;
+            d->webpTimestamp = timestamp;
+            *size_out        = init_I2(info.canvas_width, info.canvas_height);
+        }
+#endif
+    }
+    else {
+        int comp;
+        const uint8_t *out = stbi__gif_load_next(
+            &d->gifContext, &d->gif, &comp, 4, d->index >= 2 ? d->gifPrevious[1] : NULL);
+        if (out && out != (const uint8_t *) &d->gifContext) {
+            const size_t frameSize = 4 * (size_t) d->gif.w * d->gif.h;
+            uint8_t *oldest = d->gifPrevious[1];
+            d->gifPrevious[1] = d->gifPrevious[0];
+            d->gifPrevious[0] = oldest ? oldest : malloc(frameSize);
+            memcpy(d->gifPrevious[0], out, frameSize);
+            frame     = out;
+            duration  = d->gif.delay;
+            *size_out = init_I2(d->gif.w, d->gif.h);
+        }
+    }
+    if (!frame) {
+        return NULL;
+    }
+    d->index++;
+    *duration_out = duration >= minDuration_ ? duration : defDuration_;
+    const size_t frameSize = 4 * (size_t) size_out->x * size_out->y;
+    uint8_t *copy = malloc(frameSize);
+    memcpy(copy, frame, frameSize);
+    return copy;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+enum iImageJobState {
+    queued_ImageJobState,
+    decoding_ImageJobState,
+    finished_ImageJobState,
+};
+
+enum iImageJobFlag {
+    webp_ImageJobFlag     = iBit(1),
+    partial_ImageJobFlag  = iBit(2), /* incomplete data; decode as much as possible */
+    animated_ImageJobFlag = iBit(3),
+};
+
+iDeclareType(ImageFrame)
+
+struct Impl_ImageFrame {
+    uint8_t *pixels;   /* ABGR8888 */
+    int      duration; /* ms */
+};
+
+/* Decoding, restyling, and downscaling an image happens in a decoder thread. Only the texture
+   is created in the main thread, once the pixels are ready. An animation keeps the same job
+   for its lifetime: each time it runs, frames are decoded until the frame ring is full. */
+struct Impl_ImageJob {
+    iGmImage *          image; /* NULL if the image was deleted during decoding */
+    enum iImageJobState state;
+    int                 flags;
+    iBlock              data;  /* encoded */
+    enum iImageStyle    style;
+    iImageStyleColors   colors;
+    iInt2               maxSize;
+    iInt2               texSize;
+    iFrameDecoder *     frameDecoder;
+    iImageFrame         frames[3]; /* ring of decoded frames waiting to be shown */
+    size_t              firstFrame;
+    size_t              numFrames;
+    iBool               isEnded; /* no more frames will be decoded */
+};
+
+static const int maxImageDecoders_Media_ = 3;
+
+static iMutex *   decodeMutex_;
+static iCondition decodeAvailable_;
+static iPtrArray  decodeQueue_; /* oldest first */
+static iPtrArray  decoders_;
+static iBool      isStoppingDecoders_;
+
+static iImageJob *new_ImageJob_(iGmImage *image, const iBlock *data, int flags, iInt2 maxSize) {
+    iImageJob *d = calloc(1, sizeof(iImageJob));
+    d->image   = image;
+    d->state   = queued_ImageJobState;
+    d->flags   = flags;
+    initCopy_Block(&d->data, data);
+    d->style   = prefs_App()->imageStyle;
+    d->colors  = imageStyleColors_(d->style);
+    d->maxSize = maxSize;
+    return d;
+}
+
+static void delete_ImageJob_(iImageJob *d) {
+    for (size_t i = 0; i < d->numFrames; i++) {
+        free(d->frames[(d->firstFrame + i) % iElemCount(d->frames)].pixels);
+    }
+    if (d->frameDecoder) {
+        delete_FrameDecoder_(d->frameDecoder);
+    }
+    deinit_Block(&d->data);
+    free(d);
+}
+
 #if defined (LAGRANGE_ENABLE_WEBP)
-        imgData = WebPDecodeRGBA(constData_Block(data), size_Block(data), &d->size.x, &d->size.y);
-#endif        
+static uint8_t *decodePartialWebP_(const iBlock *data, iInt2 *size_out) {
+    uint8_t *     imgData = NULL;
+    WebPIDecoder *idec    = WebPINewRGB(MODE_RGBA, NULL, 0, 0);
+    const VP8StatusCode status = WebPIUpdate(idec, constData_Block(data), size_Block(data));
+    if (status == VP8_STATUS_OK || status == VP8_STATUS_SUSPENDED) {
+        int lastY, width, height, stride;
+        const uint8_t *rows = WebPIDecGetRGB(idec, &lastY, &width, &height, &stride);
+        if (rows && lastY > 0) {
+            /* Rows that haven't arrived yet remain transparent. */
+            imgData = calloc((size_t) width * height, 4);
+            for (int y = 0; y < lastY; y++) {
+                memcpy(imgData + 4 * (size_t) y * width, rows + (size_t) y * stride, 4 * width);
+            }
+            *size_out = init_I2(width, height);
+        }
+    }
+    WebPIDelete(idec);
+    return imgData;
+}
+#endif
+
+static uint8_t *process_ImageJob_(iImageJob *d, uint8_t *imgData, iInt2 size) {
+    applyImageStyle_(d->style, &d->colors, size, imgData);
+    /* TODO: Save some memory by checking if the alpha channel is actually in use. */
+    /* Resize down to min(maximum texture size, window size). */ {
+        iInt2 scaled = size;
+        if (scaled.x > d->maxSize.x) {
+            scaled.y = scaled.y * d->maxSize.x / scaled.x;
+            scaled.x = d->maxSize.x;
+        }
+        if (scaled.y > d->maxSize.y) {
+            scaled.x = scaled.x * d->maxSize.y / scaled.y;
+            scaled.y = d->maxSize.y;
+        }
+        if (!isEqual_I2(scaled, size)) {
+            uint8_t *scaledImgData = malloc(scaled.x * scaled.y * 4);
+            stbir_resize_uint8(imgData, size.x, size.y, 4 * size.x,
+                               scaledImgData, scaled.x, scaled.y, scaled.x * 4, 4);
+            free(imgData);
+            imgData = scaledImgData;
+        }
+        d->texSize = scaled;
+    }
+    return imgData;
+}
+
+static void pushFrame_ImageJob_(iImageJob *d, uint8_t *pixels, int duration) {
+    lock_Mutex(decodeMutex_);
+    d->frames[(d->firstFrame + d->numFrames) % iElemCount(d->frames)] =
+        (iImageFrame){ pixels, duration };
+    const iBool wasStarved = (d->numFrames++ == 0 && d->flags & animated_ImageJobFlag);
+    unlock_Mutex(decodeMutex_);
+    if (wasStarved) {
+        /* The animation is waiting for this frame; it doesn't poll for it. */
+        postCommand_App("media.decoded");
+    }
+}
+
+static void runStill_ImageJob_(iImageJob *d) {
+    const iBool isPartial = (d->flags & partial_ImageJobFlag) != 0;
+    iInt2       size      = zero_I2();
+    uint8_t *   imgData   = NULL;
+    if (d->flags & webp_ImageJobFlag) {
+#if defined (LAGRANGE_ENABLE_WEBP)
+        imgData = isPartial ? decodePartialWebP_(&d->data, &size)
+                            : WebPDecodeRGBA(constData_Block(&d->data), size_Block(&d->data),
+                                             &size.x, &size.y);
+#endif
     }
     else {
+        if (isPartial) {
+            /* Terminate the truncated JPEG so the received scans get decoded. */
+            appendData_Block(&d->data, "\xff\xd9", 2);
+        }
         imgData = stbi_load_from_memory(
-            constData_Block(data), (int) size_Block(data), &d->size.x, &d->size.y, NULL, 4);
-        if (!imgData) {
+            constData_Block(&d->data), (int) size_Block(&d->data), &size.x, &size.y, NULL, 4);
+        if (!imgData && !isPartial) {
             fprintf(stderr, "[media] image load failed: %s\n", stbi_failure_reason());
         }
     }
-    if (!imgData) {
-        d->size    = zero_I2();
-        d->texture = NULL;
+    clear_Block(&d->data);
+    if (imgData) {
+        pushFrame_ImageJob_(d, process_ImageJob_(d, imgData, size), 0);
     }
-    else {
-        applyImageStyle_(prefs_App()->imageStyle, d->size, imgData);        
-        /* TODO: Save some memory by checking if the alpha channel is actually in use. */
-        iWindow *window  = get_Window();
-        iInt2    texSize = d->size;
-        /* Resize down to min(maximum texture size, window size). */ {
-            SDL_Rect dispRect;
-            SDL_GetDisplayBounds(SDL_GetWindowDisplayIndex(window->win), &dispRect);
-            const iInt2 maxSize = min_I2(isEqual_I2(maxTextureSize_Window(window), zero_I2()) ?
-                                         texSize : maxTextureSize_Window(window),
-                                         coord_Window(window, dispRect.w, dispRect.h));
-            iInt2 scaled = d->size;
-            if (scaled.x > maxSize.x) {
-                scaled.y = scaled.y * maxSize.x / scaled.x;
-                scaled.x = maxSize.x;
-            }
-            if (scaled.y > maxSize.y) {
-                scaled.x = scaled.x * maxSize.y / scaled.y;
-                scaled.y = maxSize.y;
+    iGuardMutex(decodeMutex_, d->isEnded = iTrue);
+}
+
+static void runAnimation_ImageJob_(iImageJob *d) {
+    if (!d->frameDecoder) {
+        d->frameDecoder = new_FrameDecoder_(&d->data, (d->flags & webp_ImageJobFlag) != 0);
+    }
+    iFrameDecoder *dec = d->frameDecoder;
+    for (;;) {
+        iBool isFull;
+        iGuardMutex(decodeMutex_, isFull = (!d->image || d->numFrames == iElemCount(d->frames)));
+        if (isFull) {
+            break;
+        }
+        iInt2    size;
+        int      duration;
+        uint8_t *imgData = next_FrameDecoder_(dec, &size, &duration);
+        if (!imgData) {
+            if (dec->index >= 2 || (dec->index == 1 && dec->hasLooped)) {
+                /* Play it again. */
+                dec->hasLooped = iTrue;
+                rewind_FrameDecoder_(dec);
+                continue;
             }
-            if (!isEqual_I2(scaled, d->size)) {
-                uint8_t *scaledImgData = malloc(scaled.x * scaled.y * 4);
-                stbir_resize_uint8(imgData, d->size.x, d->size.y, 4 * d->size.x,
-                                   scaledImgData, scaled.x, scaled.y, scaled.x * 4, 4);
-                free(imgData);
-                imgData = scaledImgData;
-                texSize = scaled;
-                /* We keep d->size for the UI. */
+            /* A single frame (or a broken file) is shown as a still image. */
+            iGuardMutex(decodeMutex_, d->isEnded = iTrue);
+            break;
+        }
+        pushFrame_ImageJob_(d, process_ImageJob_(d, imgData, size), duration);
+    }
+}
+
+static iThreadResult run_ImageDecoder_(iThread *thread) {
+    iUnused(thread);
+    lock_Mutex(decodeMutex_);
+    for (;;) {
+        while (!isStoppingDecoders_ && isEmpty_PtrArray(&decodeQueue_)) {
+            wait_Condition(&decodeAvailable_, decodeMutex_);
+        }
+        if (isStoppingDecoders_) {
+            break;
+        }
+        iImageJob *job;
+        take_PtrArray(&decodeQueue_, 0, (void **) &job);
+        job->state = decoding_ImageJobState;
+        unlock_Mutex(decodeMutex_);
+        if (job->flags & animated_ImageJobFlag) {
+            runAnimation_ImageJob_(job);
+        }
+        else {
+            runStill_ImageJob_(job);
+        }
+        lock_Mutex(decodeMutex_);
+        job->state = finished_ImageJobState;
+        if (!job->image) {
+            delete_ImageJob_(job); /* nobody is waiting for it any more */
+        }
+        else {
+            postCommand_App("media.decoded");
+        }
+    }
+    unlock_Mutex(decodeMutex_);
+    return 0;
+}
+
+static void queue_ImageJob_(iImageJob *d) {
+    /* Called with `decodeMutex_` locked. */
+    d->state = queued_ImageJobState;
+    pushBack_PtrArray(&decodeQueue_, d);
+    signal_Condition(&decodeAvailable_);
+}
+
+static void submit_ImageJob_(iImageJob *d) {
+    if (!decodeMutex_) {
+        /* Decoders are started when the first image arrives. */
+        decodeMutex_ = new_Mutex();
+        init_Condition(&decodeAvailable_);
+        init_PtrArray(&decodeQueue_);
+        init_PtrArray(&decoders_);
+        isStoppingDecoders_ = iFalse;
+        const int numDecoders = iClamp(SDL_GetCPUCount() - 1, 1, maxImageDecoders_Media_);
+        for (int i = 0; i < numDecoders; i++) {
+            iThread *thread = new_Thread(run_ImageDecoder_);
+            pushBack_PtrArray(&decoders_, thread);
+            start_Thread(thread);
+        }
+    }
+    iGuardMutex(decodeMutex_, queue_ImageJob_(d));
+}
+
+void deinitImageDecoders_Media(void) {
+    if (!decodeMutex_) {
+        return;
+    }
+    iGuardMutex(decodeMutex_, {
+        isStoppingDecoders_ = iTrue;
+        signalAll_Condition(&decodeAvailable_);
+    });
+    iForEach(PtrArray, t, &decoders_) {
+        join_Thread(t.ptr);
+        iRelease(t.ptr);
+    }
+    deinit_PtrArray(&decoders_);
+    /* Images have already been deleted so these have no owners. */
+    iForEach(PtrArray, j, &decodeQueue_) {
+        delete_ImageJob_(j.ptr);
+    }
+    deinit_PtrArray(&decodeQueue_);
+    deinit_Condition(&decodeAvailable_);
+    delete_Mutex(decodeMutex_);
+    decodeMutex_ = NULL;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const size_t minPreviewBytes_GmImage_ = 32 * 1024;
+
+void init_GmImage(iGmImage *d, const iBlock *data) {
+    init_GmMediaProps_(&d->props);
+    initCopy_Block(&d->partialData, data);
+    d->size          = zero_I2();
+    d->numBytes      = 0;
+    d->previewBytes  = 0;
+    d->job           = NULL;
+    d->texture       = NULL;
+    d->nextFrameTime = 0;
+}
+
+static void cancelDecoding_GmImage_(iGmImage *d) {
+    if (!d->job) {
+        return;
+    }
+    iGuardMutex(decodeMutex_, {
+        if (d->job->state == decoding_ImageJobState) {
+            d->job->image = NULL; /* the decoder will delete it */
+        }
+        else {
+            if (d->job->state == queued_ImageJobState) {
+                removeOne_PtrArray(&decodeQueue_, d->job);
             }
+            delete_ImageJob_(d->job);
+        }
+        d->job = NULL;
+    });
+}
+
+void deinit_GmImage(iGmImage *d) {
+    cancelDecoding_GmImage_(d);
+    deinit_Block(&d->partialData);
+    SDL_DestroyTexture(d->texture);
+    deinit_GmMediaProps_(&d->props);
+}
+
+static iBool isJpeg_GmImage_(const iGmImage *d) {
+    return cmp_String(&d->props.mime, "image/jpeg") == 0 ||
+           cmp_String(&d->props.mime, "image/jpg") == 0;
+}
+
+static iBool isWebP_GmImage_(const iGmImage *d) {
+    return cmp_String(&d->props.mime, "image/webp") == 0;
+}
+
+/* Only the header is read, so the layout knows the size before decoding is done. */
+static iInt2 readSize_GmImage_(const iGmImage *d, const iBlock *data, iBool *isAnimated_out) {
+    iInt2 size = zero_I2();
+    *isAnimated_out = iFalse;
+    if (isWebP_GmImage_(d)) {
+#if defined (LAGRANGE_ENABLE_WEBP)
+        WebPBitstreamFeatures features;
+        if (WebPGetFeatures(constData_Block(data), size_Block(data), &features) ==
+            VP8_STATUS_OK) {
+            size = init_I2(features.width, features.height);
+#   if defined (LAGRANGE_ENABLE_WEBP_DEMUX)
+            *isAnimated_out = features.has_animation;
+#   endif
+        }
+#endif
+    }
+    else if (stbi_info_from_memory(
+                 constData_Block(data), (int) size_Block(data), &size.x, &size.y, NULL)) {
+        *isAnimated_out = cmp_String(&d->props.mime, "image/gif") == 0;
+    }
+    else {
+        size = zero_I2();
+    }
+    return size;
+}
+
+static iInt2 maxTextureSize_GmImage_(const iGmImage *d) {
+    iWindow *window = get_Window();
+    SDL_Rect dispRect;
+    SDL_GetDisplayBounds(SDL_GetWindowDisplayIndex(window->win), &dispRect);
+    return min_I2(isEqual_I2(maxTextureSize_Window(window), zero_I2()) ?
+                  d->size : maxTextureSize_Window(window),
+                  coord_Window(window, dispRect.w, dispRect.h));
+}
+
+static void startDecoding_GmImage_(iGmImage *d) {
+    iBlock *data = &d->partialData;
+    iBool   isAnimated;
+    cancelDecoding_GmImage_(d); /* a preview of partial data */
+    d->numBytes = size_Block(data);
+    d->size     = readSize_GmImage_(d, data, &isAnimated);
+    if (d->size.x > 0 && d->size.y > 0) {
+        /* A preview texture remains visible until the final one is ready. */
+        d->job = new_ImageJob_(d,
+                               data,
+                               (isWebP_GmImage_(d) ? webp_ImageJobFlag : 0) |
+                                   (isAnimated ? animated_ImageJobFlag : 0),
+                               maxTextureSize_GmImage_(d));
+        submit_ImageJob_(d->job);
+    }
+    else {
+        if (!isWebP_GmImage_(d)) {
+            fprintf(stderr, "[media] image load failed: %s\n", stbi_failure_reason());
         }
-        /* Create the texture. */
-        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
-            imgData, texSize.x, texSize.y, 32, texSize.x * 4, SDL_PIXELFORMAT_ABGR8888);
+        SDL_DestroyTexture(d->texture);
+        d->texture = NULL;
+    }
+    clear_Block(data);
+}
+
+static void updatePreview_GmImage_(iGmImage *d) {
+    const size_t numBytes = size_Block(&d->partialData);
+    iBool        isAnimated;
+    if (d->job || numBytes < d->previewBytes + iMax(minPreviewBytes_GmImage_, d->previewBytes / 2)) {
+        /* Wait until there is a meaningful amount of new data. */
+        return;
+    }
+    if (!isJpeg_GmImage_(d) && !isWebP_GmImage_(d)) {
+        return; /* no way to decode incomplete data */
+    }
+    d->size = readSize_GmImage_(d, &d->partialData, &isAnimated);
+    if (isAnimated || d->size.x <= 0 || d->size.y <= 0) {
+        return;
+    }
+    d->previewBytes = numBytes;
+    d->job = new_ImageJob_(d,
+                           &d->partialData,
+                           partial_ImageJobFlag | (isWebP_GmImage_(d) ? webp_ImageJobFlag : 0),
+                           maxTextureSize_GmImage_(d));
+    submit_ImageJob_(d->job);
+}
+
+static void setFrame_GmImage_(iGmImage *d, const uint8_t *pixels, iInt2 texSize,
+                              iBool isAnimated) {
+    const int access  = isAnimated ? SDL_TEXTUREACCESS_STREAMING : SDL_TEXTUREACCESS_STATIC;
+    int       oldAccess = 0;
+    iInt2     oldSize   = zero_I2();
+    if (d->texture) {
+        SDL_QueryTexture(d->texture, NULL, &oldAccess, &oldSize.x, &oldSize.y);
+    }
+    if (!d->texture || oldAccess != access || !isEqual_I2(oldSize, texSize)) {
+        SDL_DestroyTexture(d->texture);
         /* TODO: In multiwindow case, all windows must have the same shared renderer?
            Or at least a shared context. */
         SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1"); /* linear scaling */
-        d->texture = SDL_CreateTextureFromSurface(renderer_Window(window), surface);
-        SDL_FreeSurface(surface);
-        free(imgData);
+        d->texture = SDL_CreateTexture(renderer_Window(get_Window()),
+                                       SDL_PIXELFORMAT_ABGR8888,
+                                       access,
+                                       texSize.x,
+                                       texSize.y);
+        if (d->texture) {
+            SDL_SetTextureBlendMode(d->texture, SDL_BLENDMODE_BLEND);
+        }
     }
-    clear_Block(data);
+    if (d->texture) {
+        SDL_UpdateTexture(d->texture, NULL, pixels, texSize.x * 4);
+    }
+    /* We keep d->size for the UI. */
+}
+
+static iBool isAnimating_GmImage_(const iGmImage *d) {
+    iBool isAnimating = iFalse;
+    if (d->job && d->job->flags & animated_ImageJobFlag) {
+        iGuardMutex(decodeMutex_, isAnimating = !d->job->isEnded || d->job->numFrames > 0);
+    }
+    return isAnimating;
+}
+
+/* Shows the next decoded frame, if there is one. Returns True if the image changed. */
+static iBool showNextFrame_GmImage_(iGmImage *d) {
+    iImageJob * job   = d->job;
+    iImageFrame frame = { NULL, 0 };
+    iInt2       texSize;
+    iBool       isDone = iFalse;
+    if (!job) {
+        return iFalse;
+    }
+    lock_Mutex(decodeMutex_);
+    if (job->numFrames) {
+        frame = job->frames[job->firstFrame];
+        job->firstFrame = (job->firstFrame + 1) % iElemCount(job->frames);
+        job->numFrames--;
+    }
+    texSize = job->texSize;
+    if (job->state == finished_ImageJobState) {
+        if (job->isEnded) {
+            isDone = (job->numFrames == 0);
+        }
+        else if (frame.pixels) {
+            queue_ImageJob_(job); /* there is room for another frame */
+        }
+    }
+    unlock_Mutex(decodeMutex_);
+    if (frame.pixels) {
+        setFrame_GmImage_(d, frame.pixels, texSize, (job->flags & animated_ImageJobFlag) != 0);
+        d->nextFrameTime = SDL_GetTicks() + frame.duration;
+        free(frame.pixels);
+    }
+    if (isDone) {
+        d->job = NULL;
+        delete_ImageJob_(job);
+    }
+    return frame.pixels != NULL || isDone;
+}
+
+static iBool upload_GmImage_(iGmImage *d) {
+    if (!d->job || (d->texture && isAnimating_GmImage_(d))) {
+        return iFalse; /* animation frames are shown when they're due */
+    }
+    return showNextFrame_GmImage_(d);
 }
 
 iDefineTypeConstructionArgs(GmImage, (const iBlock *data), data)
@@ -292,9 +987,93 @@ iDefineTypeConstruction(GmDownload)
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(MediaIndex)
+
+/* Open-addressing map from link ID to the index of the link's media item. */
+struct Impl_MediaIndex {
+    uint32_t *slots; /* linkId << 16 | (index + 1), or zero if empty */
+    size_t    mask;  /* capacity - 1 */
+    size_t    count;
+};
+
+static void init_MediaIndex_(iMediaIndex *d) {
+    d->slots = NULL;
+    d->mask  = 0;
+    d->count = 0;
+}
+
+static void deinit_MediaIndex_(iMediaIndex *d) {
+    free(d->slots);
+}
+
+static void clear_MediaIndex_(iMediaIndex *d) {
+    if (d->slots) {
+        memset(d->slots, 0, sizeof(uint32_t) * (d->mask + 1));
+    }
+    d->count = 0;
+}
+
+static size_t slot_MediaIndex_(const iMediaIndex *d, iGmLinkId linkId) {
+    return (linkId * 2654435761u >> 7) & d->mask;
+}
+
+static size_t find_MediaIndex_(const iMediaIndex *d, iGmLinkId linkId) {
+    if (!d->count) {
+        return iInvalidPos;
+    }
+    for (size_t pos = slot_MediaIndex_(d, linkId); d->slots[pos]; pos = (pos + 1) & d->mask) {
+        if (d->slots[pos] >> 16 == linkId) {
+            return (d->slots[pos] & 0xffff) - 1;
+        }
+    }
+    return iInvalidPos;
+}
+
+static void insertSlot_MediaIndex_(iMediaIndex *d, uint32_t value) {
+    size_t pos = slot_MediaIndex_(d, value >> 16);
+    while (d->slots[pos]) {
+        if (d->slots[pos] >> 16 == value >> 16) {
+            return; /* the first item of a link is the one that is found */
+        }
+        pos = (pos + 1) & d->mask;
+    }
+    d->slots[pos] = value;
+    d->count++;
+}
+
+static void insert_MediaIndex_(iMediaIndex *d, iGmLinkId linkId, size_t index) {
+    iAssert(index < 0xffff);
+    if (!d->slots || (d->count + 1) * 2 > d->mask + 1) {
+        /* Keep the load factor under 0.5. */
+        uint32_t *   oldSlots = d->slots;
+        const size_t oldCap   = d->slots ? d->mask + 1 : 0;
+        const size_t newCap   = iMax(16, oldCap * 2);
+        d->slots = calloc(newCap, sizeof(uint32_t));
+        d->mask  = newCap - 1;
+        d->count = 0;
+        for (size_t i = 0; i < oldCap; i++) {
+            if (oldSlots[i]) {
+                insertSlot_MediaIndex_(d, oldSlots[i]);
+            }
+        }
+        free(oldSlots);
+    }
+    insertSlot_MediaIndex_(d, (uint32_t) linkId << 16 | (uint32_t) (index + 1));
+}
+
+static void rebuild_MediaIndex_(iMediaIndex *d, const iPtrArray *items) {
+    clear_MediaIndex_(d);
+    iConstForEach(PtrArray, i, items) {
+        const iGmMediaProps *props = i.ptr;
+        insert_MediaIndex_(d, props->linkId, index_PtrArrayConstIterator(&i));
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
 struct Impl_Media {
-    iPtrArray items[max_MediaType];
-    /* TODO: Add a hash to quickly look up a link's media. */
+    iPtrArray   items[max_MediaType];
+    iMediaIndex index[max_MediaType]; /* link ID => position in `items` */
 };
 
 iDefineTypeConstruction(Media)
@@ -302,6 +1081,7 @@ iDefineTypeConstruction(Media)
 void init_Media(iMedia *d) {
     iForIndices(i, d->items) {
         init_PtrArray(&d->items[i]);
+        init_MediaIndex_(&d->index[i]);
     }
 }
 
@@ -309,9 +1089,24 @@ void deinit_Media(iMedia *d) {
     clear_Media(d);
     iForIndices(i, d->items) {
         deinit_PtrArray(&d->items[i]);
+        deinit_MediaIndex_(&d->index[i]);
     }
 }
 
+static void addItem_Media_(iMedia *d, enum iMediaType type, void *item) {
+    const iGmMediaProps *props = item; /* all media items begin with props */
+    pushBack_PtrArray(&d->items[type], item);
+    insert_MediaIndex_(&d->index[type], props->linkId, size_PtrArray(&d->items[type]) - 1);
+}
+
+static void *takeItem_Media_(iMedia *d, enum iMediaType type, size_t index) {
+    void *item = NULL;
+    take_PtrArray(&d->items[type], index, &item);
+    /* Positions of the following items have changed. */
+    rebuild_MediaIndex_(&d->index[type], &d->items[type]);
+    return item;
+}
+
 void clear_Media(iMedia *d) {
     iForEach(PtrArray, i, &d->items[image_MediaType]) {
         deinit_GmImage(i.ptr);
@@ -324,6 +1119,7 @@ void clear_Media(iMedia *d) {
     }
     iForIndices(type, d->items) {
         clear_PtrArray(&d->items[type]);
+        clear_MediaIndex_(&d->index[type]);
     }
 }
 
@@ -335,9 +1131,10 @@ size_t memorySize_Media(const iMedia *d) {
             const iInt2 texSize = size_SDLTexture(img->texture);
             memSize += 4 * texSize.x * texSize.y; /* RGBA */
         }
-        else {
-            memSize += size_Block(&img->partialData);
+        if (img->job) {
+            memSize += img->numBytes; /* being decoded, or an animation */
         }
+        memSize += size_Block(&img->partialData);
     }
 #if defined (LAGRANGE_ENABLE_AUDIO)
     iConstForEach(PtrArray, a, &d->items[audio_MediaType]) {
@@ -362,7 +1159,8 @@ iBool setUrl_Media(iMedia *d, iGmLinkId linkId, enum iMediaType mediaType, const
         iGmDownload *dl = NULL;
         if (isNew) {
             dl = new_GmDownload();
-            pushBack_PtrArray(&d->items[download_MediaType], dl);
+            dl->props.linkId = linkId;
+            addItem_Media_(d, download_MediaType, dl);
         }
         else {
             dl = at_PtrArray(&d->items[download_MediaType], index_MediaId(existing));
@@ -388,7 +1186,7 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
     if (existing.type == image_MediaType) {
         iGmImage *img;
         if (isDeleting) {
-            take_PtrArray(&d->items[image_MediaType], existingIndex, (void **) &img);
+            img = takeItem_Media_(d, image_MediaType, existingIndex);
             delete_GmImage(img);
         }
         else {
@@ -396,7 +1194,10 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
             iAssert(equal_String(&img->props.mime, mime)); /* MIME cannot change */
             set_Block(&img->partialData, data);
             if (!isPartial) {
-                makeTexture_GmImage(img);
+                startDecoding_GmImage_(img);
+            }
+            else {
+                updatePreview_GmImage_(img);
             }
         }
     }
@@ -404,7 +1205,7 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
 #if defined (LAGRANGE_ENABLE_AUDIO)
         iGmAudio *audio;
         if (isDeleting) {
-            take_PtrArray(&d->items[audio_MediaType], existingIndex, (void **) &audio);
+            audio = takeItem_Media_(d, audio_MediaType, existingIndex);
             delete_GmAudio(audio);
         }
         else {
@@ -424,7 +1225,7 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
     else if (existing.type == download_MediaType) {
         iGmDownload *dl;
         if (isDeleting) {
-            take_PtrArray(&d->items[download_MediaType], existingIndex, (void **) &dl);
+            dl = takeItem_Media_(d, download_MediaType, existingIndex);
             delete_GmDownload(dl);
         }
         else {
@@ -443,28 +1244,40 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
     }
     else if (!isDeleting) {
         if (startsWith_String(mime, "image/")) {
-            /* Copy the image to a texture. */
+            /* The image is decoded in the background and then copied to a texture. */
             iGmImage *img = new_GmImage(data);
-            img->props.linkId = linkId; /* TODO: use a hash? */
+            img->props.linkId = linkId;
             img->props.isPermanent = !allowHide;
             set_String(&img->props.mime, mime);
-            pushBack_PtrArray(&d->items[image_MediaType], img);
+            if (isPartial) {
+                iBool isAnimated;
+                img->size = readSize_GmImage_(img, data, &isAnimated);
+                if (img->size.x <= 0 || img->size.y <= 0) {
+                    /* Layout needs the size, so wait until the header has been received. */
+                    delete_GmImage(img);
+                    return iFalse;
+                }
+            }
+            addItem_Media_(d, image_MediaType, img);
             if (!isPartial) {
-                makeTexture_GmImage(img);
+                startDecoding_GmImage_(img);
+            }
+            else {
+                updatePreview_GmImage_(img);
             }
             isNew = iTrue;
         }
         else if (startsWith_String(mime, "audio/")) {
 #if defined (LAGRANGE_ENABLE_AUDIO)
             iGmAudio *audio = new_GmAudio();
-            audio->props.linkId = linkId; /* TODO: use a hash? */
+            audio->props.linkId = linkId;
             audio->props.isPermanent = !allowHide;
             set_String(&audio->props.mime, mime);
             updateSourceData_Player(audio->player, mime, data, replace_PlayerUpdate);
             if (!isPartial) {
                 updateSourceData_Player(audio->player, NULL, NULL, complete_PlayerUpdate);
             }
-            pushBack_PtrArray(&d->items[audio_MediaType], audio);
+            addItem_Media_(d, audio_MediaType, audio);
             /* Start playing right away. */
             start_Player(audio->player);
             postCommandf_App("media.player.started player:%p", audio->player);
@@ -475,31 +1288,16 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
     return isNew;
 }
 
-static iMediaId findMediaPtr_Media_(const iPtrArray *items, enum iMediaType mediaType, iGmLinkId linkId) {
-    iConstForEach(PtrArray, i, items) {
-        const iGmMediaProps *props = i.ptr;
-        if (props->linkId == linkId) {
-            return (iMediaId){
-                .type = mediaType,
-                .id = index_PtrArrayConstIterator(&i) + 1
-            };
-        }
-    }
-    return iInvalidMediaId;
-}
-
 iMediaId findMediaForLink_Media(const iMedia *d, iGmLinkId linkId, enum iMediaType mediaType) {
-    /* TODO: Use hashes, this will get very slow if there is a large number of media items. */
-    iMediaId mid = iInvalidMediaId;
     for (int i = 0; i < max_MediaType; i++) {
         if (mediaType == i || !mediaType) {
-            mid = findMediaPtr_Media_(&d->items[i], i, linkId);
-            if (mid.type) {
-                break;
+            const size_t index = find_MediaIndex_(&d->index[i], linkId);
+            if (index != iInvalidPos) {
+                return (iMediaId){ .type = i, .id = index + 1 };
             }
         }
     }
-    return mid;
+    return iInvalidMediaId;
 }
 
 size_t numAudio_Media(const iMedia *d) {
@@ -520,12 +1318,70 @@ SDL_Texture *imageTexture_Media(const iMedia *d, iMediaId imageId) {
     iAssert(imageId.type == image_MediaType);
     const size_t index = index_MediaId(imageId);
     if (index < size_PtrArray(&d->items[image_MediaType])) {
-        const iGmImage *img = constAt_PtrArray(&d->items[image_MediaType], index);
+        iGmImage *img = iConstCast(iGmImage *, constAt_PtrArray(&d->items[image_MediaType], index));
+        upload_GmImage_(img); /* in case the decoder has just finished */
         return img->texture;
     }
     return NULL;
 }
 
+iBool isAnimatedImage_Media(const iMedia *d, iMediaId imageId) {
+    iAssert(imageId.type == image_MediaType);
+    const size_t index = index_MediaId(imageId);
+    if (index < size_PtrArray(&d->items[image_MediaType])) {
+        return isAnimating_GmImage_(constAt_PtrArray(&d->items[image_MediaType], index));
+    }
+    return iFalse;
+}
+
+iBool advanceAnimation_Media(iMedia *d, iMediaId imageId) {
+    iAssert(imageId.type == image_MediaType);
+    const size_t index = index_MediaId(imageId);
+    if (index < size_PtrArray(&d->items[image_MediaType])) {
+        iGmImage *img = at_PtrArray(&d->items[image_MediaType], index);
+        if (isAnimating_GmImage_(img) && SDL_TICKS_PASSED(SDL_GetTicks(), img->nextFrameTime)) {
+            return showNextFrame_GmImage_(img);
+        }
+    }
+    return iFalse;
+}
+
+uint32_t nextFrameTime_Media(const iMedia *d, iMediaId imageId) {
+    iAssert(imageId.type == image_MediaType);
+    const size_t index = index_MediaId(imageId);
+    if (index < size_PtrArray(&d->items[image_MediaType])) {
+        const iGmImage *img = constAt_PtrArray(&d->items[image_MediaType], index);
+        if (isAnimating_GmImage_(img)) {
+            /* If the decoder has fallen behind, "media.decoded" is posted when a frame is
+               ready, so there is nothing to wait for until then. */
+            iBool hasFrame;
+            iGuardMutex(decodeMutex_, hasFrame = (img->job->numFrames > 0));
+            return hasFrame ? iMax(img->nextFrameTime, 1u) : 0;
+        }
+    }
+    return 0;
+}
+
+iBool isDecodingImage_Media(const iMedia *d, iMediaId imageId) {
+    iAssert(imageId.type == image_MediaType);
+    const size_t index = index_MediaId(imageId);
+    if (index < size_PtrArray(&d->items[image_MediaType])) {
+        const iGmImage *img = constAt_PtrArray(&d->items[image_MediaType], index);
+        return img->job != NULL || !isEmpty_Block(&img->partialData);
+    }
+    return iFalse;
+}
+
+iBool uploadDecodedImages_Media(iMedia *d) {
+    iBool isChanged = iFalse;
+    iForEach(PtrArray, i, &d->items[image_MediaType]) {
+        if (upload_GmImage_(i.ptr)) {
+            isChanged = iTrue;
+        }
+    }
+    return isChanged;
+}
+
 iBool info_Media(const iMedia *d, iMediaId mediaId, iGmMediaInfo *info_out) {
     /* TODO: Use a hash. */
     const size_t index = index_MediaId(mediaId);
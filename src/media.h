@@ -49,8 +49,7 @@ enum iMediaFlags {
 
 enum iMediaType { /* Note: There is a limited number of bits for these; see GmRun. */
     none_MediaType,
-    image_MediaType,
-    //animatedImage_MediaType, /* TODO */
+    image_MediaType, /* may be animated */
     audio_MediaType,
     download_MediaType,
     max_MediaType
@@ -99,6 +98,14 @@ iLocalDef iBool downloadInfo_Media(const iMedia *d, uint16_t mediaId, iGmMediaIn
 
 iInt2           imageSize_Media         (const iMedia *, iMediaId imageId);
 SDL_Texture *   imageTexture_Media      (const iMedia *, iMediaId imageId);
+iBool           isDecodingImage_Media   (const iMedia *, iMediaId imageId);
+iBool           isAnimatedImage_Media   (const iMedia *, iMediaId imageId);
+iBool           advanceAnimation_Media  (iMedia *, iMediaId imageId); /* returns True if frame changed */
+uint32_t        nextFrameTime_Media     (const iMedia *, iMediaId imageId); /* zero if not animating or no frame decoded */
+iBool           uploadDecodedImages_Media (iMedia *); /* returns True if any textures changed */
+void            deinitImageDecoders_Media (void);
+
+const iString * benchmarkImageStyle_Media (void); /* for debugging */
 
 size_t          numAudio_Media          (const iMedia *);
 iPlayer *       audioPlayer_Media       (const iMedia *, iMediaId audioId);
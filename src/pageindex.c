@@ -0,0 +1,575 @@
+/* Copyright 2023 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "pageindex.h"
+#include "app.h"
+#include "gmutil.h"
+#include "ui/color.h"
+
+#include <the_Foundation/array.h>
+#include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/path.h>
+#include <the_Foundation/thread.h>
+#include <stdlib.h>
+
+static const size_t   maxPages_PageIndex_     = 200;
+static const size_t   maxTextSize_PageIndex_  = 128 * 1024; /* bytes per page */
+static const char    *fileName_PageIndex_     = "pageindex.lgr";
+static const char    *tempFileName_PageIndex_ = "pageindex.lgr.tmp";
+static const char    *magic_PageIndex_        = "lgPI";
+static const uint32_t version_PageIndex_      = 1;
+
+iDeclareType(IndexedPage)
+
+struct Impl_IndexedPage {
+    uint32_t id; /* ascending in the order of indexing */
+    iString  url;
+    iTime    when;
+    iString  text; /* only whole lines are kept if the page is very large */
+};
+
+static void init_IndexedPage_(iIndexedPage *d, uint32_t id) {
+    d->id = id;
+    init_String(&d->url);
+    initCurrent_Time(&d->when);
+    init_String(&d->text);
+}
+
+static void deinit_IndexedPage_(iIndexedPage *d) {
+    deinit_String(&d->text);
+    deinit_String(&d->url);
+}
+
+/* Pages are found via the trigrams (three consecutive bytes) of lowercase text.
+   Trigrams that span whitespace aren't indexed because search terms are single words. */
+
+iDeclareType(Postings)
+
+struct Impl_Postings {
+    uint32_t trigram;
+    iArray   pageIds; /* uint32_t, ascending */
+};
+
+static int cmpTrigram_(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static int cmpPair_(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static iBool isIndexedChar_(uint8_t c) {
+    return c > ' ';
+}
+
+static void trigrams_(iRangecc text, iArray *trigrams_out) {
+    /* Unique trigrams in ascending order. */
+    iString *lower = lower_String(collect_String(newRange_String(text)));
+    const uint8_t *pos = (const uint8_t *) constBegin_String(lower);
+    const uint8_t *end = (const uint8_t *) constEnd_String(lower);
+    clear_Array(trigrams_out);
+    for (; pos + 3 <= end; pos++) {
+        if (isIndexedChar_(pos[0]) && isIndexedChar_(pos[1]) && isIndexedChar_(pos[2])) {
+            const uint32_t tri = (pos[0] << 16) | (pos[1] << 8) | pos[2];
+            pushBack_Array(trigrams_out, &tri);
+        }
+    }
+    delete_String(lower);
+    qsort(data_Array(trigrams_out), size_Array(trigrams_out), sizeof(uint32_t), cmpTrigram_);
+    uint32_t *tris = data_Array(trigrams_out);
+    size_t    num  = 0;
+    for (size_t i = 0; i < size_Array(trigrams_out); i++) {
+        if (num == 0 || tris[num - 1] != tris[i]) {
+            tris[num++] = tris[i];
+        }
+    }
+    resize_Array(trigrams_out, num);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_PageIndex {
+    iMutex  *mtx;
+    iString  loadPath; /* loading is deferred until the index is needed */
+    iArray   pages;    /* chronologically ascending */
+    iArray   postings; /* sorted by trigram */
+    iBool    isPostingsValid; /* built when first searched */
+    iBool    isModified;
+    uint32_t nextId;
+    iMutex  *pendingMtx; /* locked after `mtx` if both are needed */
+    iArray   pending;    /* pages waiting to be indexed */
+    iThread *indexer;
+    iBool    isIndexing;
+};
+
+iDefineTypeConstruction(PageIndex)
+
+void init_PageIndex(iPageIndex *d) {
+    d->mtx = new_Mutex();
+    init_String(&d->loadPath);
+    init_Array(&d->pages, sizeof(iIndexedPage));
+    init_Array(&d->postings, sizeof(iPostings));
+    d->isPostingsValid = iFalse;
+    d->isModified      = iFalse;
+    d->nextId          = 1;
+    d->pendingMtx      = new_Mutex();
+    init_Array(&d->pending, sizeof(iIndexedPage));
+    d->indexer         = NULL;
+    d->isIndexing      = iFalse;
+}
+
+static void clearPostings_PageIndex_(iPageIndex *d) {
+    iForEach(Array, i, &d->postings) {
+        deinit_Array(&((iPostings *) i.value)->pageIds);
+    }
+    clear_Array(&d->postings);
+    d->isPostingsValid = iFalse;
+}
+
+static void clearPages_PageIndex_(iPageIndex *d) {
+    iForEach(Array, i, &d->pages) {
+        deinit_IndexedPage_(i.value);
+    }
+    clear_Array(&d->pages);
+    clearPostings_PageIndex_(d);
+}
+
+static void clearPending_PageIndex_(iPageIndex *d) {
+    iForEach(Array, i, &d->pending) {
+        deinit_IndexedPage_(i.value);
+    }
+    clear_Array(&d->pending);
+}
+
+static void waitForIndexer_PageIndex_(iPageIndex *d) {
+    if (d->indexer) {
+        join_Thread(d->indexer);
+        iReleasePtr(&d->indexer);
+    }
+}
+
+void deinit_PageIndex(iPageIndex *d) {
+    waitForIndexer_PageIndex_(d);
+    clearPending_PageIndex_(d);
+    deinit_Array(&d->pending);
+    delete_Mutex(d->pendingMtx);
+    clearPages_PageIndex_(d);
+    deinit_Array(&d->postings);
+    deinit_Array(&d->pages);
+    deinit_String(&d->loadPath);
+    delete_Mutex(d->mtx);
+}
+
+static void loadDeferred_PageIndex_(iPageIndex *d) {
+    if (isEmpty_String(&d->loadPath)) {
+        return;
+    }
+    iFile *f = new_File(&d->loadPath);
+    if (open_File(f, readOnly_FileMode)) {
+        char magic[4];
+        readData_File(f, 4, magic);
+        if (!memcmp(magic, magic_PageIndex_, 4) && readU32_File(f) <= version_PageIndex_) {
+            iStream *ins = stream_File(f);
+            const uint32_t count = readU32_Stream(ins);
+            for (uint32_t n = 0; n < count; n++) {
+                iIndexedPage page;
+                init_IndexedPage_(&page, d->nextId++);
+                deserialize_String(&page.url, ins);
+                page.when.ts = (struct timespec){ .tv_sec = readU64_Stream(ins) };
+                deserialize_String(&page.text, ins);
+                pushBack_Array(&d->pages, &page);
+            }
+        }
+    }
+    iRelease(f);
+    clear_String(&d->loadPath);
+}
+
+void load_PageIndex(iPageIndex *d, const char *dirPath) {
+    iGuardMutex(d->mtx, setCStr_String(&d->loadPath, concatPath_CStr(dirPath, fileName_PageIndex_)));
+}
+
+static void indexPending_PageIndex_(iPageIndex *d);
+
+void save_PageIndex(iPageIndex *d, const char *dirPath) {
+    lock_Mutex(d->mtx);
+    indexPending_PageIndex_(d); /* don't wait for the indexer */
+    if (d->isModified) {
+        const char *tempPath = concatPath_CStr(dirPath, tempFileName_PageIndex_);
+        iFile *f = newCStr_File(tempPath);
+        if (open_File(f, writeOnly_FileMode)) {
+            iStream *outs = stream_File(f);
+            writeData_File(f, magic_PageIndex_, 4);
+            writeU32_File(f, version_PageIndex_);
+            writeU32_Stream(outs, size_Array(&d->pages));
+            iConstForEach(Array, i, &d->pages) {
+                const iIndexedPage *page = i.value;
+                serialize_String(&page->url, outs);
+                writeU64_Stream(outs, integralSeconds_Time(&page->when));
+                serialize_String(&page->text, outs);
+            }
+        }
+        iRelease(f);
+        commitFile_App(concatPath_CStr(dirPath, fileName_PageIndex_), tempPath);
+        d->isModified = iFalse;
+    }
+    unlock_Mutex(d->mtx);
+}
+
+void clear_PageIndex(iPageIndex *d) {
+    lock_Mutex(d->mtx);
+    iGuardMutex(d->pendingMtx, clearPending_PageIndex_(d));
+    clear_String(&d->loadPath); /* previously saved pages are forgotten */
+    clearPages_PageIndex_(d);
+    d->isModified = iTrue;
+    unlock_Mutex(d->mtx);
+}
+
+size_t numPages_PageIndex(const iPageIndex *d) {
+    size_t num;
+    iGuardMutex(d->mtx, num = size_Array(&d->pages));
+    return num;
+}
+
+static void buildPostings_PageIndex_(iPageIndex *d) {
+    /* Trigram/page pairs of all pages are sorted and then grouped by trigram. */
+    iArray pairs, tris;
+    init_Array(&pairs, sizeof(uint64_t));
+    init_Array(&tris, sizeof(uint32_t));
+    clearPostings_PageIndex_(d);
+    iConstForEach(Array, i, &d->pages) {
+        const iIndexedPage *page = i.value;
+        trigrams_(range_String(&page->text), &tris);
+        iConstForEach(Array, t, &tris) {
+            const uint64_t pair = ((uint64_t) *(const uint32_t *) t.value << 32) | page->id;
+            pushBack_Array(&pairs, &pair);
+        }
+    }
+    qsort(data_Array(&pairs), size_Array(&pairs), sizeof(uint64_t), cmpPair_);
+    iPostings *post = NULL;
+    iConstForEach(Array, p, &pairs) {
+        const uint64_t pair    = *(const uint64_t *) p.value;
+        const uint32_t trigram = (uint32_t) (pair >> 32);
+        const uint32_t pageId  = (uint32_t) pair;
+        if (!post || post->trigram != trigram) {
+            iPostings newPost = { .trigram = trigram };
+            init_Array(&newPost.pageIds, sizeof(uint32_t));
+            pushBack_Array(&d->postings, &newPost);
+            post = back_Array(&d->postings);
+        }
+        pushBack_Array(&post->pageIds, &pageId);
+    }
+    deinit_Array(&tris);
+    deinit_Array(&pairs);
+    d->isPostingsValid = iTrue;
+}
+
+static void addPostings_PageIndex_(iPageIndex *d, const iIndexedPage *page) {
+    /* The page's trigrams are merged with the existing postings in a single pass. */
+    iArray tris, merged;
+    init_Array(&tris, sizeof(uint32_t));
+    init_Array(&merged, sizeof(iPostings));
+    trigrams_(range_String(&page->text), &tris);
+    const iPostings *old    = constData_Array(&d->postings);
+    const size_t     numOld = size_Array(&d->postings);
+    const uint32_t  *add    = constData_Array(&tris);
+    const size_t     numAdd = size_Array(&tris);
+    size_t i = 0, j = 0;
+    reserve_Array(&merged, numOld + numAdd);
+    while (i < numOld || j < numAdd) {
+        if (j == numAdd || (i < numOld && old[i].trigram < add[j])) {
+            pushBack_Array(&merged, &old[i++]);
+            continue;
+        }
+        iPostings post;
+        if (i < numOld && old[i].trigram == add[j]) {
+            post = old[i++]; /* moved to the merged array */
+        }
+        else {
+            post.trigram = add[j];
+            init_Array(&post.pageIds, sizeof(uint32_t));
+        }
+        pushBack_Array(&post.pageIds, &page->id); /* IDs are ascending */
+        pushBack_Array(&merged, &post);
+        j++;
+    }
+    iSwap(iArray, d->postings, merged);
+    deinit_Array(&merged);
+    deinit_Array(&tris);
+}
+
+static void removePostings_PageIndex_(iPageIndex *d, uint32_t pageId) {
+    iPostings *posts = data_Array(&d->postings);
+    size_t     num   = 0;
+    for (size_t i = 0; i < size_Array(&d->postings); i++) {
+        iArray         *ids   = &posts[i].pageIds;
+        const uint32_t *found = bsearch(&pageId, constData_Array(ids), size_Array(ids),
+                                        sizeof(uint32_t), cmpTrigram_);
+        if (found) {
+            remove_Array(ids, found - (const uint32_t *) constData_Array(ids));
+        }
+        if (isEmpty_Array(ids)) {
+            deinit_Array(ids);
+        }
+        else {
+            posts[num++] = posts[i];
+        }
+    }
+    resize_Array(&d->postings, num);
+}
+
+static void removePage_PageIndex_(iPageIndex *d, size_t index) {
+    iIndexedPage *page = at_Array(&d->pages, index);
+    if (d->isPostingsValid) {
+        removePostings_PageIndex_(d, page->id);
+    }
+    deinit_IndexedPage_(page);
+    remove_Array(&d->pages, index);
+}
+
+static size_t findUrl_(const iArray *pages, const iString *url) {
+    iConstForEach(Array, i, pages) {
+        if (equal_String(&((const iIndexedPage *) i.value)->url, url)) {
+            return index_ArrayConstIterator(&i);
+        }
+    }
+    return iInvalidPos;
+}
+
+static void indexPending_PageIndex_(iPageIndex *d) {
+    /* `mtx` must be locked. Pages are moved from the pending queue while both locks are
+       held, so a removal can't miss a page that is being indexed. */
+    lock_Mutex(d->pendingMtx);
+    if (isEmpty_Array(&d->pending)) {
+        unlock_Mutex(d->pendingMtx);
+        return;
+    }
+    loadDeferred_PageIndex_(d);
+    iForEach(Array, p, &d->pending) {
+        iIndexedPage *page = p.value;
+        /* The page may have changed since it was last indexed. */
+        const size_t old = findUrl_(&d->pages, &page->url);
+        if (old != iInvalidPos) {
+            removePage_PageIndex_(d, old);
+        }
+        while (size_Array(&d->pages) >= maxPages_PageIndex_) {
+            removePage_PageIndex_(d, 0); /* oldest */
+        }
+        page->id = d->nextId++;
+        pushBack_Array(&d->pages, page);
+        if (d->isPostingsValid) {
+            addPostings_PageIndex_(d, page);
+        }
+        d->isModified = iTrue;
+    }
+    clear_Array(&d->pending); /* pages were moved */
+    unlock_Mutex(d->pendingMtx);
+}
+
+static iThreadResult index_PageIndex_(iThread *thread) {
+    iPageIndex *d = userData_Thread(thread);
+    for (;;) {
+        lock_Mutex(d->mtx);
+        indexPending_PageIndex_(d);
+        unlock_Mutex(d->mtx);
+        iBool isDone;
+        lock_Mutex(d->pendingMtx);
+        isDone = isEmpty_Array(&d->pending);
+        if (isDone) {
+            d->isIndexing = iFalse;
+        }
+        unlock_Mutex(d->pendingMtx);
+        if (isDone) {
+            break;
+        }
+    }
+    return 0;
+}
+
+void add_PageIndex(iPageIndex *d, const iString *url, const iGmResponse *response) {
+    if (category_GmStatusCode(response->statusCode) != categorySuccess_GmStatusCode ||
+        !startsWithCase_String(&response->meta, "text/") || isEmpty_Block(&response->body) ||
+        equalCase_Rangecc(urlScheme_String(url), "about")) {
+        return;
+    }
+    iRangecc text = range_Block(&response->body);
+    if (size_Range(&text) > maxTextSize_PageIndex_) {
+        text.end = text.start + maxTextSize_PageIndex_;
+        while (text.end > text.start && text.end[-1] != '\n') {
+            text.end--;
+        }
+    }
+    iIndexedPage page;
+    init_IndexedPage_(&page, 0); /* ID is assigned when indexed */
+    set_String(&page.url, url);
+    setRange_String(&page.text, text);
+    /* Indexing is done in the background so searches in progress don't block the caller. */
+    lock_Mutex(d->pendingMtx);
+    const size_t old = findUrl_(&d->pending, url);
+    if (old != iInvalidPos) {
+        deinit_IndexedPage_(at_Array(&d->pending, old));
+        remove_Array(&d->pending, old);
+    }
+    pushBack_Array(&d->pending, &page);
+    if (!d->isIndexing) {
+        waitForIndexer_PageIndex_(d); /* already finished */
+        d->isIndexing = iTrue;
+        d->indexer    = new_Thread(index_PageIndex_);
+        setUserData_Thread(d->indexer, d);
+        start_Thread(d->indexer);
+    }
+    unlock_Mutex(d->pendingMtx);
+}
+
+void remove_PageIndex(iPageIndex *d, const iString *url) {
+    lock_Mutex(d->mtx);
+    lock_Mutex(d->pendingMtx);
+    const size_t pending = findUrl_(&d->pending, url);
+    if (pending != iInvalidPos) {
+        deinit_IndexedPage_(at_Array(&d->pending, pending));
+        remove_Array(&d->pending, pending);
+    }
+    unlock_Mutex(d->pendingMtx);
+    loadDeferred_PageIndex_(d);
+    const size_t index = findUrl_(&d->pages, url);
+    if (index != iInvalidPos) {
+        removePage_PageIndex_(d, index);
+        d->isModified = iTrue;
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static const iPostings *findPostings_PageIndex_(const iPageIndex *d, uint32_t trigram) {
+    /* The trigram is the first member so postings can be compared as trigrams. */
+    return bsearch(&trigram, constData_Array(&d->postings), size_Array(&d->postings),
+                   sizeof(iPostings), cmpTrigram_);
+}
+
+static void intersect_(iArray *ids, const iArray *other) {
+    uint32_t       *dst = data_Array(ids);
+    const uint32_t *a   = constData_Array(ids);
+    const uint32_t *b   = constData_Array(other);
+    size_t i = 0, j = 0, num = 0;
+    while (i < size_Array(ids) && j < size_Array(other)) {
+        if (a[i] < b[j]) {
+            i++;
+        }
+        else if (a[i] > b[j]) {
+            j++;
+        }
+        else {
+            dst[num++] = a[i++];
+            j++;
+        }
+    }
+    resize_Array(ids, num);
+}
+
+static void appendMatch_(iStringArray *results, const iIndexedPage *page, const iRegExp *pattern) {
+    iRegExpMatch m;
+    init_RegExpMatch(&m);
+    if (!matchString_RegExp(pattern, &page->text, &m)) {
+        return;
+    }
+    iString entry;
+    init_String(&entry);
+    iRangei cap = m.range;
+    const int prefix = iMin(10, cap.start);
+    cap.start   = cap.start - prefix;
+    cap.end     = iMin(cap.end + 30, (int) size_String(&page->text));
+    const size_t maxLen = 60;
+    if (size_Range(&cap) > maxLen) {
+        cap.end = cap.start + maxLen;
+    }
+    iString content;
+    initRange_String(&content, (iRangecc){ m.subject + cap.start, m.subject + cap.end });
+    /* This needs cleaning up; highlight the matched word. */
+    replace_Block(&content.chars, '\n', ' ');
+    replace_Block(&content.chars, '\r', ' ');
+    if (prefix + size_Range(&m.range) < size_String(&content)) {
+        insertData_Block(&content.chars, prefix + size_Range(&m.range), uiText_ColorEscape, 2);
+    }
+    insertData_Block(&content.chars, prefix, uiTextStrong_ColorEscape, 2);
+    format_String(&entry, "match len:%zu str:%s", size_String(&content), cstr_String(&content));
+    deinit_String(&content);
+    appendFormat_String(&entry, " url:%s", cstr_String(&page->url));
+    pushBack_StringArray(results, &entry);
+    deinit_String(&entry);
+}
+
+const iStringArray *search_PageIndex(iPageIndex *d, const iString *terms, const iRegExp *pattern) {
+    iStringArray *results = iClob(new_StringArray());
+    iArray query, candidates;
+    init_Array(&query, sizeof(uint32_t));
+    init_Array(&candidates, sizeof(uint32_t));
+    trigrams_(range_String(terms), &query);
+    lock_Mutex(d->mtx);
+    loadDeferred_PageIndex_(d);
+    if (!d->isPostingsValid) {
+        buildPostings_PageIndex_(d);
+    }
+    if (isEmpty_Array(&query)) {
+        /* Terms are too short to use the index. */
+        iConstForEach(Array, i, &d->pages) {
+            pushBack_Array(&candidates, &((const iIndexedPage *) i.value)->id);
+        }
+    }
+    else {
+        /* Candidate pages contain all the trigrams of the terms. */
+        iConstForEach(Array, q, &query) {
+            const iPostings *post = findPostings_PageIndex_(d, *(const uint32_t *) q.value);
+            if (!post) {
+                clear_Array(&candidates);
+                break;
+            }
+            if (index_ArrayConstIterator(&q) == 0) {
+                setCopy_Array(&candidates, &post->pageIds);
+            }
+            else {
+                intersect_(&candidates, &post->pageIds);
+            }
+            if (isEmpty_Array(&candidates)) {
+                break;
+            }
+        }
+    }
+    /* Both pages and candidates are in ascending order of ID. */
+    const uint32_t *cand    = constData_Array(&candidates);
+    const uint32_t *candEnd = cand + size_Array(&candidates);
+    iConstForEach(Array, i, &d->pages) {
+        const iIndexedPage *page = i.value;
+        if (cand == candEnd) {
+            break;
+        }
+        if (*cand == page->id) {
+            appendMatch_(results, page, pattern);
+            cand++;
+        }
+    }
+    unlock_Mutex(d->mtx);
+    deinit_Array(&candidates);
+    deinit_Array(&query);
+    return results;
+}
@@ -0,0 +1,44 @@
+/* Copyright 2023 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include "gmrequest.h"
+
+#include <the_Foundation/regexp.h>
+#include <the_Foundation/stringarray.h>
+
+/* Full-text index of visited pages. The text of each page is kept so pages can be
+   searched even after they are no longer cached in memory. */
+
+iDeclareType(PageIndex)
+iDeclareTypeConstruction(PageIndex)
+
+void    clear_PageIndex         (iPageIndex *);
+void    load_PageIndex          (iPageIndex *, const char *dirPath); /* deferred until used */
+void    save_PageIndex          (iPageIndex *, const char *dirPath); /* if modified */
+void    add_PageIndex           (iPageIndex *, const iString *url, const iGmResponse *response);
+void    remove_PageIndex        (iPageIndex *, const iString *url);
+size_t  numPages_PageIndex      (const iPageIndex *);
+
+const iStringArray *search_PageIndex(iPageIndex *, const iString *terms,
+                                     const iRegExp *pattern); /* chronologically ascending */
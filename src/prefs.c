@@ -95,9 +95,11 @@ void init_Prefs(iPrefs *d) {
     d->edgeSwipe = iTrue;
     d->pageSwipe = iTrue;
     d->allowSchemeChangingRedirect = iFalse; /* must be manually followed */
+    d->prefetchOnHover = iFalse;
     d->decodeUserVisibleURLs = iTrue;
     d->maxCacheSize      = 10;
     d->maxMemorySize     = 200;
+    d->maxRunCacheSize   = 8;
     d->maxUrlSize        = 8192;
     setCStr_String(&d->strings[uiFont_PrefsString], "default");
     setCStr_String(&d->strings[headingFont_PrefsString], "default");
@@ -98,6 +98,7 @@ enum iPrefsBool {
     /* Network */
     decodeUserVisibleURLs_PrefsBool,
     allowSchemeChangingRedirect_PrefsBool,
+    prefetchOnHover_PrefsBool,
     
     /* Style */
     monospaceGemini_PrefsBool,
@@ -169,6 +170,7 @@ struct Impl_Prefs {
             /* Network */
             iBool decodeUserVisibleURLs;
             iBool allowSchemeChangingRedirect;
+            iBool prefetchOnHover; /* look up link hosts in advance */
             
             /* Style */
             iBool monospaceGemini;
@@ -210,6 +212,7 @@ struct Impl_Prefs {
     /* Network */
     int              maxCacheSize; /* MB */
     int              maxMemorySize; /* MB */
+    int              maxRunCacheSize; /* MB; shaped text runs cached by each window */
     int              maxUrlSize; /* bytes; longer ones will be disregarded */
     /* Style */
     iStringSet *     disabledFontPacks;
@@ -234,3 +237,7 @@ iLocalDef float scrollSpeedFactor_Prefs(const iPrefs *d, enum iScrollType type)
 iLocalDef enum iGmDocumentTheme docTheme_Prefs(const iPrefs *d) {
     return isDark_ColorTheme(d->theme) ? d->docThemeDark : d->docThemeLight;
 }
+
+iLocalDef size_t runCacheBudget_Prefs(const iPrefs *d) {
+    return (size_t) d->maxRunCacheSize * 1000000;
+}
@@ -0,0 +1,304 @@
+/* Copyright 2023 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "profiler.h"
+#include "ui/color.h"
+#include "ui/metrics.h"
+#include "ui/paint.h"
+#include "ui/text.h"
+#include "ui/window.h"
+
+#include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
+#include <SDL_thread.h>
+#include <SDL_timer.h>
+
+iDeclareType(ProfilerEvent)
+
+struct Impl_ProfilerEvent {
+    uint64_t begin; /* performance counter values */
+    uint64_t end;
+    uint32_t thread;
+    int      scope;
+};
+
+static const struct {
+    const char *label;     /* shown in the overlay */
+    const char *traceName; /* event name in exported traces */
+} scopes_Profiler_[max_ProfilerScope] = {
+    { "Drawing",      "draw_MainWindow" },
+    { "Events",       "dispatchEvent_Window" },
+    { "Tickers",      "runTickers_App" },
+    { "Layout",       "doLayout_GmDocument" },
+    { "Page render",  "render_DocumentView" },
+    { "Rasterizing",  "rasterizeGlyph_Font" },
+    { "Uploading",    "flushGlyphUploads_Text" },
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(Profiler)
+
+#define numFrames_Profiler_ 120
+
+static const size_t maxEvents_Profiler_ = 100000; /* oldest are discarded */
+
+struct Impl_Profiler {
+    iMutex *        mtx;
+    iBool           isEnabled;
+    uint64_t        startTime;
+    uint64_t        frequency;
+    iProfilerEvent *events; /* ring buffer */
+    size_t          firstEvent;
+    size_t          numEvents;
+    double          current[max_ProfilerScope]; /* ms spent during the frame in progress */
+    double          frames[numFrames_Profiler_][max_ProfilerScope];
+    size_t          numFrames; /* total number of finished frames */
+};
+
+static iProfiler profiler_;
+
+/* Nested scopes are not counted twice. Each thread has its own nesting, so concurrent
+   scopes in different threads are all counted. */
+static _Thread_local int depth_Profiler_[max_ProfilerScope];
+
+void init_Profiler(void) {
+    iProfiler *d = &profiler_;
+    iZap(*d);
+    d->mtx       = new_Mutex();
+    d->frequency = SDL_GetPerformanceFrequency();
+}
+
+void deinit_Profiler(void) {
+    iProfiler *d = &profiler_;
+    free(d->events);
+    delete_Mutex(d->mtx);
+    iZap(*d);
+}
+
+static double toMs_Profiler_(const iProfiler *d, uint64_t ticks) {
+    return (double) ticks * 1000.0 / (double) d->frequency;
+}
+
+static double toUs_Profiler_(const iProfiler *d, uint64_t ticks) {
+    return (double) ticks * 1000000.0 / (double) d->frequency;
+}
+
+void setEnabled_Profiler(iBool enable) {
+    iProfiler *d = &profiler_;
+    lock_Mutex(d->mtx);
+    if (enable && !d->isEnabled) {
+        /* Start a new recording. */
+        if (!d->events) {
+            d->events = malloc(sizeof(iProfilerEvent) * maxEvents_Profiler_);
+        }
+        d->startTime  = SDL_GetPerformanceCounter();
+        d->firstEvent = 0;
+        d->numEvents  = 0;
+        d->numFrames  = 0;
+        iZap(d->current);
+    }
+    d->isEnabled = enable;
+    unlock_Mutex(d->mtx);
+}
+
+iBool isEnabled_Profiler(void) {
+    return profiler_.isEnabled;
+}
+
+uint64_t begin_Profiler(enum iProfilerScope scope) {
+    iProfiler *d = &profiler_;
+    if (!d->isEnabled) {
+        return 0;
+    }
+    depth_Profiler_[scope]++;
+    return SDL_GetPerformanceCounter();
+}
+
+void end_Profiler(enum iProfilerScope scope, uint64_t begin) {
+    if (!begin) {
+        return;
+    }
+    iProfiler *d = &profiler_;
+    const uint64_t end = SDL_GetPerformanceCounter();
+    /* Always unwound, even if the profiler was disabled during the scope. */
+    const iBool isOutermost = (--depth_Profiler_[scope] == 0);
+    lock_Mutex(d->mtx);
+    if (d->isEnabled) {
+        if (isOutermost) {
+            d->current[scope] += toMs_Profiler_(d, end - begin);
+        }
+        /* When the buffer is full, the oldest event gets overwritten. */
+        iProfilerEvent *ev = &d->events[(d->firstEvent + d->numEvents) % maxEvents_Profiler_];
+        if (d->numEvents == maxEvents_Profiler_) {
+            d->firstEvent = (d->firstEvent + 1) % maxEvents_Profiler_;
+        }
+        else {
+            d->numEvents++;
+        }
+        ev->begin  = begin;
+        ev->end    = end;
+        ev->thread = (uint32_t) SDL_ThreadID();
+        ev->scope  = scope;
+    }
+    unlock_Mutex(d->mtx);
+}
+
+void endFrame_Profiler(void) {
+    iProfiler *d = &profiler_;
+    if (!d->isEnabled) {
+        return;
+    }
+    lock_Mutex(d->mtx);
+    memcpy(d->frames[d->numFrames % numFrames_Profiler_], d->current, sizeof(d->current));
+    iZap(d->current);
+    d->numFrames++;
+    unlock_Mutex(d->mtx);
+}
+
+iDeclareType(ProfilerStats)
+
+struct Impl_ProfilerStats {
+    double last;
+    double average;
+    double peak;
+};
+
+static size_t stats_Profiler_(iProfiler *d, iProfilerStats *stats_out) {
+    lock_Mutex(d->mtx);
+    const size_t numFrames = iMin(d->numFrames, numFrames_Profiler_);
+    for (int scope = 0; scope < max_ProfilerScope; scope++) {
+        iProfilerStats *st = &stats_out[scope];
+        iZap(*st);
+        if (numFrames == 0) {
+            continue;
+        }
+        st->last = d->frames[(d->numFrames - 1) % numFrames_Profiler_][scope];
+        for (size_t i = 0; i < numFrames; i++) {
+            const double ms = d->frames[i][scope];
+            st->average += ms;
+            st->peak = iMax(st->peak, ms);
+        }
+        st->average /= numFrames;
+    }
+    unlock_Mutex(d->mtx);
+    return numFrames;
+}
+
+void drawOverlay_Profiler(iRect area) {
+    iProfiler *d = &profiler_;
+    if (!d->isEnabled) {
+        return;
+    }
+    iProfilerStats stats[max_ProfilerScope];
+    stats_Profiler_(d, stats);
+    const int   font    = uiLabelSmall_FontId;
+    const int   lineHgt = lineHeight_Text(font);
+    const int   colWidth = 6 * gap_UI;
+    const iInt2 size    = init_I2(14 * gap_UI + 3 * colWidth,
+                                  (max_ProfilerScope + 1) * lineHgt + 2 * gap_UI);
+    const iRect rect    = { sub_I2(bottomRight_Rect(area), add_I2(size, init1_I2(gap_UI))), size };
+    iPaint p;
+    init_Paint(&p);
+    fillRect_Paint(&p, rect, uiBackground_ColorId);
+    drawRect_Paint(&p, rect, uiSeparator_ColorId);
+    iInt2 pos = add_I2(topLeft_Rect(rect), init1_I2(gap_UI));
+    const int right = right_Rect(rect) - gap_UI;
+    draw_Text(font, pos, uiTextStrong_ColorId, "Frame (ms)");
+    drawAlign_Text(font, init_I2(right - 2 * colWidth, pos.y), uiTextStrong_ColorId,
+                   right_Alignment, "last");
+    drawAlign_Text(font, init_I2(right - colWidth, pos.y), uiTextStrong_ColorId,
+                   right_Alignment, "avg");
+    drawAlign_Text(font, init_I2(right, pos.y), uiTextStrong_ColorId, right_Alignment, "max");
+    for (int scope = 0; scope < max_ProfilerScope; scope++) {
+        const iProfilerStats *st = &stats[scope];
+        pos.y += lineHgt;
+        draw_Text(font, pos, uiTextDim_ColorId, "%s", scopes_Profiler_[scope].label);
+        drawAlign_Text(font, init_I2(right - 2 * colWidth, pos.y), uiText_ColorId,
+                       right_Alignment, "%.2f", st->last);
+        drawAlign_Text(font, init_I2(right - colWidth, pos.y), uiText_ColorId,
+                       right_Alignment, "%.2f", st->average);
+        drawAlign_Text(font, init_I2(right, pos.y), uiText_ColorId,
+                       right_Alignment, "%.2f", st->peak);
+    }
+}
+
+const iString *infoPage_Profiler(void) {
+    iProfiler *d = &profiler_;
+    iString *page = collectNew_String();
+    iProfilerStats stats[max_ProfilerScope];
+    const size_t numFrames = stats_Profiler_(d, stats);
+    appendFormat_String(page, "# Frame profiler\n");
+    appendFormat_String(page, "The profiler measures where time goes during each frame. While it "
+                              "is enabled, an overlay with the timings is shown in the window.\n");
+    appendFormat_String(page, "=> about:command?profiler.toggle %s\n",
+                        d->isEnabled ? "Disable profiler" : "Enable profiler");
+    appendFormat_String(page, "=> about:command?window.damage.toggle %s\n",
+                        isDamageShown_Window() ? "Stop tinting redrawn areas"
+                                               : "Tint redrawn areas (when the profiler is off)");
+    if (d->numEvents) {
+        appendFormat_String(page, "=> about:command?profiler.export Export trace "
+                                  "(%zu events, Chrome trace event format)\n", d->numEvents);
+    }
+    if (numFrames) {
+        appendFormat_String(page, "## Last %zu frames\n```\n", numFrames);
+        appendFormat_String(page, "%-16s %8s %8s %8s\n", "(ms)", "last", "avg", "max");
+        for (int scope = 0; scope < max_ProfilerScope; scope++) {
+            appendFormat_String(page, "%-16s %8.2f %8.2f %8.2f\n",
+                                scopes_Profiler_[scope].label,
+                                stats[scope].last,
+                                stats[scope].average,
+                                stats[scope].peak);
+        }
+        appendCStr_String(page, "```\n");
+    }
+    return page;
+}
+
+iBool exportTrace_Profiler(const iString *path) {
+    iProfiler *d = &profiler_;
+    iString *json = new_String();
+    appendCStr_String(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    lock_Mutex(d->mtx);
+    for (size_t i = 0; i < d->numEvents; i++) {
+        const iProfilerEvent *ev = &d->events[(d->firstEvent + i) % maxEvents_Profiler_];
+        appendFormat_String(json,
+                            "%s{\"name\":\"%s\",\"cat\":\"lagrange\",\"ph\":\"X\",\"pid\":1,"
+                            "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}\n",
+                            i > 0 ? "," : "",
+                            scopes_Profiler_[ev->scope].traceName,
+                            ev->thread,
+                            toUs_Profiler_(d, ev->begin - d->startTime),
+                            toUs_Profiler_(d, ev->end - ev->begin));
+    }
+    unlock_Mutex(d->mtx);
+    appendCStr_String(json, "]}\n");
+    iBool ok = iFalse;
+    iFile *f = new_File(path);
+    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
+        write_File(f, utf8_String(json));
+        ok = iTrue;
+    }
+    iRelease(f);
+    delete_String(json);
+    return ok;
+}
@@ -0,0 +1,56 @@
+/* Copyright 2023 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/rect.h>
+#include <the_Foundation/string.h>
+#include <stdint.h>
+
+/* Opt-in timing of the hot paths of a frame. Scopes are measured only when the profiler
+   is enabled; otherwise, marking a scope costs a single check. Results are shown in an
+   overlay in the main window and can be exported in the Chrome trace event format. */
+
+enum iProfilerScope {
+    draw_ProfilerScope,
+    event_ProfilerScope,
+    tickers_ProfilerScope,
+    layout_ProfilerScope,
+    render_ProfilerScope,
+    rasterize_ProfilerScope,
+    upload_ProfilerScope,
+    max_ProfilerScope
+};
+
+void        init_Profiler           (void);
+void        deinit_Profiler         (void);
+
+void        setEnabled_Profiler     (iBool enable);
+iBool       isEnabled_Profiler      (void);
+
+uint64_t    begin_Profiler          (enum iProfilerScope scope); /* zero when not profiling */
+void        end_Profiler            (enum iProfilerScope scope, uint64_t begin);
+void        endFrame_Profiler       (void);
+
+void        drawOverlay_Profiler    (iRect area);
+const iString * infoPage_Profiler   (void);
+iBool       exportTrace_Profiler    (const iString *path);
@@ -0,0 +1,188 @@
+/* Copyright 2023 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "resolver.h"
+#include "gmutil.h"
+#include "app.h"
+
+#include <the_Foundation/address.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/time.h>
+
+iDeclareType(ResolverEntry)
+iDeclareTypeConstruction(ResolverEntry)
+
+/* Only the time of the last lookup is kept. The addresses themselves are not used:
+   connections do their own lookup, which is then answered from the system resolver's
+   cache. */
+struct Impl_ResolverEntry {
+    iString hostName;
+    iTime   time;
+};
+
+void init_ResolverEntry(iResolverEntry *d) {
+    init_String(&d->hostName);
+    initCurrent_Time(&d->time);
+}
+
+void deinit_ResolverEntry(iResolverEntry *d) {
+    deinit_String(&d->hostName);
+}
+
+iDefineTypeConstruction(ResolverEntry)
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(Resolver)
+
+static const size_t maxEntries_Resolver_ = 64;
+static const size_t maxPending_Resolver_ = 4;
+static const double ttlSeconds_Resolver_ = 5 * 60; /* system resolvers keep entries cached
+                                                      for at least this long, typically */
+
+struct Impl_Resolver {
+    iMutex *  mtx;
+    iPtrArray entries; /* most recently used first */
+    iPtrArray lookups; /* iAddress objects; released when no longer pending */
+    size_t    numPrefetched;
+};
+
+static iResolver resolver_;
+
+void init_Resolver(void) {
+    iResolver *d = &resolver_;
+    d->mtx = new_Mutex();
+    init_PtrArray(&d->entries);
+    init_PtrArray(&d->lookups);
+    d->numPrefetched = 0;
+}
+
+void deinit_Resolver(void) {
+    iResolver *d = &resolver_;
+    iForEach(PtrArray, i, &d->lookups) {
+        waitForFinished_Address(i.ptr);
+        iRelease(i.ptr);
+    }
+    deinit_PtrArray(&d->lookups);
+    iForEach(PtrArray, j, &d->entries) {
+        delete_ResolverEntry(j.ptr);
+    }
+    deinit_PtrArray(&d->entries);
+    delete_Mutex(d->mtx);
+}
+
+static iResolverEntry *take_Resolver_(iResolver *d, const iString *hostName) {
+    iForEach(PtrArray, i, &d->entries) {
+        iResolverEntry *entry = i.ptr;
+        if (equalCase_String(&entry->hostName, hostName)) {
+            remove_PtrArrayIterator(&i);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static size_t numPending_Resolver_(iResolver *d) {
+    /* Finished lookups are released here so the caller never has to wait for one. */
+    iForEach(PtrArray, i, &d->lookups) {
+        if (!isPending_Address(i.ptr)) {
+            iRelease(i.ptr);
+            remove_PtrArrayIterator(&i);
+        }
+    }
+    return size_PtrArray(&d->lookups);
+}
+
+static void insert_Resolver_(iResolver *d, iResolverEntry *entry) {
+    pushFront_PtrArray(&d->entries, entry);
+    while (size_PtrArray(&d->entries) > maxEntries_Resolver_) {
+        delete_ResolverEntry(at_PtrArray(&d->entries, size_PtrArray(&d->entries) - 1));
+        popBack_Array(&d->entries);
+    }
+}
+
+void touch_Resolver(const iString *hostName) {
+    iResolver *d = &resolver_;
+    if (isEmpty_String(hostName)) {
+        return;
+    }
+    lock_Mutex(d->mtx);
+    iResolverEntry *entry = take_Resolver_(d, hostName);
+    if (!entry) {
+        entry = new_ResolverEntry();
+        set_String(&entry->hostName, hostName);
+    }
+    initCurrent_Time(&entry->time);
+    insert_Resolver_(d, entry);
+    unlock_Mutex(d->mtx);
+}
+
+void prefetch_Resolver(const iString *url) {
+    iResolver *d = &resolver_;
+    iUrl parts;
+    init_Url(&parts, url);
+    if (isEmpty_Range(&parts.host) || schemeProxy_App(parts.scheme)) {
+        return; /* local resource, or the connection goes to a proxy */
+    }
+    const iBool isRemote = equalCase_Rangecc(parts.scheme, "gemini") ||
+                           equalCase_Rangecc(parts.scheme, "titan") ||
+                           equalCase_Rangecc(parts.scheme, "spartan") ||
+                           equalCase_Rangecc(parts.scheme, "gopher") ||
+                           equalCase_Rangecc(parts.scheme, "finger");
+    if (!isRemote) {
+        return;
+    }
+    const iString *hostName = collectNewRange_String(parts.host);
+    lock_Mutex(d->mtx);
+    iResolverEntry *entry = take_Resolver_(d, hostName);
+    if (entry && elapsedSeconds_Time(&entry->time) < ttlSeconds_Resolver_) {
+        insert_Resolver_(d, entry); /* still fresh */
+        unlock_Mutex(d->mtx);
+        return;
+    }
+    if (numPending_Resolver_(d) >= maxPending_Resolver_) {
+        if (entry) {
+            insert_Resolver_(d, entry);
+        }
+        unlock_Mutex(d->mtx);
+        return;
+    }
+    if (!entry) {
+        entry = new_ResolverEntry();
+        set_String(&entry->hostName, hostName);
+    }
+    initCurrent_Time(&entry->time);
+    iAddress *addr = new_Address();
+    lookupTcp_Address(addr, hostName, port_Url(&parts));
+    pushBack_PtrArray(&d->lookups, addr);
+    d->numPrefetched++;
+    insert_Resolver_(d, entry);
+    unlock_Mutex(d->mtx);
+}
+
+size_t numPrefetched_Resolver(void) {
+    iResolver *d = &resolver_;
+    size_t num;
+    iGuardMutex(d->mtx, num = d->numPrefetched);
+    return num;
+}
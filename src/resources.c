@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "resources.h"
 
 #include <the_Foundation/archive.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/version.h>
 
 #if defined (iPlatformAndroidMobile)
@@ -30,98 +31,62 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #endif
 
 static iArchive *archive_;
+static iMutex *  mtx_;
+static iBlock    empty_;
 
-iBlock blobAbout_Resources;
-iBlock blobHelp_Resources;
-iBlock blobLagrange_Resources;
-iBlock blobLicense_Resources;
-iBlock blobVersion_0_13_Resources;
-iBlock blobVersion_1_5_Resources;
-iBlock blobVersion_1_10_Resources;
-iBlock blobVersion_Resources;
-iBlock blobArghelp_Resources;
-iBlock blobCs_Resources;
-iBlock blobDe_Resources;
-iBlock blobEn_Resources;
-iBlock blobEo_Resources;
-iBlock blobEs_Resources;
-iBlock blobEs_MX_Resources;
-iBlock blobEu_Resources;
-iBlock blobFi_Resources;
-iBlock blobFr_Resources;
-iBlock blobGl_Resources;
-iBlock blobHu_Resources;
-iBlock blobIa_Resources;
-iBlock blobIe_Resources;
-iBlock blobIsv_Resources;
-iBlock blobIt_Resources;
-iBlock blobJa_Resources;
-iBlock blobNl_Resources;
-iBlock blobPl_Resources;
-iBlock blobRu_Resources;
-iBlock blobSk_Resources;
-iBlock blobSr_Resources;
-iBlock blobTok_Resources;
-iBlock blobTr_Resources;
-iBlock blobUk_Resources;
-iBlock blobZh_Hans_Resources;
-iBlock blobZh_Hant_Resources;
-iBlock imageShadow_Resources;
-iBlock imageLagrange64_Resources;
-iBlock blobMacosSystemFontsIni_Resources;
-iBlock blobCacertPem_Resources;
-
+/* Resources are extracted from the archive only when they are first needed, so languages
+   and pages that are never viewed do not have to be decompressed at launch. */
 static struct {
-    iBlock *data;
-    const char *archivePath;
-} entries_[] = {
-    { &blobAbout_Resources, "about/about.gmi" },
-    { &blobLagrange_Resources, "about/lagrange.gmi" },
-    { &blobLicense_Resources, "about/license.gmi" },
+    const char *  archivePath;
+    const iBlock *data; /* owned by the archive */
+} entries_[max_ResourceId] = {
+    [about_ResourceId]               = { "about/about.gmi" },
+    [lagrange_ResourceId]            = { "about/lagrange.gmi" },
+    [license_ResourceId]             = { "about/license.gmi" },
 #if defined (iPlatformAppleMobile)
-    { &blobHelp_Resources, "about/ios-help.gmi" },
-    { &blobVersion_Resources, "about/ios-version.gmi" },
+    [help_ResourceId]                = { "about/ios-help.gmi" },
+    [version_ResourceId]             = { "about/ios-version.gmi" },
 #elif defined (iPlatformAndroidMobile)
-    { &blobHelp_Resources, "about/android-help.gmi" },
-    { &blobVersion_Resources, "about/android-version.gmi" },
+    [help_ResourceId]                = { "about/android-help.gmi" },
+    [version_ResourceId]             = { "about/android-version.gmi" },
 #else
-    { &blobHelp_Resources, "about/help.gmi" },
-    { &blobVersion_0_13_Resources, "about/version-0.13.gmi" },
-    { &blobVersion_1_5_Resources, "about/version-1.5.gmi" },
-    { &blobVersion_1_10_Resources, "about/version-1.10.gmi" },
-    { &blobVersion_Resources, "about/version.gmi" },
+    [help_ResourceId]                = { "about/help.gmi" },
+    [version_0_13_ResourceId]        = { "about/version-0.13.gmi" },
+    [version_1_5_ResourceId]         = { "about/version-1.5.gmi" },
+    [version_1_10_ResourceId]        = { "about/version-1.10.gmi" },
+    [version_ResourceId]             = { "about/version.gmi" },
 #endif
-    { &blobArghelp_Resources, "arg-help.txt" },
-    { &blobCs_Resources, "lang/cs.bin" },
-    { &blobDe_Resources, "lang/de.bin" },
-    { &blobEn_Resources, "lang/en.bin" },
-    { &blobEo_Resources, "lang/eo.bin" },
-    { &blobEs_Resources, "lang/es.bin" },
-    { &blobEs_MX_Resources, "lang/es_MX.bin" },
-    { &blobEu_Resources, "lang/eu.bin" },
-    { &blobFi_Resources, "lang/fi.bin" },
-    { &blobFr_Resources, "lang/fr.bin" },
-    { &blobGl_Resources, "lang/gl.bin" },
-    { &blobHu_Resources, "lang/hu.bin" },
-    { &blobIa_Resources, "lang/ia.bin" },
-    { &blobIe_Resources, "lang/ie.bin" },
-    { &blobIsv_Resources, "lang/isv.bin" },
-    { &blobIt_Resources, "lang/it.bin" },
-    { &blobJa_Resources, "lang/ja.bin" },
-    { &blobNl_Resources, "lang/nl.bin" },
-    { &blobPl_Resources, "lang/pl.bin" },
-    { &blobRu_Resources, "lang/ru.bin" },
-    { &blobSk_Resources, "lang/sk.bin" },
-    { &blobSr_Resources, "lang/sr.bin" },
-    { &blobTok_Resources, "lang/tok.bin" },
-    { &blobTr_Resources, "lang/tr.bin" },
-    { &blobUk_Resources, "lang/uk.bin" },
-    { &blobZh_Hans_Resources, "lang/zh_Hans.bin" },
-    { &blobZh_Hant_Resources, "lang/zh_Hant.bin" },
-    { &imageShadow_Resources, "shadow.png" },
-    { &imageLagrange64_Resources, "lagrange-64.png" },
-    { &blobMacosSystemFontsIni_Resources, "macos-system-fonts.ini" },
-    { &blobCacertPem_Resources, "cacert.pem" },
+    [argHelp_ResourceId]             = { "arg-help.txt" },
+    [langCs_ResourceId]              = { "lang/cs.bin" },
+    [langDe_ResourceId]              = { "lang/de.bin" },
+    [langEn_ResourceId]              = { "lang/en.bin" },
+    [langEo_ResourceId]              = { "lang/eo.bin" },
+    [langEs_ResourceId]              = { "lang/es.bin" },
+    [langEsMX_ResourceId]            = { "lang/es_MX.bin" },
+    [langEu_ResourceId]              = { "lang/eu.bin" },
+    [langFi_ResourceId]              = { "lang/fi.bin" },
+    [langFr_ResourceId]              = { "lang/fr.bin" },
+    [langGl_ResourceId]              = { "lang/gl.bin" },
+    [langHu_ResourceId]              = { "lang/hu.bin" },
+    [langIa_ResourceId]              = { "lang/ia.bin" },
+    [langIe_ResourceId]              = { "lang/ie.bin" },
+    [langIsv_ResourceId]             = { "lang/isv.bin" },
+    [langIt_ResourceId]              = { "lang/it.bin" },
+    [langJa_ResourceId]              = { "lang/ja.bin" },
+    [langNl_ResourceId]              = { "lang/nl.bin" },
+    [langPl_ResourceId]              = { "lang/pl.bin" },
+    [langRu_ResourceId]              = { "lang/ru.bin" },
+    [langSk_ResourceId]              = { "lang/sk.bin" },
+    [langSr_ResourceId]              = { "lang/sr.bin" },
+    [langTok_ResourceId]             = { "lang/tok.bin" },
+    [langTr_ResourceId]              = { "lang/tr.bin" },
+    [langUk_ResourceId]              = { "lang/uk.bin" },
+    [langZhHans_ResourceId]          = { "lang/zh_Hans.bin" },
+    [langZhHant_ResourceId]          = { "lang/zh_Hant.bin" },
+    [imageShadow_ResourceId]         = { "shadow.png" },
+    [imageLagrange64_ResourceId]     = { "lagrange-64.png" },
+    [macosSystemFontsIni_ResourceId] = { "macos-system-fonts.ini" },
+    [cacertPem_ResourceId]           = { "cacert.pem" },
 };
 
 iBool init_Resources(const char *path) {
@@ -148,12 +113,8 @@ iBool init_Resources(const char *path) {
         iVersion resVer;
         init_Version(&resVer, range_Block(dataCStr_Archive(archive_, "VERSION")));
         if (!cmp_Version(&resVer, &appVer)) {
-            iForIndices(i, entries_) {
-                const iBlock *data = dataCStr_Archive(archive_, entries_[i].archivePath);
-                if (data) {
-                    initCopy_Block(entries_[i].data, data);
-                }
-            }
+            mtx_ = new_Mutex();
+            init_Block(&empty_, 0);
             return iTrue;
         }
         fprintf(stderr, "[Resources] %s: version mismatch (%s != " LAGRANGE_APP_VERSION ")\n",
@@ -165,11 +126,44 @@ iBool init_Resources(const char *path) {
 
 void deinit_Resources(void) {
     iForIndices(i, entries_) {
-        deinit_Block(entries_[i].data);
+        entries_[i].data = NULL;
     }
+    deinit_Block(&empty_);
+    delete_Mutex(mtx_);
     iRelease(archive_);
 }
 
+const iBlock *blob_Resources(enum iResourceId id) {
+    iAssert(id < max_ResourceId);
+    const iBlock *data;
+    lock_Mutex(mtx_);
+    if (!entries_[id].data) {
+        const iBlock *extracted =
+            entries_[id].archivePath ? dataCStr_Archive(archive_, entries_[id].archivePath) : NULL;
+        entries_[id].data = extracted ? extracted : &empty_;
+    }
+    data = entries_[id].data;
+    unlock_Mutex(mtx_);
+    return data;
+}
+
+size_t numLoaded_Resources(size_t *totalSize_out) {
+    size_t count = 0;
+    size_t total = 0;
+    lock_Mutex(mtx_);
+    iForIndices(i, entries_) {
+        if (entries_[i].data) {
+            count++;
+            total += size_Block(entries_[i].data);
+        }
+    }
+    unlock_Mutex(mtx_);
+    if (totalSize_out) {
+        *totalSize_out = total;
+    }
+    return count;
+}
+
 const iArchive *archive_Resources(void) {
     return archive_;
 }
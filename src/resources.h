@@ -26,48 +26,92 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 iDeclareType(Archive)
 
+enum iResourceId {
+    about_ResourceId,
+    help_ResourceId,
+    lagrange_ResourceId,
+    license_ResourceId,
+    version_0_13_ResourceId,
+    version_1_5_ResourceId,
+    version_1_10_ResourceId,
+    version_ResourceId,
+    argHelp_ResourceId,
+    langCs_ResourceId,
+    langDe_ResourceId,
+    langEn_ResourceId,
+    langEo_ResourceId,
+    langEs_ResourceId,
+    langEsMX_ResourceId,
+    langEu_ResourceId,
+    langFi_ResourceId,
+    langFr_ResourceId,
+    langGl_ResourceId,
+    langHu_ResourceId,
+    langIa_ResourceId,
+    langIe_ResourceId,
+    langIsv_ResourceId,
+    langIt_ResourceId,
+    langJa_ResourceId,
+    langNl_ResourceId,
+    langPl_ResourceId,
+    langRu_ResourceId,
+    langSk_ResourceId,
+    langSr_ResourceId,
+    langTok_ResourceId,
+    langTr_ResourceId,
+    langUk_ResourceId,
+    langZhHans_ResourceId,
+    langZhHant_ResourceId,
+    imageShadow_ResourceId,
+    imageLagrange64_ResourceId,
+    macosSystemFontsIni_ResourceId,
+    cacertPem_ResourceId,
+    max_ResourceId
+};
+
 iBool               init_Resources      (const char *path);
 void                deinit_Resources    (void);
 
 const iArchive *    archive_Resources   (void);
+const iBlock *      blob_Resources      (enum iResourceId id); /* extracted on first use */
+size_t              numLoaded_Resources (size_t *totalSize_out);
 
-extern iBlock blobAbout_Resources;
-extern iBlock blobHelp_Resources;
-extern iBlock blobLagrange_Resources;
-extern iBlock blobLicense_Resources;
-extern iBlock blobVersion_0_13_Resources;
-extern iBlock blobVersion_1_5_Resources;
-extern iBlock blobVersion_1_10_Resources;
-extern iBlock blobVersion_Resources;
-extern iBlock blobArghelp_Resources;
-extern iBlock blobCs_Resources;
-extern iBlock blobDe_Resources;
-extern iBlock blobEn_Resources;
-extern iBlock blobEo_Resources;
-extern iBlock blobEs_Resources;
-extern iBlock blobEs_MX_Resources;
-extern iBlock blobEu_Resources;
-extern iBlock blobFi_Resources;
-extern iBlock blobFr_Resources;
-extern iBlock blobGl_Resources;
-extern iBlock blobHu_Resources;
-extern iBlock blobIa_Resources;
-extern iBlock blobIe_Resources;
-extern iBlock blobIsv_Resources;
-extern iBlock blobIt_Resources;
-extern iBlock blobJa_Resources;
-extern iBlock blobNl_Resources;
-extern iBlock blobPl_Resources;
-extern iBlock blobRu_Resources;
-extern iBlock blobSk_Resources;
-extern iBlock blobSr_Resources;
-extern iBlock blobTok_Resources;
-extern iBlock blobTr_Resources;
-extern iBlock blobUk_Resources;
-extern iBlock blobZh_Hans_Resources;
-extern iBlock blobZh_Hant_Resources;
-extern iBlock imageShadow_Resources;
-extern iBlock fontpackDefault_Resources;
-extern iBlock imageLagrange64_Resources;
-extern iBlock blobMacosSystemFontsIni_Resources;
-extern iBlock blobCacertPem_Resources;
+#define blobAbout_Resources               (*blob_Resources(about_ResourceId))
+#define blobHelp_Resources                (*blob_Resources(help_ResourceId))
+#define blobLagrange_Resources            (*blob_Resources(lagrange_ResourceId))
+#define blobLicense_Resources             (*blob_Resources(license_ResourceId))
+#define blobVersion_0_13_Resources        (*blob_Resources(version_0_13_ResourceId))
+#define blobVersion_1_5_Resources         (*blob_Resources(version_1_5_ResourceId))
+#define blobVersion_1_10_Resources        (*blob_Resources(version_1_10_ResourceId))
+#define blobVersion_Resources             (*blob_Resources(version_ResourceId))
+#define blobArghelp_Resources             (*blob_Resources(argHelp_ResourceId))
+#define blobCs_Resources                  (*blob_Resources(langCs_ResourceId))
+#define blobDe_Resources                  (*blob_Resources(langDe_ResourceId))
+#define blobEn_Resources                  (*blob_Resources(langEn_ResourceId))
+#define blobEo_Resources                  (*blob_Resources(langEo_ResourceId))
+#define blobEs_Resources                  (*blob_Resources(langEs_ResourceId))
+#define blobEs_MX_Resources               (*blob_Resources(langEsMX_ResourceId))
+#define blobEu_Resources                  (*blob_Resources(langEu_ResourceId))
+#define blobFi_Resources                  (*blob_Resources(langFi_ResourceId))
+#define blobFr_Resources                  (*blob_Resources(langFr_ResourceId))
+#define blobGl_Resources                  (*blob_Resources(langGl_ResourceId))
+#define blobHu_Resources                  (*blob_Resources(langHu_ResourceId))
+#define blobIa_Resources                  (*blob_Resources(langIa_ResourceId))
+#define blobIe_Resources                  (*blob_Resources(langIe_ResourceId))
+#define blobIsv_Resources                 (*blob_Resources(langIsv_ResourceId))
+#define blobIt_Resources                  (*blob_Resources(langIt_ResourceId))
+#define blobJa_Resources                  (*blob_Resources(langJa_ResourceId))
+#define blobNl_Resources                  (*blob_Resources(langNl_ResourceId))
+#define blobPl_Resources                  (*blob_Resources(langPl_ResourceId))
+#define blobRu_Resources                  (*blob_Resources(langRu_ResourceId))
+#define blobSk_Resources                  (*blob_Resources(langSk_ResourceId))
+#define blobSr_Resources                  (*blob_Resources(langSr_ResourceId))
+#define blobTok_Resources                 (*blob_Resources(langTok_ResourceId))
+#define blobTr_Resources                  (*blob_Resources(langTr_ResourceId))
+#define blobUk_Resources                  (*blob_Resources(langUk_ResourceId))
+#define blobZh_Hans_Resources             (*blob_Resources(langZhHans_ResourceId))
+#define blobZh_Hant_Resources             (*blob_Resources(langZhHant_ResourceId))
+#define imageShadow_Resources             (*blob_Resources(imageShadow_ResourceId))
+#define imageLagrange64_Resources         (*blob_Resources(imageLagrange64_ResourceId))
+#define blobMacosSystemFontsIni_Resources (*blob_Resources(macosSystemFontsIni_ResourceId))
+#define blobCacertPem_Resources           (*blob_Resources(cacertPem_ResourceId))
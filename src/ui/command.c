@@ -24,9 +24,185 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "widget.h"
 #include "app.h"
 
+#include <the_Foundation/file.h>
+#include <the_Foundation/path.h>
 #include <the_Foundation/string.h>
+#include <the_Foundation/stringlist.h>
 #include <ctype.h>
 
+/*----------------------------------------------------------------------------------------------*/
+
+/* Sorted by name. */
+static const struct {
+    const char *    name;
+    enum iCommandId id;
+} commandIds_[] = {
+    { "document.changed", documentChanged_CommandId },
+    { "document.layout.changed", documentLayoutChanged_CommandId },
+    { "document.layout.ready", documentLayoutReady_CommandId },
+    { "document.openurls.changed", documentOpenurlsChanged_CommandId },
+    { "document.render", documentRender_CommandId },
+    { "document.request.finished", documentRequestFinished_CommandId },
+    { "document.request.started", documentRequestStarted_CommandId },
+    { "document.request.updated", documentRequestUpdated_CommandId },
+    { "focus.gained", focusGained_CommandId },
+    { "focus.lost", focusLost_CommandId },
+    { "font.changed", fontChanged_CommandId },
+    { "keyroot.changed", keyrootChanged_CommandId },
+    { "media.decoded", mediaDecoded_CommandId },
+    { "media.finished", mediaFinished_CommandId },
+    { "media.updated", mediaUpdated_CommandId },
+    { "menu.closed", menuClosed_CommandId },
+    { "metrics.changed", metricsChanged_CommandId },
+    { "mouse.clicked", mouseClicked_CommandId },
+    { "navigate.back", navigateBack_CommandId },
+    { "navigate.forward", navigateForward_CommandId },
+    { "open", open_CommandId },
+    { "prefs.changed", prefsChanged_CommandId },
+    { "scroll.bottom", scrollBottom_CommandId },
+    { "scroll.moved", scrollMoved_CommandId },
+    { "scroll.page", scrollPage_CommandId },
+    { "scroll.step", scrollStep_CommandId },
+    { "scroll.top", scrollTop_CommandId },
+    { "tabs.changed", tabsChanged_CommandId },
+    { "theme.changed", themeChanged_CommandId },
+    { "visited.changed", visitedChanged_CommandId },
+    { "window.focus.gained", windowFocusGained_CommandId },
+    { "window.focus.lost", windowFocusLost_CommandId },
+    { "window.mouse.exited", windowMouseExited_CommandId },
+    { "window.resized", windowResized_CommandId },
+    { "zoom.delta", zoomDelta_CommandId },
+};
+
+static int cmpName_CommandId_(iRangecc name, const char *other) {
+    const size_t len = size_Range(&name);
+    const int    cmp = strncmp(name.start, other, len);
+    return cmp ? cmp : (other[len] ? -1 : 0);
+}
+
+static enum iCommandId find_CommandId_(iRangecc name) {
+    /* The table is constant, so looking up needs no locking. */
+    size_t first = 0, last = iElemCount(commandIds_);
+    while (first < last) {
+        const size_t mid = (first + last) / 2;
+        const int    cmp = cmpName_CommandId_(name, commandIds_[mid].name);
+        if (cmp == 0) {
+            return commandIds_[mid].id;
+        }
+        if (cmp < 0) {
+            last = mid;
+        }
+        else {
+            first = mid + 1;
+        }
+    }
+    return none_CommandId;
+}
+
+enum iCommandId id_Command(const char *command) {
+    return find_CommandId_(range_CStr(command));
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(ParsedCommand)
+
+#define maxArgs_ParsedCommand_  16
+
+/* A command that is parsed once, so matching the name and finding arguments doesn't
+   require scanning the entire string in each handler. */
+struct Impl_ParsedCommand {
+    const char *    text;
+    iRangecc        name; /* null if the name can't match anything */
+    enum iCommandId id;
+    size_t          numArgs;
+    iBool           isTruncated; /* more arguments than could be recorded */
+    iRangecc        args[maxArgs_ParsedCommand_]; /* labels, in order of appearance */
+};
+
+static void init_ParsedCommand_(iParsedCommand *d, const char *text) {
+    const char *space = strchr(text, ' ');
+    d->text        = text;
+    d->numArgs     = 0;
+    d->isTruncated = iFalse;
+    /* Same rules as `equal_Command`. Command names never contain spaces. */
+    if (!strchr(text, ':')) {
+        d->name = range_CStr(text);
+    }
+    else if (space) {
+        d->name = (iRangecc){ text, space };
+    }
+    else {
+        d->name = iNullRange;
+    }
+    /* Each " label:" is recorded so that lookups find exactly what `strstr` would. */
+    for (const char *pos = space; pos; pos = strchr(pos + 1, ' ')) {
+        const char *end = pos + 1;
+        while (*end && *end != ' ' && *end != ':') {
+            end++;
+        }
+        if (*end == ':' && end > pos + 1) {
+            if (d->numArgs == maxArgs_ParsedCommand_) {
+                d->isTruncated = iTrue;
+                break;
+            }
+            d->args[d->numArgs++] = (iRangecc){ pos + 1, end };
+        }
+    }
+    d->id = d->name.start ? find_CommandId_(d->name) : none_CommandId;
+}
+
+static iBool equalName_ParsedCommand_(const iParsedCommand *d, const char *name) {
+    if (!d->name.start) {
+        return iFalse;
+    }
+    for (const char *ch = d->name.start; ch != d->name.end; ch++, name++) {
+        if (*ch != *name) {
+            return iFalse;
+        }
+    }
+    return *name == 0;
+}
+
+/* Commands currently being dispatched to handlers. Nested dispatches deeper than this
+   just use the unparsed strings. */
+static _Thread_local iParsedCommand dispatched_[4];
+static _Thread_local int            numDispatched_;
+
+static const iParsedCommand *dispatched_Command_(const char *cmd) {
+    if (numDispatched_ > 0 && numDispatched_ <= (int) iElemCount(dispatched_)) {
+        const iParsedCommand *d = &dispatched_[numDispatched_ - 1];
+        if (d->text == cmd) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+void beginDispatch_Command(const char *commandWithArgs) {
+    if (numDispatched_ < (int) iElemCount(dispatched_)) {
+        init_ParsedCommand_(&dispatched_[numDispatched_], commandWithArgs);
+    }
+    numDispatched_++;
+}
+
+void endDispatch_Command(void) {
+    iAssert(numDispatched_ > 0);
+    numDispatched_--;
+}
+
+enum iCommandId nameId_Command(const char *commandWithArgs) {
+    const iParsedCommand *parsed = dispatched_Command_(commandWithArgs);
+    if (parsed) {
+        return parsed->id;
+    }
+    iParsedCommand temp;
+    init_ParsedCommand_(&temp, commandWithArgs);
+    return temp.id;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
 iDeclareType(Token)
 
 #define maxLen_Token 64
@@ -47,6 +223,19 @@ static void init_Token(iToken *d, const char *label) {
 }
 
 static iRangecc find_Token(const iToken *d, const char *cmd) {
+    const iParsedCommand *parsed = dispatched_Command_(cmd);
+    if (parsed) {
+        const size_t len = d->size - 2;
+        for (size_t i = 0; i < parsed->numArgs; i++) {
+            const iRangecc label = parsed->args[i];
+            if (size_Range(&label) == len && !memcmp(label.start, d->buf + 1, len)) {
+                return (iRangecc){ label.start - 1, label.end + 1 };
+            }
+        }
+        if (!parsed->isTruncated) {
+            return iNullRange;
+        }
+    }
     iRangecc range = iNullRange;
     range.start = strstr(cmd, d->buf);
     if (range.start) {
@@ -56,6 +245,10 @@ static iRangecc find_Token(const iToken *d, const char *cmd) {
 }
 
 iBool equal_Command(const char *cmdWithArgs, const char *cmd) {
+    const iParsedCommand *parsed = dispatched_Command_(cmdWithArgs);
+    if (parsed) {
+        return equalName_ParsedCommand_(parsed, cmd);
+    }
     if (strchr(cmdWithArgs, ':')) {
         return startsWith_CStr(cmdWithArgs, cmd) && cmdWithArgs[strlen(cmd)] == ' ';
     }
@@ -103,11 +296,7 @@ float argfLabel_Command(const char *cmd, const char *label) {
 }
 
 float argf_Command(const char *cmd) {
-    const char *ptr = strstr(cmd, " arg:");
-    if (ptr) {
-        return strtof(ptr + 5, NULL);
-    }
-    return 0;
+    return argfLabel_Command(cmd, "arg");
 }
 
 void *pointerLabel_Command(const char *cmd, const char *label) {
@@ -159,10 +348,10 @@ iRangecc range_Command(const char *cmd, const char *label) {
 }
 
 iInt2 dir_Command(const char *cmd) {
-    const char *ptr = strstr(cmd, " dir:");
+    const char *ptr = suffixPtr_Command(cmd, "dir");
     if (ptr) {
         iInt2 dir;
-        sscanf(ptr + 5, "%d%d", &dir.x, &dir.y);
+        sscanf(ptr, "%d%d", &dir.x, &dir.y);
         return dir;
     }
     return zero_I2();
@@ -170,9 +359,130 @@ iInt2 dir_Command(const char *cmd) {
 
 iInt2 coord_Command(const char *cmd) {
     iInt2 coord = zero_I2();
-    const char *ptr = strstr(cmd, " coord:");
+    const char *ptr = suffixPtr_Command(cmd, "coord");
     if (ptr) {
-        sscanf(ptr + 7, "%d%d", &coord.x, &coord.y);
+        sscanf(ptr, "%d%d", &coord.x, &coord.y);
     }
     return coord;
 }
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void parseEchoLog_Command_(iStringList *commands, const iBlock *log) {
+    /* Lines look like: "[command] {1:1} document.changed url:..." */
+    iRangecc line = iNullRange;
+    while (nextSplit_Rangecc(range_Block(log), "\n", &line)) {
+        const char *start = strstr(cstr_Rangecc(line), "[command] {");
+        const char *end   = start ? strstr(start, "} ") : NULL;
+        if (end) {
+            pushBackCStr_StringList(commands, end + 2);
+        }
+    }
+}
+
+const iString *benchmark_Command(void) {
+    static const char *sample_[] = {
+        "scroll.page arg:1 repeat:1",
+        "scroll.page arg:-1 repeat:1",
+        "window.resized width:1200 height:800",
+        "metrics.changed",
+        "window.resized width:1210 height:805",
+        "tabs.next",
+        "tabs.changed id:doc00000003",
+        "document.changed doc:0x7f8a5c01b000 url:gemini://skyjake.fi/lagrange/",
+        "tabs.prev",
+        "tabs.changed id:doc00000002",
+        "document.changed doc:0x7f8a5c01a000 url:gemini://geminispace.info/",
+        "mouse.clicked arg:1 button:1 coord:640 320 ptr:0x7f8a5c02c000",
+        "navigate.back",
+        "document.request.started doc:0x7f8a5c01b000 url:gemini://skyjake.fi/",
+        "document.request.updated doc:0x7f8a5c01b000 request:0x7f8a5c03d000",
+        "document.request.finished doc:0x7f8a5c01b000 request:0x7f8a5c03d000",
+        "open newtab:1 url:gemini://gemini.circumlunar.space/docs/specification.gmi",
+        "focus.gained ptr:0x7f8a5c02c000",
+        "input.ended id:url enter:1 ptr:0x7f8a5c02c100",
+        "visited.changed",
+        "zoom.delta arg:10",
+        "keyroot.changed ptr:0x7f8a5c02c000",
+    };
+    /* A representative chain of names that handlers check for. */
+    static const char *names_[] = {
+        "prefs.changed", "uilang", "config.error", "ui.split", "window.maximize",
+        "window.retain", "window.focus.lost", "window.focus.gained", "window.resized",
+        "metrics.changed", "theme.changed", "lang.changed", "font.reset", "zoom.set",
+        "zoom.delta", "bookmarks.changed", "visited.changed", "navigate.back",
+        "navigate.forward", "navigate.home", "navigate.reload", "open", "tabs.new",
+        "tabs.close", "tabs.next", "tabs.prev", "tabs.changed", "tabs.swap", "scroll.top",
+        "scroll.bottom", "scroll.step", "scroll.page", "document.changed",
+        "document.request.started", "document.request.updated", "document.request.finished",
+        "document.reload", "document.info", "mouse.clicked", "focus.gained", "focus.lost",
+        "keyroot.changed", "input.ended", "copy", "menu.open", "menu.closed", "cancel",
+    };
+    static const char *labels_[] = { "arg", "ptr", "url", "doc", "id", "newtab", "coord" };
+    const int   numRounds = 2000;
+    iString    *msg       = collectNew_String();
+    iStringList *commands = iClob(new_StringList());
+    const char *source    = "built-in sample";
+    /* Replay a log recorded with `--echo`, if one is available. */ {
+        iFile *f = iClob(new_File(collect_String(concatCStr_Path(dataDir_App(), "commands.log"))));
+        if (open_File(f, text_FileMode | readOnly_FileMode)) {
+            parseEchoLog_Command_(commands, collect_Block(readAll_File(f)));
+            source = "commands.log";
+        }
+    }
+    if (size_StringList(commands) == 0) {
+        iForIndices(i, sample_) {
+            pushBackCStr_StringList(commands, sample_[i]);
+        }
+        source = "built-in sample";
+    }
+    enum iCommandId ids[iElemCount(names_)];
+    iForIndices(n, names_) {
+        ids[n] = id_Command(names_[n]);
+    }
+    uint64_t times[3];
+    size_t   checksums[3] = { 0, 0, 0 };
+    for (int pass = 0; pass < 3; pass++) {
+        iPerfTimer timer;
+        init_PerfTimer(&timer);
+        for (int round = 0; round < numRounds; round++) {
+            iConstForEach(StringList, i, commands) {
+                const char *cmd = cstr_String(i.value);
+                enum iCommandId id = none_CommandId;
+                if (pass >= 1) {
+                    beginDispatch_Command(cmd);
+                }
+                if (pass == 2) {
+                    id = nameId_Command(cmd);
+                }
+                iForIndices(n, names_) {
+                    /* Like the handlers, names with an ID are compared by the ID. */
+                    if ((pass == 2 && ids[n]) ? id == ids[n] : equal_Command(cmd, names_[n])) {
+                        checksums[pass] += n;
+                        iForIndices(k, labels_) {
+                            if (hasLabel_Command(cmd, labels_[k])) {
+                                checksums[pass] += argLabel_Command(cmd, labels_[k]) + k;
+                            }
+                        }
+                    }
+                }
+                if (pass >= 1) {
+                    endDispatch_Command();
+                }
+            }
+        }
+        times[pass] = elapsedMicroseconds_PerfTimer(&timer);
+    }
+    appendFormat_String(msg, "# Command dispatch benchmark\n");
+    appendFormat_String(msg, "Commands: %zu (%s), handler checks: %zu, rounds: %d\n",
+                        size_StringList(commands), source, iElemCount(names_), numRounds);
+    appendFormat_String(msg, "* Unparsed strings: %.1f ms\n", times[0] / 1.0e3);
+    appendFormat_String(msg, "* Parsed once per dispatch: %.1f ms\n", times[1] / 1.0e3);
+    appendFormat_String(msg, "* Parsed, compared by ID: %.1f ms\n", times[2] / 1.0e3);
+    appendFormat_String(msg, "Results %s.\n",
+                        checksums[0] == checksums[1] && checksums[0] == checksums[2] ? "match"
+                                                                                    : "DIFFER");
+    appendFormat_String(msg, "\nRecord a log with \"lagrange --echo > commands.log\" and place it "
+                             "in the user data directory to replay it here.\n");
+    return msg;
+}
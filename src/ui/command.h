@@ -26,6 +26,58 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/string.h>
 #include <the_Foundation/vec2.h>
 
+/* While a command is being dispatched, it is parsed only once so the handlers don't need
+   to scan the string for every name and argument comparison. */
+void        beginDispatch_Command   (const char *commandWithArgs);
+void        endDispatch_Command     (void);
+
+/* Frequently dispatched commands have fixed IDs, so the handlers they pass through can
+   compare an integer instead of the name. Other commands have no ID. */
+enum iCommandId {
+    none_CommandId,
+    documentChanged_CommandId,
+    documentLayoutChanged_CommandId,
+    documentLayoutReady_CommandId,
+    documentOpenurlsChanged_CommandId,
+    documentRender_CommandId,
+    documentRequestFinished_CommandId,
+    documentRequestStarted_CommandId,
+    documentRequestUpdated_CommandId,
+    focusGained_CommandId,
+    focusLost_CommandId,
+    fontChanged_CommandId,
+    keyrootChanged_CommandId,
+    mediaDecoded_CommandId,
+    mediaFinished_CommandId,
+    mediaUpdated_CommandId,
+    menuClosed_CommandId,
+    metricsChanged_CommandId,
+    mouseClicked_CommandId,
+    navigateBack_CommandId,
+    navigateForward_CommandId,
+    open_CommandId,
+    prefsChanged_CommandId,
+    scrollBottom_CommandId,
+    scrollMoved_CommandId,
+    scrollPage_CommandId,
+    scrollStep_CommandId,
+    scrollTop_CommandId,
+    tabsChanged_CommandId,
+    themeChanged_CommandId,
+    visitedChanged_CommandId,
+    windowFocusGained_CommandId,
+    windowFocusLost_CommandId,
+    windowMouseExited_CommandId,
+    windowResized_CommandId,
+    zoomDelta_CommandId,
+    max_CommandId
+};
+
+enum iCommandId id_Command          (const char *command);
+enum iCommandId nameId_Command      (const char *commandWithArgs);
+
+const iString *benchmark_Command    (void);
+
 iBool       equal_Command           (const char *commandWithArgs, const char *command);
 iBool       equalArg_Command        (const char *commandWithArgs, const char *command,
                                      const char *label, const char *value);
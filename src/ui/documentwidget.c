@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "gmutil.h"
 #include "gopher.h"
 #include "history.h"
+#include "resolver.h"
 #include "indicatorwidget.h"
 #include "inputwidget.h"
 #include "keys.h"
@@ -47,6 +48,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "media.h"
 #include "paint.h"
 #include "periodic.h"
+#include "profiler.h"
 #include "root.h"
 #include "mediaui.h"
 #include "scrollwidget.h"
@@ -77,6 +79,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/ptrset.h>
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/stringarray.h>
+#include <the_Foundation/thread.h>
 #include <SDL_clipboard.h>
 #include <SDL_timer.h>
 #include <SDL_render.h>
@@ -228,6 +231,86 @@ static void visBufInvalidated_(iVisBuf *d, size_t index) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(LayoutJob)
+iDeclareTypeConstructionArgs(LayoutJob, iWidget *owner, uint32_t generation,
+                             const iGmDocument *doc, const iString *source, int width,
+                             int canvasWidth)
+
+/* Large documents are laid out in a background thread so the UI remains responsive.
+   The job works on a copy of the document, and the finished layout is adopted by the
+   original document in the main thread. */
+struct Impl_LayoutJob {
+    iWidget *     owner; /* notified when the layout is ready */
+    uint32_t      generation; /* identifies the job in the ready notification */
+    iThread *     thread;
+    iGmDocument * doc;
+    iString *     source; /* NULL if only the width changes */
+    iText *       text; /* metrics-only; deleted when the layout is done */
+    int           width;
+    int           canvasWidth;
+    size_t        anchorPos; /* source offset of the run to keep in place, or iInvalidPos */
+    int           anchorOffset;
+};
+
+static void wait_LayoutJob_(iLayoutJob *d) {
+    if (d->thread) {
+        join_Thread(d->thread);
+        iReleasePtr(&d->thread);
+    }
+}
+
+static iThreadResult run_LayoutJob_(iThread *thread) {
+    iLayoutJob *d = userData_Thread(thread);
+    setCurrent_Text(d->text);
+    if (d->source) {
+        setSource_GmDocument(d->doc, d->source, d->width, d->canvasWidth, final_GmDocumentUpdate);
+    }
+    else {
+        setWidth_GmDocument(d->doc, d->width, d->canvasWidth);
+    }
+    setCurrent_Text(NULL);
+    delete_Text(d->text); /* fonts may be reloaded after this */
+    d->text = NULL;
+    if (!isLayoutCancelled_GmDocument(d->doc)) {
+        postCommand_Widget(d->owner, "document.layout.ready gen:%u", d->generation);
+    }
+    return 0;
+}
+
+static void init_LayoutJob(iLayoutJob *d, iWidget *owner, uint32_t generation,
+                           const iGmDocument *doc, const iString *source, int width,
+                           int canvasWidth) {
+    d->owner        = owner;
+    d->generation   = generation;
+    d->doc          = newLayoutCopy_GmDocument(doc);
+    d->source       = source ? copy_String(source) : NULL; /* shared until modified */
+    d->text         = newMetrics_Text(text_Window(window_Widget(owner)));
+    d->width        = width;
+    d->canvasWidth  = canvasWidth;
+    d->anchorPos    = iInvalidPos;
+    d->anchorOffset = 0;
+    d->thread       = new_Thread(run_LayoutJob_);
+    setUserData_Thread(d->thread, d);
+    start_Thread(d->thread);
+}
+
+static void deinit_LayoutJob(iLayoutJob *d) {
+    wait_LayoutJob_(d);
+    delete_String(d->source);
+    iRelease(d->doc);
+}
+
+iDefineTypeConstructionArgs(LayoutJob,
+                            (iWidget *owner, uint32_t generation, const iGmDocument *doc,
+                             const iString *source, int width, int canvasWidth),
+                            owner, generation, doc, source, width, canvasWidth)
+
+static void cancel_LayoutJob_(iLayoutJob *d) {
+    cancelLayout_GmDocument(d->doc);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
 enum iRequestState {
     blank_RequestState,
     fetching_RequestState,
@@ -354,6 +437,8 @@ struct Impl_DocumentWidget {
     iGempub *      sourceGempub; /* NULL unless the page is Gempub content */
     iBanner *      banner;
     float          initNormScrollY;
+    iLayoutJob *   layoutJob; /* background layout in progress */
+    uint32_t       layoutGeneration; /* incremented for each started layout job */
 
     /* Rendering: */
     iDocumentView  view;
@@ -392,6 +477,10 @@ static void prerender_DocumentWidget_               (iAny *);
 static void scrollBegan_DocumentWidget_             (iAnyObject *, int, uint32_t);
 static void refreshWhileScrolling_DocumentWidget_   (iAny *);
 static iBool requestMedia_DocumentWidget_           (iDocumentWidget *d, iGmLinkId linkId, iBool enableFilters);
+static iBool shouldLayoutInBackground_DocumentWidget_(const iDocumentWidget *d, size_t sourceSize);
+static iLayoutJob *startLayout_DocumentWidget_      (iDocumentWidget *d, const iString *source);
+static void finishLayout_DocumentWidget_            (iDocumentWidget *d);
+static void cancelLayout_DocumentWidget_            (iDocumentWidget *d);
 
 /* TODO: The following methods are called from DocumentView, which goes the wrong way. */
 
@@ -711,8 +800,11 @@ static void addVisible_DocumentView_(void *context, const iGmRun *run) {
             pushBack_PtrArray(&d->visibleWideRuns, run);
         }
     }
-    /* Image runs are static so they're drawn as part of the content. */
-    if (isMedia_GmRun(run) && run->mediaType != image_MediaType) {
+    /* Image runs are static so they're drawn as part of the content. Animations need to
+       be updated periodically, though. */
+    if (isMedia_GmRun(run) &&
+        (run->mediaType != image_MediaType ||
+         isAnimatedImage_Media(constMedia_GmDocument(d->doc), mediaId_GmRun(run)))) {
         iAssert(run->mediaId);
         pushBack_PtrArray(&d->visibleMedia, run);
     }
@@ -835,6 +927,9 @@ static void updateHover_DocumentView_(iDocumentView *d, iInt2 mouse) {
         }
         updateHoverLinkInfo_DocumentView_(d);
         refresh_Widget(w);
+        if (d->hoverLink && prefs_App()->prefetchOnHover) {
+            prefetch_Resolver(linkUrl_GmDocument(d->doc, d->hoverLink->linkId));
+        }
     }
     /* Hovering over preformatted blocks. */
     if (isHoverAllowed_DocumentWidget_(d->owner)) {
@@ -1023,6 +1118,7 @@ static void resetScroll_DocumentView_(iDocumentView *d) {
 }
 
 static iBool updateWidth_DocumentView_(iDocumentView *d) {
+    finishLayout_DocumentWidget_(d->owner);
     if (updateWidth_GmDocument(d->doc, documentWidth_DocumentView_(d), width_Widget(d->owner))) {
         documentRunsInvalidated_DocumentView_(d); /* GmRuns reallocated */
         return iTrue;
@@ -1031,6 +1127,7 @@ static iBool updateWidth_DocumentView_(iDocumentView *d) {
 }
 
 static void updateWidthAndRedoLayout_DocumentView_(iDocumentView *d) {
+    finishLayout_DocumentWidget_(d->owner);
     setWidth_GmDocument(d->doc, documentWidth_DocumentView_(d), width_Widget(d->owner));
     documentRunsInvalidated_DocumentView_(d); /* GmRuns reallocated */
 }
@@ -1190,6 +1287,12 @@ static void documentRunsInvalidated_DocumentWidget_(iDocumentWidget *d) {
 
 static iBool updateDocumentWidthRetainingScrollPosition_DocumentView_(iDocumentView *d,
                                                                       iBool keepCenter) {
+    if (d->owner->layoutJob) {
+        if (!keepCenter) {
+            return iFalse; /* width is checked again when the job is finished */
+        }
+        finishLayout_DocumentWidget_(d->owner);
+    }
     const int newWidth = documentWidth_DocumentView_(d);
     if (newWidth == size_GmDocument(d->doc).x && !keepCenter /* not a font change */) {
         return iFalse;
@@ -1205,6 +1308,17 @@ static iBool updateDocumentWidthRetainingScrollPosition_DocumentView_(iDocumentV
         voffset = visibleRange_DocumentView_(d).start - top_Rect(run->visBounds);
     }
     run = NULL;
+    if (!keepCenter && d->owner->state == ready_RequestState &&
+        shouldLayoutInBackground_DocumentWidget_(d->owner, size_String(source_GmDocument(d->doc)))) {
+        /* Keep showing the old layout until the new one is ready. */
+        iLayoutJob *job = startLayout_DocumentWidget_(d->owner, NULL);
+        const iRangecc src = range_String(source_GmDocument(d->doc));
+        if (runLoc >= src.start && runLoc < src.end) {
+            job->anchorPos    = runLoc - src.start;
+            job->anchorOffset = voffset;
+        }
+        return iTrue;
+    }
     setWidth_GmDocument(d->doc, newWidth, width_Widget(d->owner));
     setWidth_Banner(d->owner->banner, newWidth);
     documentRunsInvalidated_DocumentWidget_(d->owner);
@@ -1339,6 +1453,10 @@ static void drawRun_DrawContext_(void *context, const iGmRun *run) {
             SDL_RenderCopy(d->paint.dst->render, tex, NULL,
                            &(SDL_Rect){ dst.pos.x, dst.pos.y, dst.size.x, dst.size.y });
         }
+        else if (isDecodingImage_Media(media_GmDocument(d->view->doc), mediaId_GmRun(run))) {
+            /* Will be drawn when the decoder is done. */
+            drawRect_Paint(&d->paint, dst, tmQuoteIcon_ColorId);
+        }
         else {
             drawRect_Paint(&d->paint, dst, tmQuoteIcon_ColorId);
             drawCentered_Text(uiLabel_FontId,
@@ -1788,6 +1906,7 @@ static iBool render_DocumentView_(const iDocumentView *d, iDrawContext *ctx, iBo
     if (isEmpty_Range(&full)) {
         return didDraw;
     }
+    const uint64_t profileBegin = begin_Profiler(render_ProfilerScope);
     d->drawBufs->lastRenderTime = SDL_GetTicks();
     /* Swap buffers around to have room available both before and after the visible region. */
     allocVisBuffer_DocumentView_(d);
@@ -1955,6 +2074,7 @@ static iBool render_DocumentView_(const iDocumentView *d, iDrawContext *ctx, iBo
             clear_PtrSet(d->invalidRuns);
         }
     }
+    end_Profiler(render_ProfilerScope, profileBegin);
     return didDraw;
 }
 
@@ -2179,6 +2299,15 @@ static uint32_t mediaUpdateInterval_DocumentWidget_(const iDocumentWidget *d) {
         else if (run->mediaType == download_MediaType) {
             interval = iMin(interval, 1000);
         }
+        else if (run->mediaType == image_MediaType) {
+            /* Wake up when the next frame is due. */
+            const uint32_t due = nextFrameTime_Media(constMedia_GmDocument(d->view.doc),
+                                                     mediaId_GmRun(run));
+            if (due) {
+                const uint32_t now = SDL_GetTicks();
+                interval = iMin(interval, SDL_TICKS_PASSED(now, due) ? 1 : due - now);
+            }
+        }
     }
     return interval != invalidInterval_ ? interval : 0;
 }
@@ -2190,12 +2319,32 @@ static uint32_t postMediaUpdate_DocumentWidget_(uint32_t interval, void *context
     return interval;
 }
 
+static void rescheduleMedia_DocumentWidget_(iDocumentWidget *d) {
+    /* The interval depends on when the next animation frames are due. */
+    if (d->mediaTimer) {
+        SDL_RemoveTimer(d->mediaTimer);
+        d->mediaTimer = 0;
+    }
+    animateMedia_DocumentWidget_(d);
+}
+
 static void updateMedia_DocumentWidget_(iDocumentWidget *d) {
     if (document_App() == d) {
-        refresh_Widget(d);
+        iBool isChanged = iFalse;
         iConstForEach(PtrArray, i, &d->view.visibleMedia) {
             const iGmRun *run = i.ptr;
-            if (run->mediaType == audio_MediaType) {
+            if (run->mediaType == image_MediaType) {
+                /* Only visible animations advance; others stop once their frames are decoded. */
+                if (advanceAnimation_Media(media_GmDocument(d->view.doc), mediaId_GmRun(run))) {
+                    invalidateLink_DocumentView_(&d->view, run->linkId);
+                    isChanged = iTrue;
+                }
+            }
+            else if (run->mediaType == download_MediaType) {
+                isChanged = iTrue; /* progress */
+            }
+            else if (run->mediaType == audio_MediaType) {
+                isChanged = iTrue; /* playback position */
 #if defined (LAGRANGE_ENABLE_AUDIO)
                 iPlayer *plr = audioPlayer_Media(media_GmDocument(d->view.doc), mediaId_GmRun(run));
                 if (idleTimeMs_Player(plr) > 3000 && ~flags_Player(plr) & volumeGrabbed_PlayerFlag &&
@@ -2205,11 +2354,11 @@ static void updateMedia_DocumentWidget_(iDocumentWidget *d) {
 #endif
             }
         }
+        if (isChanged) {
+            refresh_Widget(d);
+        }
     }
-    if (d->mediaTimer && mediaUpdateInterval_DocumentWidget_(d) == 0) {
-        SDL_RemoveTimer(d->mediaTimer);
-        d->mediaTimer = 0;
-    }
+    rescheduleMedia_DocumentWidget_(d);
 }
 
 static void animateMedia_DocumentWidget_(iDocumentWidget *d) {
@@ -2444,6 +2593,7 @@ static void documentWasChanged_DocumentWidget_(iDocumentWidget *d) {
 }
 
 static void replaceDocument_DocumentWidget_(iDocumentWidget *d, iGmDocument *newDoc) {
+    cancelLayout_DocumentWidget_(d);
     pauseAllPlayers_Media(media_GmDocument(d->view.doc), iTrue);
     iRelease(d->view.doc);
     d->view.doc = ref_Object(newDoc);
@@ -2635,6 +2785,7 @@ static void postProcessRequestContent_DocumentWidget_(iDocumentWidget *d, iBool
        data that is part of the document. */
     if (prefs_App()->openDataUrlImagesOnLoad) {
         iGmDocument *doc = d->view.doc;
+        finishLayout_DocumentWidget_(d); /* links are needed */
         for (size_t linkId = 1; ; linkId++) {
             const int      linkFlags = linkFlags_GmDocument(doc, linkId);
             const iString *linkUrl   = linkUrl_GmDocument(doc, linkId);
@@ -2723,6 +2874,7 @@ static void postProcessRequestContent_DocumentWidget_(iDocumentWidget *d, iBool
                                          "document.save" } },
                         2);
                 }
+                finishLayout_DocumentWidget_(d);
                 if (preloadCoverImage_Gempub(d->sourceGempub, d->view.doc)) {
                     redoLayout_GmDocument(d->view.doc);
                     updateVisible_DocumentView_(&d->view);
@@ -2816,9 +2968,8 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d,
     if (d->state == ready_RequestState) {
         return;
     }
+    finishLayout_DocumentWidget_(d);
     const iBool isRequestFinished = isFinished_GmRequest(d->request);
-    /* TODO: Do document update in the background. However, that requires a text metrics calculator
-       that does not try to cache the glyph bitmaps. */
     const enum iGmStatusCode statusCode = response->statusCode;
     if (category_GmStatusCode(statusCode) != categoryInput_GmStatusCode) {
         iBool setSource = iTrue;
@@ -3204,6 +3355,79 @@ static void cacheDocumentGlyphs_DocumentWidget_(const iDocumentWidget *d) {
     }
 }
 
+static iBool shouldLayoutInBackground_DocumentWidget_(const iDocumentWidget *d, size_t sourceSize) {
+    /* Small documents are laid out immediately so there is no flash of an empty page. */
+    return sourceSize >= 64 * 1024 && !isTerminal_Platform() &&
+           ~d->flags & animationPlaceholder_DocumentWidgetFlag;
+}
+
+static iLayoutJob *startLayout_DocumentWidget_(iDocumentWidget *d, const iString *source) {
+    iAssert(!d->layoutJob);
+    d->layoutJob = new_LayoutJob(as_Widget(d),
+                                 ++d->layoutGeneration,
+                                 d->view.doc,
+                                 source,
+                                 documentWidth_DocumentView_(&d->view),
+                                 width_Widget(d));
+    return d->layoutJob;
+}
+
+static void cancelLayout_DocumentWidget_(iDocumentWidget *d) {
+    if (d->layoutJob) {
+        cancel_LayoutJob_(d->layoutJob);
+        delete_LayoutJob(d->layoutJob); /* waits for the thread to stop */
+        d->layoutJob = NULL;
+    }
+}
+
+static void finishLayout_DocumentWidget_(iDocumentWidget *d) {
+    /* Waits until the background layout is done and switches to the new layout. The document
+       must not be modified while a layout job is running. */
+    iLayoutJob *job = d->layoutJob;
+    if (!job) {
+        return;
+    }
+    iDocumentView *view = &d->view;
+    wait_LayoutJob_(job);
+    d->layoutJob = NULL;
+    adoptLayout_GmDocument(view->doc, job->doc);
+    updateOpenURLs_GmDocument(view->doc);
+    setWidth_Banner(d->banner, job->width);
+    if (job->source) {
+        documentWasChanged_DocumentWidget_(d);
+        if (d->state == ready_RequestState) {
+            /* The request finished before the layout did. */
+            if (!view->userHasScrolled) {
+                init_Anim(&view->scrollY.pos, d->initNormScrollY * pageHeight_DocumentView_(view));
+            }
+            if (!isEmpty_String(&d->pendingGotoHeading)) {
+                scrollToHeading_DocumentView_(view, cstr_String(&d->pendingGotoHeading));
+                clear_String(&d->pendingGotoHeading);
+            }
+            cacheDocumentGlyphs_DocumentWidget_(d);
+        }
+    }
+    else {
+        updateVisitedLinks_GmDocument(view->doc);
+        documentRunsInvalidated_DocumentWidget_(d);
+        if (job->anchorPos != iInvalidPos) {
+            const iGmRun *run = findRunAtLoc_GmDocument(
+                view->doc, constBegin_String(source_GmDocument(view->doc)) + job->anchorPos);
+            if (run) {
+                scrollTo_DocumentView_(view,
+                                       top_Rect(run->visBounds) + lineHeight_Text(paragraph_FontId) +
+                                           job->anchorOffset,
+                                       iFalse);
+            }
+        }
+        updateVisible_DocumentView_(view);
+        view->drawBufs->flags |= updateSideBuf_DrawBufsFlag;
+        invalidate_DocumentWidget_(d);
+        refresh_Widget(d);
+    }
+    delete_LayoutJob(job);
+}
+
 static void addBannerWarnings_DocumentWidget_(iDocumentWidget *d) {
     updateBanner_DocumentWidget_(d);
     /* Warnings are not shown on internal pages. */
@@ -3278,6 +3502,7 @@ static void updateFromCachedResponse_DocumentWidget_(iDocumentWidget *d, float n
     clear_ObjectList(d->media);
     delete_Gempub(d->sourceGempub);
     d->sourceGempub = NULL;
+    cancelLayout_DocumentWidget_(d);
     pauseAllPlayers_Media(media_GmDocument(d->view.doc), iTrue);
     destroy_Widget(d->footerButtons);
     d->footerButtons = NULL;
@@ -3318,13 +3543,26 @@ static void updateFromCachedResponse_DocumentWidget_(iDocumentWidget *d, float n
 }
 
 static iBool updateFromHistory_DocumentWidget_(iDocumentWidget *d, iBool useCachedDoc) {
-    const iRecentUrl *recent = constMostRecentUrl_History(d->mod.history);
+    /* The history is locked while the cached response is used, because cache trimming
+       may free it in another thread. */
+    lock_History(d->mod.history);
+    iRecentUrl *recent      = mostRecentUrl_History(d->mod.history);
+    const iBool hasRecent   = (recent != NULL);
+    const float normScrollY = recent ? recent->normScrollY : 0.0f;
+    iBool       isCached    = iFalse;
+    iBool       hasDoc      = iFalse;
     setIdentity_DocumentWidget(d, recent ? &recent->setIdentity : NULL);
-    if (recent && recent->cachedResponse && equalCase_String(&recent->url, d->mod.url)) {
+    if (recent && equalCase_String(&recent->url, d->mod.url) &&
+        loadCachedResponse_RecentUrl(recent)) {
         iGmDocument *cachedDoc = (useCachedDoc ? recent->cachedDoc : NULL);
         updateFromCachedResponse_DocumentWidget_(
             d, recent->normScrollY, recent->cachedResponse, cachedDoc);
-        if (!cachedDoc) {
+        isCached = iTrue;
+        hasDoc   = (cachedDoc != NULL);
+    }
+    unlock_History(d->mod.history);
+    if (isCached) {
+        if (!hasDoc) {
             /* We now have a cached document. */
             setCachedDocument_History(d->mod.history, d->view.doc);
         }
@@ -3338,9 +3576,9 @@ static iBool updateFromHistory_DocumentWidget_(iDocumentWidget *d, iBool useCach
             fetch_DocumentWidget_(d);
         }
     }
-    if (recent) {
+    if (hasRecent) {
         /* Retain scroll position in refetched content as well. */
-        d->initNormScrollY = recent->normScrollY;
+        d->initNormScrollY = normScrollY;
     }
     return iFalse;
 }
@@ -3397,6 +3635,7 @@ static void togglePreFold_DocumentWidget_(iDocumentWidget *d, uint16_t preId) {
     d->view.hoverPre    = NULL;
     d->view.hoverAltPre = NULL;
     d->selectMark       = iNullRange;
+    finishLayout_DocumentWidget_(d);
     foldPre_GmDocument(d->view.doc, preId);
     redoLayout_GmDocument(d->view.doc);
     clampScroll_DocumentView_(&d->view);
@@ -3631,6 +3870,7 @@ static void checkResponse_DocumentWidget_(iDocumentWidget *d) {
                     resetScroll_DocumentView_(&d->view);
                 }
                 d->view.scrollY.pullActionTriggered = 0;
+                cancelLayout_DocumentWidget_(d);
                 pauseAllPlayers_Media(media_GmDocument(d->view.doc), iTrue);
                 iReleasePtr(&d->view.doc); /* new content incoming */
                 delete_Gempub(d->sourceGempub);
@@ -3742,6 +3982,7 @@ static iBool isDownloadRequest_DocumentWidget(const iDocumentWidget *d, const iM
 }
 
 static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
+    const enum iCommandId cmdId = nameId_Command(cmd);
     iMediaRequest *req = pointerLabel_Command(cmd, "request");
     iBool isOurRequest = iFalse;
     /* This request may already be deleted so treat the pointer with caution. */
@@ -3754,14 +3995,16 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
     if (!isOurRequest) {
         return iFalse;
     }
-    if (equal_Command(cmd, "media.updated")) {
+    if (cmdId == mediaUpdated_CommandId) {
         /* Pass new data to media players. */
         const enum iGmStatusCode code = status_GmRequest(req->req);
         if (isSuccess_GmStatusCode(code)) {
             iGmResponse *resp = lockResponse_GmRequest(req->req);
             if (isDownloadRequest_DocumentWidget(d, req) ||
+                startsWith_String(&resp->meta, "image/") ||
                 startsWith_String(&resp->meta, "audio/")) {
                 /* TODO: Use a helper? This is same as below except for the partialData flag. */
+                finishLayout_DocumentWidget_(d);
                 if (setData_Media(media_GmDocument(d->view.doc),
                                   req->linkId,
                                   &resp->meta,
@@ -3780,13 +4023,14 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
         refresh_Widget(d);
         return iTrue;
     }
-    else if (equal_Command(cmd, "media.finished")) {
+    else if (cmdId == mediaFinished_CommandId) {
         const enum iGmStatusCode code = status_GmRequest(req->req);
         /* Give the media to the document for presentation. */
         if (isSuccess_GmStatusCode(code)) {
             if (isDownloadRequest_DocumentWidget(d, req) ||
                 startsWith_String(meta_GmRequest(req->req), "image/") ||
                 startsWith_String(meta_GmRequest(req->req), "audio/")) {
+                finishLayout_DocumentWidget_(d);
                 setData_Media(media_GmDocument(d->view.doc),
                               req->linkId,
                               meta_GmRequest(req->req),
@@ -3934,6 +4178,7 @@ static void swap_DocumentWidget_(iDocumentWidget *d, iGmDocument *doc,
                                  iDocumentWidget *swapBuffersWith) {
     if (doc) {
         iAssert(isInstance_Object(doc, &Class_GmDocument));
+        finishLayout_DocumentWidget_(swapBuffersWith);
         replaceDocument_DocumentWidget_(d, doc);
         iSwap(iBanner *, d->banner, swapBuffersWith->banner);
         setOwner_Banner(d->banner, d);
@@ -4066,7 +4311,7 @@ static iBool handleSwipe_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
                 /* Use a cached document for the layer underneath. */ {
                     lock_History(d->mod.history);
                     iRecentUrl *recent = precedingLocked_History(d->mod.history);
-                    if (recent && recent->cachedResponse) {
+                    if (recent && loadCachedResponse_RecentUrl(recent)) {
                         setUrl_DocumentWidget_(swipeIn, &recent->url);
                         updateFromCachedResponse_DocumentWidget_(swipeIn,
                                                                  recent->normScrollY,
@@ -4261,7 +4506,8 @@ static const char *setIdentArg_DocumentWidget_(const iDocumentWidget *d, const i
 
 static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
     iWidget *w = as_Widget(d);
-    if (equal_Command(cmd, "document.openurls.changed")) {
+    const enum iCommandId cmdId = nameId_Command(cmd);
+    if (cmdId == documentOpenurlsChanged_CommandId) {
         if (d->flags & animationPlaceholder_DocumentWidgetFlag) {
             return iFalse;
         }
@@ -4272,12 +4518,12 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iFalse;
     }
-    if (equal_Command(cmd, "visited.changed")) {
+    if (cmdId == visitedChanged_CommandId) {
         updateVisitedLinks_GmDocument(d->view.doc);
         invalidateVisibleLinks_DocumentView_(&d->view);
         return iFalse;
     }
-    if (equal_Command(cmd, "document.render")) /* `Periodic` makes direct dispatch to here */ {
+    if (cmdId == documentRender_CommandId) /* `Periodic` makes direct dispatch to here */ {
 //        printf("%u: document.render\n", SDL_GetTicks());
         if (SDL_GetTicks() - d->view.drawBufs->lastRenderTime > 150) {
             remove_Periodic(periodic_App(), d);
@@ -4288,15 +4534,15 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iTrue;
     }
-    else if (equal_Command(cmd, "window.resized") || equal_Command(cmd, "font.changed") ||
-             equal_Command(cmd, "keyroot.changed")) {
-        if (equal_Command(cmd, "font.changed")) {
+    else if (cmdId == windowResized_CommandId || cmdId == fontChanged_CommandId ||
+             cmdId == keyrootChanged_CommandId) {
+        if (cmdId == fontChanged_CommandId) {
             invalidateCachedLayout_History(d->mod.history);
         }
         /* Alt/Option key may be involved in window size changes. */
         setLinkNumberMode_DocumentWidget_(d, iFalse);
         d->phoneToolbar = findWidget_App("bottombar");
-        const iBool keepCenter = equal_Command(cmd, "font.changed");
+        const iBool keepCenter = cmdId == fontChanged_CommandId;
         updateDocumentWidthRetainingScrollPosition_DocumentView_(&d->view, keepCenter);
         d->view.drawBufs->flags |= updateSideBuf_DrawBufsFlag;
         updateVisible_DocumentView_(&d->view);
@@ -4306,7 +4552,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         showOrHideIndicators_DocumentWidget_(d);
         refresh_Widget(w);
     }
-    else if (equal_Command(cmd, "window.focus.lost")) {
+    else if (cmdId == windowFocusLost_CommandId) {
         if (d->flags & showLinkNumbers_DocumentWidgetFlag) {
             setLinkNumberMode_DocumentWidget_(d, iFalse);
             invalidateVisibleLinks_DocumentView_(&d->view);
@@ -4314,10 +4560,10 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iFalse;
     }
-    else if (equal_Command(cmd, "window.mouse.exited")) {
+    else if (cmdId == windowMouseExited_CommandId) {
         return iFalse;
     }
-    else if (equal_Command(cmd, "theme.changed")) {
+    else if (cmdId == themeChanged_CommandId) {
         invalidatePalette_GmDocument(d->view.doc);
         invalidateTheme_History(d->mod.history); /* forget cached color palettes */
         if (document_App() == d) {
@@ -4329,8 +4575,9 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
             refresh_Widget(w);
         }
     }
-    else if (equal_Command(cmd, "document.layout.changed") && document_Root(get_Root()) == d) {
+    else if (cmdId == documentLayoutChanged_CommandId && document_Root(get_Root()) == d) {
         if (argLabel_Command(cmd, "redo")) {
+            finishLayout_DocumentWidget_(d);
             redoLayout_GmDocument(d->view.doc);
         }
         updateSize_DocumentWidget(d);
@@ -4343,7 +4590,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         showOrHideIndicators_DocumentWidget_(d);
         return iFalse;
     }
-    else if (equal_Command(cmd, "tabs.changed")) {
+    else if (cmdId == tabsChanged_CommandId) {
         setLinkNumberMode_DocumentWidget_(d, iFalse);
         if (cmp_String(id_Widget(w), suffixPtr_Command(cmd, "id")) == 0) {
             /* Set palette for our document. */
@@ -4626,6 +4873,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
     else if (equalWidget_Command(cmd, w, "document.downloadlink")) {
         if (d->contextLink) {
             const iGmLinkId linkId = d->contextLink->linkId;
+            finishLayout_DocumentWidget_(d);
             setUrl_Media(media_GmDocument(d->view.doc),
                          linkId,
                          download_MediaType,
@@ -4652,7 +4900,24 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         postCommand_Root(get_Root(), "navigate.back");
         return iTrue;
     }
-    else if (equalWidget_Command(cmd, w, "document.request.updated") &&
+    else if (cmdId == documentLayoutReady_CommandId && isFromWidget_Command(cmd, w)) {
+        /* A cancelled job may have finished before it noticed the cancellation, so its
+           notification can arrive while a newer job is still running. */
+        if (d->layoutJob && d->layoutJob->generation == argU32Label_Command(cmd, "gen")) {
+            finishLayout_DocumentWidget_(d);
+            /* The widget may have been resized while the layout was in progress. */
+            if (updateDocumentWidthRetainingScrollPosition_DocumentView_(&d->view, iFalse)) {
+                updateVisible_DocumentView_(&d->view);
+                invalidate_DocumentWidget_(d);
+                refresh_Widget(w);
+            }
+            if (document_App() == d) {
+                postCommand_App("sidebar.update"); /* outline may have changed */
+            }
+        }
+        return iTrue;
+    }
+    else if (cmdId == documentRequestUpdated_CommandId && isFromWidget_Command(cmd, w) &&
              id_GmRequest(d->request) == argU32Label_Command(cmd, "reqid")) {
         if (document_App() == d) {
             updateFetchProgress_DocumentWidget_(d);
@@ -4661,7 +4926,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         set_Atomic(&d->isRequestUpdated, iFalse); /* ready to be notified again */
         return iFalse;
     }
-    else if (equalWidget_Command(cmd, w, "document.request.finished") &&
+    else if (cmdId == documentRequestFinished_CommandId && isFromWidget_Command(cmd, w) &&
              id_GmRequest(d->request) == argU32Label_Command(cmd, "reqid")) {
         iChangeFlags(d->flags, fromCache_DocumentWidgetFlag | preventInlining_DocumentWidgetFlag,
                      iFalse);
@@ -4705,8 +4970,8 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
                           d,
                           d->sourceStatus,
                           cstr_String(d->mod.url));
-        /* Check for a pending goto. */
-        if (!isEmpty_String(&d->pendingGotoHeading)) {
+        /* Check for a pending goto. If the layout isn't ready yet, it will be done later. */
+        if (!isEmpty_String(&d->pendingGotoHeading) && !d->layoutJob) {
             scrollToHeading_DocumentView_(&d->view, cstr_String(&d->pendingGotoHeading));
             clear_String(&d->pendingGotoHeading);
         }
@@ -4771,9 +5036,17 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iTrue;
     }
-    else if (equal_Command(cmd, "media.updated") || equal_Command(cmd, "media.finished")) {
+    else if (cmdId == mediaUpdated_CommandId || cmdId == mediaFinished_CommandId) {
         return handleMediaCommand_DocumentWidget_(d, cmd);
     }
+    else if (cmdId == mediaDecoded_CommandId) {
+        if (uploadDecodedImages_Media(media_GmDocument(d->view.doc))) {
+            invalidate_DocumentWidget_(d);
+            refresh_Widget(as_Widget(d));
+        }
+        rescheduleMedia_DocumentWidget_(d); /* an animation may have a frame ready now */
+        return iFalse; /* other documents may have images, too */
+    }
 #if defined (LAGRANGE_ENABLE_AUDIO)
     else if (equal_Command(cmd, "media.player.started")) {
         /* When one media player starts, pause the others that may be playing. */
@@ -4887,7 +5160,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         refresh_Widget(d);
         return iTrue;
     }
-    else if (equal_Command(cmd, "navigate.back") && document_App() == d) {
+    else if (cmdId == navigateBack_CommandId && document_App() == d) {
         iAssert(~d->flags & animationPlaceholder_DocumentWidgetFlag);
         if (d->request) {
             postCommandf_Root(w->root,
@@ -4898,7 +5171,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         goBack_History(d->mod.history);
         return iTrue;
     }
-    else if (equal_Command(cmd, "navigate.forward") && document_App() == d) {
+    else if (cmdId == navigateForward_CommandId && document_App() == d) {
         goForward_History(d->mod.history);
         return iTrue;
     }
@@ -4967,12 +5240,12 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
                           cstr_String(rootUrl));
         return iTrue;
     }
-    else if (equalWidget_Command(cmd, w, "scroll.moved")) {
+    else if (cmdId == scrollMoved_CommandId && isFromWidget_Command(cmd, w)) {
         init_Anim(&d->view.scrollY.pos, arg_Command(cmd));
         updateVisible_DocumentView_(&d->view);
         return iTrue;
     }
-    else if (equal_Command(cmd, "scroll.page") && document_App() == d) {
+    else if (cmdId == scrollPage_CommandId && document_App() == d) {
         const int dir = arg_Command(cmd);
         if (dir > 0 && !argLabel_Command(cmd, "repeat") &&
             prefs_App()->loadImageInsteadOfScrolling &&
@@ -4986,7 +5259,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
                                    smoothDuration_DocumentWidget_(keyboard_ScrollType));
         return iTrue;
     }
-    else if (equal_Command(cmd, "scroll.top") && document_App() == d) {
+    else if (cmdId == scrollTop_CommandId && document_App() == d) {
         if (argLabel_Command(cmd, "smooth")) {
             stopWidgetMomentum_Touch(w);
             smoothScroll_DocumentView_(&d->view, -pos_SmoothScroll(&d->view.scrollY), 500);
@@ -5000,7 +5273,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         refresh_Widget(w);
         return iTrue;
     }
-    else if (equal_Command(cmd, "scroll.bottom") && document_App() == d) {
+    else if (cmdId == scrollBottom_CommandId && document_App() == d) {
         updateScrollMax_DocumentView_(&d->view); /* scrollY.max might not be fully updated */
         init_Anim(&d->view.scrollY.pos, d->view.scrollY.max);
         invalidate_VisBuf(d->view.visBuf);
@@ -5009,7 +5282,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         refresh_Widget(w);
         return iTrue;
     }
-    else if (equal_Command(cmd, "scroll.step") && document_App() == d) {
+    else if (cmdId == scrollStep_CommandId && document_App() == d) {
         const int dir = arg_Command(cmd);
         if (dir > 0 && !argLabel_Command(cmd, "repeat") &&
             prefs_App()->loadImageInsteadOfScrolling &&
@@ -5127,7 +5400,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iTrue;
     }
-    else if (equalWidget_Command(cmd, w, "menu.closed")) {
+    else if (cmdId == menuClosed_CommandId && isFromWidget_Command(cmd, w)) {
         updateHover_DocumentView_(&d->view, mouseCoord_Window(get_Window(), 0));
     }
     else if (equal_Command(cmd, "bookmarks.changed")) {
@@ -5195,6 +5468,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
                                   ? arg_Command(cmd) != 0 /* set to value */
                                   : (d->flags & viewSource_DocumentWidgetFlag) != 0; /* toggle */
         iChangeFlags(d->flags, viewSource_DocumentWidgetFlag, !gemtext);
+        finishLayout_DocumentWidget_(d);
         if (setViewFormat_GmDocument(
                 d->view.doc, gemtext ? gemini_SourceFormat : plainText_SourceFormat)) {
             documentRunsInvalidated_DocumentWidget_(d);
@@ -6176,6 +6450,7 @@ static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *e
                             return iTrue;
                         }
                         if (!requestMedia_DocumentWidget_(d, linkId, iTrue)) {
+                            finishLayout_DocumentWidget_(d); /* media will be modified */
                             if (linkFlags & content_GmLinkFlag) {
                                 /* Dismiss shown content on click. */
                                 setData_Media(media_GmDocument(view->doc),
@@ -6504,6 +6779,8 @@ void init_DocumentWidget(iDocumentWidget *d) {
     iZap(d->sourceTime);
     d->sourceGempub    = NULL;
     d->initNormScrollY = 0;
+    d->layoutJob = NULL;
+    d->layoutGeneration = 0;
     d->grabbedPlayer   = NULL;
     d->mediaTimer      = 0;
     init_String(&d->pendingGotoHeading);
@@ -6544,6 +6821,7 @@ void cancelAllRequests_DocumentWidget(iDocumentWidget *d) {
 }
 
 void deinit_DocumentWidget(iDocumentWidget *d) {
+    cancelLayout_DocumentWidget_(d);
     cancelAllRequests_DocumentWidget(d);
     pauseAllPlayers_Media(media_GmDocument(d->view.doc), iTrue);
     removeTicker_App(animate_DocumentWidget_, d);
@@ -6572,14 +6850,18 @@ void deinit_DocumentWidget(iDocumentWidget *d) {
 }
 
 void setSource_DocumentWidget(iDocumentWidget *d, const iString *source) {
+    finishLayout_DocumentWidget_(d);
     setUrl_GmDocument(d->view.doc, d->mod.url);
     const int docWidth = documentWidth_DocumentView_(&d->view);
-    setSource_GmDocument(d->view.doc,
-                         source,
-                         docWidth,
-                         width_Widget(d),
-                         isFinished_GmRequest(d->request) ? final_GmDocumentUpdate
-                                                          : partial_GmDocumentUpdate);
+    const enum iGmDocumentUpdate updateType =
+        isFinished_GmRequest(d->request) ? final_GmDocumentUpdate : partial_GmDocumentUpdate;
+    if (updateType == final_GmDocumentUpdate && isEmpty_String(source_GmDocument(d->view.doc)) &&
+        shouldLayoutInBackground_DocumentWidget_(d, size_String(source))) {
+        /* The entire document arrived at once. */
+        startLayout_DocumentWidget_(d, source);
+        return;
+    }
+    setSource_GmDocument(d->view.doc, source, docWidth, width_Widget(d), updateType);
     setWidth_Banner(d->banner, docWidth);
     documentWasChanged_DocumentWidget_(d);
 }
@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "listwidget.h"
 #include "lang.h"
 #include "lookup.h"
+#include "pageindex.h"
 #include "util.h"
 #include "visited.h"
 
@@ -45,15 +46,15 @@ iDeclareType(LookupJob)
 
 struct Impl_LookupJob {
     iRegExp *term;
+    iString words; /* separated by spaces */
     iTime now;
-    iObjectList *docs;
     iPtrArray results;
 };
 
 static void init_LookupJob(iLookupJob *d) {
     d->term = NULL;
+    init_String(&d->words);
     initCurrent_Time(&d->now);
-    d->docs = NULL;
     init_PtrArray(&d->results);
 }
 
@@ -62,7 +63,7 @@ static void deinit_LookupJob(iLookupJob *d) {
         delete_LookupResult(i.ptr);
     }
     deinit_PtrArray(&d->results);
-    iRelease(d->docs);
+    deinit_String(&d->words);
     iRelease(d->term);
 }
 
@@ -151,7 +152,6 @@ struct Impl_LookupWidget {
     iCondition   jobAvailable; /* wakes up the work thread */
     iMutex *     mtx;
     iString      pendingTerm;
-    iObjectList *pendingDocs;
     iLookupJob * finishedJob;
 };
 
@@ -274,24 +274,21 @@ static void searchVisited_LookupJob_(iLookupJob *d) {
 static void searchHistory_LookupJob_(iLookupJob *d) {
     /* Note: Called in a background thread. */
     size_t index = 0;
-    iForEach(ObjectList, i, d->docs) {
-        iConstForEach(StringArray, j,
-                      searchContents_History(history_DocumentWidget(i.object), d->term)) {
-            const char *match = cstr_String(j.value);
-            const size_t matchLen = argLabel_Command(match, "len");
-            iRangecc text;
-            text.start = strstr(match, " str:") + 5;
-            text.end = text.start + matchLen;
-            const char *url = strstr(text.end, " url:") + 5;
-            iLookupResult *res = new_LookupResult();
-            res->type = content_LookupResultType;
-            res->relevance = ++index; /* most recent comes last */
-            setCStr_String(&res->label, "\"");
-            appendRange_String(&res->label, text);
-            appendCStr_String(&res->label, "\"");
-            setCStr_String(&res->url, url);
-            pushBack_PtrArray(&d->results, res);
-        }
+    iConstForEach(StringArray, j, search_PageIndex(pageIndex_App(), &d->words, d->term)) {
+        const char *match = cstr_String(j.value);
+        const size_t matchLen = argLabel_Command(match, "len");
+        iRangecc text;
+        text.start = strstr(match, " str:") + 5;
+        text.end = text.start + matchLen;
+        const char *url = strstr(text.end, " url:") + 5;
+        iLookupResult *res = new_LookupResult();
+        res->type = content_LookupResultType;
+        res->relevance = ++index; /* most recent comes last */
+        setCStr_String(&res->label, "\"");
+        appendRange_String(&res->label, text);
+        appendCStr_String(&res->label, "\"");
+        setCStr_String(&res->url, url);
+        pushBack_PtrArray(&d->results, res);
     }
 }
 
@@ -348,9 +345,8 @@ static iThreadResult worker_LookupWidget_(iThread *thread) {
             delete_String(pattern);
         }
         const size_t termLen = length_String(&d->pendingTerm); /* characters */
+        set_String(&job->words, &d->pendingTerm);
         clear_String(&d->pendingTerm);
-        job->docs = d->pendingDocs;
-        d->pendingDocs = NULL;
         unlock_Mutex(d->mtx);
         /* Do the lookup. */ {
             searchBookmarks_LookupJob_(job);
@@ -403,7 +399,6 @@ void init_LookupWidget(iLookupWidget *d) {
     init_Condition(&d->jobAvailable);
     d->mtx = new_Mutex();
     init_String(&d->pendingTerm);
-    d->pendingDocs = NULL;
     d->finishedJob = NULL;
     updateMetrics_LookupWidget_(d);
     start_Thread(d->work);
@@ -412,7 +407,6 @@ void init_LookupWidget(iLookupWidget *d) {
 void deinit_LookupWidget(iLookupWidget *d) {
     /* Stop the worker. */ {
         iGuardMutex(d->mtx, {
-            iReleasePtr(&d->pendingDocs);
             clear_String(&d->pendingTerm);
             signal_Condition(&d->jobAvailable);
         });
@@ -429,9 +423,7 @@ void submit_LookupWidget(iLookupWidget *d, const iString *term) {
     iGuardMutex(d->mtx, {
         set_String(&d->pendingTerm, term);
         trim_String(&d->pendingTerm);
-        iReleasePtr(&d->pendingDocs);
         if (!isEmpty_String(&d->pendingTerm)) {
-            d->pendingDocs = listDocuments_App(get_Root()); /* holds reference to all open tabs */
             signal_Condition(&d->jobAvailable);
         }
         else {
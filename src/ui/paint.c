@@ -27,6 +27,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 iInt2 origin_Paint;
 
+static SDL_Texture *damageTarget_Paint_; /* NULL target is the window itself */
+static iBool        isDamageClipped_Paint_;
+static iRect        damage_Paint_;
+
 iLocalDef SDL_Renderer *renderer_Paint_(const iPaint *d) {
     iAssert(d->dst);
     return d->dst->render;
@@ -62,7 +66,7 @@ void beginTarget_Paint(iPaint *d, SDL_Texture *target) {
 
 void endTarget_Paint(iPaint *d) {
     if (d->setTarget) {
-        SDL_SetRenderTarget(renderer_Paint_(d), d->oldTarget);
+        restoreTarget_SDLRenderer(renderer_Paint_(d), d->oldTarget);
         origin_Paint = d->oldOrigin;
         d->oldOrigin = zero_I2();
         d->oldTarget = NULL;
@@ -70,6 +74,10 @@ void endTarget_Paint(iPaint *d) {
     }
 }
 
+iLocalDef iBool isDamageTarget_Paint_(const iPaint *d) {
+    return isDamageClipped_Paint_ && SDL_GetRenderTarget(renderer_Paint_(d)) == damageTarget_Paint_;
+}
+
 void setClip_Paint(iPaint *d, iRect rect) {
     addv_I2(&rect.pos, origin_Paint);
     iRect targetRect = zero_Rect();
@@ -82,6 +90,9 @@ void setClip_Paint(iPaint *d, iRect rect) {
     if (isEqual_I2(zero_I2(), origin_Paint)) {
         rect = intersect_Rect(rect, rect_Root(get_Root()));
     }
+    if (isDamageTarget_Paint_(d)) {
+        rect = intersect_Rect(rect, damage_Paint_);
+    }
     if (isEmpty_Rect(rect)) {
         rect = init_Rect(0, 0, 1, 1);
     }
@@ -89,7 +100,7 @@ void setClip_Paint(iPaint *d, iRect rect) {
 }
 
 void unsetClip_Paint(iPaint *d) {
-    if (numRoots_Window(get_Window()) > 1) {
+    if (numRoots_Window(get_Window()) > 1 || isDamageTarget_Paint_(d)) {
         setClip_Paint(d, rect_Root(get_Root()));
         return;
     }
@@ -102,6 +113,29 @@ void unsetClip_Paint(iPaint *d) {
 #endif
 }
 
+void beginDamage_Paint(iPaint *d, iRect damage) {
+    /* Everything drawn into the current target gets clipped to the damaged area. Widget
+       buffers and other render targets are unaffected. */
+    damageTarget_Paint_    = SDL_GetRenderTarget(renderer_Paint_(d));
+    damage_Paint_          = damage;
+    isDamageClipped_Paint_ = iTrue;
+    SDL_RenderSetClipRect(renderer_Paint_(d), (const SDL_Rect *) &damage);
+}
+
+void endDamage_Paint(iPaint *d) {
+    isDamageClipped_Paint_ = iFalse;
+    damageTarget_Paint_    = NULL;
+    SDL_RenderSetClipRect(renderer_Paint_(d), NULL);
+}
+
+iBool isDamaged_Paint(const iPaint *d, iRect rect) {
+    if (!isDamageTarget_Paint_(d)) {
+        return iTrue;
+    }
+    addv_I2(&rect.pos, origin_Paint);
+    return !isEmpty_Rect(intersect_Rect(rect, damage_Paint_));
+}
+
 void drawRect_Paint(const iPaint *d, iRect rect, int color) {
     addv_I2(&rect.pos, origin_Paint);
     iInt2 br = bottomRight_Rect(rect);
@@ -205,3 +239,11 @@ iInt2 size_SDLTexture(SDL_Texture *d) {
     SDL_QueryTexture(d, NULL, NULL, &size.x, &size.y);
     return size;
 }
+
+void restoreTarget_SDLRenderer(SDL_Renderer *render, SDL_Texture *oldTarget) {
+    SDL_SetRenderTarget(render, oldTarget);
+    /* SDL resets the clip when switching to a texture target. */
+    if (oldTarget && isDamageClipped_Paint_ && oldTarget == damageTarget_Paint_) {
+        SDL_RenderSetClipRect(render, (const SDL_Rect *) &damage_Paint_);
+    }
+}
@@ -47,6 +47,10 @@ void    endTarget_Paint     (iPaint *);
 void    setClip_Paint       (iPaint *, iRect rect);
 void    unsetClip_Paint     (iPaint *);
 
+void    beginDamage_Paint   (iPaint *, iRect damage); /* limit drawing in current target */
+void    endDamage_Paint     (iPaint *);
+iBool   isDamaged_Paint     (const iPaint *, iRect rect);
+
 void    drawRect_Paint          (const iPaint *, iRect rect, int color);
 void    drawRectThickness_Paint (const iPaint *, iRect rect, int thickness, int color);
 void    fillRect_Paint          (const iPaint *, iRect rect, int color);
@@ -67,3 +71,4 @@ iLocalDef void drawVLine_Paint(const iPaint *d, iInt2 pos, int len, int color) {
 void    drawPin_Paint       (iPaint *, iRect rangeRect, int dir, int pinColor);
 
 iInt2   size_SDLTexture     (SDL_Texture *);
+void    restoreTarget_SDLRenderer   (SDL_Renderer *, SDL_Texture *oldTarget);
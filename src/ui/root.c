@@ -417,6 +417,7 @@ static iWidget *makeIdentityMenu_(iWidget *parent) {
 
 iBool handleRootCommands_Widget(iWidget *root, const char *cmd) {
     iUnused(root);
+    const enum iCommandId cmdId = nameId_Command(cmd);
     if (equal_Command(cmd, "menu.open")) {
         iWidget *button = pointer_Command(cmd);
         iWidget *menu = findChild_Widget(button, "menu");
@@ -509,12 +510,12 @@ iBool handleRootCommands_Widget(iWidget *root, const char *cmd) {
         SDL_SetWindowInputFocus(window->win);
         return iTrue;
     }
-    else if (equal_Command(cmd, "window.focus.lost")) {
+    else if (cmdId == windowFocusLost_CommandId) {
         setTextColor_LabelWidget(findWidget_App("winbar.app"), uiAnnotation_ColorId);
         setTextColor_LabelWidget(findWidget_App("winbar.title"), uiAnnotation_ColorId);
         return iFalse;
     }
-    else if (equal_Command(cmd, "window.focus.gained")) {
+    else if (cmdId == windowFocusGained_CommandId) {
         setTextColor_LabelWidget(findWidget_App("winbar.app"), uiTextAppTitle_ColorId);
         setTextColor_LabelWidget(findWidget_App("winbar.title"), uiTextStrong_ColorId);
         return iFalse;
@@ -555,14 +556,14 @@ iBool handleRootCommands_Widget(iWidget *root, const char *cmd) {
         }
         return iTrue;
     }
-    else if (deviceType_App() == tablet_AppDeviceType && equal_Command(cmd, "window.resized")) {
+    else if (deviceType_App() == tablet_AppDeviceType && cmdId == windowResized_CommandId) {
         iSidebarWidget *sidebar = findChild_Widget(root, "sidebar");
         iSidebarWidget *sidebar2 = findChild_Widget(root, "sidebar2");
         setWidth_SidebarWidget(sidebar, 73.0f);
         setWidth_SidebarWidget(sidebar2, 73.0f);
         return iFalse;
     }
-    else if (deviceType_App() == phone_AppDeviceType && equal_Command(cmd, "window.resized")) {
+    else if (deviceType_App() == phone_AppDeviceType && cmdId == windowResized_CommandId) {
         /* Place the sidebar next to or under doctabs depending on orientation. */
         iSidebarWidget *sidebar = findChild_Widget(root, "sidebar");
         removeChild_Widget(parent_Widget(sidebar), sidebar);
@@ -609,7 +610,7 @@ iBool handleRootCommands_Widget(iWidget *root, const char *cmd) {
         }
         return iFalse; /* all roots must handle this */
     }
-    else if (equal_Command(cmd, "theme.changed")) {
+    else if (cmdId == themeChanged_CommandId) {
         /* The phone toolbar is draw-buffered so it needs refreshing. */
         refresh_Widget(findWidget_App("toolbar"));
         return iFalse;
@@ -802,6 +803,14 @@ void notifyVisualOffsetChange_Root(iRoot *d) {
     }
 }
 
+void addDamage_Root(iRoot *d, iRect rect) {
+    rect = intersect_Rect(rect, rect_Root(d));
+    if (isEmpty_Rect(rect)) {
+        return;
+    }
+    d->damage = isEmpty_Rect(d->damage) ? rect : union_Rect(d->damage, rect);
+}
+
 void dismissPortraitPhoneSidebars_Root(iRoot *d) {
     if (deviceType_App() == phone_AppDeviceType && isPortrait_App()) {
         iWidget *sidebar = findChild_Widget(d->widget, "sidebar");
@@ -963,7 +972,8 @@ static void updateNavBarActions_(iWidget *navBar) {
 }
 
 static iBool handleNavBarCommands_(iWidget *navBar, const char *cmd) {
-    if (equal_Command(cmd, "window.resized") || equal_Command(cmd, "metrics.changed")) {
+    const enum iCommandId cmdId = nameId_Command(cmd);
+    if (cmdId == windowResized_CommandId || cmdId == metricsChanged_CommandId) {
         updateNavBarSize_(navBar);
         //arrange_Widget(root_Widget(navBar));
         //updateBottomBarPosition_(findWidget_Root("bottombar"), iFalse);
@@ -1021,10 +1031,10 @@ static iBool handleNavBarCommands_(iWidget *navBar, const char *cmd) {
         return iTrue;
     }
     else if (deviceType_App() != desktop_AppDeviceType &&
-             (equal_Command(cmd, "focus.gained") || equal_Command(cmd, "focus.lost"))) {
+             (cmdId == focusGained_CommandId || cmdId == focusLost_CommandId)) {
         iInputWidget *url = findChild_Widget(navBar, "url");
         if (pointer_Command(cmd) == url) {
-            const iBool isFocused = equal_Command(cmd, "focus.gained");
+            const iBool isFocused = cmdId == focusGained_CommandId;
             if (deviceType_App() == tablet_AppDeviceType && isPortrait_App()) {
                 setFlags_Widget(findChild_Widget(navBar, "navbar.action1"), hidden_WidgetFlag, isFocused);
                 setFlags_Widget(findChild_Widget(navBar, "navbar.action2"), hidden_WidgetFlag, isFocused);
@@ -1097,7 +1107,7 @@ static iBool handleNavBarCommands_(iWidget *navBar, const char *cmd) {
     else if (startsWith_CStr(cmd, "document.")) {
         /* React to the current document only. */
         if (document_Command(cmd) == document_App()) {
-            if (equal_Command(cmd, "document.changed")) {
+            if (cmdId == documentChanged_CommandId) {
                 iInputWidget *url = findWidget_Root("url");
                 const iString *urlStr = collect_String(suffix_Command(cmd, "url"));
                 const enum iGmStatusCode statusCode = argLabel_Command(cmd, "status");
@@ -1149,7 +1159,7 @@ static iBool handleNavBarCommands_(iWidget *navBar, const char *cmd) {
                 checkLoadAnimation_Root_(get_Root());
                 return iFalse;
             }
-            else if (equal_Command(cmd, "document.request.started")) {
+            else if (cmdId == documentRequestStarted_CommandId) {
                 iInputWidget *url = findChild_Widget(navBar, "url");
                 setTextCStr_InputWidget(url, suffixPtr_Command(cmd, "url"));
                 checkLoadAnimation_Root_(get_Root());
@@ -1158,7 +1168,7 @@ static iBool handleNavBarCommands_(iWidget *navBar, const char *cmd) {
             }
         }
     }
-    else if (equal_Command(cmd, "tabs.changed")) {
+    else if (cmdId == tabsChanged_CommandId) {
         /* Update navbar according to the current tab. */
         iDocumentWidget *doc = document_App();
         iAssert(doc);
@@ -1175,7 +1185,7 @@ static iBool handleNavBarCommands_(iWidget *navBar, const char *cmd) {
         makePaletteGlobal_GmDocument(document_DocumentWidget(doc));
         refresh_Widget(findWidget_Root("doctabs"));
     }
-    else if (equal_Command(cmd, "mouse.clicked") && arg_Command(cmd)) {
+    else if (cmdId == mouseClicked_CommandId && arg_Command(cmd)) {
         iWidget *widget = pointer_Command(cmd);
         iWidget *menu = findWidget_App("doctabs.menu");
         iAssert(menu->root == navBar->root);
@@ -1277,8 +1287,9 @@ static void updateToolBarActions_(iWidget *toolBar) {
 }
 
 static iBool handleToolBarCommands_(iWidget *toolBar, const char *cmd) {
-    if (equalWidget_Command(cmd, toolBar, "mouse.clicked") && arg_Command(cmd) &&
-        argLabel_Command(cmd, "button") == SDL_BUTTON_RIGHT) {
+    const enum iCommandId cmdId = nameId_Command(cmd);
+    if (cmdId == mouseClicked_CommandId && isFromWidget_Command(cmd, toolBar) &&
+        arg_Command(cmd) && argLabel_Command(cmd, "button") == SDL_BUTTON_RIGHT) {
         iWidget *menu = findChild_Widget(toolBar, "toolbar.menu");
         arrange_Widget(menu);
         openMenu_Widget(menu, innerToWindow_Widget(menu, init_I2(0, -height_Widget(menu))));
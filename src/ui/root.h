@@ -27,6 +27,7 @@ struct Impl_Root {
     iAudience *visualOffsetsChanged; /* called after running tickers */
     iColor     tmPalette[tmMax_ColorId]; /* theme-specific palette */
     iString    tabInsertId; /* place new tab next to this one */
+    iRect      damage; /* window area that needs redrawing; accumulated since last draw */
 };
 
 iDeclareTypeConstruction(Root)
@@ -53,6 +54,7 @@ void        updateToolbarColors_Root            (iRoot *);
 void        showOrHideNewTabButton_Root         (iRoot *);
 
 void        notifyVisualOffsetChange_Root       (iRoot *);
+void        addDamage_Root                      (iRoot *, iRect rect);
 
 size_t      windowIndex_Root                    (const iRoot *);
 iInt2       size_Root                           (const iRoot *);
@@ -35,7 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #   include <fribidi/fribidi.h>
 #endif
 
-static iText *current_Text_;
+static _Thread_local iText *current_Text_; /* each thread may have its own current Text */
 
 int   gap_Text;                           /* cf. gap_UI in metrics.h */
 
@@ -356,7 +356,7 @@ void init_TextBuf(iTextBuf *d, iWrapText *wrapText, int font, int color) {
         SDL_SetRenderDrawColor(render, 255, 255, 255, 0);
         SDL_RenderClear(render);
         draw_WrapText(wrapText, font, zero_I2(), color | fillBackground_ColorId);
-        SDL_SetRenderTarget(render, oldTarget);
+        restoreTarget_SDLRenderer(render, oldTarget);
         origin_Paint = oldOrigin;
         SDL_SetTextureBlendMode(d->texture, SDL_BLENDMODE_BLEND);
         setBaseAttributes_Text(-1, -1);
@@ -55,13 +55,32 @@ void    delete_Text             (iText *);
 void    init_Text               (iText *, SDL_Renderer *, float documentFontSizeFactor);
 void    deinit_Text             (iText *);
 
-void    setCurrent_Text         (iText *);
+void    setCurrent_Text         (iText *); /* current Text of the calling thread */
 iText * current_Text            (void);
 
+/* A metrics-only Text can be used for shaping and measuring text in a background thread.
+   It has no glyph cache texture, so it cannot draw anything. Fonts are not reloaded while
+   metrics-only Texts exist. */
+iText * newMetrics_Text         (const iText *);
+void    waitForMetrics_Text     (void); /* blocks until all metrics-only Texts are deleted */
+
 void    setDocumentFontSize_Text(iText *, float fontSizeFactor); /* affects all except `default*` fonts */
 void    resetFonts_Text         (iText *);
 void    resetFontCache_Text     (iText *);
 
+iDeclareType(RunCacheStats)
+
+struct Impl_RunCacheStats {
+    size_t count;  /* shaped runs */
+    size_t size;   /* approximate bytes */
+    size_t budget; /* bytes */
+    size_t hits;
+    size_t misses;
+};
+
+iRunCacheStats  runCacheStats_Text      (const iText *);
+void            setRunCacheBudget_Text  (iText *, size_t bytes); /* see `runcachesize.set` */
+
 enum iAnsiFlag {
     allowFg_AnsiFlag        = iBit(1),
     allowBg_AnsiFlag        = iBit(2),
@@ -70,6 +89,7 @@ enum iAnsiFlag {
 };
 
 void    setOpacity_Text         (float opacity);
+void    beginFrame_Text         (iText *); /* glyph cache pages drawn from are kept */
 void    setBaseAttributes_Text  (int fontId, int fgColorId); /* current "normal" text attributes */
 void    setAnsiFlags_Text       (int ansiFlags);
 int     ansiFlags_Text          (void);
@@ -81,9 +81,6 @@ static void runSimple_Font_(iFont *d, const iRunArgs *args) {
     const enum iRunMode mode        = args->mode;
     const char *        lastWordEnd = args->text.start;
     SDL_Renderer *render = current_Text()->render;
-#if defined (LAGRANGE_ENABLE_STB_TRUETYPE)
-    SDL_Texture *cache = current_StbText_()->cache;
-#endif
     iAssert(args->text.end >= args->text.start);
     if (wrap) {
         wrap->wrapRange_        = args->text;
@@ -101,7 +98,7 @@ static void runSimple_Font_(iFont *d, const iRunArgs *args) {
     if (mode & draw_RunMode) {
         const iColor clr = get_Color(args->color);
 #if defined (LAGRANGE_ENABLE_STB_TRUETYPE)
-        SDL_SetTextureColorMod(cache, clr.r, clr.g, clr.b);
+        setGlyphColor_StbText_(current_StbText_(), clr);
 #endif
 #if defined (SDL_SEAL_CURSES)
         const enum iFontStyle style = style_FontId(fontId_Text(d));
@@ -148,7 +145,7 @@ static void runSimple_Font_(iFont *d, const iRunArgs *args) {
                                      current_Text()->baseFgColorId,
                                      none_ColorId, &clr, NULL);
 #if defined (LAGRANGE_ENABLE_STB_TRUETYPE)
-                    SDL_SetTextureColorMod(cache, clr.r, clr.g, clr.b);
+                    setGlyphColor_StbText_(current_StbText_(), clr);
 #endif
 #if defined (SDL_SEAL_CURSES)
                     SDL_SetRenderTextColor(render, clr.r, clr.g, clr.b);
@@ -242,7 +239,7 @@ static void runSimple_Font_(iFont *d, const iRunArgs *args) {
                 if (mode & draw_RunMode && ~mode & permanentColorFlag_RunMode) {
                     const iColor clr = get_Color(colorNum);
 #if defined (LAGRANGE_ENABLE_STB_TRUETYPE)
-                    SDL_SetTextureColorMod(cache, clr.r, clr.g, clr.b);
+                    setGlyphColor_StbText_(current_StbText_(), clr);
 #endif
                     if (args->mode & fillBackground_RunMode) {
                         SDL_SetRenderDrawColor(render, clr.r, clr.g, clr.b, 0);
@@ -264,7 +261,7 @@ static void runSimple_Font_(iFont *d, const iRunArgs *args) {
 //            printf("[Text] missing from cache: %lc (%x)\n", (int) ch, ch);
             //cacheTextGlyphs_Font_(d, args->text);
             cacheSingleGlyph_Font_(glyph->font, index_Glyph_(glyph));
-            glyph = glyph_Font_(d, ch); /* cache may have been reset */
+            glyph = glyph_Font_(d, ch);
         }
         int x2 = x1 + glyph->rect[hoff].size.x;
         if (isHitPointOnThisLine) {
@@ -355,7 +352,7 @@ static void runSimple_Font_(iFont *d, const iRunArgs *args) {
                 SDL_RenderFillRect(render, &dst);
             }
 #if defined (LAGRANGE_ENABLE_STB_TRUETYPE)
-            SDL_RenderCopy(render, cache, &src, &dst);
+            SDL_RenderCopy(render, glyphTexture_StbText_(current_StbText_(), glyph), &src, &dst);
 #endif
 #if defined (SDL_SEAL_CURSES)
             SDL_RenderDrawUnicode(render, dst.x, dst.y, ch);
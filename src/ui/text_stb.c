@@ -22,9 +22,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 /* Overview of types:
 
-- Text : top-level text renderer instance (one per window)
+- Text : top-level text renderer instance (one per window, plus metrics-only ones for
+  measuring text in background threads)
 - Font : a font's assets for rendering, e.g., metrics and cached glyphs
-- Glyph : hash node; a single cached glyph, with Rect in cache texture
+- Glyph : hash node; a single cached glyph, with Rect in a glyph cache page
+- GlyphPage : one texture of the glyph cache; least recently used pages are evicted
 - AttributedText : text string to be drawn that is split into sub-runs by attributes (font, color)
 - AttributedRun : a run inside AttributedText
 - GlyphBuffer : HarfBuzz-shaped glyphs corresponding to an AttributedRun
@@ -35,7 +37,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
  
 Optimization notes:
 
-- Caching FontRuns is quite effective, but there is still plenty of unnecessary iteration
+- Caching FontRuns is quite effective (the cache is an LRU hash with a byte budget), but
+  there is still plenty of unnecessary iteration
   of glyphs during wrapping of long text. It could help if there is a direct mapping between
   wrapPosRange and a GlyphBuffer's glyph indices.
 
@@ -48,12 +51,14 @@ Optimization notes:
 #include "window.h"
 #include "paint.h"
 #include "app.h"
+#include "profiler.h"
 
 #include <the_Foundation/array.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
 #include <the_Foundation/hash.h>
 #include <the_Foundation/math.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/stringlist.h>
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/path.h>
@@ -126,6 +131,8 @@ struct Impl_Glyph {
     float     advance; /* scaled */
     iRect     rect[4]; /* zero and half pixel offset */
     iInt2     d[4];
+    int       page;     /* glyph cache page where `rect` is located; -1 if not placed yet */
+    uint32_t  lastUsed; /* frame number */
 };
 
 void init_Glyph(iGlyph *d, uint32_t glyphIndex) {
@@ -135,6 +142,8 @@ void init_Glyph(iGlyph *d, uint32_t glyphIndex) {
     d->advance    = 0.0f;
     iZap(d->rect);
     iZap(d->d);
+    d->page       = -1;
+    d->lastUsed   = 0;
 }
 
 void deinit_Glyph(iGlyph *d) {
@@ -256,6 +265,22 @@ struct Impl_CacheRow {
     iInt2 pos;
 };
 
+iDeclareType(GlyphPage)
+
+struct Impl_GlyphPage {
+    SDL_Texture *texture;
+    iArray       rows; /* CacheRow; indexed by row height */
+    int          bottom;
+};
+
+iDeclareType(RasterGlyph)
+
+struct Impl_RasterGlyph {
+    iGlyph *glyph;
+    int     hoff;
+    iRect   rect;
+};
+
 iDeclareType(PrioMapItem)
 struct Impl_PrioMapItem {
     int      priority;
@@ -276,21 +301,36 @@ iDeclareTypeConstructionArgs(StbText, SDL_Renderer *render, float documentFontSi
 
 struct Impl_StbText {
     iText          base;
+    iBool          isMetricsOnly; /* no glyph cache; only for measuring */
     iArray         fonts; /* fonts currently selected for use (incl. all styles/sizes) */
     int            overrideFontId; /* always checked for glyphs first, regardless of which font is used */    
     iArray         fontPriorityOrder;
-    SDL_Texture *  cache;
-    iInt2          cacheSize;
+    iArray         cachePages; /* GlyphPage; textures where rasterized glyphs are stored */
+    iInt2          cacheSize; /* of each page */
     int            cacheRowAllocStep;
-    int            cacheBottom;
-    iArray         cacheRows;
+    size_t         cacheNumRows;
+    int            cachePage; /* where new glyphs are placed */
+    uint32_t       cacheFrame; /* incremented when a frame begins; for glyph last-use stamps */
+    iColor         cacheColor; /* color and alpha modulation of the pages */
+    SDL_Surface *  uploadBuf; /* newly rasterized glyphs waiting to be copied to the pages */
+    iArray         uploads; /* RasterGlyph */
+    int            uploadX;
     SDL_Palette *  grayscale;
     SDL_Palette *  blackAndWhite; /* unsmoothed glyph palette */
     iBool          missingGlyphs;  /* true if a glyph couldn't be found */
     iChar          missingChars[20]; /* rotating buffer of the latest missing characters */
-    iFontRun *     cachedFontRuns[16]; /* recently generated HarfBuzz glyph buffers */
+    iHash          fontRuns; /* recently generated HarfBuzz glyph buffers; key is a hash of text+args */
+    iFontRun *     mruFontRun; /* LRU list of `fontRuns`, starting from the most recently used */
+    iFontRun *     lruFontRun;
+    size_t         fontRunsSize; /* approximate bytes */
+    size_t         fontRunsBudget;
+    size_t         fontRunHits;
+    size_t         fontRunMisses;
 };
 
+static const size_t metricsFontRunsBudget_StbText_ = 1024 * 1024; /* bytes */
+static const size_t maxGlyphPages_StbText_         = 4;
+
 iLocalDef iStbText *current_StbText_(void) {
     return (iStbText *) current_Text();
 }
@@ -300,6 +340,19 @@ iLocalDef iFont *font_Text_(enum iFontId id) {
     return at_Array(&current_StbText_()->fonts, id & mask_FontId);
 }
 
+static void initFontRuns_StbText_(iStbText *d) {
+    init_Hash(&d->fontRuns);
+    d->mruFontRun     = NULL;
+    d->lruFontRun     = NULL;
+    d->fontRunsSize   = 0;
+    d->fontRunsBudget = runCacheBudget_Prefs(prefs_App()); /* `runcachesize.set` */
+    d->fontRunHits    = 0;
+    d->fontRunMisses  = 0;
+}
+
+static void clearFontRuns_StbText_(iStbText *);
+static size_t numFontRuns_StbText_(const iStbText *);
+
 static void setupFontVariants_StbText_(iStbText *d, const iFontSpec *spec, int baseId) {
     const float uiSize   = fontSize_UI * (isMobile_Platform() ? 1.1f : 1.0f);
     const float textSize = fontSize_UI * d->base.contentFontSize;
@@ -388,7 +441,6 @@ static int maxGlyphHeight_Text_(const iText *d) {
 }
 
 static void initCache_StbText_(iStbText *d) {
-    init_Array(&d->cacheRows, sizeof(iCacheRow));
     const int textSize = d->base.contentFontSize * fontSize_UI;
     iAssert(textSize > 0);
     numOffsetSteps_Glyph_   = get_Window()->pixelRatio < 2.0f   ? 4
@@ -407,26 +459,68 @@ static void initCache_StbText_(iStbText *d) {
         d->cacheSize.x = renderInfo.max_texture_width;
     }
     d->cacheRowAllocStep = iMax(2, textSize / 6);
-    /* Allocate initial (empty) rows. These will be assigned actual locations in the cache
-       once at least one glyph is stored. */
+    d->cacheNumRows      = 0;
     for (int h = d->cacheRowAllocStep;
          h <= 5 * textSize + d->cacheRowAllocStep;
          h += d->cacheRowAllocStep) {
-        pushBack_Array(&d->cacheRows, &(iCacheRow){ .height = 0 });
+        d->cacheNumRows++;
     }
-    d->cacheBottom = 0;
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
-    d->cache = SDL_CreateTexture(d->base.render,
-                                 SDL_PIXELFORMAT_RGBA4444,
-                                 SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
-                                 d->cacheSize.x,
-                                 d->cacheSize.y);
-    SDL_SetTextureBlendMode(d->cache, SDL_BLENDMODE_BLEND);
+    init_Array(&d->cachePages, sizeof(iGlyphPage)); /* pages are created when needed */
+    d->cachePage  = -1;
+    d->cacheFrame = 0;
+    d->cacheColor = (iColor){ 255, 255, 255, 255 };
+    d->uploadBuf  = NULL;
+    init_Array(&d->uploads, sizeof(iRasterGlyph));
+    d->uploadX    = 0;
 }
 
 static void deinitCache_StbText_(iStbText *d) {
-    deinit_Array(&d->cacheRows);
-    SDL_DestroyTexture(d->cache);
+    iForEach(Array, i, &d->cachePages) {
+        iGlyphPage *page = i.value;
+        deinit_Array(&page->rows);
+        SDL_DestroyTexture(page->texture);
+    }
+    deinit_Array(&d->cachePages);
+    deinit_Array(&d->uploads);
+    if (d->uploadBuf) {
+        SDL_FreeSurface(d->uploadBuf);
+    }
+}
+
+static void resetRows_GlyphPage_(iGlyphPage *d, size_t numRows) {
+    /* Allocate initial (empty) rows. These will be assigned actual locations in the page
+       once at least one glyph is stored. */
+    clear_Array(&d->rows);
+    for (size_t i = 0; i < numRows; i++) {
+        pushBack_Array(&d->rows, &(iCacheRow){ .height = 0 });
+    }
+    d->bottom = 0;
+}
+
+static int newPage_StbText_(iStbText *d) {
+    iGlyphPage page;
+    init_Array(&page.rows, sizeof(iCacheRow));
+    resetRows_GlyphPage_(&page, d->cacheNumRows);
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    page.texture = SDL_CreateTexture(d->base.render,
+                                     SDL_PIXELFORMAT_RGBA4444,
+                                     SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
+                                     d->cacheSize.x,
+                                     d->cacheSize.y);
+    SDL_SetTextureBlendMode(page.texture, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureColorMod(page.texture, d->cacheColor.r, d->cacheColor.g, d->cacheColor.b);
+    SDL_SetTextureAlphaMod(page.texture, d->cacheColor.a);
+    pushBack_Array(&d->cachePages, &page);
+    return (int) size_Array(&d->cachePages) - 1;
+}
+
+static void setGlyphColor_StbText_(iStbText *d, iColor clr) {
+    d->cacheColor.r = clr.r;
+    d->cacheColor.g = clr.g;
+    d->cacheColor.b = clr.b;
+    iForEach(Array, i, &d->cachePages) {
+        SDL_SetTextureColorMod(((iGlyphPage *) i.value)->texture, clr.r, clr.g, clr.b);
+    }
 }
 
 void init_StbText(iStbText *d, SDL_Renderer *render, float documentFontSizeFactor) {
@@ -435,9 +529,10 @@ void init_StbText(iStbText *d, SDL_Renderer *render, float documentFontSizeFacto
     setCurrent_Text(&d->base);
     init_Array(&d->fonts, sizeof(iFont));
     init_Array(&d->fontPriorityOrder, sizeof(iPrioMapItem));
+    d->isMetricsOnly   = iFalse;
     d->missingGlyphs   = iFalse;
     iZap(d->missingChars);
-    iZap(d->cachedFontRuns);
+    initFontRuns_StbText_(d);
     /* A grayscale palette for rasterized glyphs. */ {
         SDL_Color colors[256];
         for (int i = 0; i < 256; ++i) {
@@ -461,15 +556,14 @@ void init_StbText(iStbText *d, SDL_Renderer *render, float documentFontSizeFacto
 }
 
 void deinit_StbText(iStbText *d) {
-#if defined (LAGRANGE_ENABLE_HARFBUZZ)
-    iForIndices(i, d->cachedFontRuns) {
-        delete_FontRun(d->cachedFontRuns[i]);
+    clearFontRuns_StbText_(d);
+    deinit_Hash(&d->fontRuns);
+    deinitFonts_StbText_(d); /* in a metrics-only Text, fonts just own their glyph tables */
+    deinitCache_StbText_(d); /* a metrics-only Text has no pages */
+    if (!d->isMetricsOnly) {
+        SDL_FreePalette(d->blackAndWhite);
+        SDL_FreePalette(d->grayscale);
     }
-#endif
-    SDL_FreePalette(d->blackAndWhite);
-    SDL_FreePalette(d->grayscale);
-    deinitFonts_StbText_(d);
-    deinitCache_StbText_(d);
     deinit_Array(&d->fontPriorityOrder);
     deinit_Array(&d->fonts);
     deinit_Text(&d->base);
@@ -481,13 +575,72 @@ iText *new_Text(SDL_Renderer *render, float documentFontSizeFactor) {
     return (iText *) d;
 }
 
+static iMutex *   metricsMutex_;
+static iCondition metricsDeleted_;
+static int        numMetrics_; /* number of existing metrics-only Texts */
+
+iText *newMetrics_Text(const iText *source) {
+    const iStbText *src = (const iStbText *) source;
+    iStbText *d = iMalloc(StbText);
+    iZap(*d);
+    init_Text(&d->base, NULL, 1.0f);
+    d->base.contentFontSize = source->contentFontSize;
+    d->isMetricsOnly        = iTrue;
+    d->overrideFontId       = src->overrideFontId;
+    initFontRuns_StbText_(d);
+    d->fontRunsBudget       = metricsFontRunsBudget_StbText_;
+    init_Array(&d->cachePages, sizeof(iGlyphPage));
+    init_Array(&d->uploads, sizeof(iRasterGlyph));
+    init_Array(&d->fontPriorityOrder, sizeof(iPrioMapItem));
+    setCopy_Array(&d->fontPriorityOrder, &src->fontPriorityOrder);
+    /* The font files and specs are shared, but glyph metrics are looked up separately so
+       the source Text's glyph tables are never accessed from another thread. */
+    init_Array(&d->fonts, sizeof(iFont));
+    iConstForEach(Array, i, &src->fonts) {
+        iFont font = *(const iFont *) i.value;
+        font.table = NULL;
+        pushBack_Array(&d->fonts, &font);
+    }
+    if (!metricsMutex_) {
+        metricsMutex_ = new_Mutex();
+        init_Condition(&metricsDeleted_);
+    }
+    iGuardMutex(metricsMutex_, numMetrics_++);
+    return &d->base;
+}
+
+void waitForMetrics_Text(void) {
+    if (metricsMutex_) {
+        lock_Mutex(metricsMutex_);
+        while (numMetrics_ > 0) {
+            wait_Condition(&metricsDeleted_, metricsMutex_);
+        }
+        unlock_Mutex(metricsMutex_);
+    }
+}
+
 void delete_Text(iText *d) {
+    const iBool isMetricsOnly = ((iStbText *) d)->isMetricsOnly;
     deinit_StbText((iStbText *) d);
     free(d);
+    if (isMetricsOnly) {
+        iGuardMutex(metricsMutex_, {
+            numMetrics_--;
+            signal_Condition(&metricsDeleted_);
+        });
+    }
 }
 
 void setOpacity_Text(float opacity) {
-    SDL_SetTextureAlphaMod(current_StbText_()->cache, iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f);
+    iStbText *d = current_StbText_();
+    d->cacheColor.a = iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f;
+    iForEach(Array, i, &d->cachePages) {
+        SDL_SetTextureAlphaMod(((iGlyphPage *) i.value)->texture, d->cacheColor.a);
+    }
+}
+
+void beginFrame_Text(iText *d) {
+    ((iStbText *) d)->cacheFrame++;
 }
 
 static void resetCache_StbText_(iStbText *d) {
@@ -502,6 +655,7 @@ void resetFonts_Text(iText *d) {
     iText *oldActive = current_Text();
     iStbText *s = (iStbText *) d;
     setCurrent_Text(d); /* some routines rely on the global `activeText_` pointer */
+    clearFontRuns_StbText_(s); /* glyph buffers refer to the fonts */
     deinitFonts_StbText_(s);
     deinitCache_StbText_(s);
     initCache_StbText_(s);
@@ -516,6 +670,27 @@ void resetFontCache_Text(iText *d) {
     setCurrent_Text(oldActive);
 }
 
+iRunCacheStats runCacheStats_Text(const iText *d) {
+    const iStbText *s = (const iStbText *) d;
+    iRunCacheStats stats = { .size   = s->fontRunsSize,
+                             .budget = s->fontRunsBudget,
+                             .hits   = s->fontRunHits,
+                             .misses = s->fontRunMisses };
+    stats.count = numFontRuns_StbText_(s);
+    return stats;
+}
+
+void setRunCacheBudget_Text(iText *d, size_t bytes) {
+    iStbText *s = (iStbText *) d;
+    if (s->isMetricsOnly) {
+        return; /* keeps its own small budget */
+    }
+    s->fontRunsBudget = bytes;
+    if (s->fontRunsSize > bytes) {
+        clearFontRuns_StbText_(s);
+    }
+}
+
 static SDL_Palette *glyphPalette_(void) {
     return prefs_App()->fontSmoothing ? current_StbText_()->grayscale
                                       : current_StbText_()->blackAndWhite;
@@ -541,42 +716,119 @@ static SDL_Surface *rasterizeGlyph_Font_(const iFont *d, uint32_t glyphIndex, fl
 #endif
 }
 
-iLocalDef iCacheRow *cacheRow_StbText_(iStbText *d, int height) {
-    return at_Array(&d->cacheRows, (height - 1) / d->cacheRowAllocStep);
+iLocalDef iCacheRow *cacheRow_StbText_(iStbText *d, iGlyphPage *page, int height) {
+    return at_Array(&page->rows, (height - 1) / d->cacheRowAllocStep);
 }
 
-static iInt2 assignCachePos_Text_(iStbText *d, iInt2 size) {
-    iCacheRow *cur = cacheRow_StbText_(d, size.y);
+static iInt2 assignCachePos_StbText_(iStbText *d, iGlyphPage *page, iInt2 size) {
+    iCacheRow *cur = cacheRow_StbText_(d, page, size.y);
     if (cur->height == 0) {
         /* Begin a new row height. */
         cur->height = (1 + (size.y - 1) / d->cacheRowAllocStep) * d->cacheRowAllocStep;
-        cur->pos.y = d->cacheBottom;
-        d->cacheBottom = cur->pos.y + cur->height;
+        cur->pos.y = page->bottom;
+        page->bottom = cur->pos.y + cur->height;
     }
     iAssert(cur->height >= size.y);
-    /* TODO: Automatically enlarge the cache if running out of space?
-       Maybe make it paged, but beware of texture swapping too often inside a text string. */
     if (cur->pos.x + size.x > d->cacheSize.x) {
-        /* Does not fit on this row, advance to a new location in the cache. */
-        cur->pos.y = d->cacheBottom;
+        /* Does not fit on this row, advance to a new location in the page. */
+        cur->pos.y = page->bottom;
         cur->pos.x = 0;
-        d->cacheBottom += cur->height;
-        iAssert(d->cacheBottom <= d->cacheSize.y);
+        page->bottom += cur->height;
+        iAssert(page->bottom <= d->cacheSize.y);
     }
     const iInt2 assigned = cur->pos;
     cur->pos.x += size.x;
     return assigned;
 }
 
-static void allocate_Font_(iFont *d, iGlyph *glyph, int hoff) {
+static void flushGlyphUploads_StbText_(iStbText *d);
+
+static int leastRecentlyUsedPage_StbText_(const iStbText *d) {
+    /* A page is as recent as its most recently used glyph. */
+    const size_t numPages = size_Array(&d->cachePages);
+    uint32_t *   stamps   = calloc(numPages, sizeof(uint32_t));
+    iConstForEach(Array, f, &d->fonts) {
+        const iGlyphTable *table = ((const iFont *) f.value)->table;
+        if (table) {
+            iConstForEach(Hash, g, &table->glyphs) {
+                const iGlyph *glyph = (const iGlyph *) g.value;
+                if (glyph->page >= 0) {
+                    stamps[glyph->page] = iMax(stamps[glyph->page], glyph->lastUsed);
+                }
+            }
+        }
+    }
+    int lru = -1;
+    for (size_t i = 0; i < numPages; i++) {
+        /* Pages used during the current frame are never evicted. */
+        if (stamps[i] < d->cacheFrame && (lru < 0 || stamps[i] < stamps[lru])) {
+            lru = (int) i;
+        }
+    }
+    free(stamps);
+    return lru;
+}
+
+static void evictPage_StbText_(iStbText *d, int pageIndex) {
+#if !defined (NDEBUG)
+    printf("[Text] evicting glyph cache page %d\n", pageIndex); fflush(stdout);
+#endif
+    flushGlyphUploads_StbText_(d); /* pending uploads may be targeting this page */
+    iForEach(Array, f, &d->fonts) {
+        iGlyphTable *table = ((iFont *) f.value)->table;
+        if (table) {
+            iForEach(Hash, g, &table->glyphs) {
+                iGlyph *glyph = (iGlyph *) g.value;
+                if (glyph->page == pageIndex) {
+                    /* Metrics are kept; the glyph gets placed again when needed. */
+                    glyph->page   = -1;
+                    glyph->flags &= ~rasterizedAll_GlyphFlag_;
+                }
+            }
+        }
+    }
+    resetRows_GlyphPage_(at_Array(&d->cachePages, pageIndex), d->cacheNumRows);
+}
+
+static int nextPage_StbText_(iStbText *d) {
+    if (size_Array(&d->cachePages) < maxGlyphPages_StbText_) {
+        return newPage_StbText_(d);
+    }
+    const int lru = leastRecentlyUsedPage_StbText_(d);
+    if (lru < 0) {
+        /* Everything is needed for the current frame, so we'll have to exceed the limit.
+           Extra pages get reused via eviction in later frames. */
+        return newPage_StbText_(d);
+    }
+    evictPage_StbText_(d, lru);
+    return lru;
+}
+
+static void placeGlyph_StbText_(iStbText *d, iGlyph *glyph) {
+    iAssert(!d->isMetricsOnly);
+    iAssert(glyph->page < 0);
+    /* All subpixel offsets are placed on the same page, advancing in rows. */
+    if (d->cachePage < 0 ||
+        ((const iGlyphPage *) constAt_Array(&d->cachePages, d->cachePage))->bottom >
+            d->cacheSize.y - maxGlyphHeight_Text_(&d->base)) {
+        d->cachePage = nextPage_StbText_(d);
+    }
+    iGlyphPage *page = at_Array(&d->cachePages, d->cachePage);
+    for (int hoff = 0; hoff < numOffsetSteps_Glyph_; hoff++) {
+        glyph->rect[hoff].pos = assignCachePos_StbText_(d, page, glyph->rect[hoff].size);
+    }
+    glyph->page     = d->cachePage;
+    glyph->lastUsed = d->cacheFrame;
+}
+
+static void measureGlyph_Font_(iFont *d, iGlyph *glyph, int hoff) {
     iRect *glRect = &glyph->rect[hoff];
     int    x0, y0, x1, y1;
     measureGlyph_FontFile(d->font.file, index_Glyph_(glyph), d->xScale, d->yScale,
                           hoff * offsetStep_Glyph_(),
                           &x0, &y0, &x1, &y1);
-    glRect->size = init_I2(x1 - x0, y1 - y0);
-    /* Determine placement in the glyph cache texture, advancing in rows. */
-    glRect->pos    = assignCachePos_Text_(current_StbText_(), glRect->size);
+    glRect->size   = init_I2(x1 - x0, y1 - y0);
+    glRect->pos    = zero_I2(); /* placed on a page when rasterized */
     glyph->d[hoff] = init_I2(x0, y0);
     glyph->d[hoff].y += d->vertOffset;
     if (hoff == 0) { /* hoff>=1 uses same metrics as `glyph` */
@@ -654,20 +906,12 @@ static iGlyph *glyphByIndex_Font_(iFont *d, uint32_t glyphIndex) {
         glyph = node;
     }
     else {
-        iStbText *tx = current_StbText_();
-        /* If the cache is running out of space, clear it and we'll recache what's needed currently. */
-        if (tx->cacheBottom > tx->cacheSize.y - maxGlyphHeight_Text_(&tx->base)) {
-#if !defined (NDEBUG)
-            printf("[Text] glyph cache is full, clearing!\n"); fflush(stdout);
-#endif
-            resetCache_StbText_(tx);
-        }
         glyph = new_Glyph(glyphIndex);
         glyph->font = d;
-        /* New glyphs are always allocated at least. This reserves a position in the cache
-           and updates the glyph metrics. */
+        /* New glyphs are always measured at least. A position in the glyph cache is only
+           reserved when the glyph gets rasterized. */
         for (int offsetIndex = 0; offsetIndex < numOffsetSteps_Glyph_; offsetIndex++) {
-            allocate_Font_(d, glyph, offsetIndex);
+            measureGlyph_Font_(d, glyph, offsetIndex);
         }
         insert_Hash(&d->table->glyphs, &glyph->node);
     }
@@ -705,131 +949,102 @@ static iChar nextChar_(const char **chPos, const char *end) {
 
 /*----------------------------------------------------------------------------------------------*/
 
-iDeclareType(RasterGlyph)
-
-struct Impl_RasterGlyph {
-    iGlyph *glyph;
-    int     hoff;
-    iRect   rect;
-};
-
-static void cacheGlyphs_Font_(iFont *d, const uint32_t *glyphIndices, size_t numGlyphIndices) {
-    /* TODO: Make this an object so it can be used sequentially without reallocating buffers. */
-    SDL_Surface *buf     = NULL;
-    const iInt2  bufSize = init_I2(iMin(512, d->font.height * iMin(2 * numGlyphIndices, 20)),
-                                   d->font.height * 4 / 3);
-    int          bufX    = 0;
-    iArray *     rasters = NULL;
-    SDL_Texture *oldTarget = NULL;
-    iBool        isTargetChanged = iFalse;
-    iAssert(isExposed_Window(get_Window()));
-    /* We'll flush the buffered rasters periodically until everything is cached. */
-    size_t index = 0;
-    while (index < numGlyphIndices) {
-        for (; index < numGlyphIndices; index++) {
-            const uint32_t glyphIndex = glyphIndices[index];
-            const int lastCacheBottom = current_StbText_()->cacheBottom;
-            iGlyph *glyph = glyphByIndex_Font_(d, glyphIndex);
-            if (current_StbText_()->cacheBottom < lastCacheBottom) {
-                /* The cache was reset due to running out of space. We need to restart from
-                   the beginning! */
-                bufX = 0;
-                if (rasters) {
-                    clear_Array(rasters);
-                }
-                index = 0;
-                break;
-            }
-            if (!isFullyRasterized_Glyph_(glyph)) {
-                /* Need to cache this. */
-                if (buf == NULL) {
-                    rasters = new_Array(sizeof(iRasterGlyph));
-                    buf     = SDL_CreateRGBSurfaceWithFormat(
-                                0, bufSize.x, bufSize.y,
-                                LAGRANGE_RASTER_DEPTH,
-                                LAGRANGE_RASTER_FORMAT);
-                    SDL_SetSurfaceBlendMode(buf, SDL_BLENDMODE_NONE);
-                    SDL_SetSurfacePalette(buf, glyphPalette_());
-                }
-                SDL_Surface *surfaces[4] = { NULL, NULL, NULL, NULL };
-                for (int si = 0; si < numOffsetSteps_Glyph_; si++) {
-                    surfaces[si] = !isRasterized_Glyph_(glyph, si)
-                                       ? rasterizeGlyph_Font_(glyph->font,
-                                                              index_Glyph_(glyph),
-                                                              si * offsetStep_Glyph_())
-                                       : NULL;
-                }
-                iBool outOfSpace = iFalse;
-                iForIndices(i, surfaces) {
-                    if (surfaces[i]) {
-                        const int w = surfaces[i]->w;
-                        const int h = surfaces[i]->h;
-                        if (bufX + w <= bufSize.x) {
-                            SDL_BlitSurface(surfaces[i],
-                                            NULL,
-                                            buf,
-                                            &(SDL_Rect){ bufX, 0, w, h });
-                            pushBack_Array(rasters,
-                                           &(iRasterGlyph){ glyph, i, init_Rect(bufX, 0, w, h) });
-                            bufX += w;
-                        }
-                        else {
-                            outOfSpace = iTrue;
-                            break;
-                        }
-                    }
-                }
-                iForIndices(i, surfaces) { /* cleanup */
-                    if (surfaces[i]) {
-                        if (surfaces[i]->flags & SDL_PREALLOC) {
-                            free(surfaces[i]->pixels);
-                        }
-                        SDL_FreeSurface(surfaces[i]);
-                    }
-                }
-                if (outOfSpace) {
-                    /* Redo this glyph. `index` does not get incremented. */
-                    break;
-                }
-            }
-        }
-        /* Finished or the buffer is full, copy the glyphs to the cache texture. */
-        if (!isEmpty_Array(rasters)) {
-            SDL_Renderer *render = current_Text()->render;
-            SDL_Texture *bufTex = SDL_CreateTextureFromSurface(render, buf);
-            SDL_SetTextureBlendMode(bufTex, SDL_BLENDMODE_NONE);
-            if (!isTargetChanged) {
-                isTargetChanged = iTrue;
-                oldTarget = SDL_GetRenderTarget(render);
-                SDL_SetRenderTarget(render, current_StbText_()->cache);
+static void flushGlyphUploads_StbText_(iStbText *d) {
+    if (isEmpty_Array(&d->uploads)) {
+        return;
+    }
+    const uint64_t profileBegin = begin_Profiler(upload_ProfilerScope);
+    SDL_Renderer *render    = d->base.render;
+    SDL_Texture  *oldTarget = SDL_GetRenderTarget(render);
+    SDL_Texture  *bufTex    = SDL_CreateTextureFromSurface(render, d->uploadBuf);
+    SDL_SetTextureBlendMode(bufTex, SDL_BLENDMODE_NONE);
+    /* Copy to one page at a time so the render target is switched as few times as possible. */
+    iConstForEach(Array, p, &d->cachePages) {
+        const int pageIndex   = (int) index_ArrayConstIterator(&p);
+        iBool     isTargetSet = iFalse;
+        iConstForEach(Array, i, &d->uploads) {
+            const iRasterGlyph *rg = i.value;
+            if (rg->glyph->page != pageIndex) {
+                continue;
             }
-//            printf("copying %zu rasters from %p\n", size_Array(rasters), bufTex); fflush(stdout);
-            iConstForEach(Array, i, rasters) {
-                const iRasterGlyph *rg = i.value;
-//                iAssert(isEqual_I2(rg->rect.size, rg->glyph->rect[rg->hoff].size));
-                const iRect *glRect = &rg->glyph->rect[rg->hoff];
-                SDL_RenderCopy(render,
-                               bufTex,
-                               (const SDL_Rect *) &rg->rect,
-                               (const SDL_Rect *) glRect);
-                setRasterized_Glyph_(rg->glyph, rg->hoff);
-//                printf(" - %u (hoff %d)\n", index_Glyph_(rg->glyph), rg->hoff);
+            if (!isTargetSet) {
+                SDL_SetRenderTarget(render, ((const iGlyphPage *) p.value)->texture);
+                isTargetSet = iTrue;
             }
-            SDL_DestroyTexture(bufTex);
-            /* Resume with an empty buffer. */
-            clear_Array(rasters);
-            bufX = 0;
+            SDL_RenderCopy(render,
+                           bufTex,
+                           (const SDL_Rect *) &rg->rect,
+                           (const SDL_Rect *) &rg->glyph->rect[rg->hoff]);
         }
     }
-    if (rasters) {
-        delete_Array(rasters);
+    restoreTarget_SDLRenderer(render, oldTarget);
+    SDL_DestroyTexture(bufTex);
+    clear_Array(&d->uploads);
+    d->uploadX = 0;
+    end_Profiler(upload_ProfilerScope, profileBegin);
+}
+
+static void stageGlyph_StbText_(iStbText *d, iGlyph *glyph) {
+    /* Rasterized glyphs are collected in a buffer and copied to the pages in batches.
+       The buffer is flushed when it gets full or when a glyph is about to be drawn. */
+    if (!d->uploadBuf) {
+        d->uploadBuf = SDL_CreateRGBSurfaceWithFormat(
+            0,
+            d->cacheSize.x,
+            iMin(d->cacheSize.y, maxGlyphHeight_Text_(&d->base)),
+            LAGRANGE_RASTER_DEPTH,
+            LAGRANGE_RASTER_FORMAT);
+        SDL_SetSurfaceBlendMode(d->uploadBuf, SDL_BLENDMODE_NONE);
+    }
+    SDL_SetSurfacePalette(d->uploadBuf, glyphPalette_());
+    for (int hoff = 0; hoff < numOffsetSteps_Glyph_; hoff++) {
+        if (isRasterized_Glyph_(glyph, hoff)) {
+            continue;
+        }
+        const uint64_t profileBegin = begin_Profiler(rasterize_ProfilerScope);
+        SDL_Surface *surface =
+            rasterizeGlyph_Font_(glyph->font, index_Glyph_(glyph), hoff * offsetStep_Glyph_());
+        end_Profiler(rasterize_ProfilerScope, profileBegin);
+        const int w = surface->w;
+        const int h = surface->h;
+        if (d->uploadX + w > d->uploadBuf->w) {
+            flushGlyphUploads_StbText_(d);
+        }
+        SDL_BlitSurface(surface, NULL, d->uploadBuf, &(SDL_Rect){ d->uploadX, 0, w, h });
+        pushBack_Array(&d->uploads, &(iRasterGlyph){ glyph, hoff, init_Rect(d->uploadX, 0, w, h) });
+        d->uploadX += w;
+        /* Drawing will flush the buffer first, so the glyph can already be considered
+           rasterized. */
+        setRasterized_Glyph_(glyph, hoff);
+        if (surface->flags & SDL_PREALLOC) {
+            free(surface->pixels);
+        }
+        SDL_FreeSurface(surface);
     }
-    if (buf) {
-        SDL_FreeSurface(buf);
+}
+
+static void cacheGlyphs_Font_(iFont *d, const uint32_t *glyphIndices, size_t numGlyphIndices) {
+    iStbText *tx = current_StbText_();
+    iAssert(isExposed_Window(get_Window()));
+    for (size_t index = 0; index < numGlyphIndices; index++) {
+        iGlyph *glyph = glyphByIndex_Font_(d, glyphIndices[index]);
+        if (isFullyRasterized_Glyph_(glyph)) {
+            continue;
+        }
+        if (glyph->page < 0) {
+            placeGlyph_StbText_(tx, glyph);
+        }
+        stageGlyph_StbText_(tx, glyph);
     }
-    if (isTargetChanged) {
-        SDL_SetRenderTarget(current_Text()->render, oldTarget);
+}
+
+static SDL_Texture *glyphTexture_StbText_(iStbText *d, const iGlyph *glyph) {
+    if (glyph->page < 0) {
+        return NULL; /* not rasterized */
     }
+    flushGlyphUploads_StbText_(d);
+    iConstCast(iGlyph *, glyph)->lastUsed = d->cacheFrame;
+    return ((const iGlyphPage *) constAt_Array(&d->cachePages, glyph->page))->texture;
 }
 
 iLocalDef void cacheSingleGlyph_Font_(iFont *d, uint32_t glyphIndex) {
@@ -1087,6 +1302,10 @@ iLocalDef iBool equal_FontRunArgs(const iFontRunArgs *a, const iFontRunArgs *b)
 }
 
 struct Impl_FontRun {
+    iHashNode       node;
+    iFontRun       *prev, *next; /* in the order of use */
+    iBlock          text; /* for verifying cache hits */
+    size_t          size; /* approximate bytes */
     uint32_t        textCrc32;
     iFontRunArgs    args;
     iAttributedText attrText;
@@ -1108,6 +1327,9 @@ static const hb_script_t hbScripts_[max_Script] = {
 #endif
 
 void init_FontRun(iFontRun *d, const iFontRunArgs *args, const iRangecc text, uint32_t crc) {
+    d->prev      = NULL;
+    d->next      = NULL;
+    initData_Block(&d->text, text.start, size_Range(&text));
     d->textCrc32 = crc;
     d->args = *args;
     /* Split the text into a number of attributed runs that specify exactly which
@@ -1161,6 +1383,15 @@ void init_FontRun(iFontRun *d, const iFontRunArgs *args, const iRangecc text, ui
     for (size_t runIndex = 0; runIndex < runCount; runIndex++) {
         alignOtherFontsVertically_GlyphBuffer_(at_Array(&d->buffers, runIndex), args->font);
     }
+    /* Estimate memory use for the cache budget. */
+    d->size = sizeof(*d) + size_Block(&d->text) +
+              size_Array(&d->attrText.runs) * sizeof(iAttributedRun) +
+              size_Array(&d->attrText.logical) * (2 * sizeof(iChar) + 3 * sizeof(int) + 1);
+    iConstForEach(Array, b, &d->buffers) {
+        const iGlyphBuffer *buf = b.value;
+        d->size += sizeof(*buf) +
+                   buf->glyphCount * (sizeof(hb_glyph_info_t) + sizeof(hb_glyph_position_t));
+    }
 }
 
 void deinit_FontRun(iFontRun *d) {
@@ -1169,6 +1400,7 @@ void deinit_FontRun(iFontRun *d) {
     }
     deinit_Array(&d->buffers);
     deinit_AttributedText(&d->attrText);
+    deinit_Block(&d->text);
 }
 
 iLocalDef const iGlyphBuffer *buffer_FontRun(const iFontRun *d, size_t pos) {
@@ -1319,16 +1551,16 @@ void process_RunLayer_(iRunLayer *d, int layerIndex) {
                 if (layerIndex == foreground_RunLayerType && !isSpace) {
                     /* Draw the glyph. */
                     if (!isRasterized_Glyph_(glyph, hoff)) {
-                        cacheSingleGlyph_Font_(runFont, glyphId); /* may cause cache reset */
-                        glyph = glyphByIndex_Font_(runFont, glyphId);
+                        cacheSingleGlyph_Font_(runFont, glyphId); /* may evict other glyphs */
                         iAssert(isRasterized_Glyph_(glyph, hoff));
                     }
+                    SDL_Texture *page = glyphTexture_StbText_(current_StbText_(), glyph);
                     if (~d->mode & permanentColorFlag_RunMode) {
-                        SDL_SetTextureColorMod(current_StbText_()->cache, fgClr.r, fgClr.g, fgClr.b);
+                        SDL_SetTextureColorMod(page, fgClr.r, fgClr.g, fgClr.b);
                     }
                     SDL_Rect src;
                     memcpy(&src, &glyph->rect[hoff], sizeof(SDL_Rect));
-                    SDL_RenderCopy(current_Text()->render, current_StbText_()->cache, &src, &dst);
+                    SDL_RenderCopy(current_Text()->render, page, &src, &dst);
                 }
 #if 0
                 /* Show spaces and direction. */
@@ -1354,38 +1586,71 @@ void process_RunLayer_(iRunLayer *d, int layerIndex) {
     }   
 }
 
-static unsigned fontRunCacheHits_  = 0;
-static unsigned fontRunCacheTotal_ = 0;
+static void unlinkFontRun_StbText_(iStbText *d, iFontRun *run) {
+    if (run->prev) run->prev->next = run->next; else d->mruFontRun = run->next;
+    if (run->next) run->next->prev = run->prev; else d->lruFontRun = run->prev;
+    run->prev = run->next = NULL;
+}
+
+static void pushFontRun_StbText_(iStbText *d, iFontRun *run) {
+    run->prev = NULL;
+    run->next = d->mruFontRun;
+    if (d->mruFontRun) d->mruFontRun->prev = run; else d->lruFontRun = run;
+    d->mruFontRun = run;
+}
+
+static void removeFontRun_StbText_(iStbText *d, iFontRun *run) {
+    unlinkFontRun_StbText_(d, run);
+    remove_Hash(&d->fontRuns, run->node.key);
+    d->fontRunsSize -= run->size;
+    delete_FontRun(run);
+}
+
+static void clearFontRuns_StbText_(iStbText *d) {
+    while (d->lruFontRun) {
+        removeFontRun_StbText_(d, d->lruFontRun);
+    }
+    iAssert(d->fontRunsSize == 0);
+}
+
+static size_t numFontRuns_StbText_(const iStbText *d) {
+    size_t count = 0;
+    for (const iFontRun *run = d->mruFontRun; run; run = run->next) {
+        count++;
+    }
+    return count;
+}
 
 static iFontRun *makeOrFindCachedFontRun_StbText_(iStbText *d, const iFontRunArgs *runArgs,
                                                   const iRangecc text, iBool *wasFound) {
-    fontRunCacheTotal_++;
-#if 0
-    if (fontRunCacheTotal_ % 100 == 0) {
-        printf("FONT RUN CACHE: %d/%d rate:%.1f%%\n",
-               fontRunCacheHits_,
-               fontRunCacheTotal_,
-               (float) fontRunCacheHits_ / (float) fontRunCacheTotal_ * 100);
-        fflush(stdout);
-    }
-#endif
     const uint32_t crc = iCrc32(text.start, size_Range(&text));
-    iForIndices(i, d->cachedFontRuns) {
-        if (d->cachedFontRuns[i] && d->cachedFontRuns[i]->textCrc32 == crc &&
-            equal_FontRunArgs(runArgs, &d->cachedFontRuns[i]->args)) {
-            d->cachedFontRuns[i]->attrText.source = text;
-            fontRunCacheHits_++;
-            *wasFound = iTrue;
-            return d->cachedFontRuns[i];
-        }
+    /* Arguments are compared as bytes, so they can also be hashed that way. */
+    const uint32_t key = crc ^ iCrc32((const char *) runArgs, sizeof(*runArgs));
+    iFontRun *run = (iFontRun *) value_Hash(&d->fontRuns, key);
+    if (run && run->textCrc32 == crc && equal_FontRunArgs(runArgs, &run->args) &&
+        size_Block(&run->text) == size_Range(&text) &&
+        memcmp(constData_Block(&run->text), text.start, size_Range(&text)) == 0) {
+        run->attrText.source = text;
+        unlinkFontRun_StbText_(d, run);
+        pushFontRun_StbText_(d, run);
+        d->fontRunHits++;
+        *wasFound = iTrue;
+        return run;
+    }
+    if (run) {
+        removeFontRun_StbText_(d, run); /* same key, different run */
     }
+    d->fontRunMisses++;
     *wasFound = iFalse;
-    delete_FontRun(d->cachedFontRuns[iElemCount(d->cachedFontRuns) - 1]);
-    memmove(d->cachedFontRuns + 1,
-            d->cachedFontRuns,
-            sizeof(d->cachedFontRuns) - sizeof(d->cachedFontRuns[0]));
-    d->cachedFontRuns[0] = new_FontRun(runArgs, text, crc);
-    return d->cachedFontRuns[0];
+    run = new_FontRun(runArgs, text, crc);
+    run->node.key = key;
+    insert_Hash(&d->fontRuns, &run->node);
+    pushFontRun_StbText_(d, run);
+    d->fontRunsSize += run->size;
+    while (d->fontRunsSize > d->fontRunsBudget && d->lruFontRun != run) {
+        removeFontRun_StbText_(d, d->lruFontRun);
+    }
+    return run;
 }
 
 static void run_Font_(iFont *d, const iRunArgs *args) {
@@ -1399,14 +1664,16 @@ static void run_Font_(iFont *d, const iRunArgs *args) {
     iWrapText  *wrap         = args->wrap;
     iFontRun   *fontRun;
     iBool       didFindCachedFontRun = iFalse;
+    iAssert(~mode & draw_RunMode || !current_StbText_()->isMetricsOnly);
     /* Set the default text foreground color. */
     if (mode & draw_RunMode) {
         const iColor clr = get_Color(args->color);
-        SDL_SetTextureColorMod(current_StbText_()->cache, clr.r, clr.g, clr.b);
+        setGlyphColor_StbText_(current_StbText_(), clr);
     }
     iAssert(args->text.end >= args->text.start);
-    /* We keep a small cache of recently shaped runs because preparing these can be expensive.
-       Quite frequently the same text is quickly re-drawn and/or measured (e.g., InputWidget). */
+    /* We keep a cache of recently shaped runs because preparing these can be expensive.
+       Quite frequently the same text is quickly re-drawn and/or measured (e.g., InputWidget,
+       or scrolling back to a previously visible part of a document). */
     fontRun = makeOrFindCachedFontRun_StbText_(
         current_StbText_(),
         &(iFontRunArgs){ args->maxLen,
@@ -1776,6 +2043,15 @@ static void run_Font_(iFont *d, const iRunArgs *args) {
 
 #else /* !defined (LAGRANGE_ENABLE_HARFBUZZ) */
 
+static void clearFontRuns_StbText_(iStbText *d) {
+    iUnused(d);
+}
+
+static size_t numFontRuns_StbText_(const iStbText *d) {
+    iUnused(d);
+    return 0;
+}
+
 /* The fallback method: an incomplete solution for simple scripts. */
 #   define run_Font_    runSimple_Font_
 #   include "text_simple.c"
@@ -1809,5 +2085,8 @@ void resetMissing_Text(iText *d) {
 }
 
 SDL_Texture *glyphCache_Text(void) {
-    return current_StbText_()->cache;
+    const iStbText *d = current_StbText_();
+    return isEmpty_Array(&d->cachePages)
+               ? NULL
+               : ((const iGlyphPage *) constFront_Array(&d->cachePages))->texture;
 }
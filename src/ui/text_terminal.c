@@ -160,10 +160,28 @@ void delete_Text(iText *d) {
     free(d);
 }
 
+iText *newMetrics_Text(const iText *source) {
+    iTuiText *d = iMalloc(TuiText);
+    init_TuiText(d, NULL, 1.0f);
+    d->base.contentFontSize = source->contentFontSize;
+    return (iText *) d;
+}
+
+void waitForMetrics_Text(void) {}
+
 void resetFonts_Text(iText *d) {}
 
 void resetFontCache_Text(iText *d) {}
 
+iRunCacheStats runCacheStats_Text(const iText *d) {
+    iUnused(d);
+    return (iRunCacheStats){ 0 };
+}
+
+void setRunCacheBudget_Text(iText *d, size_t bytes) {
+    iUnused(d, bytes);
+}
+
 iChar missing_Text(size_t index) {
     iUnused(index);
     return 0;
@@ -183,6 +201,10 @@ void setOpacity_Text(float opacity) {
     iUnused(opacity);
 }
 
+void beginFrame_Text(iText *d) {
+    iUnused(d);
+}
+
 void cache_Text(int fontId, iRangecc text) {}
 
 static iChar nextChar_(const char **chPos, const char *end) {
@@ -702,11 +702,12 @@ static iBool processEvent_UploadWidget_(iUploadWidget *d, const SDL_Event *ev) {
                 iReleasePtr(&d->request);
                 return iTrue;
             }
-            setUploadData_GmRequest(d->request,
+            close_File(f);
+            /* The file contents are read only when the request is sent. */
+            setUploadFile_GmRequest(d->request,
                                     text_InputWidget(d->mime),
-                                    collect_Block(readAll_File(f)),
+                                    &d->filePath,
                                     text_InputWidget(d->token));
-            close_File(f);
         }
 //        iConnect(GmRequest, d->request, updated,  d, requestUpdated_UploadWidget_);
         iConnect(GmRequest, d->request, finished, d, requestFinished_UploadWidget_);
@@ -3193,11 +3193,13 @@ iWidget *makePreferences_Widget(void) {
             { "padding" },
             { "input id:prefs.cachesize maxlen:4 selectall:1 unit:mb" },
             { "input id:prefs.memorysize maxlen:4 selectall:1 unit:mb" },
+            { "input id:prefs.runcachesize maxlen:3 selectall:1 unit:mb" },
             { "padding" },
             { "toggle id:prefs.decodeurls" },
             { "input id:prefs.urlsize maxlen:7 selectall:1" },
             { "padding" },
             { "toggle id:prefs.redirect.allowscheme" },
+            { "toggle id:prefs.prefetch.hover" },
             { "padding" },
             { NULL }
         };
@@ -3524,6 +3526,17 @@ iWidget *makePreferences_Widget(void) {
                                          resizeToParentHeight_WidgetFlag);
             setContentPadding_InputWidget(mem, 0, width_Widget(unit) - 4 * gap_UI);
         }
+        /* Text run cache size. */ {
+            iInputWidget *runs = new_InputWidget(3);
+            setSelectAllOnFocus_InputWidget(runs, iTrue);
+            addPrefsInputWithHeading_(headings, values, "prefs.runcachesize", iClob(runs));
+            iWidget *unit =
+                addChildFlags_Widget(as_Widget(runs),
+                                     iClob(new_LabelWidget("${mb}", NULL)),
+                                     frameless_WidgetFlag | moveToParentRightEdge_WidgetFlag |
+                                         resizeToParentHeight_WidgetFlag);
+            setContentPadding_InputWidget(runs, 0, width_Widget(unit) - 4 * gap_UI);
+        }
         addDialogPadding_(headings, values);
         addDialogToggleGroup_(headings,
                               values,
@@ -3607,6 +3620,7 @@ iWidget *makePreferences_Widget(void) {
                                                    &values),
                      "prefs.page.network");
         addDialogToggle_(headings, values, "${prefs.redirect.allowscheme}", "prefs.redirect.allowscheme");
+        addDialogToggle_(headings, values, "${prefs.prefetch.hover}", "prefs.prefetch.hover");
         addDialogToggle_(headings, values, "${prefs.decodeurls}", "prefs.decodeurls");
         addPrefsInputWithHeading_(headings, values, "prefs.urlsize", iClob(new_InputWidget(10)));
         makeTwoColumnHeading_("${heading.prefs.proxies}", headings, values);
@@ -1801,12 +1801,26 @@ iLocalDef iBool isFullyContainedByOther_Rect(const iRect d, const iRect other) {
     return equal_Rect(intersect_Rect(d, other), d);
 }
 
+static iRect drawBounds_Widget_(const iWidget *d) {
+    iRect bounds = bounds_Widget(d);
+    if (d->flags & drawBackgroundToBottom_WidgetFlag) {
+        bounds.size.y += size_Root(d->root).y;
+    }
+    return bounds;
+}
+
+static iBool isDamaged_Widget_(const iWidget *d, const iPaint *p) {
+    /* Safe area backgrounds extend past the bounds by an amount not known here. */
+    if (d->flags & (drawBackgroundToHorizontalSafeArea_WidgetFlag |
+                    drawBackgroundToVerticalSafeArea_WidgetFlag)) {
+        return iTrue;
+    }
+    return isDamaged_Paint(p, drawBounds_Widget_(d));
+}
+
 static void addToPotentiallyVisible_Widget_(const iWidget *d, iPtrArray *pvs, iRect *fullyMasked) {
     if (isDrawn_Widget_(d)) {
-        iRect bounds = bounds_Widget(d);
-        if (d->flags & drawBackgroundToBottom_WidgetFlag) {
-            bounds.size.y += size_Root(d->root).y;
-        }
+        const iRect bounds = drawBounds_Widget_(d);
         if (isFullyContainedByOther_Rect(bounds, *fullyMasked)) {
             return; /* can't be seen */
         }
@@ -1845,9 +1859,12 @@ void drawChildren_Widget(const iWidget *d) {
     if (!isDrawn_Widget_(d)) {
         return;
     }
+    iPaint p;
+    init_Paint(&p);
     iConstForEach(ObjectList, i, d->children) {
         const iWidget *child = constAs_Widget(i.object);
-        if (~child->flags & keepOnTop_WidgetFlag && isDrawn_Widget_(child)) {
+        if (~child->flags & keepOnTop_WidgetFlag && isDrawn_Widget_(child) &&
+            isDamaged_Widget_(child, &p)) {
             incrementDrawCount_(child);
             class_Widget(child)->draw(child);
         }
@@ -1860,7 +1877,12 @@ void drawRoot_Widget(const iWidget *d) {
     iPtrArray pvs;
     init_PtrArray(&pvs);
     findPotentiallyVisible_Widget_(d, &pvs);
+    iPaint p;
+    init_Paint(&p);
     iReverseConstForEach(PtrArray, i, &pvs) {
+        if (!isDamaged_Widget_(i.ptr, &p)) {
+            continue;
+        }
         incrementDrawCount_(i.ptr);
         class_Widget(i.ptr)->draw(i.ptr);
     }
@@ -1905,7 +1927,7 @@ static void beginBufferDraw_Widget_(const iWidget *d) {
 static void endBufferDraw_Widget_(const iWidget *d) {
     if (d->drawBuf) {
         d->drawBuf->isValid = iTrue;
-        SDL_SetRenderTarget(renderer_Window(get_Window()), d->drawBuf->oldTarget);
+        restoreTarget_SDLRenderer(renderer_Window(get_Window()), d->drawBuf->oldTarget);
         origin_Paint = d->drawBuf->oldOrigin;
 //        printf("endBufferDraw: origin %d,%d\n", origin_Paint.x, origin_Paint.y);
 //        fflush(stdout);
@@ -2241,11 +2263,15 @@ iBool isSelected_Widget(const iAnyObject *d) {
     return iFalse;
 }
 
+iBool isFromWidget_Command(const char *cmd, const iWidget *widget) {
+    const iWidget *src = pointer_Command(cmd);
+    iAssert(!src || strstr(cmd, " ptr:"));
+    return src == widget || hasParent_Widget(src, widget);
+}
+
 iBool equalWidget_Command(const char *cmd, const iWidget *widget, const char *checkCommand) {
     if (equal_Command(cmd, checkCommand)) {
-        const iWidget *src = pointer_Command(cmd);
-        iAssert(!src || strstr(cmd, " ptr:"));
-        if (src == widget || hasParent_Widget(src, widget)) {
+        if (isFromWidget_Command(cmd, widget)) {
             return iTrue;
         }
 //        if (src && type_Window(window_Widget(src)) == popup_WindowType) {
@@ -2481,7 +2507,17 @@ void refresh_Widget(const iAnyObject *d) {
             w->drawBuf->isValid = iFalse;
         }
     }
-    postRefresh_App();
+    /* Only the widget's own area needs to be redrawn, unless it may be drawing outside its
+       bounds or is moving around. */
+    const iWidget *w = d;
+    if (w->root && (w->flags & (keepOnTop_WidgetFlag | visualOffset_WidgetFlag |
+                                dragged_WidgetFlag | drawBackgroundToBottom_WidgetFlag)) == 0) {
+        addDamage_Root(w->root, expanded_Rect(bounds_Widget(w), init1_I2(gap_UI)));
+        postDamageRefresh_App();
+    }
+    else {
+        postRefresh_App();
+    }
 }
 
 void raise_Widget(iWidget *d) {
@@ -328,6 +328,7 @@ void    postCommand_Widget          (const iAnyObject *, const char *cmd, ...);
 void    refresh_Widget              (const iAnyObject *);
 
 iBool   equalWidget_Command (const char *cmd, const iWidget *widget, const char *checkCommand);
+iBool   isFromWidget_Command (const char *cmd, const iWidget *widget); /* ptr: is widget or child */
 
 iDeclareType(WidgetScrollInfo)
 
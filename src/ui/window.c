@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "window.h"
 
 #include "../app.h"
+#include "../profiler.h"
 #include "bookmarks.h"
 #include "command.h"
 #include "defs.h"
@@ -53,8 +54,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <SDL_timer.h>
 #include <SDL_syswm.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include "stb_image.h"
 #include "stb_image_resize.h"
 
@@ -65,6 +64,7 @@ static float initialUiScale_ = 1.0f;
 static iBool isOpenGLRenderer_;
 static iBool isDrawing_;
 static iBool isResizing_;
+static iBool isDamageShown_; /* debug: tint the areas redrawn in each frame */
 
 iDefineTypeConstructionArgs(Window,
                             (enum iWindowType type, iRect rect, uint32_t flags),
@@ -591,6 +591,7 @@ void init_Window(iWindow *d, enum iWindowType type, iRect rect, uint32_t flags)
     d->isInvalidated = iFalse; /* set when posting event, to avoid repeated events */
     d->isMouseInside = iTrue;
     set_Atomic(&d->isRefreshPending, iTrue);
+    set_Atomic(&d->isFullRedrawPending, iTrue);
     d->ignoreClick   = iFalse;
     d->focusGainedAt = SDL_GetTicks();
     d->frameTime     = SDL_GetTicks();
@@ -719,6 +720,7 @@ void init_MainWindow(iMainWindow *d, iRect rect) {
     d->place.snap             = 0;
     d->keyboardHeight         = 0;
     d->backBuf                = NULL;
+    d->isBackBufValid         = iFalse;
     const iInt2 minSize =
         (isMobile_Platform() ? zero_I2() /* windows aren't independently resizable */
                              : init_I2(425, 325));
@@ -728,6 +730,8 @@ void init_MainWindow(iMainWindow *d, iRect rect) {
         SDL_RendererInfo info;
         SDL_GetRendererInfo(d->base.render, &info);
         isOpenGLRenderer_ = !iCmpStr(info.name, "opengl");
+        /* Widgets can be redrawn individually if there is a persistent buffer to draw into. */
+        d->enableDamage = !isTerminal_Platform() && SDL_RenderTargetSupported(d->base.render);
 #if !defined(NDEBUG) && !defined (iPlatformTerminal)
         printf("[window] max texture size: %d x %d\n",
                info.max_texture_width,
@@ -848,7 +852,7 @@ static void invalidate_Window_(iAnyWindow *d, iBool forced) {
         w->isInvalidated = iTrue;
         if (w->type == main_WindowType) {
             iMainWindow *mw = as_MainWindow(w);
-            if (mw->enableBackBuf && mw->backBuf) {
+            if (mw->backBuf) {
                 SDL_DestroyTexture(mw->backBuf);
                 mw->backBuf = NULL;
             }
@@ -1429,13 +1433,15 @@ static uint32_t windowId_SDLEvent_(const SDL_Event *ev) {
     }
 }
 
-iBool dispatchEvent_Window(iWindow *d, const SDL_Event *ev) {
+static iBool dispatchEvent_Window_(iWindow *d, const SDL_Event *ev) {
     /* For the right window? */
     const uint32_t evWin = windowId_SDLEvent_(ev);
     if (evWin && evWin != id_Window(d)) {
         return iFalse; /* Meant for a different window. */
     }
     const iWidget *oldHover = d->hover;
+    /* The old hover widget may be deleted during dispatch, so remember where it was. */
+    const iRect oldHoverBounds = oldHover ? bounds_Widget(oldHover) : zero_Rect();
     if (ev->type == SDL_MOUSEMOTION) {
         /* Hover widget may change. */
         setHover_Widget(NULL);
@@ -1476,7 +1482,19 @@ iBool dispatchEvent_Window(iWindow *d, const SDL_Event *ev) {
         }
     }
     if (d->hover != oldHover) {
-        refresh_Widget(d->hover); /* Note: oldHover may have been deleted */
+        /* The old hover highlight must be erased, too. */
+        if (oldHover && !isRecentlyDeleted_Widget(oldHover)) {
+            refresh_Widget(oldHover);
+        }
+        else if (oldHover) {
+            iForIndices(i, d->roots) {
+                if (d->roots[i]) {
+                    addDamage_Root(d->roots[i], expanded_Rect(oldHoverBounds, init1_I2(gap_UI)));
+                }
+            }
+            postDamageRefresh_App();
+        }
+        refresh_Widget(d->hover);
         if (d->hover && d->hover->flags2 & commandOnHover_WidgetFlag2) {
             SDL_UserEvent notif = { .type      = SDL_USEREVENT,
                                     .timestamp = SDL_GetTicks(),
@@ -1489,6 +1507,13 @@ iBool dispatchEvent_Window(iWindow *d, const SDL_Event *ev) {
     return wasUsed;
 }
 
+iBool dispatchEvent_Window(iWindow *d, const SDL_Event *ev) {
+    const uint64_t profileBegin = begin_Profiler(event_ProfilerScope);
+    const iBool    wasUsed      = dispatchEvent_Window_(d, ev);
+    end_Profiler(event_ProfilerScope, profileBegin);
+    return wasUsed;
+}
+
 iAnyObject *hitChild_Window(const iWindow *d, iInt2 coord) {
     if (coord.x < 0 || coord.y < 0) {
         return NULL;
@@ -1524,6 +1549,7 @@ void draw_Window(iWindow *d) {
         return;
     }
     isDrawing_ = iTrue;
+    beginFrame_Text(d->text);
     iPaint p;
     init_Paint(&p);
     iRoot *root = d->roots[0];
@@ -1575,6 +1601,7 @@ void draw_MainWindow(iMainWindow *d) {
         checkPixelRatioChange_Window_(&d->base);
     }
     setCurrent_Text(d->base.text);
+    beginFrame_Text(d->base.text);
     /* Check if root needs resizing. */ {
         const iBool wasPortrait = isPortrait_App();
 //        iInt2 renderSize;
@@ -1588,7 +1615,7 @@ void draw_MainWindow(iMainWindow *d) {
         /* TODO: On macOS, a detached popup window will mess up the main window's rendering
            completely. Looks like a render target mixup. macOS builds normally use native menus,
            though, so leaving it in. */
-        if (d->enableBackBuf) { 
+        if (d->enableBackBuf || d->enableDamage) { 
             /* Possible resize the backing buffer. */
             if (!d->backBuf || !isEqual_I2(size_SDLTexture(d->backBuf), w->size)) {
                 if (d->backBuf) {
@@ -1599,6 +1626,7 @@ void draw_MainWindow(iMainWindow *d) {
                                                SDL_TEXTUREACCESS_TARGET,
                                                w->size.x,
                                                w->size.y);
+                d->isBackBufValid = iFalse;
 //                printf("NEW BACKING: %dx%d %p\n", renderSize.x, renderSize.y, d->backBuf); fflush(stdout);
             }
         }
@@ -1606,6 +1634,33 @@ void draw_MainWindow(iMainWindow *d) {
     setCurrent_Window(d);
     const int   winFlags = SDL_GetWindowFlags(d->base.win);
     const iBool gotFocus = (winFlags & SDL_WINDOW_INPUT_FOCUS) != 0;
+    /* Find out which parts of the window need redrawing. Anything that was not reported
+       as widget damage, or that may affect more than the widget's own bounds, causes the
+       entire window to be redrawn. */
+    iBool isFullRedraw = exchange_Atomic(&w->isFullRedrawPending, iFalse) || !d->enableDamage ||
+                         !d->isBackBufValid || !d->backBuf || isEnabled_Profiler();
+    iRect damage = zero_Rect();
+    iForIndices(i, w->roots) {
+        iRoot *root = w->roots[i];
+        if (root) {
+            if (root->didChangeArrangement || root->didAnimateVisualOffsets) {
+                isFullRedraw = iTrue;
+            }
+            iConstForEach(PtrArray, t, onTop_Root(root)) {
+                if (isVisible_Widget(t.ptr)) {
+                    isFullRedraw = iTrue; /* popups may cast shadows or fade the background */
+                    break;
+                }
+            }
+            if (!isEmpty_Rect(root->damage)) {
+                damage = isEmpty_Rect(damage) ? root->damage : union_Rect(damage, root->damage);
+            }
+            root->damage = zero_Rect();
+        }
+    }
+    if (isEmpty_Rect(damage)) {
+        isFullRedraw = iTrue;
+    }
     iPaint p;
     init_Paint(&p);
     if (d->backBuf) {
@@ -1632,9 +1687,16 @@ void draw_MainWindow(iMainWindow *d) {
             back = get_Color(uiBackground_ColorId);
 #endif
         }
-        unsetClip_Paint(&p); /* update clip to full window */
         SDL_SetRenderDrawColor(w->render, back.r, back.g, back.b, 255);
-        SDL_RenderClear(w->render);
+        if (isFullRedraw) {
+            unsetClip_Paint(&p); /* update clip to full window */
+            SDL_RenderClear(w->render);
+        }
+        else {
+            /* The rest of the back buffer is kept as is. */
+            beginDamage_Paint(&p, damage);
+            SDL_RenderFillRect(w->render, NULL);
+        }
     }
     /* Draw widgets. */
     w->frameTime = SDL_GetTicks();
@@ -1700,6 +1762,22 @@ void draw_MainWindow(iMainWindow *d) {
                 }
             }
         }
+        if (isDamageShown_ && !isFullRedraw) {
+            /* The tint changes every frame, so areas that keep getting redrawn flicker
+               while the rest of the window keeps the tint from when it was last drawn. */
+            setCurrent_Root(w->roots[0]);
+            beginDamage_Paint(&p, damage); /* clip covers all roots */
+            SDL_SetRenderDrawBlendMode(w->render, SDL_BLENDMODE_BLEND);
+            p.alpha = 64;
+            fillRect_Paint(&p, damage, d->base.frameCount & 1 ? red_ColorId : blue_ColorId);
+            p.alpha = 255;
+            SDL_SetRenderDrawBlendMode(w->render, SDL_BLENDMODE_NONE);
+        }
+        if (isEnabled_Profiler()) {
+            setCurrent_Root(w->roots[0]);
+            unsetClip_Paint(&p);
+            drawOverlay_Profiler(safeRect_Root(w->roots[0]));
+        }
         setCurrent_Root(NULL);
 #if !defined (NDEBUG)
         draw_Text(uiLabelBold_FontId,
@@ -1709,9 +1787,19 @@ void draw_MainWindow(iMainWindow *d) {
                   drawCount_);
         drawCount_ = 0;
 #endif
+        d->isBackBufValid = (d->backBuf != NULL);
+    }
+    else {
+        d->isBackBufValid = iFalse;
+    }
+    if (!isFullRedraw) {
+        endDamage_Paint(&p);
     }
     if (d->backBuf) {
+        /* The renderer has no way to present a partial frame, so the whole buffer is copied
+           even if only a small part of it was redrawn. */
         SDL_SetRenderTarget(d->base.render, NULL);
+        SDL_RenderSetClipRect(d->base.render, NULL);
         SDL_RenderCopy(d->base.render, d->backBuf, NULL, NULL);
     }
 #if 0
@@ -1829,6 +1917,14 @@ iMainWindow *get_MainWindow(void) {
     return theMainWindow_;
 }
 
+void setDamageShown_Window(iBool show) {
+    isDamageShown_ = show;
+}
+
+iBool isDamageShown_Window(void) {
+    return isDamageShown_;
+}
+
 iBool isOpenGLRenderer_Window(void) {
     return isOpenGLRenderer_;
 }
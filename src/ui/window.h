@@ -92,6 +92,7 @@ struct Impl_Window {
     iBool         isMouseInside;
     iBool         isInvalidated;
     iAtomicInt    isRefreshPending;
+    iAtomicInt    isFullRedrawPending; /* otherwise only the damaged areas of roots are redrawn */
     iBool         ignoreClick;
     uint32_t      focusGainedAt;
     SDL_Renderer *render;
@@ -127,6 +128,8 @@ struct Impl_MainWindow {
     int           maxDrawableHeight;
     iBool         enableBackBuf; /* only used on macOS with Metal (helps with refresh glitches for some reason??) */
     SDL_Texture * backBuf; /* enables refreshing the window without redrawing anything */
+    iBool         enableDamage; /* keep backBuf contents and redraw only damaged areas */
+    iBool         isBackBufValid;
 };
 
 iLocalDef enum iWindowType type_Window(const iAnyWindow *d) {
@@ -163,6 +166,8 @@ void        updateHover_Window      (iWindow *);
 
 iWindow *   get_Window              (void);
 iBool       isOpenGLRenderer_Window (void);
+void        setDamageShown_Window   (iBool show); /* debug: tint redrawn areas */
+iBool       isDamageShown_Window    (void);
 
 void        setCurrent_Window       (iAnyWindow *);
 